@@ -0,0 +1,10 @@
+#define APISUPPORT_NONPOSIX_DIRECTIO 1
+#ifdef apisupport_dummy
+export CFLAGS_NONPOSIX_DIRECTIO="-D_GNU_SOURCE"
+#endif
+#define APISUPPORT_LINUX_IO_URING 1
+#ifdef apisupport_dummy
+export CFLAGS_LINUX_IO_URING="-D_DEFAULT_SOURCE"
+#endif
+#define APISUPPORT_LINUX_EPOLL 1
+#define APISUPPORT_LIBSSL_HOST_NAME 1
@@ -0,0 +1,20 @@
+#define CPUSUPPORT_HWCAP_GETAUXVAL 1
+#define CPUSUPPORT_X86_CPUID 1
+#define CPUSUPPORT_X86_CPUID_COUNT 1
+#define CPUSUPPORT_X86_SHANI 1
+#ifdef cpusupport_dummy
+export CFLAGS_X86_SHANI="-msse2 -msha"
+#endif
+#define CPUSUPPORT_X86_SSE2 1
+#define CPUSUPPORT_X86_SSE42 1
+#ifdef cpusupport_dummy
+export CFLAGS_X86_SSE42="-msse4.2"
+#endif
+#define CPUSUPPORT_X86_SSE42_64 1
+#ifdef cpusupport_dummy
+export CFLAGS_X86_SSE42_64="-msse4.2"
+#endif
+#define CPUSUPPORT_X86_SSSE3 1
+#ifdef cpusupport_dummy
+export CFLAGS_X86_SSSE3="-mssse3"
+#endif
@@ -1,12 +1,14 @@
 #include <sys/time.h>
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include "events.h"
 #include "pool.h"
 #include "proto_lbs.h"
+#include "slab.h"
 #include "warnp.h"
 #include "wire.h"
 
@@ -14,6 +16,7 @@
 #include "btree_node.h"
 #include "node.h"
 #include "serialize.h"
+#include "serializer.h"
 
 #include "btree.h"
 
@@ -38,6 +41,12 @@ static const struct timeval free_time = {
 	.tv_usec = 0
 };
 
+/* Time between reports of how well leaf pages are compressing. */
+static const struct timeval zreport_time = {
+	.tv_sec = 3600,
+	.tv_usec = 0
+};
+
 /* Callback for PARAMS2 request. */
 static int
 callback_params(void * cookie, int failed, size_t blklen, uint64_t blkno,
@@ -135,21 +144,67 @@ err0:
 	return (-1);
 }
 
+/* Report how well the leaf pages written so far have compressed. */
+static void
+zreport(struct btree * T)
+{
+
+	/* Don't repeat ourselves if nothing has been written. */
+	if (T->zrawbytes == T->zreported)
+		return;
+	T->zreported = T->zrawbytes;
+
+	warn0("Leaf pages compressed to %.1f%% of their size "
+	    "(%" PRIu64 " of %" PRIu64 " bytes)",
+	    100.0 * (double)T->zbytes / (double)T->zrawbytes,
+	    T->zbytes, T->zrawbytes);
+}
+
+/* Callback for periodic compression reports. */
+static int
+callback_zreport(void * cookie)
+{
+	struct btree * T = cookie;
+
+	/* The timer is no longer scheduled. */
+	T->z_timer = NULL;
+
+	/* Report the compression ratio. */
+	zreport(T);
+
+	/* Schedule another report. */
+	if ((T->z_timer =
+	    events_timer_register(callback_zreport, T, &zreport_time)) == NULL)
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 /**
- * btree_init(Q_lbs, npages, npagebytes, keylen, vallen, Scost):
+ * btree_init(Q_lbs, npages, npagebytes, keylen, vallen, Scost, scanres,
+ *     zleaves, getv):
  * Initialize a B+Tree with backing store accessible by sending requests via
  * the request queue ${Q_lbs}.  Aim to keep (in order of preference) at most
  * ${npages}, ${npagebytes} / pagelen, or 1024 nodes of the tree in RAM at a
  * time.  Verify that keys of length ${keylen} and values of length ${vallen}
  * can be used with the available page size; or set the variables to sensible
  * default values.  Storing a GB of data for a month costs roughly ${Scost}
- * times as much as performing 10^6 I/Os.
+ * times as much as performing 10^6 I/Os.  If ${scanres} is non-zero, use
+ * a scan-resistant policy for evicting nodes from RAM.  If ${zleaves} is
+ * non-zero, compress leaf pages when that allows them to hold more data.
+ * If ${getv} is non-zero, read runs of consecutive pages with GETV requests.
  *
  * This function may call events_run() internally.
  */
 struct btree *
 btree_init(struct wire_requestqueue * Q_lbs, uint64_t npages,
-    uint64_t npagebytes, uint64_t * keylen, uint64_t * vallen, double Scost)
+    uint64_t npagebytes, uint64_t * keylen, uint64_t * vallen, double Scost,
+    int scanres, int zleaves, int getv)
 {
 	struct btree * T;
 	struct node * C;
@@ -177,6 +232,9 @@ btree_init(struct wire_requestqueue * Q_lbs, uint64_t npages,
 	/* Attach LBS request queue to the tree. */
 	T->LBS = Q_lbs;
 
+	/* No serialization threads unless our caller starts them. */
+	T->S = NULL;
+
 	/* Issue a PARAMS2 request. */
 	PC.T = T;
 	PC.failed = PC.done = 0;
@@ -240,13 +298,37 @@ btree_init(struct wire_requestqueue * Q_lbs, uint64_t npages,
 	}
 
 	/* Create a page pool. */
-	if ((T->P = pool_init(T->poolsz,
-	    offsetof(struct node, pool_cookie))) == NULL)
+	if ((T->P = pool_init(T->poolsz, offsetof(struct node, pool_cookie),
+	    scanres ? POOL_2Q : POOL_LRU)) == NULL)
 		goto err1;
 
+	/* Create an allocator for the page buffers of nodes in the pool. */
+	T->zscratch = NULL;
+	if ((T->pagebufs = slab_init(T->pagelen, T->poolsz)) == NULL)
+		goto err2;
+
+	/* Allocate space for working out how small leaves compress. */
+	if (zleaves && ((T->zscratch =
+	    malloc((SERIALIZE_ZPAGES + 1) * T->pagelen)) == NULL))
+		goto err2;
+
 	/* No root nodes yet. */
 	T->root_shadow = T->root_dirty = NULL;
 
+	/* Compress leaf pages if requested; nothing written yet. */
+	T->zleaves = zleaves;
+	T->zrawbytes = T->zbytes = T->zreported = 0;
+	T->z_timer = NULL;
+
+	/* No access pattern seen and nothing being read ahead yet. */
+	T->ra_next = NULL;
+	T->ra_pos = 0;
+	T->nreadahead = 0;
+
+	/* Use GETV if the block store handles it; nothing waiting yet. */
+	T->getv = getv;
+	T->run = NULL;
+
 	/*
 	 * Try to find a root node by scanning backwards from the last block
 	 * the block store reports having present.
@@ -295,7 +377,7 @@ btree_init(struct wire_requestqueue * Q_lbs, uint64_t npages,
 	if (T->root_dirty != NULL) {
 		/* Record the size of the serialized node. */
 		T->root_dirty->pagesize =
-		    (uint32_t)serialize_size(T->root_dirty);
+		    (uint32_t)serialize_size(T, T->root_dirty);
 
 		/* Figure out the oldestleaf. */
 		if (T->root_dirty->type == NODE_TYPE_PARENT) {
@@ -374,6 +456,13 @@ gotroot:
 		goto err0;
 	}
 
+	/* Schedule a callback to report how well leaves are compressing. */
+	if (T->zleaves && ((T->z_timer = events_timer_register(
+	    callback_zreport, T, &zreport_time)) == NULL)) {
+		btree_free(T);
+		goto err0;
+	}
+
 	/* Start background cleaning. */
 	if ((T->cstate = btree_cleaning_start(T, Scost)) == NULL) {
 		warnp("Cannot start background cleaning");
@@ -395,6 +484,8 @@ err3:
 
 	/* Merged exit path. */
 err2:
+	free(T->zscratch);
+	slab_free(T->pagebufs);
 	pool_free(T->P);
 err1:
 	free(T);
@@ -407,6 +498,8 @@ err0:
  * btree_free(T):
  * Free the B-Tree ${T}, which must have root_shadow == root_dirty and must
  * have no pages locked other than the root node.
+ *
+ * This function may call events_run() internally.
  */
 void
 btree_free(struct btree * T)
@@ -422,6 +515,19 @@ btree_free(struct btree * T)
 	if (T->gc_timer != NULL)
 		events_timer_cancel(T->gc_timer);
 
+	/* Kill the compression report timer, and report one last time. */
+	if (T->z_timer != NULL)
+		events_timer_cancel(T->z_timer);
+	zreport(T);
+
+	/* Wait for any readahead fetches to complete. */
+	while (T->nreadahead > 0) {
+		if (events_run()) {
+			warnp("Error running event loop");
+			exit(1);
+		}
+	}
+
 	/* Release the root locks. */
 	btree_node_unlock(T, T->root_shadow);
 	btree_node_unlock(T, T->root_dirty);
@@ -432,8 +538,13 @@ btree_free(struct btree * T)
 	/* Free the (paged-out) root node. */
 	node_free(T->root_shadow);
 
-	/* Free the page pool. */
+	/* Stop the serialization threads. */
+	serializer_free(T->S);
+
+	/* Free the page pool and page buffers. */
 	pool_free(T->P);
+	slab_free(T->pagebufs);
+	free(T->zscratch);
 
 	/* Free the tree structure. */
 	free(T);
@@ -7,6 +7,9 @@
 /* Opaque types. */
 struct cleaner;
 struct node;
+struct readrun;
+struct serializer;
+struct slab;
 struct wire_requestqueue;
 
 /* B+Tree structure. */
@@ -28,6 +31,27 @@ struct btree {
 	struct node * root_shadow;	/* Root node in shadow tree. */
 	struct node * root_dirty;	/* Root node in dirty tree. */
 	struct pool * P;		/* Page pool. */
+	struct slab * pagebufs;		/* Allocator for page buffers. */
+
+	/* Used to detect sequential access and read ahead. */
+	struct node * ra_next;		/* Next node if access is sequential. */
+	size_t ra_pos;			/* Position of ra_next in its parent. */
+	size_t nreadahead;		/* # of readaheads in progress. */
+
+	/* Used to read runs of consecutive pages with GETV requests. */
+	int getv;			/* The block store handles GETV. */
+	struct readrun * run;		/* Pages waiting to be read. */
+
+	/* Used for compressing leaf pages. */
+	int zleaves;			/* Compress leaf pages if possible. */
+	uint64_t zrawbytes;		/* Leaf bytes written, uncompressed. */
+	uint64_t zbytes;		/* Leaf page bytes written. */
+	uint64_t zreported;		/* zrawbytes when last reported. */
+	uint8_t * zscratch;		/* Scratch space for compression. */
+	void * z_timer;			/* Cookie from events_timer. */
+
+	/* Threads for serializing leaves (started by the caller), or NULL. */
+	struct serializer * S;
 
 	/* Used to periodically call FREE(). */
 	void * gc_timer;		/* Cookie from events_timer. */
@@ -39,19 +63,23 @@ struct btree {
 };
 
 /**
- * btree_init(Q_lbs, npages, npagebytes, keylen, vallen, Scost):
+ * btree_init(Q_lbs, npages, npagebytes, keylen, vallen, Scost, scanres,
+ *     zleaves, getv):
  * Initialize a B+Tree with backing store accessible by sending requests via
  * the request queue ${Q_lbs}.  Aim to keep (in order of preference) at most
  * ${npages}, ${npagebytes} / pagelen, or 1024 nodes of the tree in RAM at a
  * time.  Verify that keys of length ${keylen} and values of length ${vallen}
  * can be used with the available page size; or set the variables to sensible
  * default values.  Storing a GB of data for a month costs roughly ${Scost}
- * times as much as performing 10^6 I/Os.
+ * times as much as performing 10^6 I/Os.  If ${scanres} is non-zero, use
+ * a scan-resistant policy for evicting nodes from RAM.  If ${zleaves} is
+ * non-zero, compress leaf pages when that allows them to hold more data.
+ * If ${getv} is non-zero, read runs of consecutive pages with GETV requests.
  *
  * This function may call events_run() internally.
  */
 struct btree * btree_init(struct wire_requestqueue *, uint64_t, uint64_t,
-    uint64_t *, uint64_t *, double);
+    uint64_t *, uint64_t *, double, int, int, int);
 
 /**
  * btree_balance(T, callback, cookie):
@@ -85,6 +113,8 @@ void btree_sanity(struct btree *);
  * btree_free(T):
  * Free the B-Tree ${T}, which must have root_shadow == root_dirty and must
  * have no pages locked other than the root node.
+ *
+ * This function may call events_run() internally.
  */
 void btree_free(struct btree *);
 
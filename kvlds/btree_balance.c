@@ -1,10 +1,12 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "events.h"
 #include "imalloc.h"
 #include "kvldskey.h"
+#include "kvpair.h"
 
 #include "btree_node.h"
 #include "node.h"
@@ -50,7 +52,7 @@ splitchildren(struct btree * T, struct node * N)
 	/* Figure out how many children we'll have after splitting them. */
 	for (new_nkeys = i = 0; i <= N->nkeys; i++) {
 		if (node_present(N->v.children[i]) &&
-		    (serialize_size(N->v.children[i]) > T->pagelen))
+		    (serialize_size(T, N->v.children[i]) > T->pagelen))
 			new_nkeys +=
 			    btree_node_split_nparts(T, N->v.children[i]);
 		else
@@ -84,7 +86,7 @@ splitchildren(struct btree * T, struct node * N)
 	for (i = 0, j = 0; i <= N->nkeys; i++, j += nparts) {
 		/* If a node is present and overlarge, split it. */
 		if (node_present(N->v.children[i]) &&
-		    (serialize_size(N->v.children[i]) > T->pagelen)) {
+		    (serialize_size(T, N->v.children[i]) > T->pagelen)) {
 			if (btree_node_split(T, N->v.children[i],
 			    &new_keys[j], &new_children[j], &nparts)) {
 				/*
@@ -273,7 +275,7 @@ splittree(struct btree * T)
 #endif
 
 	/* Next, split the root (if necessary). */
-	while (serialize_size(T->root_dirty) > T->pagelen) {
+	while (serialize_size(T, T->root_dirty) > T->pagelen) {
 		/* Try to create a new root. */
 		if ((R = splitroot(T, T->root_dirty)) == NULL)
 			goto err0;
@@ -338,13 +340,17 @@ planmergenode(struct balance_cookie * B, struct node * N)
 		if (!gotdirty)
 			goto nomerge;
 
+		/* Don't retry a merge which we found to be too large. */
+		if (N->v.children[i]->nomerge)
+			goto nomerge;
+
 		/*
 		 * Figure out how large a node we'll produce if we merge this
 		 * node into the next one.
 		 */
 		if (!leafchild)
 			plen += kvldskey_serial_size(N->u.keys[i]);
-		plen += serialize_merge_size(N->v.children[i]);
+		plen += serialize_merge_size(B->T, N->v.children[i]);
 
 		/* Would the resulting node be too big? */
 		if (plen > maxplen)
@@ -362,7 +368,7 @@ nomerge:
 		 * state we're tracking so we can check if other nodes should
 		 * be merged into this one.
 		 */
-		plen = serialize_size(N->v.children[i]);
+		plen = serialize_size(B->T, N->v.children[i]);
 		gotdirty = (N->v.children[i]->state == NODE_STATE_DIRTY);
 		leafchild = (N->v.children[i]->type == NODE_TYPE_LEAF);
 	}
@@ -455,12 +461,60 @@ err0:
 	return (-1);
 }
 
+/*
+ * Return non-zero if merging the ${nsep} + 1 dirty nodes ${c} of the B+Tree
+ * ${T} will produce a node which fits into a page even if it becomes the
+ * root.  Only compressed leaves can fail to fit, since when planning merges
+ * we can only estimate how well the merged leaf will compress.  Set
+ * ${*pagesize} to the size of the merged node's page if we worked it out,
+ * or to (uint32_t)(-1) if not.
+ */
+static int
+mergefits(struct btree * T, struct node ** c, size_t nsep,
+    uint32_t * pagesize)
+{
+	struct kvpair_const * pairs;
+	size_t nkeys;
+	size_t size;
+	size_t i, j;
+	int fits;
+
+	/* Merged sizes are known unless we're compressing leaves. */
+	*pagesize = (uint32_t)(-1);
+	if (!T->zleaves || (c[0]->type != NODE_TYPE_LEAF))
+		return (1);
+
+	/* Gather the key-value pairs. */
+	for (nkeys = i = 0; i <= nsep; i++)
+		nkeys += c[i]->nkeys;
+	if (IMALLOC(pairs, nkeys, struct kvpair_const))
+		return (0);
+	for (j = i = 0; i <= nsep; j += c[i]->nkeys, i++) {
+		if (c[i]->nkeys > 0)
+			memcpy(&pairs[j], c[i]->u.pairs,
+			    c[i]->nkeys * sizeof(struct kvpair_const));
+	}
+
+	/* Will they fit into a page? */
+	size = serialize_leaf_size(T, pairs, nkeys);
+	fits = (size + SERIALIZE_ROOT <= T->pagelen);
+	free(pairs);
+
+	/* If so, we know how large the merged node's page will be. */
+	if (fits)
+		*pagesize = (uint32_t)size;
+
+	/* Return the answer. */
+	return (fits);
+}
+
 /* Perform planned merges in a subtree. */
 static int
 domergenode(struct balance_cookie * B, struct node * N)
 {
-	size_t nmerges, i, j;
+	size_t nmerges, i, j, k;
 	size_t nmerge;
+	uint32_t pagesize;
 	int failed = 0;		/* We haven't failed yet. */
 	int merging;
 	struct node * NC;
@@ -557,12 +611,28 @@ domergenode(struct balance_cookie * B, struct node * N)
 			continue;
 		}
 
-		/* Merge children. */
-		if (btree_node_merge(B->T,
+		/*
+		 * Merge children; but if the merged node wouldn't fit, just
+		 * copy the children and keys and don't try to merge them again.
+		 */
+		if (!mergefits(B->T, &N->v.children[i - nmerge], nmerge,
+		    &pagesize)) {
+			for (k = i - nmerge; k < i; k++) {
+				N->v.children[k]->merging = 0;
+				N->v.children[k]->nomerge = 1;
+				N->v.children[j] = N->v.children[k];
+				N->u.keys[j] = N->u.keys[k];
+				j += 1;
+			}
+			N->v.children[j] = N->v.children[i];
+		} else if (btree_node_merge(B->T,
 		    &N->v.children[i - nmerge], &N->u.keys[i - nmerge],
 		    &N->v.children[j], &N->u.keys[j], nmerge)) {
 			j += nmerge;
 			failed = 1;
+		} else {
+			/* Don't compress the merged leaf again to size it. */
+			N->v.children[j]->pagesize = pagesize;
 		}
 
 		/* Copy the separator key. */
@@ -5,6 +5,7 @@
 #include "kvldskey.h"
 #include "kvpair.h"
 #include "mpool.h"
+#include "pfxsearch.h"
 
 #include "btree.h"
 #include "btree_node.h"
@@ -47,6 +48,11 @@ btree_find_kvpair(struct node * N, const struct kvldskey * k)
 	min = 0;
 	max = N->nkeys;
 
+	/* Narrow that down to the keys whose prefixes match. */
+	if (N->pfx != NULL)
+		pfxsearch(N->pfx, N->nkeys, kvldskey_prefix(k, N->mlen_t),
+		    &min, &max);
+
 	/* Keep looking until we figure out where it belongs. */
 	while (min != max) {
 		/* Compare to the midpoint. */
@@ -88,6 +94,11 @@ btree_find_child(struct node * N, const struct kvldskey * k)
 	min = 0;
 	max = N->nkeys;
 
+	/* Narrow that down to the keys whose prefixes match. */
+	if (N->pfx != NULL)
+		pfxsearch(N->pfx, N->nkeys, kvldskey_prefix(k, N->mlen_t),
+		    &min, &max);
+
 	/* Keep looking until we figure out where it belongs. */
 	while (min != max) {
 		/* Compare to the midpoint. */
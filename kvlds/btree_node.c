@@ -10,6 +10,7 @@
 #include "kvpair.h"
 #include "pool.h"
 #include "proto_lbs.h"
+#include "slab.h"
 #include "warnp.h"
 
 #include "btree.h"
@@ -19,6 +20,9 @@
 
 #include "btree_node.h"
 
+/* Number of following siblings to read ahead when access is sequential. */
+#define READAHEAD	64
+
 /* Reader callback. */
 struct reader {
 	int (* callback)(void *);
@@ -33,6 +37,15 @@ struct reading {
 	struct btree * T;	/* B+tree to which this page belongs. */
 	size_t pagelen;		/* Size of page. */
 	int canfail;		/* Non-zero if failure is an option. */
+	int readahead;		/* Non-zero if started by readahead. */
+};
+
+/* Pages waiting to be read by a single GETV request. */
+struct readrun {
+	struct btree * T;	/* B+tree to which the pages belong. */
+	void * event;		/* Cookie from events_immediate_register. */
+	size_t npages;		/* Number of pages in the run. */
+	struct node * N[PROTO_LBS_GETV_MAX];	/* Nodes being read. */
 };
 
 /* Descend-into-node state. */
@@ -43,7 +56,9 @@ struct descend {
 };
 
 static int callback_fetch(void *, int, int, const uint8_t *);
+static int callback_fetchrun(void *, int, int, const uint8_t *);
 static int callback_descend(void *);
+static void readahead(struct btree *, struct node *);
 
 /**
  * freedata(T, N):
@@ -74,14 +89,22 @@ freedata(struct btree * T, struct node * N)
 			free(N->v.children);
 		}
 
+		/* Free the search accelerator, if any. */
+		free(N->pfx);
+		N->pfx = NULL;
+
 		/* This node no longer has any data. */
 		N->nkeys = (size_t)(-1);
 	}
 
 	/* If the node has a serialized buffer, free it. */
 	if (N->pagebuf) {
-		free(N->pagebuf);
+		if (N->zpage)
+			free(N->pagebuf);
+		else
+			slab_release(T->pagebufs, N->pagebuf);
 		N->pagebuf = NULL;
+		N->zpage = 0;
 	}
 
 	/* We just removed a reason for keeping the parent(s) present. */
@@ -95,16 +118,26 @@ freedata(struct btree * T, struct node * N)
 	N->type = NODE_TYPE_NP;
 }
 
-/* Add a node to the page pool and handle any resulting eviction. */
+/*
+ * Add a node to the page pool and handle any resulting eviction.  If
+ * ${lowpri} is non-zero, add it at low priority; in that case return 1
+ * without adding it if that would require evicting a low-priority node.
+ */
 static int
-makepresent(struct btree * T, struct node * N)
+makepresent(struct btree * T, struct node * N, int lowpri)
 {
 	void * evict;
 	struct node * N_evict;
+	int rc;
 
 	/* Add the node to the pool. */
-	if (pool_rec_add(T->P, N, &evict))
-		goto err0;
+	if (lowpri) {
+		if ((rc = pool_rec_add_lowpri(T->P, N, &evict)) != 0)
+			return (rc);
+	} else {
+		if (pool_rec_add(T->P, N, &evict))
+			goto err0;
+	}
 	N_evict = evict;
 
 	/* If a node was evicted, make it non-present. */
@@ -147,7 +180,7 @@ btree_node_mknode(struct btree * T, unsigned int type, int height, size_t nkeys,
 		goto err0;
 
 	/* Make the node present. */
-	if (makepresent(T, N))
+	if (makepresent(T, N, 0))
 		goto err1;
 
 	/* This is a DIRTY node of the indicated type and height. */
@@ -183,6 +216,158 @@ err0:
 	return (NULL);
 }
 
+/* Send the run of pages waiting to be read in the B+Tree ${T}. */
+static int
+sendrun(struct btree * T)
+{
+	struct readrun * R = T->run;
+
+	/* Nothing else can join this run. */
+	T->run = NULL;
+	if (R->event != NULL)
+		events_immediate_cancel(R->event);
+
+	/* A single page is read the usual way. */
+	if (R->npages == 1) {
+		if (proto_lbs_request_get(T->LBS, R->N[0]->pagenum,
+		    T->pagelen, callback_fetch, R->N[0]))
+			goto err1;
+		free(R);
+	} else {
+		if (proto_lbs_request_getv(T->LBS, R->N[0]->pagenum,
+		    (uint32_t)R->npages, T->pagelen, callback_fetchrun, R))
+			goto err1;
+	}
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(R);
+
+	/* Failure! */
+	return (-1);
+}
+
+/* Send the run of pages which was waiting for the event loop. */
+static int
+callback_sendrun(void * cookie)
+{
+	struct btree * T = cookie;
+
+	/* This event has fired. */
+	T->run->event = NULL;
+
+	/* Send the run. */
+	return (sendrun(T));
+}
+
+/*
+ * Queue the node ${N} to be read in the B+Tree ${T}.  Pages queued while the
+ * current event is being handled are sent once it returns, with each run of
+ * consecutive pages read by a single GETV request.
+ */
+static int
+queueread(struct btree * T, struct node * N)
+{
+	struct readrun * R = T->run;
+
+	/* If this page doesn't extend the waiting run, send that run now. */
+	if ((R != NULL) && ((R->npages == PROTO_LBS_GETV_MAX) ||
+	    (N->pagenum != R->N[R->npages - 1]->pagenum + 1))) {
+		if (sendrun(T))
+			goto err0;
+		R = NULL;
+	}
+
+	/* Start a new run if necessary. */
+	if (R == NULL) {
+		if ((R = malloc(sizeof(struct readrun))) == NULL)
+			goto err0;
+		R->T = T;
+		R->npages = 0;
+		if ((R->event = events_immediate_register(callback_sendrun,
+		    T, 1)) == NULL)
+			goto err1;
+		T->run = R;
+	}
+
+	/* Add this page to the run. */
+	R->N[R->npages++] = N;
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(R);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Start reading the node ${N}, which must be of type NODE_TYPE_NP, in the
+ * B+Tree ${T}.  If ${readahead} is non-zero, the node is added to the page
+ * pool at low priority, and 1 is returned if this cannot be done.
+ */
+static int
+startread(struct btree * T, struct node * N, int canfail, int readahead)
+{
+	int rc;
+
+	/* Make this page present. */
+	if ((rc = makepresent(T, N, readahead)) != 0)
+		return (rc);
+	btree_node_lock(T, N->p_shadow);
+	btree_node_lock(T, N->p_dirty);
+
+	/* Create a read-in-progress structure. */
+	if ((N->u.reading = malloc(sizeof(struct reading))) == NULL)
+		goto err1;
+	N->u.reading->pagelen = T->pagelen;
+	N->u.reading->T = T;
+	N->u.reading->canfail = canfail;
+	N->u.reading->readahead = readahead;
+
+	/* Create a list of reader callbacks. */
+	if ((N->u.reading->list = readerlist_init(0)) == NULL)
+		goto err2;
+
+	/*
+	 * Read the page.  A GETV fails if any of its pages do not exist, so
+	 * pages which might not exist are read on their own.
+	 */
+	if (T->getv && !canfail) {
+		if (queueread(T, N))
+			goto err3;
+	} else {
+		if (proto_lbs_request_get(T->LBS, N->pagenum, T->pagelen,
+		    callback_fetch, N))
+			goto err3;
+	}
+
+	/* This page is now being read. */
+	N->type = NODE_TYPE_READ;
+	if (readahead)
+		T->nreadahead += 1;
+
+	/* Success! */
+	return (0);
+
+err3:
+	readerlist_free(N->u.reading->list);
+err2:
+	free(N->u.reading);
+err1:
+	btree_node_unlock(T, N->p_shadow);
+	btree_node_unlock(T, N->p_dirty);
+	pool_rec_free(T->P, N);
+	N->pool_cookie = NULL;
+
+	/* Failure! */
+	return (-1);
+}
+
 /**
  * btree_node_fetch_canfail(T, N, callback, cookie, canfail):
  * Fetch the node ${N} which is currently of type either NODE_TYPE_NP or
@@ -201,30 +386,8 @@ btree_node_fetch_canfail(struct btree * T, struct node * N,
 
 	/* If we're not already reading, do so. */
 	if (N->type == NODE_TYPE_NP) {
-		/* Make this page present. */
-		if (makepresent(T, N))
+		if (startread(T, N, canfail, 0))
 			goto err0;
-		btree_node_lock(T, N->p_shadow);
-		btree_node_lock(T, N->p_dirty);
-
-		/* Create a read-in-progress structure. */
-		if ((N->u.reading = malloc(sizeof(struct reading))) == NULL)
-			goto err1;
-		N->u.reading->pagelen = T->pagelen;
-		N->u.reading->T = T;
-		N->u.reading->canfail = canfail;
-
-		/* Create a list of reader callbacks. */
-		if ((N->u.reading->list = readerlist_init(0)) == NULL)
-			goto err2;
-
-		/* Read the page. */
-		if (proto_lbs_request_get(T->LBS, N->pagenum, T->pagelen,
-		    callback_fetch, N))
-			goto err3;
-
-		/* This page is now being read. */
-		N->type = NODE_TYPE_READ;
 	}
 
 	/* If we can't fail, mark the read as such. */
@@ -243,13 +406,6 @@ btree_node_fetch_canfail(struct btree * T, struct node * N,
 	/* Success! */
 	return (0);
 
-err3:
-	readerlist_free(N->u.reading->list);
-err2:
-	free(N->u.reading);
-err1:
-	pool_rec_free(T->P, N);
-	N->pool_cookie = NULL;
 err0:
 	/* Failure! */
 	return (-1);
@@ -307,6 +463,10 @@ callback_fetch(void * cookie, int failed, int status, const uint8_t * buf)
 	struct reader * r;
 	size_t i;
 
+	/* This readahead is no longer in progress. */
+	if (R->readahead)
+		R->T->nreadahead -= 1;
+
 	/* Throw a fit if the read request failed. */
 	if (failed) {
 		warnp("LBS GET request failed");
@@ -322,7 +482,7 @@ callback_fetch(void * cookie, int failed, int status, const uint8_t * buf)
 	/* If the block exists, parse it. */
 	if (status == 0) {
 		/* Parse the page. */
-		if (deserialize(N, buf, R->pagelen)) {
+		if (deserialize(R->T, N, buf, R->pagelen)) {
 			warn0("Cannot deserialize page");
 			goto err2;
 		}
@@ -380,6 +540,26 @@ err1:
 	return (-1);
 }
 
+/* Parse each page read by a GETV request. */
+static int
+callback_fetchrun(void * cookie, int failed, int status, const uint8_t * buf)
+{
+	struct readrun * R = cookie;
+	size_t i;
+	int rc = 0;
+
+	/* Handle the pages one by one, as if each had its own GET. */
+	for (i = 0; (i < R->npages) && (rc == 0); i++)
+		rc = callback_fetch(R->N[i], failed, status,
+		    (buf != NULL) ? &buf[i * R->T->pagelen] : NULL);
+
+	/* Free the run. */
+	free(R);
+
+	/* Return status from callbacks. */
+	return (rc);
+}
+
 /**
  * btree_node_destroy(T, N):
  * Remove the node ${N} from the B+Tree ${T} and free it.  If present, the
@@ -570,6 +750,9 @@ btree_node_descend(struct btree * T, struct node * N,
 			goto err1;
 	}
 
+	/* Read ahead if we're stepping through a parent's children. */
+	readahead(T, N);
+
 	/* Success! */
 	return (0);
 
@@ -580,6 +763,114 @@ err0:
 	return (-1);
 }
 
+/*
+ * Move from the child at position ${*pos} of the parent ${*P} to the next
+ * node of the same height in key order, looking no further than the first
+ * child of the next sibling of ${*P}, and only if that sibling is present.
+ * Return the node (updating ${P} and ${pos}), or NULL if none was found.
+ */
+static struct node *
+nextnode(struct node ** P, size_t * pos)
+{
+	struct node * G;
+	size_t i;
+
+	/* If this parent has more children, move on to the next one. */
+	if (*pos < (*P)->nkeys) {
+		*pos += 1;
+		return ((*P)->v.children[*pos]);
+	}
+
+	/* Otherwise find this parent's position in its own parent. */
+	if ((G = (*P)->p_shadow) == NULL)
+		return (NULL);
+	for (i = 0; i < G->nkeys; i++) {
+		if (G->v.children[i] == *P)
+			break;
+	}
+
+	/* Move on to the first child of the next parent, if it's present. */
+	if ((i == G->nkeys) ||
+	    (G->v.children[i + 1]->type != NODE_TYPE_PARENT))
+		return (NULL);
+	*P = G->v.children[i + 1];
+	*pos = 0;
+	return ((*P)->v.children[0]);
+}
+
+/*
+ * Record that we are descending into the node ${N} in the B+Tree ${T}, which
+ * must be locked or being read.  If this is the node which follows the one we
+ * last descended into, start reading the next READAHEAD nodes at low
+ * priority.
+ */
+static void
+readahead(struct btree * T, struct node * N)
+{
+	struct node * P = N->p_shadow;
+	struct node * P_old;
+	struct node * C;
+	size_t pos;
+	size_t i;
+
+	/* If this node has no clean parent, it has no siblings to read. */
+	if (P == NULL)
+		return;
+
+	/* Is this the node we expected to come next? */
+	pos = T->ra_pos;
+	if ((N != T->ra_next) || (pos > P->nkeys) ||
+	    (P->v.children[pos] != N)) {
+		/*
+		 * Not sequential.  If we just had to fetch this node, note
+		 * which node follows it so that we can spot a sequential scan
+		 * starting here; otherwise don't bother searching for it.
+		 */
+		if (N->type != NODE_TYPE_READ)
+			return;
+		for (pos = 0; pos < P->nkeys; pos++) {
+			if (P->v.children[pos] == N)
+				break;
+		}
+		T->ra_next = nextnode(&P, &pos);
+		T->ra_pos = pos;
+		return;
+	}
+
+	/* Keep the parent present while we look at its children. */
+	btree_node_lock(T, P);
+
+	/* Look at the next READAHEAD nodes. */
+	T->ra_next = NULL;
+	for (i = 0; i < READAHEAD; i++) {
+		/* Move on, switching our lock if we move to a new parent. */
+		P_old = P;
+		if ((C = nextnode(&P, &pos)) == NULL)
+			break;
+		if (P != P_old) {
+			btree_node_lock(T, P);
+			btree_node_unlock(T, P_old);
+		}
+
+		/* Remember which node we expect next. */
+		if (i == 0) {
+			T->ra_next = C;
+			T->ra_pos = pos;
+		}
+
+		/*
+		 * Start reading the node if it isn't present.  Stop if the
+		 * pool is full of low-priority pages; readahead is advisory,
+		 * so ignore failures.
+		 */
+		if ((C->type == NODE_TYPE_NP) && startread(T, C, 0, 1))
+			break;
+	}
+
+	/* We're done with the parent. */
+	btree_node_unlock(T, P);
+}
+
 /* Invoke the callback on the provided node. */
 static int
 callback_descend(void * cookie)
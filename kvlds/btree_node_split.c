@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,33 +13,135 @@
 
 #include "btree_node.h"
 
+/*
+ * Add the key-value pair #${i} of the leaf ${N} to a leaf under construction
+ * which has size ${*plainsize} if written out normally and ${*fcsize} if
+ * front-coded, where ${first} is non-zero if this is its first pair.  Return
+ * the new size of the leaf (the lesser of the two) for the purpose of deciding
+ * where to split: A key can take one byte more in a front-coded leaf than
+ * its serialized length, so we count an extra byte for front-coded leaves in
+ * order that adding a pair to a leaf below the split threshold still cannot
+ * take it beyond the page size.
+ */
+static size_t
+addpair(struct node * N, size_t i, int first, size_t * plainsize,
+    size_t * fcsize)
+{
+
+	/* Add the key size. */
+	*plainsize += kvldskey_serial_size(N->u.pairs[i].k);
+	*fcsize += serialize_fckey_size(first ? NULL : N->u.pairs[i - 1].k,
+	    N->u.pairs[i].k);
+
+	/* Add the value size. */
+	*plainsize += kvldskey_serial_size(N->u.pairs[i].v);
+	*fcsize += kvldskey_serial_size(N->u.pairs[i].v);
+
+	/* The leaf will be front-coded if that makes it smaller. */
+	return ((*fcsize < *plainsize) ? *fcsize + 1 : *plainsize);
+}
+
+/*
+ * Return the number of key-value pairs, starting from pair #${start} of the
+ * leaf ${N} belonging to the B+Tree ${T}, which should go into the next part
+ * when splitting ${N}.  Set ${*pagesize} to the size of that part's page if
+ * it was worked out along the way, or to (uint32_t)(-1) if not.
+ */
+static size_t
+partlen(struct btree * T, struct node * N, size_t start, size_t breakat,
+    uint32_t * pagesize)
+{
+	size_t cursize, plainsize, fcsize;
+	size_t rawsize, guesssize;
+	size_t size;
+	size_t n, lo, hi, guess;
+	int tries;
+
+	/* Add key-value pairs until we exceed the threshold. */
+	cursize = plainsize = fcsize = SERIALIZE_OVERHEAD;
+	for (n = 0; start + n < N->nkeys; n++) {
+		if (cursize > breakat)
+			break;
+		cursize = addpair(N, start + n, n == 0, &plainsize, &fcsize);
+	}
+
+	/* We haven't compressed anything. */
+	*pagesize = (uint32_t)(-1);
+
+	/* Unless leaves are compressed, this is where we split. */
+	if (!T->zleaves)
+		return (n);
+
+	/*
+	 * A compressed leaf can hold more pairs, as long as they take at
+	 * most SERIALIZE_ZPAGES pages uncompressed; so we want the most
+	 * pairs we can put into the part without it exceeding the threshold
+	 * once compressed.  We know that the first ${n} pairs fit.
+	 *
+	 * Compressing is slow, so rather than a binary search, guess from how
+	 * well leaves have compressed so far; then refine the guess on the
+	 * assumption that the compressed size is proportional to the number
+	 * of pairs, for a few tries.
+	 */
+	guesssize = breakat;
+	if (T->zbytes > 0)
+		guesssize = (size_t)((double)breakat *
+		    (double)T->zrawbytes / (double)T->zbytes);
+	cursize = plainsize = fcsize = SERIALIZE_OVERHEAD;
+	for (rawsize = 0, hi = guess = 0; start + hi < N->nkeys; hi++) {
+		rawsize += kvldskey_serial_size(N->u.pairs[start + hi].k);
+		rawsize += kvldskey_serial_size(N->u.pairs[start + hi].v);
+		if (rawsize > SERIALIZE_ZPAGES * T->pagelen)
+			break;
+		if (cursize <= guesssize) {
+			cursize = addpair(N, start + hi, hi == 0, &plainsize,
+			    &fcsize);
+			guess = hi + 1;
+		}
+	}
+	for (lo = n, tries = 0; (tries < 4) && (lo < hi); tries++) {
+		/* Try something we don't know the answer for. */
+		if (guess <= lo)
+			guess = lo + 1;
+		if (guess > hi)
+			guess = hi;
+
+		/* Does it fit? */
+		size = serialize_leaf_size(T, &N->u.pairs[start], guess);
+		if (size <= breakat) {
+			lo = guess;
+			*pagesize = (uint32_t)size;
+		} else {
+			hi = guess - 1;
+		}
+
+		/* Scale the guess towards the threshold. */
+		if (size > SERIALIZE_OVERHEAD)
+			guess = (size_t)((double)guess *
+			    (double)(breakat - SERIALIZE_OVERHEAD) /
+			    (double)(size - SERIALIZE_OVERHEAD));
+	}
+
+	/* Return the number of pairs. */
+	return (lo);
+}
+
 /* Return the number of parts into which a leaf node should be split. */
 static size_t
-nparts_leaf(struct node * N, size_t breakat)
+nparts_leaf(struct btree * T, struct node * N, size_t breakat)
 {
+	uint32_t pagesize;
 	size_t nparts;
 	size_t i;
-	size_t cursize;
 
 	/* This is a leaf. */
 	assert(N->type == NODE_TYPE_LEAF);
 
 	/* Scan through nodes. */
 	nparts = 1;
-	cursize = SERIALIZE_OVERHEAD;
-	for (i = 0; i < N->nkeys; i++) {
-		/* Should we split before this next key-value pair? */
-		if (cursize > breakat) {
-			nparts += 1;
-			cursize = SERIALIZE_OVERHEAD;
-		}
-
-		/* Add the key size. */
-		cursize += kvldskey_serial_size(N->u.pairs[i].k);
-
-		/* Add the value size. */
-		cursize += kvldskey_serial_size(N->u.pairs[i].v);
-	}
+	for (i = partlen(T, N, 0, breakat, &pagesize); i < N->nkeys;
+	    i += partlen(T, N, i, breakat, &pagesize))
+		nparts += 1;
 
 	/* Return the number of parts. */
 	return (nparts);
@@ -91,7 +194,7 @@ btree_node_split_nparts(struct btree * T, struct node * N)
 
 	/* Handle leaves and parents separately. */
 	if (N->type == NODE_TYPE_LEAF)
-		return (nparts_leaf(N, breakat));
+		return (nparts_leaf(T, N, breakat));
 	else
 		return (nparts_parent(N, breakat));
 }
@@ -127,8 +230,8 @@ static int
 split_leaf(struct btree * T, struct node * N, const struct kvldskey ** keys,
     struct node ** parents, size_t * nparts, size_t breakat)
 {
+	uint32_t pagesize;
 	size_t i;
-	size_t cursize;
 	size_t nkeys;
 
 	/* This is a leaf. */
@@ -136,45 +239,28 @@ split_leaf(struct btree * T, struct node * N, const struct kvldskey ** keys,
 
 	/* Scan through nodes. */
 	*nparts = 0;
-	cursize = SERIALIZE_OVERHEAD;
-	nkeys = 0;
-	for (i = 0; i < N->nkeys; i++) {
-		/* Should we split before this next key-value pair? */
-		if (cursize > breakat) {
-			/* Create a new leaf node. */
-			if ((parents[*nparts] =
-			    makeleaf(T, nkeys, &N->u.pairs[i - nkeys])) == NULL)
-				goto err1;
-
-			/*
-			 * Create a separator key which is greater than the
-			 * previous key and less than or equal to the next
-			 * key.
-			 */
-			keys[*nparts] = N->u.pairs[i].k;
-
-			/* We've finished this part. */
-			*nparts += 1;
-			cursize = SERIALIZE_OVERHEAD;
-			nkeys = 0;
-		}
-
-		/* Add the key size. */
-		cursize += kvldskey_serial_size(N->u.pairs[i].k);
-
-		/* Add the value size. */
-		cursize += kvldskey_serial_size(N->u.pairs[i].v);
-
-		/* We have a key in the node we're constructing. */
-		nkeys += 1;
+	for (i = 0; ; i += nkeys) {
+		/* How many key-value pairs go into this part? */
+		nkeys = partlen(T, N, i, breakat, &pagesize);
+
+		/* Create a new leaf node, remembering its size if known. */
+		if ((parents[*nparts] =
+		    makeleaf(T, nkeys, &N->u.pairs[i])) == NULL)
+			goto err1;
+		parents[*nparts]->pagesize = pagesize;
+		*nparts += 1;
+
+		/* Was that the last part? */
+		if (i + nkeys == N->nkeys)
+			break;
+
+		/*
+		 * Create a separator key which is greater than the previous
+		 * key and less than or equal to the next key.
+		 */
+		keys[*nparts - 1] = N->u.pairs[i + nkeys].k;
 	}
 
-	/* Create a leaf with whatever we've got left over. */
-	if ((parents[*nparts] = makeleaf(T, nkeys,
-	    &N->u.pairs[i - nkeys])) == NULL)
-		goto err1;
-	*nparts += 1;
-
 	/* Destroy the old node. */
 	btree_node_destroy(T, N);
 
@@ -12,9 +12,13 @@
 #include "btree_node.h"
 #include "node.h"
 #include "serialize.h"
+#include "serializer.h"
 
 #include "btree.h"
 
+/* Don't bother handing fewer leaves than this to serialization threads. */
+#define MINPARALLEL	64
+
 struct write_cookie {
 	/* Callback to be performed after sync is done. */
 	int (* callback)(void *);
@@ -22,8 +26,15 @@ struct write_cookie {
 
 	/* The B+Tree. */
 	struct btree * T;
+
+	/* Pages to be written. */
+	size_t npages;			/* Number of pages. */
+	struct node ** nodes;		/* Nodes being written. */
+	const uint8_t ** bufv;		/* Pages. */
+	uint8_t ** zbufv;		/* Compressed pages to free, or NULL. */
 };
 
+static int callback_serialized(void *, int);
 static int callback_append(void *, int, int, uint64_t);
 static int callback_unshadow(void *);
 
@@ -47,23 +58,24 @@ ndirty(struct node * N)
 	return (n);
 }
 
-/* Serialize the dirty nodes in a (sub)tree. */
-static int
-serializetree(struct btree * T, struct node * N, size_t pagelen,
-    uint64_t nextblk, const uint8_t ** bufv, uint64_t * pn)
+/*
+ * Assign page numbers to the dirty nodes in a (sub)tree, children before
+ * parents, and record the nodes in ${nodes}.
+ */
+static void
+numbertree(struct node * N, uint64_t nextblk, struct node ** nodes,
+    uint64_t * pn)
 {
 	size_t i;
 
 	/* If this node is not dirty, return immediately. */
 	if (N->state != NODE_STATE_DIRTY)
-		return (0);
+		return;
 
-	/* If this node has children, serialize them first. */
+	/* If this node has children, number them first. */
 	if (N->type == NODE_TYPE_PARENT) {
 		for (i = 0; i <= N->nkeys; i++)
-			if (serializetree(T, N->v.children[i], pagelen,
-			    nextblk, bufv, pn))
-				goto err0;
+			numbertree(N->v.children[i], nextblk, nodes, pn);
 	}
 
 	/* Record this node's page number. */
@@ -81,10 +93,83 @@ serializetree(struct btree * T, struct node * N, size_t pagelen,
 		}
 	}
 
-	/* Serialize the page and record the page pointer. */
-	if (serialize(T, N, pagelen))
+	/* Record the node. */
+	nodes[*pn] = N;
+	*pn += 1;
+}
+
+/*
+ * Serialize the pages which have not already been serialized, in order (so
+ * that children are serialized before their parents, which record the sizes
+ * of their children's pages), and record pointers to the pages.
+ */
+static int
+serializepages(struct write_cookie * WC)
+{
+	struct node * N;
+	size_t i;
+
+	for (i = 0; i < WC->npages; i++) {
+		N = WC->nodes[i];
+
+		/* Serialize the page if necessary. */
+		if ((N->pagebuf == NULL) &&
+		    serialize(WC->T, N, WC->T->pagelen, &WC->zbufv[i]))
+			goto err0;
+
+		/* Record the page pointer. */
+		if (WC->zbufv[i] != NULL)
+			WC->bufv[i] = WC->zbufv[i];
+		else
+			WC->bufv[i] = N->pagebuf;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Free the page vectors. */
+static void
+freepages(struct write_cookie * WC)
+{
+	size_t i;
+
+	for (i = 0; i < WC->npages; i++)
+		free(WC->zbufv[i]);
+	free(WC->zbufv);
+	free(WC->bufv);
+	free(WC->nodes);
+}
+
+/* Serialize any remaining pages and write the pages out. */
+static int
+writepages(struct write_cookie * WC)
+{
+	struct btree * T = WC->T;
+
+	/* Serialize pages and record pointers into the vectors. */
+	if (serializepages(WC))
+		goto err0;
+
+	/* Sanity check the number of pages. */
+	assert(WC->npages <= UINT32_MAX);
+
+	/* Write pages out. */
+	if (proto_lbs_request_append_blks(T->LBS, (uint32_t)WC->npages,
+	    T->nextblk, T->pagelen, WC->bufv, callback_append, WC)) {
+		warnp("Error writing pages");
 		goto err0;
-	bufv[(*pn)++] = N->pagebuf;
+	}
+
+	/*
+	 * The pages have been copied into the request, so we can free the
+	 * compressed pages and the page vectors.
+	 */
+	freepages(WC);
 
 	/* Success! */
 	return (0);
@@ -130,6 +215,15 @@ makeclean(struct btree * T, struct node * N)
 	/* Mark this node as clean. */
 	N->state = NODE_STATE_CLEAN;
 
+	/*
+	 * Its keys now live in its page and won't change, so build the
+	 * search accelerator; if we can't, searches are merely slower.
+	 */
+	(void)node_mkpfx(N);
+
+	/* Merging it might work out differently next time. */
+	N->nomerge = 0;
+
 	/* Remove the node-is-dirty lock on the node. */
 	btree_node_unlock(T, N);
 
@@ -198,9 +292,9 @@ int
 btree_sync(struct btree * T, int (* callback)(void *), void * cookie)
 {
 	struct write_cookie * WC;
-	size_t npages;
-	const uint8_t ** bufv;
+	size_t nleaves;
 	uint64_t pn = 0;
+	size_t i;
 
 	/* Bake a cookie. */
 	if ((WC = malloc(sizeof(struct write_cookie))) == NULL)
@@ -210,36 +304,63 @@ btree_sync(struct btree * T, int (* callback)(void *), void * cookie)
 	WC->cookie = cookie;
 
 	/* Figure out how many pages we need to write. */
-	npages = ndirty(T->root_dirty);
+	WC->npages = ndirty(T->root_dirty);
 
-	/* Allocate a vector to hold pointers to pages. */
-	if (IMALLOC(bufv, npages, const uint8_t *))
+	/* Allocate vectors to hold pointers to nodes and pages. */
+	if (IMALLOC(WC->nodes, WC->npages, struct node *))
 		goto err1;
-
-	/* Serialize pages and record pointers into the vector. */
-	if (serializetree(T, T->root_dirty, T->pagelen, T->nextblk,
-	    bufv, &pn))
+	if (IMALLOC(WC->bufv, WC->npages, const uint8_t *))
 		goto err2;
+	if (IMALLOC(WC->zbufv, WC->npages, uint8_t *))
+		goto err3;
+	for (i = 0; i < WC->npages; i++)
+		WC->zbufv[i] = NULL;
 
-	/* Sanity check the number of pages serialized. */
-	assert(pn == npages);
-	assert(npages <= UINT32_MAX);
+	/* Assign page numbers and record the nodes. */
+	numbertree(T->root_dirty, T->nextblk, WC->nodes, &pn);
 
-	/* Write pages out. */
-	if (proto_lbs_request_append_blks(T->LBS, (uint32_t)npages, T->nextblk,
-	    T->pagelen, bufv, callback_append, WC)) {
-		warnp("Error writing pages");
-		goto err2;
+	/* Sanity check the number of pages. */
+	assert(pn == WC->npages);
+
+	/*
+	 * Count the leaves which serialization threads could handle, and
+	 * make sure we know their sizes; finding out how small a leaf
+	 * compresses uses scratch space in the tree which threads can't share.
+	 */
+	for (nleaves = i = 0; i < WC->npages; i++) {
+		if ((WC->nodes[i]->type == NODE_TYPE_LEAF) &&
+		    (WC->nodes[i]->root == 0)) {
+			serialize_size(T, WC->nodes[i]);
+			nleaves++;
+		}
+	}
+
+	/*
+	 * If we have serialization threads and enough leaves to make it
+	 * worthwhile, have the threads serialize the leaves while we go back
+	 * to handling events; we'll write the pages out once they're done.
+	 */
+	if ((T->S != NULL) && (nleaves >= MINPARALLEL)) {
+		if (serializer_run(T->S, WC->nodes, WC->npages, T->pagelen,
+		    WC->zbufv, callback_serialized, WC))
+			goto err4;
+		return (0);
 	}
 
-	/* Free the page pointers vector. */
-	free(bufv);
+	/* Otherwise, serialize the pages ourselves and write them out. */
+	if (writepages(WC))
+		goto err4;
 
 	/* Success! */
 	return (0);
 
+err4:
+	freepages(WC);
+	goto err1;
+err3:
+	free(WC->bufv);
 err2:
-	free(bufv);
+	free(WC->nodes);
 err1:
 	free(WC);
 err0:
@@ -247,6 +368,33 @@ err0:
 	return (-1);
 }
 
+/* Callback for btree_sync when the serialization threads are done. */
+static int
+callback_serialized(void * cookie, int failed)
+{
+	struct write_cookie * WC = cookie;
+
+	/* Did the threads manage to serialize the leaves? */
+	if (failed) {
+		warnp("Error serializing pages");
+		goto err1;
+	}
+
+	/* Serialize the parents and write the pages out. */
+	if (writepages(WC))
+		goto err1;
+
+	/* Success! */
+	return (0);
+
+err1:
+	freepages(WC);
+	free(WC);
+
+	/* Failure! */
+	return (-1);
+}
+
 /* Callback for btree_sync when write is complete. */
 static int
 callback_append(void * cookie, int failed, int status, uint64_t blkno)
@@ -12,6 +12,7 @@
 #include "events.h"
 #include "imalloc.h"
 #include "kvldskey.h"
+#include "monoclock.h"
 #include "mpool.h"
 #include "netbuf.h"
 #include "network.h"
@@ -22,11 +23,12 @@
 
 #include "btree.h"
 #include "btree_cleaning.h"
+#include "groupcommit.h"
 #include "node.h"
 
 #include "dispatch.h"
 
-/* Maximum number of requests to have pending at once. */
+/* Maximum number of requests to have pending at once per connection. */
 #define MAXREQS	4096
 
 /* Linked list of requests. */
@@ -37,20 +39,48 @@ struct requestq {
 	/* Next request in the linked list. */
 	struct requestq * next;
 
+	/* Connection which the request arrived on. */
+	struct dispatch_conn * C;
+
 	/* Used for NMRs after dequeueing. */
-	struct dispatch_state * D;
 	size_t npages;
 };
 
-/* Request dispatcher state. */
-struct dispatch_state {
-	/* Connection management. */
+/* Batch of modifying requests. */
+struct mr_batch {
+	struct dispatch_state * D;	/* Dispatcher. */
+	size_t nreqs;			/* # requests in the batch. */
+	struct dispatch_conn ** conns;	/* Origins of batch requests. */
+	struct timeval tv_launch;	/* When the batch was launched. */
+};
+
+/* Client connection. */
+struct dispatch_conn {
+	/* Bookkeeping. */
+	struct dispatch_state * D;	/* Dispatcher. */
+	struct dispatch_conn * next;	/* Next in linked list. */
+	struct dispatch_conn * prev;	/* Previous in linked list. */
+	void * reap_cookie;		/* Cookie from events_immediate. */
+
+	/* The connection. */
 	int dying;			/* Our connection is dying. */
 	int s;				/* Connected socket. */
 	struct netbuf_read * readq;	/* Packet read queue. */
 	struct netbuf_write * writeq;	/* Packet write queue. */
 	void * read_cookie;		/* Request read cookie. */
 	size_t nrequests;		/* Number of responses we owe. */
+};
+
+/* Request dispatcher state. */
+struct dispatch_state {
+	/* Connection management. */
+	int s;				/* Listening socket. */
+	void * accept_cookie;		/* Cookie from network_accept. */
+	int accept_done;		/* Don't accept more connections. */
+	int once;			/* Only accept one connection. */
+	struct dispatch_conn * conns;	/* Active connections. */
+	size_t nconns;			/* # active connections. */
+	size_t maxconns;		/* Max # active connections. */
 
 	/* Operational parameters. */
 	struct btree * T;		/* The B+Tree we're working on. */
@@ -66,7 +96,6 @@ struct dispatch_state {
 	/* Modifying requests. */
 	struct requestq * mr_head;	/* First request in the queue. */
 	struct requestq ** mr_tail;	/* Pointer to final NULL. */
-	size_t mr_reqs;			/* # requests in current batch. */
 	size_t mr_concurrency;		/* Max # pages touched by MRs. */
 
 	/* Stop-queuing-MRs-yet-and-start-processing-them controls. */
@@ -76,6 +105,7 @@ struct dispatch_state {
 	int mr_timer_expired;		/* Timer has expired. */
 	struct timeval mr_timeout;	/* Maximum time for MR to wait. */
 	size_t mr_min_batch;		/* Minimum MR batch w/o timeout. */
+	struct groupcommit * mr_gc;	/* Adapts the above, or NULL. */
 
 	/* Cleaning-flush timer. */
 	void * mrc_timer;		/* Cookie from events_timer. */
@@ -84,8 +114,11 @@ struct dispatch_state {
 
 MPOOL(requestq, struct requestq, 4096);
 
+static int accept_start(struct dispatch_state *);
 static int callback_accept(void *, int);
 static int dropconnection(void *);
+static int checkdead(struct dispatch_conn *);
+static int callback_reap(void *);
 static int poke_nmr(struct dispatch_state *);
 static int callback_nmr_done(void *);
 static int poke_mr(struct dispatch_state *);
@@ -93,63 +126,268 @@ static int callback_mr_timer(void *);
 static int callback_mrc_timer(void *);
 static int callback_mr_done(void *);
 static int gotrequest(void *, int);
-static int readreqs(struct dispatch_state *);
+static int readreqs(struct dispatch_conn *);
 
 /* Time between ticks of the 'flush cleans if we have had no MRs' clock. */
 static const struct timeval fivesec = {.tv_sec = 5, .tv_usec = 0};
 
-/* The connection is dying.  Help speed up the process. */
+/* Start accepting a connection if we want more connections. */
 static int
-dropconnection(void * cookie)
+accept_start(struct dispatch_state * D)
+{
+
+	/* Do nothing if we're already accepting a connection. */
+	if (D->accept_cookie != NULL)
+		goto done;
+
+	/* Do nothing if we don't want any more connections. */
+	if (D->accept_done || (D->nconns == D->maxconns))
+		goto done;
+
+	/* Accept a connection. */
+	if ((D->accept_cookie =
+	    network_accept(D->s, callback_accept, D)) == NULL)
+		goto err0;
+
+done:
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* A connection has arrived. */
+static int
+callback_accept(void * cookie, int s)
 {
 	struct dispatch_state * D = cookie;
-	struct requestq * RQ;
+	struct dispatch_conn * C;
 
-	/* This connection is dying. */
-	D->dying = 1;
+	/* We're not accepting a connection any more. */
+	D->accept_cookie = NULL;
 
-	/* If we're reading a packet, stop it. */
-	if (D->read_cookie != NULL) {
-		wire_readpacket_wait_cancel(D->read_cookie);
-		D->read_cookie = NULL;
+	/* Check if the accept failed. */
+	if (s == -1) {
+		warnp("Error accepting connection");
+		goto err0;
 	}
 
-	/* Free queued requests. */
-	while ((RQ = D->nmr_head) != NULL) {
-		/* Remove from the queue. */
-		D->nmr_head = RQ->next;
+	/* If we only handle one connection, this is it. */
+	if (D->once)
+		D->accept_done = 1;
 
-		/* Free the request and linked list node. */
-		proto_kvlds_request_free(RQ->R);
-		mpool_requestq_free(RQ);
+	/* Allocate a connection structure. */
+	if ((C = malloc(sizeof(struct dispatch_conn))) == NULL)
+		goto err1;
+	C->D = D;
+	C->reap_cookie = NULL;
+	C->dying = 0;
+	C->s = s;
+	C->read_cookie = NULL;
+	C->nrequests = 0;
 
-		/* That's one request we won't be responding to. */
-		D->nrequests -= 1;
+	/* Make the accepted connection non-blocking. */
+	if (fcntl(C->s, F_SETFL, O_NONBLOCK) == -1) {
+		warnp("Cannot make connection non-blocking");
+		goto err2;
+	}
+
+	/* Create a buffered writer for the connection. */
+	if ((C->writeq = netbuf_write_init(C->s, dropconnection, C)) == NULL) {
+		warnp("Cannot create packet write queue");
+		goto err2;
 	}
-	while ((RQ = D->mr_head) != NULL) {
+
+	/* Create a buffered reader for the connection. */
+	if ((C->readq = netbuf_read_init(C->s)) == NULL) {
+		warn0("Cannot create packet read queue");
+		goto err3;
+	}
+
+	/* Start listening for packets. */
+	if (readreqs(C))
+		goto err4;
+
+	/* Add this connection to the list. */
+	C->prev = NULL;
+	C->next = D->conns;
+	if (C->next != NULL)
+		C->next->prev = C;
+	D->conns = C;
+	D->nconns += 1;
+
+	/* Accept another connection if we want more. */
+	if (accept_start(D))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err4:
+	netbuf_read_free(C->readq);
+err3:
+	netbuf_write_free(C->writeq);
+err2:
+	free(C);
+err1:
+	if (close(s))
+		warnp("close");
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Remove the requests which arrived on the connection ${C} from the request
+ * queue with head ${head} and tail ${tail}, and free them.  Return the number
+ * of requests removed.
+ */
+static size_t
+dropqueued(struct requestq ** head, struct requestq *** tail,
+    struct dispatch_conn * C)
+{
+	struct requestq ** p;
+	struct requestq * RQ;
+	size_t n = 0;
+
+	/* Walk the queue, unlinking requests from this connection. */
+	for (p = head; (RQ = *p) != NULL; ) {
+		if (RQ->C != C) {
+			p = &RQ->next;
+			continue;
+		}
+
 		/* Remove from the queue. */
-		D->mr_head = RQ->next;
-		D->mr_qlen -= 1;
+		*p = RQ->next;
 
 		/* Free the request and linked list node. */
 		proto_kvlds_request_free(RQ->R);
 		mpool_requestq_free(RQ);
+		n += 1;
+	}
+
+	/* The queue now ends here. */
+	*tail = p;
+
+	/* Return the number of requests removed. */
+	return (n);
+}
 
-		/* That's one request we won't be responding to. */
-		D->nrequests -= 1;
+/* The connection is dying.  Help speed up the process. */
+static int
+dropconnection(void * cookie)
+{
+	struct dispatch_conn * C = cookie;
+	struct dispatch_state * D = C->D;
+	size_t n;
+
+	/* This connection is dying. */
+	C->dying = 1;
+
+	/* If we're reading a packet, stop it. */
+	if (C->read_cookie != NULL) {
+		wire_readpacket_wait_cancel(C->read_cookie);
+		C->read_cookie = NULL;
 	}
 
-	/* Cancel any stop-queuing timer; we've freed the queue anyway. */
-	if (D->mr_timer != NULL) {
-		events_timer_cancel(D->mr_timer);
-		D->mr_timer = NULL;
+	/* Free queued requests; we won't be responding to them. */
+	C->nrequests -= dropqueued(&D->nmr_head, &D->nmr_tail, C);
+	n = dropqueued(&D->mr_head, &D->mr_tail, C);
+	C->nrequests -= n;
+	D->mr_qlen -= n;
+
+	/* If no MRs are queued, cancel any stop-queuing timer. */
+	if (D->mr_qlen == 0) {
+		if (D->mr_timer != NULL) {
+			events_timer_cancel(D->mr_timer);
+			D->mr_timer = NULL;
+		}
+
+		/* The (unset) timer hasn't expired. */
+		D->mr_timer_expired = 0;
 	}
 
-	/* The (unset) timer hasn't expired. */
-	D->mr_timer_expired = 0;
+	/* Clean up the connection if it has nothing left to do. */
+	return (checkdead(C));
+}
+
+/* If the connection ${C} is dead, schedule it to be cleaned up. */
+static int
+checkdead(struct dispatch_conn * C)
+{
+
+	/* Nothing to do if it's still alive or about to be reaped. */
+	if ((C->dying == 0) || (C->nrequests > 0) || (C->reap_cookie != NULL))
+		goto done;
+
+	/*
+	 * Schedule the clean-up rather than doing it now, since we may be
+	 * running in a callback from the connection's write queue.
+	 */
+	if ((C->reap_cookie =
+	    events_immediate_register(callback_reap, C, 0)) == NULL)
+		goto err0;
 
-	/* Success!  (We can't fail -- but netbuf_write doesn't know that.) */
+done:
+	/* Success! */
 	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Close and free a dead connection. */
+static int
+callback_reap(void * cookie)
+{
+	struct dispatch_conn * C = cookie;
+	struct dispatch_state * D = C->D;
+
+	/*
+	 * There should be no requests in progress.  We should not be reading
+	 * a request, and the connection should be dying.
+	 */
+	assert(C->nrequests == 0);
+	assert(C->read_cookie == NULL);
+	assert(C->dying == 1);
+
+	/* Detach from the dispatcher. */
+	if (C->prev == NULL)
+		D->conns = C->next;
+	else
+		C->prev->next = C->next;
+	if (C->next != NULL)
+		C->next->prev = C->prev;
+	D->nconns -= 1;
+
+	/* Free the buffered reader. */
+	netbuf_read_free(C->readq);
+
+	/* Free the buffered writer. */
+	netbuf_write_free(C->writeq);
+
+	/* Close the socket. */
+	while (close(C->s)) {
+		if (errno == EINTR)
+			continue;
+		warnp("close");
+		goto err1;
+	}
+
+	/* Free the connection state. */
+	free(C);
+
+	/* We may want another connection now. */
+	return (accept_start(D));
+
+err1:
+	free(C);
+
+	/* Failure! */
+	return (-1);
 }
 
 /* Launch non-modifying requests, if possible. */
@@ -176,8 +414,7 @@ poke_nmr(struct dispatch_state * D)
 		D->nmr_head = RQ->next;
 
 		/* Launch the request. */
-		RQ->D = D;
-		if (dispatch_nmr_launch(D->T, RQ->R, D->writeq,
+		if (dispatch_nmr_launch(D->T, RQ->R, RQ->C->writeq,
 		    callback_nmr_done, RQ))
 			goto err0;
 		D->nmr_ip += RQ->npages;
@@ -196,7 +433,8 @@ static int
 callback_nmr_done(void * cookie)
 {
 	struct requestq * RQ = cookie;
-	struct dispatch_state * D = RQ->D;
+	struct dispatch_conn * C = RQ->C;
+	struct dispatch_state * D = C->D;
 
 	/* This NMR is no longer in progress. */
 	D->nmr_ip -= RQ->npages;
@@ -205,10 +443,14 @@ callback_nmr_done(void * cookie)
 	mpool_requestq_free(RQ);
 
 	/* We've finished with this request. */
-	D->nrequests -= 1;
+	C->nrequests -= 1;
 
 	/* Check if we need to read more requests. */
-	if (readreqs(D))
+	if (readreqs(C))
+		goto err0;
+
+	/* Check if the connection is dead. */
+	if (checkdead(C))
 		goto err0;
 
 	/* Poke the queue in case we can now handle another request. */
@@ -230,29 +472,43 @@ poke_mr(struct dispatch_state * D)
 	size_t concurrency = D->mr_concurrency;
 	size_t pagesperop = (size_t)(D->T->root_dirty->height + 1);
 	struct proto_kvlds_request ** reqs;
+	struct netbuf_write ** WQs;
 	struct requestq * RQ;
+	struct mr_batch * MB;
 	size_t i;
 
-	/* Sanity check. */
-	assert(D->mr_qlen <= MAXREQS);
-
 	/* Launch a batch of requests if possible. */
 	if ((D->mr_inprogress == 0) &&
 	    ((D->mr_timer_expired != 0) ||
 	     (D->docleans != 0) ||
 	     (D->mr_qlen >= D->mr_min_batch))) {
+		/* Bake a cookie. */
+		if ((MB = malloc(sizeof(struct mr_batch))) == NULL)
+			goto err0;
+		MB->D = D;
+
+		/* Record when the batch was launched, if we care. */
+		if ((D->mr_gc != NULL) && monoclock_get(&MB->tv_launch)) {
+			warnp("monoclock_get");
+			goto err1;
+		}
+
 		/* Figure out how many requests will be in this batch. */
 		if (D->mr_qlen * pagesperop > concurrency)
-			D->mr_reqs = concurrency / pagesperop;
+			MB->nreqs = concurrency / pagesperop;
 		else
-			D->mr_reqs = D->mr_qlen;
+			MB->nreqs = D->mr_qlen;
 
-		/* Allocate an array. */
-		if (IMALLOC(reqs, D->mr_reqs, struct proto_kvlds_request *))
-			goto err0;
+		/* Allocate arrays. */
+		if (IMALLOC(reqs, MB->nreqs, struct proto_kvlds_request *))
+			goto err1;
+		if (IMALLOC(WQs, MB->nreqs, struct netbuf_write *))
+			goto err2;
+		if (IMALLOC(MB->conns, MB->nreqs, struct dispatch_conn *))
+			goto err3;
 
 		/* Fill the array with requests. */
-		for (i = 0; i < D->mr_reqs; i++) {
+		for (i = 0; i < MB->nreqs; i++) {
 			/* We should have a request. */
 			assert(D->mr_head != NULL);
 
@@ -261,8 +517,10 @@ poke_mr(struct dispatch_state * D)
 			D->mr_head = RQ->next;
 			D->mr_qlen -= 1;
 
-			/* Insert into the array. */
+			/* Insert into the arrays. */
 			reqs[i] = RQ->R;
+			WQs[i] = RQ->C->writeq;
+			MB->conns[i] = RQ->C;
 
 			/* Free linked list node. */
 			mpool_requestq_free(RQ);
@@ -272,9 +530,9 @@ poke_mr(struct dispatch_state * D)
 		D->mr_inprogress = 1;
 
 		/* Launch the batch of modifying requests. */
-		if (dispatch_mr_launch(D->T, reqs, D->mr_reqs, D->writeq,
-		    callback_mr_done, D))
-			goto err1;
+		if (dispatch_mr_launch(D->T, reqs, WQs, MB->nreqs,
+		    callback_mr_done, MB))
+			goto err4;
 
 		/* We beat the clock.  Disable it. */
 		if (D->mr_timer != NULL) {
@@ -315,14 +573,27 @@ poke_mr(struct dispatch_state * D)
 	/* Success! */
 	return (0);
 
-err1:
+err4:
 	/* These requests can never be done, but at least we can free them. */
-	for (i = 0; i < D->mr_reqs; i++)
+	for (i = 0; i < MB->nreqs; i++)
 		proto_kvlds_request_free(reqs[i]);
+	free(MB->conns);
+	free(WQs);
 	free(reqs);
+	free(MB);
 err0:
 	/* Failure! */
 	return (-1);
+
+err3:
+	free(WQs);
+err2:
+	free(reqs);
+err1:
+	free(MB);
+
+	/* Failure! */
+	return (-1);
 }
 
 /* The MR timer has expired. */
@@ -370,7 +641,11 @@ callback_mrc_timer(void * cookie)
 static int
 callback_mr_done(void * cookie)
 {
-	struct dispatch_state * D = cookie;
+	struct mr_batch * MB = cookie;
+	struct dispatch_state * D = MB->D;
+	struct dispatch_conn * C;
+	struct timeval tv;
+	size_t i;
 
 #ifdef SANITY_CHECKS
 	/* Sanity check the B+Tree. */
@@ -378,15 +653,37 @@ callback_mr_done(void * cookie)
 #endif
 
 	/* We've handled a bunch of requests. */
-	D->nrequests -= D->mr_reqs;
+	for (i = 0; i < MB->nreqs; i++)
+		MB->conns[i]->nrequests -= 1;
+
+	/*
+	 * Check if we need to read more requests, and whether any of the
+	 * connections are now dead.
+	 */
+	for (i = 0; i < MB->nreqs; i++) {
+		C = MB->conns[i];
+		if (readreqs(C) || checkdead(C))
+			goto err0;
+	}
+
+	/* Adjust the group commit parameters based on this batch. */
+	if (D->mr_gc != NULL) {
+		if (monoclock_get(&tv)) {
+			warnp("monoclock_get");
+			goto err0;
+		}
+		if (groupcommit_batch(D->mr_gc, timeval_diff(MB->tv_launch, tv),
+		    &D->mr_timeout, &D->mr_min_batch))
+			goto err0;
+	}
+
+	/* We don't need the list of connections any more. */
+	free(MB->conns);
+	free(MB);
 
 	/* No MRs are in progress any more. */
 	D->mr_inprogress = 0;
 
-	/* Check if we need to read more requests. */
-	if (readreqs(D))
-		goto err0;
-
 	/* Maybe we can launch some more MRs? */
 	return (poke_mr(D));
 
@@ -397,28 +694,28 @@ err0:
 
 /* Start reading a request if it is appropriate to do so. */
 static int
-readreqs(struct dispatch_state * D)
+readreqs(struct dispatch_conn * C)
 {
 
 	/* If this connection is dying, do nothing. */
-	if (D->dying)
+	if (C->dying)
 		goto done;
 
 	/* If we don't have a reader, don't try to read. */
-	if (D->readq == NULL)
+	if (C->readq == NULL)
 		goto done;
 
 	/* If we are already reading, do nothing. */
-	if (D->read_cookie != NULL)
+	if (C->read_cookie != NULL)
 		goto done;
 
 	/* If we have MAXREQS requests in progress, do nothing. */
-	if (D->nrequests == MAXREQS)
+	if (C->nrequests == MAXREQS)
 		goto done;
 
 	/* Wait for a request to arrive. */
-	if ((D->read_cookie = wire_readpacket_wait(D->readq,
-	    gotrequest, D)) == NULL) {
+	if ((C->read_cookie = wire_readpacket_wait(C->readq,
+	    gotrequest, C)) == NULL) {
 		warnp("Error reading request from connection");
 		goto err0;
 	}
@@ -436,12 +733,13 @@ err0:
 static int
 gotrequest(void * cookie, int status)
 {
-	struct dispatch_state * D = cookie;
+	struct dispatch_conn * C = cookie;
+	struct dispatch_state * D = C->D;
 	struct proto_kvlds_request * R;
 	struct requestq * RQ;
 
 	/* We're no longer waiting for a packet to arrive. */
-	D->read_cookie = NULL;
+	C->read_cookie = NULL;
 
 	/* If the wait failed, the connection is dead. */
 	if (status)
@@ -457,11 +755,11 @@ gotrequest(void * cookie, int status)
 			goto err0;
 
 		/* If we have MAXREQS requests, stop looping. */
-		if (D->nrequests == MAXREQS)
+		if (C->nrequests == MAXREQS)
 			break;
 
 		/* Attempt to read a request. */
-		if (proto_kvlds_request_read(D->readq, R))
+		if (proto_kvlds_request_read(C->readq, R))
 			goto drop1;
 
 		/* If we have no request, stop looping. */
@@ -469,19 +767,20 @@ gotrequest(void * cookie, int status)
 			break;
 
 		/* We owe a response to the client. */
-		D->nrequests += 1;
+		C->nrequests += 1;
 
 		/* Construct a linked list node. */
 		if ((RQ = mpool_requestq_malloc()) == NULL)
 			goto err1;
 		RQ->R = R;
 		RQ->next = NULL;
+		RQ->C = C;
 
 		/* Add to the modifying or non-modifying queue, and poke it. */
 		switch (R->type) {
 		case PROTO_KVLDS_PARAMS:
 			/* Send the response immediately. */
-			if (proto_kvlds_response_params(D->writeq, RQ->R->ID,
+			if (proto_kvlds_response_params(C->writeq, RQ->R->ID,
 			    (uint32_t)D->kmax, (uint32_t)D->vmax))
 				goto err2;
 
@@ -492,7 +791,7 @@ gotrequest(void * cookie, int status)
 			proto_kvlds_request_free(R);
 
 			/* This request has been handled. */
-			D->nrequests -= 1;
+			C->nrequests -= 1;
 			break;
 		case PROTO_KVLDS_CAS:
 		case PROTO_KVLDS_SET:
@@ -519,6 +818,8 @@ gotrequest(void * cookie, int status)
 
 			/* The MR queue has gained an element. */
 			D->mr_qlen += 1;
+			if (D->mr_gc != NULL)
+				groupcommit_arrival(D->mr_gc);
 
 			/* Poke the queue. */
 			if (poke_mr(D))
@@ -549,7 +850,7 @@ gotrequest(void * cookie, int status)
 	proto_kvlds_request_free(R);
 
 	/* Wait for more requests to arrive. */
-	if (readreqs(D))
+	if (readreqs(C))
 		goto err0;
 
 	/* Success! */
@@ -557,12 +858,13 @@ gotrequest(void * cookie, int status)
 
 drop2:
 	mpool_requestq_free(RQ);
-	D->nrequests -= 1;
+	C->nrequests -= 1;
 drop1:
 	proto_kvlds_request_free(R);
 drop:
 	/* We didn't get a valid request.  Drop the connection. */
-	dropconnection(D);
+	if (dropconnection(C))
+		goto err0;
 
 	/* All is good. */
 	return (0);
@@ -570,7 +872,7 @@ drop:
 err2:
 	mpool_requestq_free(RQ);
 err1:
-	D->nrequests -= 1;
+	C->nrequests -= 1;
 	proto_kvlds_request_free(R);
 err0:
 	/* Failure! */
@@ -578,16 +880,19 @@ err0:
 }
 
 /**
- * dispatch_accept(s, T, kmax, vmax, w, g):
- * Accept a connection from the listening socket ${s} and return a dispatch
- * state for the B+Tree ${T}.  Keys will be at most ${kmax} bytes; values
- * will be at most ${vmax} bytes; up to ${w} seconds should be spent waiting
- * for more requests before performing a group commit, unless ${g} requests
- * are pending.
+ * dispatch_init(s, T, kmax, vmax, w, g, L, maxconns, once):
+ * Accept connections from the listening socket ${s}, up to ${maxconns} at
+ * once (or only a single connection if ${once} is non-zero), and return a
+ * dispatch state for the B+Tree ${T}.  Keys will be at most ${kmax} bytes;
+ * values will be at most ${vmax} bytes; up to ${w} seconds should be spent
+ * waiting for more requests before performing a group commit, unless ${g}
+ * requests are pending.  If ${L} is non-zero, adjust those parameters over
+ * time to keep the 99th percentile latency of modifying requests below ${L}
+ * seconds.
  */
 struct dispatch_state *
-dispatch_accept(int s, struct btree * T,
-    size_t kmax, size_t vmax, double w, size_t g)
+dispatch_init(int s, struct btree * T, size_t kmax, size_t vmax, double w,
+    size_t g, double L, size_t maxconns, int once)
 {
 	struct dispatch_state * D;
 
@@ -596,18 +901,20 @@ dispatch_accept(int s, struct btree * T,
 		goto err0;
 
 	/* Initialize dispatcher. */
-	D->dying = 0;
-	D->readq = NULL;
-	D->read_cookie = NULL;
+	D->s = s;
+	D->accept_cookie = NULL;
+	D->accept_done = 0;
+	D->once = once;
+	D->conns = NULL;
+	D->nconns = 0;
+	D->maxconns = maxconns;
 	D->T = T;
 	D->kmax = kmax;
 	D->vmax = vmax;
-	D->nrequests = 0;
 	D->nmr_head = NULL;
 	D->nmr_ip = 0;
 	D->nmr_concurrency = T->poolsz / 4;
 	D->mr_head = NULL;
-	D->mr_reqs = 0;
 	D->mr_concurrency = T->poolsz / 4;
 	D->mr_inprogress = 0;
 	D->mr_qlen = 0;
@@ -618,6 +925,14 @@ dispatch_accept(int s, struct btree * T,
 	    * 1000000);
 	D->mr_min_batch = g;
 
+	/* Prepare to adjust the group commit parameters if requested. */
+	if (L != 0.0) {
+		if ((D->mr_gc = groupcommit_init(L)) == NULL)
+			goto err1;
+	} else {
+		D->mr_gc = NULL;
+	}
+
 	/**
 	 * Adjust maximum # of pages touched by MRs (if necessary).  In
 	 * addition to the limit of T->poolsz / 4 (as calculated above), we
@@ -641,85 +956,39 @@ dispatch_accept(int s, struct btree * T,
 	if ((D->mrc_timer = events_timer_register(callback_mrc_timer, D,
 	    &fivesec)) == NULL) {
 		warnp("events_timer_register");
-		goto err1;
-	}
-
-	/* Accept a connection. */
-	if (network_accept(s, callback_accept, D) == NULL)
-		goto err2;
-
-	/* Success! */
-	return (D);
-
-err2:
-	events_timer_cancel(D->mrc_timer);
-err1:
-	free(D);
-err0:
-	/* Failure! */
-	return (NULL);
-}
-
-/* A connection has arrived. */
-static int
-callback_accept(void * cookie, int s)
-{
-	struct dispatch_state * D = cookie;
-
-	/* We have a socket. */
-	if ((D->s = s) == -1) {
-		warnp("Error accepting connection");
-		goto err0;
-	}
-
-	/* Make the accepted connection non-blocking. */
-	if (fcntl(D->s, F_SETFL, O_NONBLOCK) == -1) {
-		warnp("Cannot make connection non-blocking");
-		goto err1;
-	}
-
-	/* Create a buffered writer for the connection. */
-	if ((D->writeq = netbuf_write_init(D->s, dropconnection, D)) == NULL) {
-		warnp("Cannot create packet write queue");
-		goto err1;
-	}
-
-	/* Create a buffered reader for the connection. */
-	if ((D->readq = netbuf_read_init(D->s)) == NULL) {
-		warn0("Cannot create packet read queue");
 		goto err2;
 	}
 
-	/* Start listening for packets. */
-	if (readreqs(D))
+	/* Start accepting connections. */
+	if (accept_start(D))
 		goto err3;
 
 	/* Success! */
-	return (0);
+	return (D);
 
 err3:
-	netbuf_read_free(D->readq);
+	events_timer_cancel(D->mrc_timer);
 err2:
-	netbuf_write_free(D->writeq);
+	groupcommit_free(D->mr_gc);
 err1:
-	if (close(D->s))
-		warnp("close");
+	free(D);
 err0:
 	/* Failure! */
-	return (-1);
+	return (NULL);
 }
 
 /**
  * dispatch_alive(D):
  * Return non-zero iff the dispatch state ${D} is still alive (if it is
- * waiting for a connection to arrive, is reading requests, or has requests
- * in progress).
+ * waiting for a connection to arrive, has connections which have not yet
+ * been cleaned up, or has modifying requests in progress).
  */
 int
 dispatch_alive(struct dispatch_state * D)
 {
 
-	return ((D->dying == 0) || (D->nrequests > 0));
+	return ((D->accept_cookie != NULL) || (D->nconns > 0) ||
+	    (D->mr_inprogress != 0));
 }
 
 /**
@@ -727,46 +996,28 @@ dispatch_alive(struct dispatch_state * D)
  * Clean up the dispatch state ${D}.  The function dispatch_alive(${D}) must
  * have previously returned zero.
  */
-int
+void
 dispatch_done(struct dispatch_state * D)
 {
 
 	/*
-	 * There should not be a MR timer running, because there should be
-	 * no requests in progress.  We should not be reading a request, and
-	 * the connection should be dying.
+	 * We should not be accepting connections or have any connections
+	 * left; so there should not be a MR timer running, because there
+	 * are no requests in progress.
 	 */
+	assert(D->accept_cookie == NULL);
+	assert(D->conns == NULL);
+	assert(D->nconns == 0);
 	assert(D->mr_timer == NULL);
-	assert(D->nrequests == 0);
-	assert(D->read_cookie == NULL);
-	assert(D->dying == 1);
+	assert(D->mr_inprogress == 0);
 
 	/* Stop the cleaning timer. */
-	events_timer_cancel(D->mrc_timer);
-
-	/* Free the buffered reader. */
-	netbuf_read_free(D->readq);
-
-	/* Free the buffered writer. */
-	netbuf_write_free(D->writeq);
+	if (D->mrc_timer != NULL)
+		events_timer_cancel(D->mrc_timer);
 
-	/* Close the socket. */
-	while (close(D->s)) {
-		if (errno == EINTR)
-			continue;
-		warnp("close");
-		goto err1;
-	}
+	/* Free the group commit parameter state. */
+	groupcommit_free(D->mr_gc);
 
 	/* Free the dispatcher state. */
 	free(D);
-
-	/* Success! */
-	return (0);
-
-err1:
-	free(D);
-
-	/* Failure! */
-	return (-1);
 }
@@ -10,21 +10,24 @@ struct netbuf_write;
 struct proto_kvlds_request;
 
 /**
- * dispatch_accept(s, T, kmax, vmax, w, g):
- * Accept a connection from the listening socket ${s} and return a dispatch
- * state for the B+Tree ${T}.  Keys will be at most ${kmax} bytes; values
- * will be at most ${vmax} bytes; up to ${w} seconds should be spent waiting
- * for more requests before performing a group commit, unless ${g} requests
- * are pending.
+ * dispatch_init(s, T, kmax, vmax, w, g, L, maxconns, once):
+ * Accept connections from the listening socket ${s}, up to ${maxconns} at
+ * once (or only a single connection if ${once} is non-zero), and return a
+ * dispatch state for the B+Tree ${T}.  Keys will be at most ${kmax} bytes;
+ * values will be at most ${vmax} bytes; up to ${w} seconds should be spent
+ * waiting for more requests before performing a group commit, unless ${g}
+ * requests are pending.  If ${L} is non-zero, adjust those parameters over
+ * time to keep the 99th percentile latency of modifying requests below ${L}
+ * seconds.
  */
-struct dispatch_state * dispatch_accept(int, struct btree *, size_t, size_t,
-    double, size_t);
+struct dispatch_state * dispatch_init(int, struct btree *, size_t, size_t,
+    double, size_t, double, size_t, int);
 
 /**
  * dispatch_alive(D):
  * Return non-zero iff the dispatch state ${D} is still alive (if it is
- * waiting for a connection to arrive, is reading requests, or has requests
- * in progress).
+ * waiting for a connection to arrive, has connections which have not yet
+ * been cleaned up, or has modifying requests in progress).
  */
 int dispatch_alive(struct dispatch_state *);
 
@@ -33,7 +36,7 @@ int dispatch_alive(struct dispatch_state *);
  * Clean up the dispatch state ${D}.  The function dispatch_alive(${D}) must
  * have previously returned zero.
  */
-int dispatch_done(struct dispatch_state *);
+void dispatch_done(struct dispatch_state *);
 
 /**
  * dispatch_nmr_launch(T, R, WQ, callback_done, cookie_done):
@@ -45,13 +48,14 @@ int dispatch_nmr_launch(struct btree *, struct proto_kvlds_request *,
     struct netbuf_write *, int (*)(void *), void *);
 
 /**
- * dispatch_mr_launch(T, reqs, nreqs, WQ, callback_done, cookie):
+ * dispatch_mr_launch(T, reqs, WQs, nreqs, callback_done, cookie):
  * Perform the ${nreqs} modifying requests ${reqs[0]} ... ${reqs[nreqs - 1]}
- * on the B+Tree ${T}; write response packets to the write queue ${WQ}; and
- * free the requests and request array.  Invoke the callback
- * ${callback_done}(${cookie}) after the requests have been serviced.
+ * on the B+Tree ${T}; write the response to each request ${reqs[i]} to the
+ * write queue ${WQs[i]}; and free the requests, request array, and write
+ * queue array.  Invoke the callback ${callback_done}(${cookie}) after the
+ * requests have been serviced.
  */
-int dispatch_mr_launch(struct btree *, struct proto_kvlds_request **, size_t,
-    struct netbuf_write *, int (*)(void *), void *);
+int dispatch_mr_launch(struct btree *, struct proto_kvlds_request **,
+    struct netbuf_write **, size_t, int (*)(void *), void *);
 
 #endif /* !DISPATCH_H_ */
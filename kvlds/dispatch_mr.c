@@ -21,6 +21,7 @@
 /* A single request. */
 struct req_cookie {
 	struct proto_kvlds_request * R;
+	struct netbuf_write * WQ;
 	struct node * leaf;
 	struct batch * batch;
 	int opdone;
@@ -32,7 +33,6 @@ struct batch {
 	void * cookie;
 	size_t nreqs;
 	struct btree * T;
-	struct netbuf_write * WQ;
 	struct req_cookie ** reqs;
 	size_t leavestofind;
 	struct node ** dirties;
@@ -87,15 +87,16 @@ finddirty(struct nodepair * V, size_t N, struct node * shadow)
 }
 
 /**
- * dispatch_mr_launch(T, reqs, nreqs, WQ, callback_done, cookie):
+ * dispatch_mr_launch(T, reqs, WQs, nreqs, callback_done, cookie):
  * Perform the ${nreqs} modifying requests ${reqs[0]} ... ${reqs[nreqs - 1]}
- * on the B+Tree ${T}; write response packets to the write queue ${WQ}; and
- * free the requests and request array.  Invoke the callback
- * ${callback_done}(${cookie}) after the requests have been serviced.
+ * on the B+Tree ${T}; write the response to each request ${reqs[i]} to the
+ * write queue ${WQs[i]}; and free the requests, request array, and write
+ * queue array.  Invoke the callback ${callback_done}(${cookie}) after the
+ * requests have been serviced.
  */
 int
 dispatch_mr_launch(struct btree * T, struct proto_kvlds_request ** reqs,
-    size_t nreqs, struct netbuf_write * WQ,
+    struct netbuf_write ** WQs, size_t nreqs,
     int (* callback_done)(void *), void * cookie)
 {
 	struct batch * B;
@@ -113,7 +114,6 @@ dispatch_mr_launch(struct btree * T, struct proto_kvlds_request ** reqs,
 	B->cookie = cookie;
 	B->nreqs = nreqs;
 	B->T = T;
-	B->WQ = WQ;
 
 	/* Allocate an array of request cookie pointers. */
 	if (IMALLOC(B->reqs, B->nreqs, struct req_cookie *))
@@ -126,6 +126,7 @@ dispatch_mr_launch(struct btree * T, struct proto_kvlds_request ** reqs,
 		if ((B->reqs[i] = mpool_reqcookie_malloc()) == NULL)
 			goto err2;
 		B->reqs[i]->R = reqs[i];
+		B->reqs[i]->WQ = WQs[i];
 		B->reqs[i]->batch = B;
 		B->reqs[i]->opdone = 0;
 	}
@@ -149,7 +150,8 @@ dispatch_mr_launch(struct btree * T, struct proto_kvlds_request ** reqs,
 		}
 	}
 
-	/* Free input request vector. */
+	/* Free input request and write queue vectors. */
+	free(WQs);
 	free(reqs);
 
 	/* Success! */
@@ -500,30 +502,30 @@ callback_synced(void * cookie)
 
 		switch (R->type) {
 		case PROTO_KVLDS_SET:
-			if (proto_kvlds_response_set(B->WQ, R->ID))
+			if (proto_kvlds_response_set(req->WQ, R->ID))
 				goto err0;
 			break;
 		case PROTO_KVLDS_CAS:
-			if (proto_kvlds_response_cas(B->WQ, R->ID,
+			if (proto_kvlds_response_cas(req->WQ, R->ID,
 			    req->opdone ? 0 : 1))
 				goto err0;
 			break;
 		case PROTO_KVLDS_ADD:
-			if (proto_kvlds_response_add(B->WQ, R->ID,
+			if (proto_kvlds_response_add(req->WQ, R->ID,
 			    req->opdone ? 0 : 1))
 				goto err0;
 			break;
 		case PROTO_KVLDS_MODIFY:
-			if (proto_kvlds_response_modify(B->WQ, R->ID,
+			if (proto_kvlds_response_modify(req->WQ, R->ID,
 			    req->opdone ? 0 : 1))
 				goto err0;
 			break;
 		case PROTO_KVLDS_DELETE:
-			if (proto_kvlds_response_delete(B->WQ, R->ID))
+			if (proto_kvlds_response_delete(req->WQ, R->ID))
 				goto err0;
 			break;
 		case PROTO_KVLDS_CAD:
-			if (proto_kvlds_response_cad(B->WQ, R->ID,
+			if (proto_kvlds_response_cad(req->WQ, R->ID,
 			    req->opdone ? 0 : 1))
 				goto err0;
 			break;
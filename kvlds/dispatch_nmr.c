@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "events.h"
 #include "imalloc.h"
@@ -7,15 +8,22 @@
 #include "kvpair.h"
 #include "netbuf.h"
 #include "proto_kvlds.h"
-#include "ptrheap.h"
 
 #include "btree.h"
 #include "btree_find.h"
 #include "btree_node.h"
 #include "node.h"
+#include "serialize.h"
 
 #include "dispatch.h"
 
+/* The in-range key-value pairs from one leaf of a RANGE. */
+struct rangeleaf {
+	struct node * N;	/* Leaf, until it is paged in. */
+	uint8_t * buf;		/* Serialized keys and values. */
+	size_t len;		/* Length of buf. */
+};
+
 /* Non-modifying request state. */
 struct nmr_cookie {
 	/* State provided by caller. */
@@ -26,18 +34,21 @@ struct nmr_cookie {
 	struct netbuf_write * WQ;
 
 	/* Internal state used for RANGE requests. */
-	struct ptrheap * H;
-	struct kvldskey * end;
-	size_t mlen;
-	size_t nkeys;
-	size_t rlen;
-	size_t leavesleft;
+	struct kvldskey * end;		/* End of the range covered. */
+	struct kvldskey * cursor;	/* Key being looked up. */
+	struct rangeleaf * leaves;	/* Leaves, in key order. */
+	size_t nleaves;			/* # leaves in the array. */
+	size_t maxleaves;		/* Size of the array. */
+	size_t pending;			/* # lookups and descents pending. */
 };
 
 static int callback_get_gotleaf(void *, struct node *);
 static int callback_range_gotnode(void *, struct node *, struct kvldskey *);
+static int rangeleaf(struct nmr_cookie *, struct node *);
 static int callback_range_gotleaf(void *, struct node *);
+static int inrange(struct nmr_cookie *, const struct kvldskey *);
 static int rangedone(struct nmr_cookie *);
+static int rangesend(struct nmr_cookie *);
 
 /**
  * dispatch_nmr_launch(T, R, WQ, callback_done, cookie_done):
@@ -74,19 +85,44 @@ dispatch_nmr_launch(struct btree * T, struct proto_kvlds_request * R,
 			goto err1;
 		break;
 	case PROTO_KVLDS_RANGE:
+		/*
+		 * Figure out the maximum number of leaves to process.  This
+		 * can't exceed the number of children a parent can have,
+		 * since that's how many pages the dispatcher allows for.
+		 */
+		C->maxleaves = C->R->range_max / C->T->pagelen;
+		if (C->maxleaves > C->T->pagelen / SERIALIZE_PERCHILD)
+			C->maxleaves = C->T->pagelen / SERIALIZE_PERCHILD;
+		if (C->maxleaves == 0)
+			C->maxleaves = 1;
+
+		/*
+		 * Allocate an array to hold the leaves, so that we can
+		 * process them in key order regardless of the order they
+		 * are paged in.
+		 */
+		if (IMALLOC(C->leaves, C->maxleaves, struct rangeleaf))
+			goto err1;
+		C->nleaves = 0;
+		C->end = NULL;
+		C->cursor = NULL;
+
 		/*
 		 * Find a node of height 1 or less which is responsible for a
 		 * range containing the start key.
 		 */
+		C->pending = 1;
 		if (btree_find_range(C->T, C->T->root_shadow,
 		    C->R->range_start, 1, callback_range_gotnode, C))
-			goto err1;
+			goto err2;
 		break;
 	}
 
 	/* Success! */
 	return (0);
 
+err2:
+	free(C->leaves);
 err1:
 	free(C);
 err0:
@@ -142,60 +178,44 @@ err1:
 	return (-1);
 }
 
-/* We've found a node responsible for this range. */
+/* We've found a node responsible for part of this range. */
 static int
 callback_range_gotnode(void * cookie, struct node * N,
     struct kvldskey * end)
 {
 	struct nmr_cookie * C = cookie;
+	const struct kvldskey * k;
 	size_t start;
-	size_t stop;
 	size_t i;
 
+	/* Figure out which key we were looking for. */
+	k = (C->cursor != NULL) ? C->cursor : C->R->range_start;
+
 	/* Record the end-of-range key. */
+	kvldskey_free(C->end);
 	C->end = end;
 
-	/* Record how far all keys in the range must match. */
-	C->mlen = N->mlen_t;
-
-	/* Create a heap for holding key-value pairs. */
-	if ((C->H = ptrheap_init(kvpair_cmp, NULL, (void *)&C->mlen)) == NULL)
-		goto err1;
-
-	/* We don't have any key-value pairs yet. */
-	C->nkeys = 0;
-	C->rlen = 0;
-
 	/* Leaves and parents get handled differently. */
 	switch (N->height) {
 	case 0:
 		/* Descend into a single leaf. */
-		C->leavesleft = 1;
-		if (btree_node_descend(C->T, N, callback_range_gotleaf, C))
-			goto err2;
+		if (rangeleaf(C, N))
+			goto err0;
 		break;
 	case 1:
-		/* Not descending into any leaves yet. */
-		C->leavesleft = 0;
-
 		/* Figure out which leaf to start with. */
-		start = btree_find_child(N, C->R->range_start);
-
-		/* Figure out the maximum number of leaves to process. */
-		stop = start + C->R->range_max / C->T->pagelen;
-		if (stop == start)
-			stop = start + 1;
+		start = btree_find_child(N, k);
 
-		/* Process leaf nodes. */
-		for (i = start; (i <= N->nkeys) && (i < stop); i++) {
+		/* Process leaf nodes until we have as many as we want. */
+		for (i = start; (i <= N->nkeys) &&
+		    (C->nleaves < C->maxleaves); i++) {
 			/* Do this leaf. */
-			C->leavesleft += 1;
-			if (btree_node_descend(C->T, N->v.children[i],
-			    callback_range_gotleaf, C))
+			if (rangeleaf(C, N->v.children[i]))
 				goto err0;
 
 			/* Stop if we've gone too far. */
-			if ((i < N->nkeys) && (kvldskey_cmp(C->R->range_end,
+			if ((i < N->nkeys) && (C->R->range_end->len > 0) &&
+			    (kvldskey_cmp(C->R->range_end,
 			    N->u.keys[i]) < 0)) {
 				i++;
 				break;
@@ -211,75 +231,125 @@ callback_range_gotnode(void * cookie, struct node * N,
 		break;
 	}
 
+	/* We've finished looking up this key. */
+	kvldskey_free(C->cursor);
+	C->cursor = NULL;
+
+	/*
+	 * If this node's range extends as far as the range we're handling,
+	 * or if we have as many leaves as we want, we're done looking for
+	 * leaves; otherwise, look for the node responsible for the next part
+	 * of the range.  Its leaves will be paged in concurrently with the
+	 * leaves we already have.
+	 */
+	if ((C->end->len > 0) && (C->nleaves < C->maxleaves) &&
+	    ((C->R->range_end->len == 0) ||
+	     (kvldskey_cmp(C->end, C->R->range_end) <= 0))) {
+		if ((C->cursor = kvldskey_dup(C->end)) == NULL)
+			goto err0;
+		C->pending += 1;
+		if (btree_find_range(C->T, C->T->root_shadow, C->cursor, 1,
+		    callback_range_gotnode, C))
+			goto err0;
+	}
+
 	/* Release the lock picked up by btree_find_range. */
 	btree_node_unlock(C->T, N);
 
+	/* This lookup is no longer pending. */
+	C->pending -= 1;
+
+	/* Are we done all the leaves? */
+	if (C->pending == 0) {
+		if (rangedone(C))
+			goto err0;
+	}
+
 	/* Success! */
 	return (0);
 
-err2:
-	ptrheap_free(C->H);
-err1:
-	kvldskey_free(C->end);
-	proto_kvlds_request_free(C->R);
-	free(C);
 err0:
 	/* Failure! */
 	return (-1);
 }
 
-/* Suck key-value pairs from a leaf into the heap. */
+/* Record the leaf ${N} as the next leaf of the range, and page it in. */
+static int
+rangeleaf(struct nmr_cookie * C, struct node * N)
+{
+	struct rangeleaf * L = &C->leaves[C->nleaves++];
+
+	/* We don't have any pairs from this leaf yet. */
+	L->N = N;
+	L->buf = NULL;
+	L->len = 0;
+
+	/* Page in the leaf. */
+	C->pending += 1;
+	if (btree_node_descend(C->T, N, callback_range_gotleaf, C))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* A leaf has been paged in; if it was the last one, send the response. */
 static int
 callback_range_gotleaf(void * cookie, struct node * N)
 {
 	struct nmr_cookie * C = cookie;
-	struct kvpair * kv;
+	const struct kvpair_const * kv;
+	struct rangeleaf * L;
 	size_t i;
+	int pos;
 
-	/* Scan through the key-value pairs (maybe) copying them. */
-	for (i = 0; i < N->nkeys; i++) {
-		/* Is this key too small? */
-		if (kvldskey_cmp(N->u.pairs[i].k, C->R->range_start) < 0)
-			continue;
+	/* Find the leaf record for this node. */
+	for (i = 0; C->leaves[i].N != N; i++)
+		assert(i + 1 < C->nleaves);
+	L = &C->leaves[i];
+	L->N = NULL;
 
-		/* Is this key too large? */
-		if ((C->R->range_end->len > 0) &&
-		    (kvldskey_cmp(N->u.pairs[i].k, C->R->range_end) > 0))
+	/*
+	 * Copy out the pairs which are in the range.  We can't hold onto the
+	 * lock picked up by btree_node_descend until the other leaves arrive,
+	 * since the node might become a shadow node and get freed when the
+	 * next sync completes.
+	 */
+	for (i = 0; i < N->nkeys; i++) {
+		kv = &N->u.pairs[i];
+		if ((pos = inrange(C, kv->k)) < 0)
 			continue;
-
-		/* Does it fit? */
-		C->rlen += kvldskey_serial_size(N->u.pairs[i].k);
-		C->rlen += kvldskey_serial_size(N->u.pairs[i].v);
-		if ((C->nkeys > 0) && (C->R->range_max < C->rlen))
+		if (pos > 0)
 			break;
-
-		/* Add the pair to the heap. */
-		if ((kv = malloc(sizeof(struct kvpair))) == NULL)
-			goto err0;
-		if ((kv->k = kvldskey_dup(N->u.pairs[i].k)) == NULL)
-			goto err1;
-		if ((kv->v = kvldskey_dup(N->u.pairs[i].v)) == NULL)
-			goto err2;
-		if (ptrheap_add(C->H, kv))
-			goto err3;
-		C->nkeys += 1;
+		L->len += kvldskey_serial_size(kv->k) +
+		    kvldskey_serial_size(kv->v);
 	}
-
-	/* If we exited early, adjust the end pointer. */
-	if (i < N->nkeys) {
-		kvldskey_free(C->end);
-		if ((C->end = kvldskey_dup(N->u.pairs[i].k)) == NULL)
-			goto err0;
+	if ((L->len > 0) && ((L->buf = malloc(L->len)) == NULL))
+		goto err1;
+	for (L->len = 0, i = 0; i < N->nkeys; i++) {
+		kv = &N->u.pairs[i];
+		if ((pos = inrange(C, kv->k)) < 0)
+			continue;
+		if (pos > 0)
+			break;
+		kvldskey_serialize(kv->k, &L->buf[L->len]);
+		L->len += kvldskey_serial_size(kv->k);
+		kvldskey_serialize(kv->v, &L->buf[L->len]);
+		L->len += kvldskey_serial_size(kv->v);
 	}
 
 	/* Release the lock picked up by btree_node_descend. */
 	btree_node_unlock(C->T, N);
 
-	/* We've handled a leaf. */
-	C->leavesleft -= 1;
+	/* This leaf is no longer pending. */
+	C->pending -= 1;
 
 	/* Are we done all the leaves? */
-	if (C->leavesleft == 0) {
+	if (C->pending == 0) {
 		if (rangedone(C))
 			goto err0;
 	}
@@ -287,80 +357,48 @@ callback_range_gotleaf(void * cookie, struct node * N)
 	/* Success! */
 	return (0);
 
-err3:
-	kvldskey_free(kv->v);
-err2:
-	kvldskey_free(kv->k);
 err1:
-	free(kv);
+	btree_node_unlock(C->T, N);
 err0:
 	/* Failure! */
 	return (-1);
 }
 
-/* Send the RANGE response and clean up. */
+/*
+ * Return -1, 0, or 1 if the key ${K} is before, within, or after the range
+ * requested by the RANGE request in the cookie ${C}.
+ */
 static int
-rangedone(struct nmr_cookie * C)
+inrange(struct nmr_cookie * C, const struct kvldskey * K)
 {
-	const struct kvldskey * next;
-	struct kvldskey ** keys;
-	struct kvldskey ** values;
-	struct kvpair * kv;
-	size_t i;
 
-	/*
-	 * If we've handled a range which goes beyond the ending key we were
-	 * provided with, we want to return the ending key as the next key.
-	 */
-	if (C->end->len == 0)
-		next = C->R->range_end;
-	else if (C->R->range_end->len == 0)
-		next = C->end;
-	else if (kvldskey_cmp(C->end, C->R->range_end) < 0)
-		next = C->end;
-	else
-		next = C->R->range_end;
-
-	/* Allocate arrays for holding keys and values. */
-	if (IMALLOC(keys, C->nkeys, struct kvldskey *))
-		goto err2;
-	if (IMALLOC(values, C->nkeys, struct kvldskey *))
-		goto err3;
+	/* Is this key too small? */
+	if (kvldskey_cmp(K, C->R->range_start) < 0)
+		return (-1);
 
-	/* Pull key-value pairs out of the heap. */
-	for (i = 0; i < C->nkeys; i++) {
-		/* Get a key-value pair. */
-		kv = ptrheap_getmin(C->H);
-		assert(kv != NULL);
-
-		/* Remove it from the heap. */
-		ptrheap_deletemin(C->H);
-
-		/* Stuff the key and value into the respective arrays. */
-		keys[i] = kv->k;
-		values[i] = kv->v;
-
-		/* Free the key-value pair structure. */
-		free(kv);
-	}
+	/* Is this key too large? */
+	if ((C->R->range_end->len > 0) &&
+	    (kvldskey_cmp(K, C->R->range_end) > 0))
+		return (1);
 
-	/* Send the RANGE response. */
-	if (proto_kvlds_response_range(C->WQ, C->R->ID, C->nkeys, next,
-	    keys, values))
-		goto err4;
+	/* The key is in the range. */
+	return (0);
+}
 
-	/* Free the values. */
-	for (i = 0; i < C->nkeys; i++)
-		kvldskey_free(values[i]);
-	free(values);
+/* Send the RANGE response and clean up. */
+static int
+rangedone(struct nmr_cookie * C)
+{
+	size_t i;
 
-	/* Free the keys. */
-	for (i = 0; i < C->nkeys; i++)
-		kvldskey_free(keys[i]);
-	free(keys);
+	/* Send the response. */
+	if (rangesend(C))
+		goto err1;
 
-	/* Free the heap. */
-	ptrheap_free(C->H);
+	/* Free the pairs copied out of the leaves. */
+	for (i = 0; i < C->nleaves; i++)
+		free(C->leaves[i].buf);
+	free(C->leaves);
 
 	/* Free the end-of-range value provided by btree_find_range. */
 	kvldskey_free(C->end);
@@ -370,7 +408,7 @@ rangedone(struct nmr_cookie * C)
 
 	/* Schedule the completion callback. */
 	if (!events_immediate_register(C->callback_done, C->cookie_done, 0))
-		goto err1;
+		goto err0;
 
 	/* Free the cookie. */
 	free(C);
@@ -378,21 +416,102 @@ rangedone(struct nmr_cookie * C)
 	/* Success! */
 	return (0);
 
-err4:
-	for (i = 0; i < C->nkeys; i++)
-		kvldskey_free(values[i]);
-	for (i = 0; i < C->nkeys; i++)
-		kvldskey_free(keys[i]);
-	free(values);
-err3:
-	free(keys);
-err2:
-	ptrheap_free(C->H);
+err1:
+	for (i = 0; i < C->nleaves; i++)
+		free(C->leaves[i].buf);
+	free(C->leaves);
 	kvldskey_free(C->end);
 	proto_kvlds_request_free(C->R);
-err1:
+err0:
 	free(C);
 
 	/* Failure! */
 	return (-1);
 }
+
+/*
+ * Write a RANGE response holding the key-value pairs copied out of the
+ * leaves, in order, directly into the write queue.
+ */
+static int
+rangesend(struct nmr_cookie * C)
+{
+	const struct kvldskey * next;
+	const struct kvldskey * k;
+	const struct kvldskey * v;
+	struct rangeleaf * L;
+	uint8_t * kvbuf;
+	size_t nkeys, kvlen, pairlen;
+	size_t i, j;
+	size_t bufpos;
+
+	/*
+	 * Figure out how many of the key-value pairs in the range fit into
+	 * the response.  We always return at least one pair (if there are
+	 * any); if we stop early, the next request will start at the first
+	 * key we didn't return.
+	 */
+	nkeys = kvlen = 0;
+	for (i = 0; i < C->nleaves; i++) {
+		L = &C->leaves[i];
+		for (j = 0; j < L->len; j += pairlen) {
+			k = (const struct kvldskey *)&L->buf[j];
+			v = (const struct kvldskey *)
+			    &L->buf[j + kvldskey_serial_size(k)];
+			pairlen = kvldskey_serial_size(k) +
+			    kvldskey_serial_size(v);
+
+			/* Does it fit? */
+			if ((nkeys > 0) &&
+			    (C->R->range_max < kvlen + pairlen)) {
+				kvldskey_free(C->end);
+				if ((C->end = kvldskey_dup(k)) == NULL)
+					goto err0;
+				goto scanned;
+			}
+
+			/* This pair will be in the response. */
+			nkeys += 1;
+			kvlen += pairlen;
+		}
+	}
+scanned:
+
+	/*
+	 * If we've handled a range which goes beyond the ending key we were
+	 * provided with, we want to return the ending key as the next key.
+	 */
+	if (C->end->len == 0)
+		next = C->R->range_end;
+	else if (C->R->range_end->len == 0)
+		next = C->end;
+	else if (kvldskey_cmp(C->end, C->R->range_end) < 0)
+		next = C->end;
+	else
+		next = C->R->range_end;
+
+	/* Start writing the response. */
+	if ((kvbuf = proto_kvlds_response_range_getbuf(C->WQ, C->R->ID,
+	    nkeys, next, kvlen)) == NULL)
+		goto err0;
+
+	/* The pairs we're sending are a prefix of the leaves' pairs. */
+	for (bufpos = i = 0; (i < C->nleaves) && (bufpos < kvlen); i++) {
+		L = &C->leaves[i];
+		j = (L->len < kvlen - bufpos) ? L->len : kvlen - bufpos;
+		memcpy(&kvbuf[bufpos], L->buf, j);
+		bufpos += j;
+	}
+	assert(bufpos == kvlen);
+
+	/* Finish the response. */
+	if (proto_kvlds_response_range_done(C->WQ, kvbuf, next, kvlen))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
@@ -0,0 +1,168 @@
+#include <sys/time.h>
+
+#include <stdlib.h>
+
+#include "monoclock.h"
+#include "onlinequantile.h"
+#include "warnp.h"
+
+#include "groupcommit.h"
+
+/* Adjust the group commit parameters at most once per this many seconds. */
+#define INTERVAL	1.0
+
+/* Maximum commit delay and forced commit size (as for -w and -g). */
+#define MAXDELAY	1.0
+#define MAXBATCH	1024
+
+/* Group commit parameter state. */
+struct groupcommit {
+	double L;			/* Target p99 latency. */
+	struct timeval tv_start;	/* Start of the current interval. */
+	size_t narrivals;		/* # requests arrived in interval. */
+	struct onlinequantile * p99;	/* Batch latencies in interval. */
+};
+
+/**
+ * groupcommit_init(L):
+ * Prepare to choose group commit parameters which keep the 99th percentile
+ * latency of modifying requests below ${L} seconds.
+ */
+struct groupcommit *
+groupcommit_init(double L)
+{
+	struct groupcommit * G;
+
+	/* Allocate structure. */
+	if ((G = malloc(sizeof(struct groupcommit))) == NULL)
+		goto err0;
+	G->L = L;
+	G->narrivals = 0;
+
+	/* Start the first interval. */
+	if (monoclock_get(&G->tv_start)) {
+		warnp("monoclock_get");
+		goto err1;
+	}
+	if ((G->p99 = onlinequantile_init(0.99)) == NULL)
+		goto err1;
+
+	/* Success! */
+	return (G);
+
+err1:
+	free(G);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * groupcommit_arrival(G):
+ * Record in ${G} that a modifying request has arrived.
+ */
+void
+groupcommit_arrival(struct groupcommit * G)
+{
+
+	/* Count the request. */
+	G->narrivals += 1;
+}
+
+/**
+ * groupcommit_batch(G, t, w, g):
+ * Record in ${G} that a batch of modifying requests took ${t} seconds from
+ * being launched until its responses were sent.  If it is time to adjust the
+ * group commit parameters, set the commit delay ${w} and the minimum forced
+ * commit size ${g} based on the batch latencies and request arrival rate
+ * observed since they were last adjusted.
+ */
+int
+groupcommit_batch(struct groupcommit * G, double t, struct timeval * w,
+    size_t * g)
+{
+	struct onlinequantile * p99;
+	struct timeval tv;
+	double elapsed;
+	double S, rate, delay;
+	size_t batch;
+
+	/* Record the batch latency. */
+	if (onlinequantile_add(G->p99, t))
+		goto err0;
+
+	/* Wait until the interval is over. */
+	if (monoclock_get(&tv)) {
+		warnp("monoclock_get");
+		goto err0;
+	}
+	if ((elapsed = timeval_diff(G->tv_start, tv)) < INTERVAL)
+		goto done;
+
+	/* Get the p99 batch latency (we have data) and the arrival rate. */
+	(void)onlinequantile_get(G->p99, &S);
+	rate = (double)G->narrivals / elapsed;
+
+	/*
+	 * A request may wait for the commit delay, then for a batch which
+	 * was already in progress, and then for its own batch; so whatever
+	 * is left of the latency target after two batches can be spent
+	 * waiting for more requests to arrive.
+	 */
+	delay = G->L - 2.0 * S;
+	if (delay > MAXDELAY)
+		delay = MAXDELAY;
+
+	/*
+	 * Waiting only increases the number of requests per commit if more
+	 * requests are likely to arrive in the meantime; otherwise it merely
+	 * adds latency.  If we have as many requests as we expect to arrive
+	 * during the delay, there's no point waiting any longer.
+	 */
+	if ((delay <= 0.0) || (rate * delay < 1.0)) {
+		delay = 0.0;
+		batch = 1;
+	} else if (rate * delay >= MAXBATCH) {
+		batch = MAXBATCH;
+	} else {
+		batch = (size_t)(rate * delay);
+	}
+
+	/* Set the new parameters. */
+	w->tv_sec = (time_t)delay;
+	w->tv_usec = (suseconds_t)((delay - (double)w->tv_sec) * 1000000);
+	*g = batch;
+
+	/* Start a new interval. */
+	if ((p99 = onlinequantile_init(0.99)) == NULL)
+		goto err0;
+	onlinequantile_free(G->p99);
+	G->p99 = p99;
+	G->tv_start = tv;
+	G->narrivals = 0;
+
+done:
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * groupcommit_free(G):
+ * Free the group commit parameter state ${G}.
+ */
+void
+groupcommit_free(struct groupcommit * G)
+{
+
+	/* Behave consistently with free(NULL). */
+	if (G == NULL)
+		return;
+
+	/* Free the quantile structure and our state. */
+	onlinequantile_free(G->p99);
+	free(G);
+}
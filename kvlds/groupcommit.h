@@ -0,0 +1,40 @@
+#ifndef GROUPCOMMIT_H_
+#define GROUPCOMMIT_H_
+
+#include <stddef.h>
+
+/* Opaque types. */
+struct groupcommit;
+struct timeval;
+
+/**
+ * groupcommit_init(L):
+ * Prepare to choose group commit parameters which keep the 99th percentile
+ * latency of modifying requests below ${L} seconds.
+ */
+struct groupcommit * groupcommit_init(double);
+
+/**
+ * groupcommit_arrival(G):
+ * Record in ${G} that a modifying request has arrived.
+ */
+void groupcommit_arrival(struct groupcommit *);
+
+/**
+ * groupcommit_batch(G, t, w, g):
+ * Record in ${G} that a batch of modifying requests took ${t} seconds from
+ * being launched until its responses were sent.  If it is time to adjust the
+ * group commit parameters, set the commit delay ${w} and the minimum forced
+ * commit size ${g} based on the batch latencies and request arrival rate
+ * observed since they were last adjusted.
+ */
+int groupcommit_batch(struct groupcommit *, double, struct timeval *,
+    size_t *);
+
+/**
+ * groupcommit_free(G):
+ * Free the group commit parameter state ${G}.
+ */
+void groupcommit_free(struct groupcommit *);
+
+#endif /* !GROUPCOMMIT_H_ */
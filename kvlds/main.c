@@ -17,6 +17,7 @@
 
 #include "btree.h"
 #include "dispatch.h"
+#include "serializer.h"
 
 static void
 usage(void)
@@ -24,10 +25,12 @@ usage(void)
 
 	fprintf(stderr, "usage: kivaloo-kvlds "
 	    "-s <kvlds socket> -l <lbs socket> "
-	    "[-C <npages> | -c <pagemem>] [-1] "
+	    "[-C <npages> | -c <pagemem>] [-1] [-n <max # connections>] [-Q] "
 	    "[-k <max key length>] [-v <max value length>] [-p <pidfile>] "
 	    "[-S <cost of storage per GB-month>] "
-	    "[-w <commit delay time>] [-g <min forced commit size>]\n");
+	    "[-T <# of serialization threads>] "
+	    "[-w <commit delay time>] [-g <min forced commit size>] "
+	    "[-L <p99 latency target>] [-z] [-G]\n");
 	fprintf(stderr, "       kivaloo-kvlds --version\n");
 	exit(1);
 }
@@ -54,15 +57,21 @@ main(int argc, char * argv[])
 
 	/* Command-line parameters. */
 	uint64_t opt_C = (uint64_t)(-1);
+	int opt_G = 0;
 	uint64_t opt_c = (uint64_t)(-1);
 	uint64_t opt_g = (uint64_t)(-1);
 	uint64_t opt_k = (uint64_t)(-1);
+	double opt_L = 0.0;
 	char * opt_l = NULL;
+	size_t opt_n = 0;
 	char * opt_p = NULL;
+	int opt_Q = 0;
 	double opt_S = 1.0;
 	char * opt_s = NULL;
+	size_t opt_T = 0;
 	uint64_t opt_v = (uint64_t)(-1);
 	double opt_w = 0.0;
+	int opt_z = 0;
 	int opt_1 = 0;
 
 	/* Working variables. */
@@ -87,6 +96,11 @@ main(int argc, char * argv[])
 			if (humansize_parse(optarg, &opt_c))
 				OPT_EINVAL(ch, optarg);
 			break;
+		GETOPT_OPT("-G"):
+			if (opt_G != 0)
+				usage();
+			opt_G = 1;
+			break;
 		GETOPT_OPTARG("-g"):
 			if (opt_g != (uint64_t)(-1))
 				usage();
@@ -99,18 +113,35 @@ main(int argc, char * argv[])
 			if (humansize_parse(optarg, &opt_k))
 				OPT_EINVAL(ch, optarg);
 			break;
+		GETOPT_OPTARG("-L"):
+			if (opt_L != 0.0)
+				usage();
+			if (PARSENUM(&opt_L, optarg, 0, INFINITY))
+				OPT_EPARSE(ch, optarg);
+			break;
 		GETOPT_OPTARG("-l"):
 			if (opt_l != NULL)
 				usage();
 			if ((opt_l = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPTARG("-n"):
+			if (opt_n != 0)
+				usage();
+			if (PARSENUM(&opt_n, optarg, 0, 65535))
+				OPT_EPARSE(ch, optarg);
+			break;
 		GETOPT_OPTARG("-p"):
 			if (opt_p != NULL)
 				usage();
 			if ((opt_p = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPT("-Q"):
+			if (opt_Q != 0)
+				usage();
+			opt_Q = 1;
+			break;
 		GETOPT_OPTARG("-S"):
 			if (opt_S != 1.0)
 				usage();
@@ -123,6 +154,12 @@ main(int argc, char * argv[])
 			if ((opt_s = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPTARG("-T"):
+			if (opt_T != 0)
+				usage();
+			if (PARSENUM(&opt_T, optarg, 1, 64))
+				OPT_EPARSE(ch, optarg);
+			break;
 		GETOPT_OPTARG("-v"):
 			if (opt_v != (uint64_t)(-1))
 				usage();
@@ -135,6 +172,11 @@ main(int argc, char * argv[])
 			if (PARSENUM(&opt_w, optarg, 0, INFINITY))
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPT("-z"):
+			if (opt_z != 0)
+				usage();
+			opt_z = 1;
+			break;
 		GETOPT_OPT("--version"):
 			fprintf(stderr, "kivaloo-kvlds @VERSION@\n");
 			exit(0);
@@ -198,6 +240,12 @@ main(int argc, char * argv[])
 		    "-g %" PRIu64, opt_g);
 		exit(1);
 	}
+	if ((opt_L < 0.0) || (opt_L > 60.0)) {
+		warn0("Latency target in [0.0, 60.0]: -L %f", opt_L);
+		exit(1);
+	}
+	if ((opt_L != 0.0) && ((opt_w != 0.0) || (opt_g != (uint64_t)(-1))))
+		usage();
 
 	/* Resolve listening address. */
 	if ((sas_s = sock_resolve(opt_s)) == NULL) {
@@ -237,8 +285,8 @@ main(int argc, char * argv[])
 	}
 
 	/* Initialize the B+Tree. */
-	if ((T =
-	    btree_init(Q_lbs, opt_C, opt_c, &opt_k, &opt_v, opt_S)) == NULL) {
+	if ((T = btree_init(Q_lbs, opt_C, opt_c, &opt_k, &opt_v, opt_S,
+	    opt_Q, opt_z, opt_G)) == NULL) {
 		warnp("Cannot initialize B+Tree");
 		exit(1);
 	}
@@ -255,26 +303,31 @@ main(int argc, char * argv[])
 		exit(1);
 	}
 
-	/* Handle connections, one at a time. */
-	do {
-		/* Accept a connection. */
-		if ((dstate = dispatch_accept(s, T,
-		    (size_t)opt_k, (size_t)opt_v, opt_w, (size_t)opt_g))
-		    == NULL)
-			exit(1);
+	/*
+	 * Start threads for serializing pages.  This must happen after we
+	 * daemonize, since threads do not survive fork().
+	 */
+	if ((opt_T > 0) && ((T->S = serializer_init(T, opt_T)) == NULL)) {
+		warnp("Cannot start serialization threads");
+		exit(1);
+	}
 
-		/* Loop until the connection is dead. */
-		do {
-			if (events_run()) {
-				warnp("Error running event loop");
-				exit(1);
-			}
-		} while (dispatch_alive(dstate));
+	/* Start accepting connections. */
+	if ((dstate = dispatch_init(s, T, (size_t)opt_k, (size_t)opt_v,
+	    opt_w, (size_t)opt_g, opt_L, opt_n ? opt_n : SIZE_MAX,
+	    opt_1)) == NULL)
+		exit(1);
 
-		/* Close and free the connection. */
-		if (dispatch_done(dstate))
+	/* Loop until the dispatcher is finished. */
+	do {
+		if (events_run()) {
+			warnp("Error running event loop");
 			exit(1);
-	} while (opt_1 == 0);
+		}
+	} while (dispatch_alive(dstate));
+
+	/* Clean up the dispatcher. */
+	dispatch_done(dstate);
 
 	/* Free the B+Tree. */
 	btree_free(T);
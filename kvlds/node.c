@@ -1,7 +1,12 @@
+#include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "imalloc.h"
+#include "kvldskey.h"
+#include "kvpair.h"
+
 #include "node.h"
 
 /**
@@ -30,6 +35,7 @@ node_alloc(uint64_t pagenum, uint64_t oldestleaf, uint32_t pagesize)
 	N->height = -1;
 	N->nkeys = (size_t)(-1);
 	N->pagebuf = NULL;
+	N->pfx = NULL;
 
 	/* Success! */
 	return (N);
@@ -39,6 +45,43 @@ err0:
 	return (NULL);
 }
 
+/**
+ * node_mkpfx(N):
+ * Build the search accelerator ${N}->pfx for the node ${N}, which must
+ * have type NODE_TYPE_LEAF or NODE_TYPE_PARENT and must not have one
+ * already.  Return -1 if memory cannot be allocated; searches will work
+ * without the accelerator, but more slowly.
+ */
+int
+node_mkpfx(struct node * N)
+{
+	size_t i;
+
+	/* Sanity check. */
+	assert(N->pfx == NULL);
+
+	/* Allocate the array. */
+	if (IMALLOC(N->pfx, N->nkeys, uint64_t))
+		goto err0;
+
+	/* Record the prefix of each key after the shared mlen_t bytes. */
+	if (N->type == NODE_TYPE_LEAF) {
+		for (i = 0; i < N->nkeys; i++)
+			N->pfx[i] = kvldskey_prefix(N->u.pairs[i].k,
+			    N->mlen_t);
+	} else {
+		for (i = 0; i < N->nkeys; i++)
+			N->pfx[i] = kvldskey_prefix(N->u.keys[i], N->mlen_t);
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 /**
  * node_free(N):
  * Free the node ${N}, which must have type NODE_TYPE_NP.
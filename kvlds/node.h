@@ -65,6 +65,19 @@ struct node {
 	/* 1 if the node needs to be considered for merging; 0 otherwise. */
 	unsigned int needmerge : 1;
 
+	/*
+	 * 1 if pagebuf was allocated by malloc rather than from the page
+	 * buffer allocator, since it holds the uncompressed contents of a
+	 * compressed page (which may be larger than a page); 0 otherwise.
+	 */
+	unsigned int zpage : 1;
+
+	/*
+	 * 1 if this DIRTY leaf was found not to compress well enough to be
+	 * merged into the next node; 0 otherwise.
+	 */
+	unsigned int nomerge : 1;
+
 	/* Height of this node (leaf = 0); -1 if !present. */
 	int8_t height;
 
@@ -151,11 +164,20 @@ struct node {
 	} v;
 
 	/*
-	 * Serialized page if node is CLEAN or SHADOW.  Keys and values
-	 * point into here.  (If DIRTY, keys and values point into SHADOW
-	 * nodes' serialized pages and/or into request structures.)
+	 * Serialized page if node is CLEAN or SHADOW (uncompressed, if the
+	 * page was compressed).  Keys and values point into here, except
+	 * that the keys of a front-coded leaf point into space allocated
+	 * after the array of pairs.  (If DIRTY, keys and values point into
+	 * SHADOW nodes' pages or key space and/or into request structures.)
 	 */
 	uint8_t * pagebuf;
+
+	/*
+	 * Search accelerator if node is CLEAN or SHADOW: for each key,
+	 * kvldskey_prefix(key, mlen_t).  NULL if the node is DIRTY, or if
+	 * memory could not be allocated when the node became CLEAN.
+	 */
+	uint64_t * pfx;
 };
 
 /**
@@ -165,6 +187,15 @@ struct node {
  */
 struct node * node_alloc(uint64_t, uint64_t, uint32_t);
 
+/**
+ * node_mkpfx(N):
+ * Build the search accelerator ${N}->pfx for the node ${N}, which must
+ * have type NODE_TYPE_LEAF or NODE_TYPE_PARENT and must not have one
+ * already.  Return -1 if memory cannot be allocated; searches will work
+ * without the accelerator, but more slowly.
+ */
+int node_mkpfx(struct node *);
+
 /**
  * node_free(N):
  * Free the node ${N}, which must have type NODE_TYPE_NP.
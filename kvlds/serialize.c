@@ -8,6 +8,8 @@
 #include "imalloc.h"
 #include "kvldskey.h"
 #include "kvpair.h"
+#include "lz.h"
+#include "slab.h"
 #include "sysendian.h"
 #include "warnp.h"
 
@@ -19,7 +21,8 @@
  * B+Tree page format:
  * offset length data
  * ====== ====== ====
- *      0     6   "KVLDS\0"
+ *      0     6   "KVLDS\0"; or "KVLDS\1" for a front-coded leaf, or
+ *                "KVLDS\2" for a compressed leaf
  *      6     2   BE number of keys (N)
  *      8     1   X = Height + 0x80 * rootedness:
  *                    0x00 - Non-root leaf node.
@@ -41,6 +44,15 @@
  *       ...
  *    ???   ???   Serialized value #(N-1)
  *
+ * The DATA for a front-coded leaf node is the same, except that each key is
+ * stored as a one-byte length of the prefix it shares with the previous key
+ * (zero for key #0), followed by the serialization of the rest of the key.
+ *
+ * In a compressed leaf node, the DATA (not front-coded) is replaced by:
+ *      0     4   BE length of compressed DATA (Z)
+ *      4     4   BE length of uncompressed DATA
+ *      8     Z   DATA compressed with lz_compress
+ *
  * The DATA for a non-leaf node is:
  *      0   ???   Serialized key #0
  *       ...
@@ -57,23 +69,302 @@
  * key or value data.
  *
  * Thus the size of a leaf node is 10 + 2*N + sum(len(key)) + sum(len(value)),
- * and the size of a non-leaf node is 30 + 21*N + sum(len(key)).
+ * or 10 + 3*N + sum(len(key) - shared(key)) + sum(len(value)) if front-coded,
+ * and the size of a non-leaf node is 30 + 21*N + sum(len(key)).  We front-code
+ * a leaf iff that makes its page smaller.  If leaf compression is enabled, we
+ * compress a leaf iff that makes its page smaller still and the uncompressed
+ * DATA takes at most SERIALIZE_ZPAGES pages.
  *
  * IMPORTANT: If the serialized format changes, values in serialize.h might
  * need to be updated.
  */
 
+/*
+ * Compute the DATA lengths of a leaf holding the ${nkeys} key-value pairs
+ * ${pairs} without and with front-coding.
+ */
+static void
+leafsizes(const struct kvpair_const * pairs, size_t nkeys, size_t * plainlen,
+    size_t * fclen)
+{
+	const struct kvldskey * prev = NULL;
+	size_t i;
+
+	*plainlen = *fclen = 0;
+	for (i = 0; i < nkeys; i++) {
+		*plainlen += kvldskey_serial_size(pairs[i].k);
+		*fclen += serialize_fckey_size(prev, pairs[i].k);
+		*plainlen += kvldskey_serial_size(pairs[i].v);
+		*fclen += kvldskey_serial_size(pairs[i].v);
+		prev = pairs[i].k;
+	}
+}
+
+/*
+ * Return the size of a compressed page with a ${hdrlen}-byte header holding
+ * the ${nkeys} key-value pairs ${pairs}, which take ${plainlen} bytes if not
+ * front-coded; or SIZE_MAX if we can't fit them into a page of the B+Tree
+ * ${T} of fewer than ${maxsize} bytes that way.  This uses the scratch space
+ * in ${T}, so it must not be called from serialization threads.
+ */
+static size_t
+leafzsize(struct btree * T, const struct kvpair_const * pairs, size_t nkeys,
+    size_t plainlen, size_t hdrlen, size_t maxsize)
+{
+	uint8_t * buf = T->zscratch;
+	uint8_t * p;
+	size_t zlen;
+	size_t i;
+
+	/* There's no point producing a page which isn't smaller. */
+	if (maxsize > T->pagelen + 1)
+		maxsize = T->pagelen + 1;
+
+	/* Only leaves of limited size can be compressed. */
+	if ((nkeys == 0) || (nkeys > UINT16_MAX) ||
+	    (plainlen > SERIALIZE_ZPAGES * T->pagelen) ||
+	    (hdrlen + 8 + 1 >= maxsize))
+		return (SIZE_MAX);
+
+	/* Write out the keys and then the values. */
+	for (p = buf, i = 0; i < nkeys; i++) {
+		kvldskey_serialize(pairs[i].k, p);
+		p += kvldskey_serial_size(pairs[i].k);
+	}
+	for (i = 0; i < nkeys; i++) {
+		kvldskey_serialize(pairs[i].v, p);
+		p += kvldskey_serial_size(pairs[i].v);
+	}
+
+	/* Compress into whatever space there is after the header. */
+	zlen = lz_compress(buf, plainlen, &buf[plainlen],
+	    maxsize - 1 - hdrlen - 8);
+
+	/* Return the compressed page size, if it fits. */
+	return ((zlen > 0) ? hdrlen + 8 + zlen : SIZE_MAX);
+}
+
+/*
+ * Return the size of a page with a ${hdrlen}-byte header holding the
+ * ${nkeys} key-value pairs ${pairs} of a leaf of the B+Tree ${T}.
+ */
+static size_t
+leafsize(struct btree * T, const struct kvpair_const * pairs, size_t nkeys,
+    size_t hdrlen)
+{
+	size_t plainlen, fclen;
+	size_t size, zsize;
+
+	/* Front-code the leaf if that makes it smaller. */
+	leafsizes(pairs, nkeys, &plainlen, &fclen);
+	size = hdrlen + ((fclen < plainlen) ? fclen : plainlen);
+
+	/* Compress the leaf if that makes it smaller still. */
+	if (T->zleaves) {
+		zsize = leafzsize(T, pairs, nkeys, plainlen, hdrlen, size);
+		if (zsize < size)
+			size = zsize;
+	}
+
+	/* Return the page size. */
+	return (size);
+}
+
+/*
+ * Decompress the compressed leaf page ${buf} of length ${*buflenp} into a
+ * newly allocated page buffer for the node ${N} of the B+Tree ${T}; set
+ * ${*buflenp} to the length of the uncompressed page, and record the size
+ * of the compressed page.
+ */
+static int
+decompress(struct btree * T, struct node * N, const uint8_t * buf,
+    size_t * buflenp)
+{
+	size_t buflen = *buflenp;
+	size_t hdrlen;
+	size_t zlen, rawlen;
+	size_t i;
+
+	/* Figure out how long the header is. */
+	if (buflen < SERIALIZE_OVERHEAD)
+		goto err0;
+	hdrlen = SERIALIZE_OVERHEAD + ((buf[8] & 0x80) ? SERIALIZE_ROOT : 0);
+
+	/* Parse the compressed and uncompressed DATA lengths. */
+	if (buflen < hdrlen + 8)
+		goto err0;
+	zlen = be32dec(&buf[hdrlen]);
+	rawlen = be32dec(&buf[hdrlen + 4]);
+	if ((zlen > buflen - hdrlen - 8) ||
+	    (rawlen > SERIALIZE_ZPAGES * T->pagelen))
+		goto err0;
+
+	/* Make sure that the rest of the page is zeros. */
+	for (i = hdrlen + 8 + zlen; i < buflen; i++) {
+		if (buf[i] != 0)
+			goto err0;
+	}
+
+	/* Copy the header and decompress the DATA after it. */
+	if ((N->pagebuf = malloc(hdrlen + rawlen)) == NULL)
+		goto err0;
+	memcpy(N->pagebuf, buf, hdrlen);
+	if (lz_decompress(&buf[hdrlen + 8], zlen, &N->pagebuf[hdrlen], rawlen))
+		goto err1;
+	N->zpage = 1;
+
+	/* Record the compressed page size. */
+	N->pagesize = (uint32_t)(hdrlen + 8 + zlen);
+
+	/* Success! */
+	*buflenp = hdrlen + rawlen;
+	return (0);
+
+err1:
+	free(N->pagebuf);
+	N->pagebuf = NULL;
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Write out the front-coded keys of the leaf ${N} to ${*bufp} and advance
+ * ${*bufp} past them.  Since the keys are not stored intact in the page,
+ * copy them into space allocated after a new array of key-value pairs.
+ */
+static int
+writekeys_fc(struct node * N, uint8_t ** bufp)
+{
+	struct kvpair_const * pairs;
+	const struct kvldskey * k;
+	uint8_t * p = *bufp;
+	uint8_t * kp;
+	size_t keylen;
+	size_t shared;
+	size_t i;
+
+	/* Allocate a new array of pairs, followed by space for the keys. */
+	for (keylen = i = 0; i < N->nkeys; i++)
+		keylen += kvldskey_serial_size(N->u.pairs[i].k);
+	if ((pairs = malloc(N->nkeys * sizeof(struct kvpair_const) + keylen))
+	    == NULL)
+		goto err0;
+	kp = (uint8_t *)&pairs[N->nkeys];
+
+	/* Write out and copy the keys. */
+	for (i = 0; i < N->nkeys; i++) {
+		k = N->u.pairs[i].k;
+		if (i > 0)
+			shared = kvldskey_mlen(N->u.pairs[i - 1].k, k);
+		else
+			shared = 0;
+		*p++ = (uint8_t)shared;
+		*p++ = (uint8_t)(k->len - shared);
+		memcpy(p, &k->buf[shared], k->len - shared);
+		p += k->len - shared;
+
+		kvldskey_serialize(k, kp);
+		pairs[i].k = (struct kvldskey *)kp;
+		pairs[i].v = N->u.pairs[i].v;
+		kp += kvldskey_serial_size(k);
+	}
+
+	/* Replace the node's array of pairs. */
+	free(N->u.pairs);
+	N->u.pairs = pairs;
+
+	/* Success! */
+	*bufp = p;
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Parse the ${N->nkeys} front-coded keys of a leaf out of the ${*buflenp}-byte
+ * buffer ${*bufp} and advance ${*bufp} past them.  Allocate N->u.pairs with
+ * space after the array of pairs into which the keys are reconstructed.
+ */
+static int
+parsekeys_fc(struct node * N, uint8_t ** bufp, size_t * buflenp)
+{
+	uint8_t * p = *bufp;
+	size_t buflen = *buflenp;
+	size_t keylen, prevlen;
+	uint8_t * kp;
+	size_t i;
+
+	/* We never write empty front-coded leaves. */
+	if (N->nkeys == 0)
+		goto err0;
+
+	/* Check the keys and add up their reconstructed lengths. */
+	for (keylen = prevlen = i = 0; i < N->nkeys; i++) {
+		if (buflen < 2)
+			goto err0;
+		if ((p[0] > prevlen) || (p[0] + p[1] > UINT8_MAX))
+			goto err0;
+		if (buflen - 2 < p[1])
+			goto err0;
+		prevlen = (size_t)p[0] + p[1];
+		keylen += 1 + prevlen;
+		buflen -= 2 + (size_t)p[1];
+		p += 2 + (size_t)p[1];
+	}
+
+	/* Allocate the array of pairs, followed by space for the keys. */
+	if ((N->u.pairs = malloc(N->nkeys * sizeof(struct kvpair_const) +
+	    keylen)) == NULL)
+		goto err0;
+	kp = (uint8_t *)&N->u.pairs[N->nkeys];
+
+	/* Reconstruct the keys. */
+	for (p = *bufp, i = 0; i < N->nkeys; i++) {
+		kp[0] = (uint8_t)(p[0] + p[1]);
+		if (i > 0)
+			memcpy(&kp[1], N->u.pairs[i - 1].k->buf, p[0]);
+		memcpy(&kp[1 + p[0]], &p[2], p[1]);
+		N->u.pairs[i].k = (struct kvldskey *)kp;
+		kp += kvldskey_serial_size(N->u.pairs[i].k);
+		p += 2 + (size_t)p[1];
+	}
+
+	/* Success! */
+	*bufp = p;
+	*buflenp = buflen;
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 /**
- * serialize(T, N, buflen):
- * Serialize the dirty node ${N} into a newly allocated page buffer.  Adjust
- * key and value pointers to point into this new buffer.
+ * serialize_buf(T, N, buflen, pagebuf, zbuf, rawlen):
+ * Serialize the dirty node ${N} as serialize() does, using ${pagebuf}, which
+ * must have been allocated from the page buffer allocator of the B+Tree ${T},
+ * as the node's page buffer unless the page is compressed; in that case the
+ * caller must return ${pagebuf} to the allocator.  Set ${*rawlen} to the
+ * size the page would have if it were not compressed.  Nothing other than
+ * ${N} is modified, and nothing in ${T} which can change is read except for
+ * the size of the tree (if ${N} is the root); so non-root nodes whose sizes
+ * have been found by serialize_size may be serialized by multiple threads at
+ * once.
  */
 int
-serialize(struct btree * T, struct node * N, size_t buflen)
+serialize_buf(struct btree * T, struct node * N, size_t buflen,
+    uint8_t * pagebuf, uint8_t ** zbuf, size_t * rawlen)
 {
+	size_t plainlen, fclen;
 	size_t pagelen;
+	size_t hdrlen;
+	size_t zlen;
 	uint8_t * p;
 	size_t i;
+	int fc, z;
 
 	/* Sanity check: This node should be dirty and have no page buffer. */
 	assert(N->state == NODE_STATE_DIRTY);
@@ -86,18 +377,49 @@ serialize(struct btree * T, struct node * N, size_t buflen)
 	assert(N->nkeys <= UINT16_MAX);
 
 	/* Get the page length.  This also sets N->pagelen. */
-	pagelen = serialize_size(N);
+	pagelen = serialize_size(T, N);
 
 	/* Sanity check: The page should fit into the buffer. */
 	assert(pagelen <= buflen);
+	assert(buflen <= T->pagelen);
 
-	/* Allocate a page buffer. */
-	if ((N->pagebuf = malloc(buflen)) == NULL)
-		goto err0;
+	/* Figure out how long the page header is. */
+	hdrlen = SERIALIZE_OVERHEAD + (N->root ? SERIALIZE_ROOT : 0);
+
+	/*
+	 * Should we front-code or compress this node?  We compressed it in
+	 * serialize_size iff that made it smaller than the alternatives.
+	 */
+	fc = z = 0;
+	plainlen = fclen = 0;
+	if (N->type == NODE_TYPE_LEAF) {
+		leafsizes(N->u.pairs, N->nkeys, &plainlen, &fclen);
+		if (pagelen < hdrlen + ((fclen < plainlen) ? fclen : plainlen))
+			z = 1;
+		else if (fclen < plainlen)
+			fc = 1;
+	}
+
+	/*
+	 * Pick a page buffer.  A compressed leaf is held uncompressed, so it
+	 * might not fit into a buffer from the page buffer allocator.
+	 */
+	if (z) {
+		if ((N->pagebuf = malloc(hdrlen + plainlen)) == NULL)
+			goto err0;
+		N->zpage = 1;
+	} else {
+		N->pagebuf = pagebuf;
+	}
 	p = N->pagebuf;
 
+	/* Allocate a buffer for the compressed page to be written out. */
+	*zbuf = NULL;
+	if (z && ((*zbuf = malloc(buflen)) == NULL))
+		goto err1;
+
 	/* Copy magic. */
-	memcpy(p, "KVLDS\0", 6);
+	memcpy(p, z ? "KVLDS\2" : (fc ? "KVLDS\1" : "KVLDS\0"), 6);
 	p += 6;
 
 	/* Write out the number of keys. */
@@ -124,10 +446,15 @@ serialize(struct btree * T, struct node * N, size_t buflen)
 	/* Write out node data. */
 	if (N->type == NODE_TYPE_LEAF) {
 		/* Write out the keys. */
-		for (i = 0; i < N->nkeys; i++) {
-			kvldskey_serialize(N->u.pairs[i].k, p);
-			N->u.pairs[i].k = (struct kvldskey *)p;
-			p += kvldskey_serial_size(N->u.pairs[i].k);
+		if (fc) {
+			if (writekeys_fc(N, &p))
+				goto err1;
+		} else {
+			for (i = 0; i < N->nkeys; i++) {
+				kvldskey_serialize(N->u.pairs[i].k, p);
+				N->u.pairs[i].k = (struct kvldskey *)p;
+				p += kvldskey_serial_size(N->u.pairs[i].k);
+			}
 		}
 
 		/* Write out the values. */
@@ -163,30 +490,104 @@ serialize(struct btree * T, struct node * N, size_t buflen)
 		}
 	}
 
-	/* Sanity-check: Make sure we computed the size correctly. */
-	assert(p == N->pagebuf + pagelen);
+	/* Compress the leaf if appropriate. */
+	if (z) {
+		/* Sanity-check: We should have written the whole leaf. */
+		assert(p == N->pagebuf + hdrlen + plainlen);
+
+		/* Copy the header, then the DATA lengths and DATA. */
+		memcpy(*zbuf, N->pagebuf, hdrlen);
+		zlen = lz_compress(&N->pagebuf[hdrlen], plainlen,
+		    &(*zbuf)[hdrlen + 8], pagelen - hdrlen - 8);
+		be32enc(&(*zbuf)[hdrlen], (uint32_t)zlen);
+		be32enc(&(*zbuf)[hdrlen + 4], (uint32_t)plainlen);
+		p = *zbuf + hdrlen + 8 + zlen;
+
+		/* Sanity-check: This should match serialize_size. */
+		assert(p == *zbuf + pagelen);
+	} else {
+		/* Sanity-check: Make sure we computed the size correctly. */
+		assert(p == N->pagebuf + pagelen);
+	}
 
 	/* Zero the remaining space. */
 	memset(p, 0, buflen - pagelen);
 
+	/* Record how large the page would be without compression. */
+	if (N->type == NODE_TYPE_LEAF)
+		*rawlen = hdrlen + ((fclen < plainlen) ? fclen : plainlen);
+	else
+		*rawlen = pagelen;
+
+	/* Success! */
+	return (0);
+
+err1:
+	if (N->zpage)
+		free(N->pagebuf);
+	N->pagebuf = NULL;
+	N->zpage = 0;
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * serialize(T, N, buflen, zbuf):
+ * Serialize the dirty node ${N} into a newly allocated page buffer of length
+ * ${buflen}, which must not exceed the page length of the B+Tree ${T}.
+ * Adjust key and value pointers to point into this new buffer (or for keys
+ * in a front-coded leaf, into space allocated along with the node's array of
+ * key-value pairs).  If the page is compressed, the page buffer holds it
+ * uncompressed; set ${*zbuf} to a newly allocated ${buflen}-byte buffer
+ * holding the page to be written out, which the caller must free.
+ * Otherwise, set ${*zbuf} to NULL.
+ */
+int
+serialize(struct btree * T, struct node * N, size_t buflen, uint8_t ** zbuf)
+{
+	uint8_t * pagebuf;
+	size_t rawlen;
+
+	/* Allocate a page buffer and serialize the node. */
+	if ((pagebuf = slab_alloc(T->pagebufs)) == NULL)
+		goto err0;
+	if (serialize_buf(T, N, buflen, pagebuf, zbuf, &rawlen))
+		goto err1;
+
+	/* A compressed leaf has its own page buffer. */
+	if (N->pagebuf != pagebuf)
+		slab_release(T->pagebufs, pagebuf);
+
+	/* Keep track of how well leaves are compressing. */
+	if ((N->type == NODE_TYPE_LEAF) && T->zleaves) {
+		T->zrawbytes += rawlen;
+		T->zbytes += N->pagesize;
+	}
+
 	/* Success! */
 	return (0);
 
+err1:
+	slab_release(T->pagebufs, pagebuf);
 err0:
 	/* Failure! */
 	return (-1);
 }
 
 /**
- * deserialize(N, buf, buflen):
- * Deserialize the node ${N} out of the ${buflen}-byte page buffer ${buf}.
+ * deserialize(T, N, buf, buflen):
+ * Deserialize the node ${N} of the B+Tree ${T} out of the ${buflen}-byte page
+ * buffer ${buf}, where ${buflen} must not exceed the page length of ${T}.
  * Extra data held in the serialized root node is not processed.
  */
 int
-deserialize(struct node * N, const uint8_t * buf, size_t buflen)
+deserialize(struct btree * T, struct node * N, const uint8_t * buf,
+    size_t buflen)
 {
 	uint8_t * p;
 	size_t i;
+	uint8_t magic;
 
 	/*
 	 * Clear errno; we will use it to distinguish between internal errors
@@ -201,17 +602,26 @@ deserialize(struct node * N, const uint8_t * buf, size_t buflen)
 	assert(N->type == NODE_TYPE_READ);
 	assert(N->state == NODE_STATE_CLEAN);
 
-	/* Copy the serialized page. */
-	if ((N->pagebuf = malloc(buflen)) == NULL)
-		goto err0;
-	memcpy(N->pagebuf, buf, buflen);
+	/* Sanity check: The page must fit into a page buffer. */
+	assert(buflen <= T->pagelen);
+
+	/* Copy the serialized page, decompressing it if necessary. */
+	if ((buflen >= 6) && (memcmp(buf, "KVLDS\2", 6) == 0)) {
+		if (decompress(T, N, buf, &buflen))
+			goto err1;
+	} else {
+		if ((N->pagebuf = slab_alloc(T->pagebufs)) == NULL)
+			goto err0;
+		memcpy(N->pagebuf, buf, buflen);
+	}
 	p = N->pagebuf;
 
 	/* Check magic. */
 	if (buflen < 6)
 		goto err1;
-	if (memcmp(p, "KVLDS\0", 6))
+	if (memcmp(p, "KVLDS", 5) || (p[5] > 2))
 		goto err1;
+	magic = p[5];
 	p += 6; buflen -= 6;
 
 	/* Parse # of keys. */
@@ -234,6 +644,10 @@ deserialize(struct node * N, const uint8_t * buf, size_t buflen)
 		N->type = NODE_TYPE_LEAF;
 	p += 1; buflen -= 1;
 
+	/* Only leaves are front-coded or compressed. */
+	if ((magic != 0) && (N->type != NODE_TYPE_LEAF))
+		goto err1;
+
 	/* Parse matching prefix length. */
 	N->mlen_t = p[0];
 	p += 1; buflen -= 1;
@@ -246,19 +660,27 @@ deserialize(struct node * N, const uint8_t * buf, size_t buflen)
 
 	/* Parse node data. */
 	if (N->type == NODE_TYPE_LEAF) {
-		/* Allocate array of key-value pairs. */
-		if (IMALLOC(N->u.pairs, N->nkeys, struct kvpair_const))
-			goto err1;
-
-		/* Parse keys. */
-		for (i = 0; i < N->nkeys; i++) {
-			if (buflen == 0)
-				goto err2;
-			N->u.pairs[i].k = (struct kvldskey *)p;
-			if (buflen < kvldskey_serial_size(N->u.pairs[i].k))
-				goto err2;
-			p += kvldskey_serial_size(N->u.pairs[i].k);
-			buflen -= kvldskey_serial_size(N->u.pairs[i].k);
+		if (magic == 1) {
+			/* Parse keys into a new array of key-value pairs. */
+			if (parsekeys_fc(N, &p, &buflen))
+				goto err1;
+		} else {
+			/* Allocate array of key-value pairs. */
+			if (IMALLOC(N->u.pairs, N->nkeys,
+			    struct kvpair_const))
+				goto err1;
+
+			/* Parse keys. */
+			for (i = 0; i < N->nkeys; i++) {
+				if (buflen == 0)
+					goto err2;
+				N->u.pairs[i].k = (struct kvldskey *)p;
+				if (buflen <
+				    kvldskey_serial_size(N->u.pairs[i].k))
+					goto err2;
+				p += kvldskey_serial_size(N->u.pairs[i].k);
+				buflen -= kvldskey_serial_size(N->u.pairs[i].k);
+			}
 		}
 
 		/* Parse values. */
@@ -272,6 +694,10 @@ deserialize(struct node * N, const uint8_t * buf, size_t buflen)
 			buflen -= kvldskey_serial_size(N->u.pairs[i].v);
 		}
 
+		/* Build the search accelerator. */
+		if (node_mkpfx(N))
+			goto err2;
+
 		/* Figure out how far the keys match. */
 		if (N->nkeys > 0) {
 			N->mlen_n = (uint8_t)kvldskey_mlen(N->u.pairs[0].k,
@@ -302,6 +728,10 @@ deserialize(struct node * N, const uint8_t * buf, size_t buflen)
 			buflen -= kvldskey_serial_size(N->u.keys[i]);
 		}
 
+		/* Build the search accelerator. */
+		if (node_mkpfx(N))
+			goto err3;
+
 		/* Allocate array of children. */
 		if (IMALLOC(N->v.children, N->nkeys + 1, struct node *))
 			goto err3;
@@ -345,6 +775,8 @@ err4:
 	N->v.children = NULL;
 
 err3:
+	free(N->pfx);
+	N->pfx = NULL;
 	free(N->u.keys);
 	N->u.keys = NULL;
 	goto err1;
@@ -353,6 +785,8 @@ err3:
 	 * LEAF parsing error handling path.
 	 */
 err2:
+	free(N->pfx);
+	N->pfx = NULL;
 	free(N->u.pairs);
 	N->u.pairs = NULL;
 
@@ -360,8 +794,12 @@ err2:
 	 * LEAF+PARENT merged error handling path.
 	 */
 err1:
-	free(N->pagebuf);
+	if (N->zpage)
+		free(N->pagebuf);
+	else
+		slab_release(T->pagebufs, N->pagebuf);
 	N->pagebuf = NULL;
+	N->zpage = 0;
 	if (errno != 0)
 		warnp("Error parsing page");
 	else
@@ -373,8 +811,8 @@ err0:
 
 /**
  * deserialize_root(T, buf):
- * For a ${buf} for which deserialize(N, ${buf}, buflen) succeeded and set
- * N->root to 1, parse extra root page data into the B+tree ${T}.
+ * For a ${buf} for which deserialize(T, N, ${buf}, buflen) succeeded and
+ * set N->root to 1, parse extra root page data into the B+tree ${T}.
  */
 int
 deserialize_root(struct btree * T, const uint8_t * buf)
@@ -388,11 +826,12 @@ deserialize_root(struct btree * T, const uint8_t * buf)
 }
 
 /**
- * serialize_size(N):
- * Return the size of the page created by serializing the node ${N}.
+ * serialize_size(T, N):
+ * Return the size of the page created by serializing the node ${N} of the
+ * B+Tree ${T}.
  */
 size_t
-serialize_size(struct node * N)
+serialize_size(struct btree * T, struct node * N)
 {
 	size_t size;
 	size_t i;
@@ -422,12 +861,9 @@ serialize_size(struct node * N)
 		assert(size == SERIALIZE_OVERHEAD + SERIALIZE_ROOT);
 	}
 
-	/* Node data and keys. */
+	/* Node data and keys; leaves are front-coded or compressed. */
 	if (N->type == NODE_TYPE_LEAF) {
-		for (i = 0; i < N->nkeys; i++) {
-			size += kvldskey_serial_size(N->u.pairs[i].k);
-			size += kvldskey_serial_size(N->u.pairs[i].v);
-		}
+		size = leafsize(T, N->u.pairs, N->nkeys, size);
 	} else {
 		for (i = 0; i < N->nkeys; i++) {
 			if (N->v.children[i]->merging == 0) {
@@ -454,12 +890,13 @@ serialize_size(struct node * N)
 }
 
 /**
- * serialize_merge_size(N):
- * Return the size by which a page will increase by having the node ${N}
- * merged into it (excluding any separator key for parent nodes).
+ * serialize_merge_size(T, N):
+ * Return the size by which a page will increase by having the node ${N} of
+ * the B+Tree ${T} merged into it (excluding any separator key for parent
+ * nodes).  For compressed leaves this is only an estimate.
  */
 size_t
-serialize_merge_size(struct node * N)
+serialize_merge_size(struct btree * T, struct node * N)
 {
 	size_t headerlen;
 
@@ -471,5 +908,38 @@ serialize_merge_size(struct node * N)
 		headerlen = SERIALIZE_OVERHEAD + SERIALIZE_ROOT;
 	else
 		headerlen = SERIALIZE_OVERHEAD;
-	return (serialize_size(N) - headerlen);
+	return (serialize_size(T, N) - headerlen);
+}
+
+/**
+ * serialize_leaf_size(T, pairs, nkeys):
+ * Return the size of the page created by serializing a non-root leaf of the
+ * B+Tree ${T} holding the ${nkeys} key-value pairs ${pairs}.
+ */
+size_t
+serialize_leaf_size(struct btree * T, const struct kvpair_const * pairs,
+    size_t nkeys)
+{
+
+	return (leafsize(T, pairs, nkeys, SERIALIZE_OVERHEAD));
+}
+
+/**
+ * serialize_fckey_size(prev, k):
+ * Return the size of the key ${k} in a front-coded leaf page where it follows
+ * the key ${prev}, or is the first key if ${prev} is NULL.
+ */
+size_t
+serialize_fckey_size(const struct kvldskey * prev, const struct kvldskey * k)
+{
+	size_t shared;
+
+	/* How much of the key is shared with the previous key? */
+	if (prev != NULL)
+		shared = kvldskey_mlen(prev, k);
+	else
+		shared = 0;
+
+	/* Shared length, then the serialization of the rest of the key. */
+	return (1 + kvldskey_serial_size(k) - shared);
 }
@@ -6,14 +6,23 @@
 
 /* Opaque types. */
 struct btree;
+struct kvldskey;
+struct kvpair_const;
 struct node;
 
 /**
- * The size of a leaf non-root node is:
+ * The size of a leaf non-root node is the lesser of:
  *     SERIALIZE_OVERHEAD +
  *         sum(KSS(key[i]), i = 0 .. nkeys) +
  *         sum(KSS(value[i]), i = 0 .. nkeys)
- * where KSS(x) is kvldskey_serial_size(x).
+ * and (for a front-coded leaf):
+ *     SERIALIZE_OVERHEAD +
+ *         sum(serialize_fckey_size(key[i - 1], key[i]), i = 0 .. nkeys) +
+ *         sum(KSS(value[i]), i = 0 .. nkeys)
+ * where KSS(x) is kvldskey_serial_size(x) and key[-1] is NULL; or if leaf
+ * compression is enabled, the size of the compressed page (including 8 bytes
+ * of DATA lengths) if that is smaller still and the uncompressed DATA which
+ * is not front-coded takes at most SERIALIZE_ZPAGES * pagelen bytes.
  *
  * The size of a parent non-root node is:
  *     SERIALIZE_OVERHEAD +
@@ -26,39 +35,79 @@ struct node;
 #define SERIALIZE_OVERHEAD	10
 #define SERIALIZE_ROOT		8
 #define SERIALIZE_PERCHILD	20
+#define SERIALIZE_ZPAGES	4
+
+/**
+ * serialize(T, N, buflen, zbuf):
+ * Serialize the dirty node ${N} into a newly allocated page buffer of length
+ * ${buflen}, which must not exceed the page length of the B+Tree ${T}.
+ * Adjust key and value pointers to point into this new buffer (or for keys
+ * in a front-coded leaf, into space allocated along with the node's array of
+ * key-value pairs).  If the page is compressed, the page buffer holds it
+ * uncompressed; set ${*zbuf} to a newly allocated ${buflen}-byte buffer
+ * holding the page to be written out, which the caller must free.
+ * Otherwise, set ${*zbuf} to NULL.
+ */
+int serialize(struct btree *, struct node *, size_t, uint8_t **);
 
 /**
- * serialize(T, N, buflen):
- * Serialize the dirty node ${N} into a newly allocated page buffer.  Adjust
- * key and value pointers to point into this new buffer.
+ * serialize_buf(T, N, buflen, pagebuf, zbuf, rawlen):
+ * Serialize the dirty node ${N} as serialize() does, using ${pagebuf}, which
+ * must have been allocated from the page buffer allocator of the B+Tree ${T},
+ * as the node's page buffer unless the page is compressed; in that case the
+ * caller must return ${pagebuf} to the allocator.  Set ${*rawlen} to the
+ * size the page would have if it were not compressed.  Nothing other than
+ * ${N} is modified, and nothing in ${T} which can change is read except for
+ * the size of the tree (if ${N} is the root); so non-root nodes whose sizes
+ * have been found by serialize_size may be serialized by multiple threads at
+ * once.
  */
-int serialize(struct btree *, struct node *, size_t);
+int serialize_buf(struct btree *, struct node *, size_t, uint8_t *,
+    uint8_t **, size_t *);
 
 /**
- * deserialize(N, buf, buflen):
- * Deserialize the node ${N} out of the ${buflen}-byte page buffer ${buf}.
+ * deserialize(T, N, buf, buflen):
+ * Deserialize the node ${N} of the B+Tree ${T} out of the ${buflen}-byte page
+ * buffer ${buf}, where ${buflen} must not exceed the page length of ${T}.
  * Extra data held in the serialized root node is not processed.
  */
-int deserialize(struct node *, const uint8_t *, size_t);
+int deserialize(struct btree *, struct node *, const uint8_t *, size_t);
 
 /**
  * deserialize_root(T, buf):
- * For a ${buf} for which deserialize(N, ${buf}, buflen) succeeded and set
- * N->root to 1, parse extra root page data into the B+tree ${T}.
+ * For a ${buf} for which deserialize(T, N, ${buf}, buflen) succeeded and
+ * set N->root to 1, parse extra root page data into the B+tree ${T}.
  */
 int deserialize_root(struct btree *, const uint8_t *);
 
 /**
- * serialize_size(N):
- * Return the size of the page created by serializing the node ${N}.
+ * serialize_size(T, N):
+ * Return the size of the page created by serializing the node ${N} of the
+ * B+Tree ${T}.
+ */
+size_t serialize_size(struct btree *, struct node *);
+
+/**
+ * serialize_merge_size(T, N):
+ * Return the size by which a page will increase by having the node ${N} of
+ * the B+Tree ${T} merged into it (excluding any separator key for parent
+ * nodes).  For compressed leaves this is only an estimate.
+ */
+size_t serialize_merge_size(struct btree *, struct node *);
+
+/**
+ * serialize_leaf_size(T, pairs, nkeys):
+ * Return the size of the page created by serializing a non-root leaf of the
+ * B+Tree ${T} holding the ${nkeys} key-value pairs ${pairs}.
  */
-size_t serialize_size(struct node *);
+size_t serialize_leaf_size(struct btree *, const struct kvpair_const *,
+    size_t);
 
 /**
- * serialize_merge_size(N):
- * Return the size by which a page will increase by having the node ${N}
- * merged into it (excluding any separator key for parent nodes).
+ * serialize_fckey_size(prev, k):
+ * Return the size of the key ${k} in a front-coded leaf page where it follows
+ * the key ${prev}, or is the first key if ${prev} is NULL.
  */
-size_t serialize_merge_size(struct node *);
+size_t serialize_fckey_size(const struct kvldskey *, const struct kvldskey *);
 
 #endif /* !SERIALIZE_H_ */
@@ -0,0 +1,439 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "imalloc.h"
+#include "network.h"
+#include "noeintr.h"
+#include "slab.h"
+#include "warnp.h"
+
+#include "btree.h"
+#include "node.h"
+#include "serialize.h"
+
+#include "serializer.h"
+
+/* Number of nodes a thread takes to serialize at once. */
+#define CHUNKLEN	16
+
+/* Serializer state. */
+struct serializer {
+	/* Thread management. */
+	pthread_mutex_t mtx;		/* Controls access to this structure. */
+	pthread_cond_t cv;		/* Signalled when there is work. */
+	pthread_t * thr;		/* Thread IDs. */
+	size_t nthreads;		/* Number of threads. */
+	int suicide;			/* Threads need to kill themselves. */
+
+	/* Wakeup socket pair, written to by the last thread to finish. */
+	int spair[2];			/* Read spair[0], write spair[1]. */
+	uint8_t wakeupbuf;		/* Byte read from spair[0]. */
+	void * wakeup_cookie;		/* Cookie from network_read. */
+
+	/* The B+Tree whose nodes we serialize. */
+	struct btree * T;
+
+	/* Work to be done. */
+	struct node ** nodes;		/* Nodes to serialize. */
+	uint8_t ** pagebufs;		/* Page buffers, or NULL to skip. */
+	uint8_t ** zbufv;		/* Compressed pages. */
+	size_t n;			/* Number of nodes. */
+	size_t pagelen;			/* Length of pages. */
+	size_t next;			/* Next node to serialize. */
+	size_t nbusy;			/* # threads serializing nodes. */
+
+	/* Results. */
+	int failed;			/* Non-zero if serializing failed. */
+	uint64_t zrawbytes;		/* Leaf bytes, uncompressed. */
+	uint64_t zbytes;		/* Leaf page bytes. */
+
+	/* Callback to be performed when done. */
+	int (* callback)(void *, int);
+	void * cookie;
+};
+
+/* Serialization thread. */
+static void *
+workthread(void * cookie)
+{
+	struct serializer * S = cookie;
+	struct node * N;
+	size_t start, end, i;
+	size_t rawlen;
+	uint64_t zrawbytes, zbytes;
+	uint8_t wakeup = 0;
+	int failed;
+	int rc;
+
+	/* Grab the mutex. */
+	if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		exit(1);
+	}
+
+	/* Infinite loop doing work until told to suicide. */
+	do {
+		/* Sleep until we have work or need to kill ourself. */
+		while ((S->next == S->n) && (S->suicide == 0)) {
+			if ((rc = pthread_cond_wait(&S->cv, &S->mtx)) != 0) {
+				warn0("pthread_cond_wait: %s", strerror(rc));
+				exit(1);
+			}
+		}
+
+		/* If we need to kill ourself, stop looping. */
+		if (S->suicide)
+			break;
+
+		/* Take a chunk of nodes. */
+		start = S->next;
+		end = (S->n - start > CHUNKLEN) ? start + CHUNKLEN : S->n;
+		S->next = end;
+		S->nbusy++;
+
+		/* Serialize the nodes without holding the mutex. */
+		if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+			warn0("pthread_mutex_unlock: %s", strerror(rc));
+			exit(1);
+		}
+		failed = 0;
+		zrawbytes = zbytes = 0;
+		for (i = start; i < end; i++) {
+			/* Skip nodes which we aren't serializing. */
+			if (S->pagebufs[i] == NULL)
+				continue;
+
+			/* Serialize the node. */
+			N = S->nodes[i];
+			if (serialize_buf(S->T, N, S->pagelen, S->pagebufs[i],
+			    &S->zbufv[i], &rawlen)) {
+				failed = 1;
+				continue;
+			}
+
+			/* Keep track of how well leaves are compressing. */
+			zrawbytes += rawlen;
+			zbytes += N->pagesize;
+		}
+		if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+			warn0("pthread_mutex_lock: %s", strerror(rc));
+			exit(1);
+		}
+
+		/* Record the results. */
+		S->nbusy--;
+		S->failed |= failed;
+		S->zrawbytes += zrawbytes;
+		S->zbytes += zbytes;
+
+		/* If all the work is done, wake up the event loop. */
+		if ((S->next == S->n) && (S->nbusy == 0)) {
+			if (noeintr_write(S->spair[1], &wakeup, 1) != 1) {
+				warnp("Error writing to wakeup socket");
+				exit(1);
+			}
+		}
+	} while (1);
+
+	/* Release the mutex and die. */
+	if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		exit(1);
+	}
+	return (NULL);
+}
+
+/* The threads have finished serializing nodes. */
+static int
+workdone(void * cookie, ssize_t lenread)
+{
+	struct serializer * S = cookie;
+	struct btree * T = S->T;
+	uint8_t ** pagebufs;
+	size_t i;
+	int failed;
+	int rc;
+
+	/* This read is no longer pending. */
+	S->wakeup_cookie = NULL;
+
+	/* If we failed to read a byte, something is seriously wrong. */
+	if (lenread != 1) {
+		warnp("Error reading from wakeup socket");
+		goto err0;
+	}
+
+	/* Collect the results. */
+	if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		goto err0;
+	}
+	assert((S->next == S->n) && (S->nbusy == 0));
+	failed = S->failed;
+	if (T->zleaves) {
+		T->zrawbytes += S->zrawbytes;
+		T->zbytes += S->zbytes;
+	}
+	pagebufs = S->pagebufs;
+	S->pagebufs = NULL;
+	if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Return page buffers which weren't used. */
+	for (i = 0; i < S->n; i++) {
+		if (S->nodes[i]->pagebuf != pagebufs[i])
+			slab_release(T->pagebufs, pagebufs[i]);
+	}
+	free(pagebufs);
+
+	/* Perform the callback. */
+	return ((S->callback)(S->cookie, failed));
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * serializer_init(T, nthreads):
+ * Create ${nthreads} threads which serialize leaves of the B+Tree ${T}.
+ */
+struct serializer *
+serializer_init(struct btree * T, size_t nthreads)
+{
+	struct serializer * S;
+	size_t i;
+	int rc;
+
+	/* Allocate a serializer structure. */
+	if ((S = malloc(sizeof(struct serializer))) == NULL)
+		goto err0;
+	S->T = T;
+	S->nthreads = 0;
+	S->suicide = 0;
+	S->wakeup_cookie = NULL;
+	S->nodes = NULL;
+	S->pagebufs = NULL;
+	S->zbufv = NULL;
+	S->n = S->next = S->nbusy = 0;
+
+	/* Allocate space for thread IDs. */
+	if (IMALLOC(S->thr, nthreads, pthread_t))
+		goto err1;
+
+	/* Create a socket pair for sending work completion messages. */
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, S->spair)) {
+		warnp("socketpair");
+		goto err2;
+	}
+
+	/* Mark the read end of the socket pair as non-blocking. */
+	if (fcntl(S->spair[0], F_SETFL, O_NONBLOCK) == -1) {
+		warnp("Cannot make wakeup socket non-blocking");
+		goto err3;
+	}
+
+	/* Create the mutex and condition variable. */
+	if ((rc = pthread_mutex_init(&S->mtx, NULL)) != 0) {
+		warn0("pthread_mutex_init: %s", strerror(rc));
+		goto err3;
+	}
+	if ((rc = pthread_cond_init(&S->cv, NULL)) != 0) {
+		warn0("pthread_cond_init: %s", strerror(rc));
+		goto err4;
+	}
+
+	/*
+	 * Create the threads while holding the mutex, to make sure that they
+	 * see the initialized structure.
+	 */
+	if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		goto err5;
+	}
+	for (i = 0; i < nthreads; i++) {
+		if ((rc = pthread_create(&S->thr[i], NULL, workthread,
+		    S)) != 0) {
+			warn0("pthread_create: %s", strerror(rc));
+			goto err6;
+		}
+		S->nthreads++;
+	}
+	if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Success! */
+	return (S);
+
+err6:
+	/* Stop the threads we managed to create. */
+	pthread_mutex_unlock(&S->mtx);
+	serializer_free(S);
+	goto err0;
+
+err5:
+	pthread_cond_destroy(&S->cv);
+err4:
+	pthread_mutex_destroy(&S->mtx);
+err3:
+	close(S->spair[1]);
+	close(S->spair[0]);
+err2:
+	free(S->thr);
+err1:
+	free(S);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * serializer_run(S, nodes, n, pagelen, zbufv, callback, cookie):
+ * Using the threads of the serializer ${S}, serialize the non-root leaves
+ * among the ${n} dirty nodes ${nodes} into pages of length ${pagelen} as
+ * serialize() would, recording compressed pages in ${zbufv}; other nodes are
+ * skipped.  When this is done, invoke ${callback}(${cookie}, failed), where
+ * ${failed} is non-zero if a node could not be serialized.  The nodes must
+ * not be accessed until then.
+ */
+int
+serializer_run(struct serializer * S, struct node ** nodes, size_t n,
+    size_t pagelen, uint8_t ** zbufv, int (* callback)(void *, int),
+    void * cookie)
+{
+	uint8_t ** pagebufs;
+	size_t i;
+	int rc;
+
+	/* Sanity-check: We shouldn't be running already. */
+	assert(S->wakeup_cookie == NULL);
+	assert(n > 0);
+
+	/*
+	 * The page buffer allocator isn't thread-safe, so allocate page
+	 * buffers for the leaves here.
+	 */
+	if (IMALLOC(pagebufs, n, uint8_t *))
+		goto err0;
+	for (i = 0; i < n; i++) {
+		if ((nodes[i]->type != NODE_TYPE_LEAF) || nodes[i]->root) {
+			pagebufs[i] = NULL;
+			continue;
+		}
+		if ((pagebufs[i] = slab_alloc(S->T->pagebufs)) == NULL)
+			goto err1;
+	}
+
+	/* Wait for the threads to finish. */
+	if ((S->wakeup_cookie = network_read(S->spair[0], &S->wakeupbuf, 1, 1,
+	    workdone, S)) == NULL) {
+		warnp("Error reading from wakeup socket");
+		goto err1;
+	}
+
+	/* Hand the work to the threads and wake them up. */
+	if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		goto err2;
+	}
+	S->nodes = nodes;
+	S->pagebufs = pagebufs;
+	S->zbufv = zbufv;
+	S->n = n;
+	S->pagelen = pagelen;
+	S->next = 0;
+	S->failed = 0;
+	S->zrawbytes = S->zbytes = 0;
+	S->callback = callback;
+	S->cookie = cookie;
+	if ((rc = pthread_cond_broadcast(&S->cv)) != 0) {
+		warn0("pthread_cond_broadcast: %s", strerror(rc));
+		goto err3;
+	}
+	if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err3:
+	S->n = S->next = 0;
+	S->pagebufs = NULL;
+	pthread_mutex_unlock(&S->mtx);
+err2:
+	network_read_cancel(S->wakeup_cookie);
+	S->wakeup_cookie = NULL;
+err1:
+	while (i-- > 0)
+		slab_release(S->T->pagebufs, pagebufs[i]);
+	free(pagebufs);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * serializer_free(S):
+ * Stop the threads of the serializer ${S}, which must not be running, and
+ * free it.
+ */
+void
+serializer_free(struct serializer * S)
+{
+	size_t i;
+	int rc;
+
+	/* Behave consistently with free(NULL). */
+	if (S == NULL)
+		return;
+
+	/* Sanity-check: We shouldn't be running. */
+	assert(S->wakeup_cookie == NULL);
+
+	/* Tell the threads to die, and wake them up. */
+	if ((rc = pthread_mutex_lock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		exit(1);
+	}
+	S->suicide = 1;
+	if ((rc = pthread_cond_broadcast(&S->cv)) != 0) {
+		warn0("pthread_cond_broadcast: %s", strerror(rc));
+		exit(1);
+	}
+	if ((rc = pthread_mutex_unlock(&S->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		exit(1);
+	}
+
+	/* Wait for the threads to die. */
+	for (i = 0; i < S->nthreads; i++) {
+		if ((rc = pthread_join(S->thr[i], NULL)) != 0) {
+			warn0("pthread_join: %s", strerror(rc));
+			exit(1);
+		}
+	}
+
+	/* Clean up. */
+	pthread_cond_destroy(&S->cv);
+	pthread_mutex_destroy(&S->mtx);
+	if (close(S->spair[1]))
+		warnp("close");
+	if (close(S->spair[0]))
+		warnp("close");
+	free(S->thr);
+	free(S);
+}
@@ -0,0 +1,37 @@
+#ifndef SERIALIZER_H_
+#define SERIALIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque types. */
+struct btree;
+struct node;
+struct serializer;
+
+/**
+ * serializer_init(T, nthreads):
+ * Create ${nthreads} threads which serialize leaves of the B+Tree ${T}.
+ */
+struct serializer * serializer_init(struct btree *, size_t);
+
+/**
+ * serializer_run(S, nodes, n, pagelen, zbufv, callback, cookie):
+ * Using the threads of the serializer ${S}, serialize the non-root leaves
+ * among the ${n} dirty nodes ${nodes} into pages of length ${pagelen} as
+ * serialize() would, recording compressed pages in ${zbufv}; other nodes are
+ * skipped.  When this is done, invoke ${callback}(${cookie}, failed), where
+ * ${failed} is non-zero if a node could not be serialized.  The nodes must
+ * not be accessed until then.
+ */
+int serializer_run(struct serializer *, struct node **, size_t, size_t,
+    uint8_t **, int (*)(void *, int), void *);
+
+/**
+ * serializer_free(S):
+ * Stop the threads of the serializer ${S}, which must not be running, and
+ * free it.
+ */
+void serializer_free(struct serializer *);
+
+#endif /* !SERIALIZER_H_ */
@@ -114,6 +114,9 @@ gotrequest(void * cookie, int status)
 			if (state_get(D->S, R, callback_get, D))
 				goto err1;
 			break;
+		case PROTO_LBS_GETV:
+			warn0("PROTO_LBS_GETV is not implemented");
+			goto drop1;
 		case PROTO_LBS_APPEND:
 			state_params(D->S, &blklen, &lastblk, &nextblk);
 			if (R->r.append.blklen != blklen)
@@ -105,6 +105,9 @@ gotrequest(void * cookie, int status)
 			if (s3state_get(D->S, R, callback_get, D))
 				goto err1;
 			break;
+		case PROTO_LBS_GETV:
+			warn0("PROTO_LBS_GETV is not implemented in lbs-s3");
+			goto drop1;
 		case PROTO_LBS_APPEND:
 			if (R->r.append.blklen != D->S->blklen)
 				goto drop2;
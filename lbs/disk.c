@@ -1,3 +1,11 @@
+#ifdef APISUPPORT_CONFIG_FILE
+#include APISUPPORT_CONFIG_FILE
+#endif
+
+/**
+ * APISUPPORT CFLAGS: NONPOSIX_DIRECTIO
+ */
+
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -5,6 +13,8 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "noeintr.h"
@@ -17,6 +27,45 @@
 #define O_BINARY 0
 #endif
 
+/* Open flags for bypassing the kernel's buffer cache, if possible. */
+#ifdef APISUPPORT_NONPOSIX_DIRECTIO
+#define DIRECT_FLAGS O_DIRECT
+#else
+#define DIRECT_FLAGS 0
+#endif
+
+/**
+ * disk_direct_supported(void):
+ * Return non-zero if direct (uncached) I/O is available on this platform.
+ */
+int
+disk_direct_supported(void)
+{
+
+	return (DIRECT_FLAGS != 0);
+}
+
+/**
+ * disk_allocbuf(nbytes):
+ * Allocate a buffer of ${nbytes} bytes which is suitably aligned for direct
+ * I/O.  The buffer should be freed with free().
+ */
+uint8_t *
+disk_allocbuf(size_t nbytes)
+{
+	void * buf;
+	int rc;
+
+	/* Allocate an aligned buffer. */
+	if ((rc = posix_memalign(&buf, DISK_DIRECT_ALIGN, nbytes)) != 0) {
+		errno = rc;
+		return (NULL);
+	}
+
+	/* Success! */
+	return (buf);
+}
+
 /**
  * disk_syncdir(path):
  * Make sure the directory ${path} is synced to disk.  On some systems, it is
@@ -61,23 +110,27 @@ err0:
 }
 
 /**
- * disk_read(path, offset, nbytes, buf):
- * Read ${nbytes} bytes from position ${offset} in file ${path} into the
- * buffer ${buf}.  Treat EOF as an error.  If the file ${path} does not
- * exist, fail and return with errno set to ENOENT.
+ * disk_open(path, direct):
+ * Open the file ${path} for reading and return a file descriptor.  If the
+ * file ${path} does not exist, fail and return with errno set to ENOENT.  If
+ * ${direct} is non-zero, bypass the kernel's buffer cache; reads must then
+ * use buffers from disk_allocbuf() and be aligned to DISK_DIRECT_ALIGN.
  */
 int
-disk_read(const char * path, off_t offset, size_t nbytes, uint8_t * buf)
+disk_open(const char * path, int direct)
 {
+	int flags = O_RDONLY | O_BINARY;
 	int fd;
-	size_t bufpos;
-	ssize_t lenread;
+
+	/* Are we bypassing the buffer cache? */
+	if (direct)
+		flags |= DIRECT_FLAGS;
 
 	/*
 	 * Attempt to open the file.  Pass an errno value of ENOENT back
 	 * without printing a warning, since it might be a non-error.
 	 */
-	while ((fd = open(path, O_RDONLY | O_BINARY)) == -1) {
+	while ((fd = open(path, flags)) == -1) {
 		/* Try again on EINTR. */
 		if (errno == EINTR)
 			continue;
@@ -91,21 +144,36 @@ disk_read(const char * path, off_t offset, size_t nbytes, uint8_t * buf)
 		goto err0;
 	}
 
-	/* Seek to the appropriate position. */
-	if (lseek(fd, offset, SEEK_SET) == -1) {
-		warnp("lseek(%s, %" PRIu64 ")", path, (uint64_t)(offset));
-		goto err1;
-	}
+	/* Success! */
+	return (fd);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * disk_pread(fd, offset, nbytes, buf):
+ * Read ${nbytes} bytes from position ${offset} in the file open as ${fd}
+ * into the buffer ${buf}.  Treat EOF as an error.
+ */
+int
+disk_pread(int fd, off_t offset, size_t nbytes, uint8_t * buf)
+{
+	size_t bufpos;
+	ssize_t lenread;
 
 	/* Read into the buffer. */
 	for (bufpos = 0; bufpos < nbytes; bufpos += (size_t)lenread) {
 		/* Read some bytes. */
-		lenread = read(fd, &buf[bufpos], nbytes - bufpos);
+		lenread = pread(fd, &buf[bufpos], nbytes - bufpos,
+		    offset + (off_t)bufpos);
 
 		/* EOF? */
 		if (lenread == 0) {
-			warn0("Unexpected EOF reading file: %s", path);
-			goto err1;
+			warn0("Unexpected EOF reading block file at"
+			    " offset %" PRIu64, (uint64_t)(offset));
+			goto err0;
 		}
 
 		/* EINTR is harmless. */
@@ -114,15 +182,83 @@ disk_read(const char * path, off_t offset, size_t nbytes, uint8_t * buf)
 
 		/* Print a warning and fail on other errors. */
 		if (lenread == -1) {
-			warnp("Error reading file: %s", path);
-			goto err1;
+			warnp("pread");
+			goto err0;
 		}
 	}
 
-	/* Close the file. */
-	while (close(fd)) {
-		if (errno != EINTR) {
-			warnp("close(%s)", path);
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * disk_openw(path, create, direct):
+ * Open the file ${path} for writing and return a file descriptor.  If
+ * ${create} is non-zero, create the file (which should not exist yet) with
+ * 0600 permissions.  If ${direct} is non-zero, bypass the kernel's buffer
+ * cache.
+ */
+int
+disk_openw(const char * path, int create, int direct)
+{
+	int flags = O_WRONLY | O_BINARY;
+	int fd;
+
+	/* Are we bypassing the buffer cache? */
+	if (direct)
+		flags |= DIRECT_FLAGS;
+
+	/* Open or create the file, depending on ${create}. */
+	do {
+		if (create)
+			fd = open(path, flags | O_CREAT | O_EXCL,
+			    S_IRUSR | S_IWUSR);
+		else
+			fd = open(path, flags);
+	} while ((fd == -1) && (errno == EINTR));
+
+	/* Did we fail? */
+	if (fd == -1) {
+		warnp("open(%s)", path);
+		goto err0;
+	}
+
+	/* Success! */
+	return (fd);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * disk_pwrite(fd, offset, nbytes, buf):
+ * Write ${nbytes} bytes from ${buf} to position ${offset} in the file open
+ * as ${fd}.
+ */
+int
+disk_pwrite(int fd, off_t offset, size_t nbytes, const uint8_t * buf)
+{
+	size_t bufpos;
+	ssize_t lenwrit;
+
+	/* Write from the buffer. */
+	for (bufpos = 0; bufpos < nbytes; bufpos += (size_t)lenwrit) {
+		/* Write some bytes. */
+		lenwrit = pwrite(fd, &buf[bufpos], nbytes - bufpos,
+		    offset + (off_t)bufpos);
+
+		/* EINTR is harmless. */
+		if ((lenwrit == -1) && (errno == EINTR))
+			lenwrit = 0;
+
+		/* Print a warning and fail on other errors. */
+		if (lenwrit == -1) {
+			warnp("pwrite");
 			goto err0;
 		}
 	}
@@ -130,34 +266,126 @@ disk_read(const char * path, off_t offset, size_t nbytes, uint8_t * buf)
 	/* Success! */
 	return (0);
 
-err1:
-	if (close(fd))
-		warnp("close");
 err0:
 	/* Failure! */
 	return (-1);
 }
 
 /**
- * disk_write(path, creat, nbytes, buf, nosync):
+ * disk_prealloc(fd, len):
+ * Make sure that space is allocated for the first ${len} bytes of the file
+ * open as ${fd}, if the platform and filesystem support this.
+ */
+int
+disk_prealloc(int fd, off_t len)
+{
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+	int rc;
+
+	/* Allocate space; posix_fallocate returns an error number. */
+	while ((rc = posix_fallocate(fd, 0, len)) == EINTR)
+		continue;
+
+	/* Not all filesystems support preallocation; that's fine. */
+	if ((rc == EINVAL) || (rc == EOPNOTSUPP))
+		rc = 0;
+
+	/* Anything else is an error. */
+	if (rc != 0) {
+		warn0("posix_fallocate: %s", strerror(rc));
+		goto err0;
+	}
+#else
+	(void)fd; /* UNUSED */
+	(void)len; /* UNUSED */
+#endif
+
+	/* Success! */
+	return (0);
+
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+err0:
+	/* Failure! */
+	return (-1);
+#endif
+}
+
+/**
+ * disk_sync(fd, dataonly):
+ * Flush the file open as ${fd} to disk.  If ${dataonly} is non-zero, only
+ * flush data and the metadata needed to read it, if the platform allows.
+ */
+int
+disk_sync(int fd, int dataonly)
+{
+	int rc;
+
+	/* Flush the file, retrying on EINTR. */
+	do {
+#if defined(_POSIX_SYNCHRONIZED_IO) && (_POSIX_SYNCHRONIZED_IO > 0)
+		if (dataonly)
+			rc = fdatasync(fd);
+		else
+			rc = fsync(fd);
+#else
+		(void)dataonly; /* UNUSED */
+		rc = fsync(fd);
+#endif
+	} while ((rc == -1) && (errno == EINTR));
+
+	/* Did we fail? */
+	if (rc) {
+		warnp("fsync");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * disk_write(path, creat, nbytes, buf, nosync, direct):
  * Append ${nbytes} from ${buf} to the end of the file ${path} and fsync.  If
  * ${creat} is non-zero, create the file (which should not exist yet) first
- * with 0600 permissions.  If ${nosync} is non-zero, skip the fsync.
+ * with 0600 permissions.  If ${nosync} is non-zero, skip the fsync.  If
+ * ${direct} is non-zero, bypass the kernel's buffer cache; ${nbytes} and the
+ * length of the file must then be multiples of DISK_DIRECT_ALIGN.
  */
 int
 disk_write(const char * path, int create, size_t nbytes, const uint8_t * buf,
-    int nosync)
+    int nosync, int direct)
 {
+	uint8_t * abuf = NULL;	/* free(NULL) simplifies error path. */
+	int flags = O_WRONLY | O_BINARY | O_APPEND;
 	int fd;
 
+	/* Are we bypassing the buffer cache? */
+	if (direct) {
+		flags |= DIRECT_FLAGS;
+
+		/* Copy into an aligned buffer if necessary. */
+		if ((uintptr_t)buf % DISK_DIRECT_ALIGN) {
+			if ((abuf = disk_allocbuf(nbytes)) == NULL) {
+				warnp("posix_memalign");
+				goto err0;
+			}
+			memcpy(abuf, buf, nbytes);
+			buf = abuf;
+		}
+	}
+
 	/* Open or create the file, depending on ${creat}. */
 	do {
 		/* Attempt to open/create. */
 		if (create) {
-			fd = open(path, O_WRONLY | O_BINARY | O_APPEND |
-			    O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+			fd = open(path, flags | O_CREAT | O_EXCL,
+			    S_IRUSR | S_IWUSR);
 		} else {
-			fd = open(path, O_WRONLY | O_BINARY | O_APPEND);
+			fd = open(path, flags);
 		}
 
 		/* If we hit EINTR, try again. */
@@ -191,6 +419,9 @@ disk_write(const char * path, int create, size_t nbytes, const uint8_t * buf,
 		}
 	}
 
+	/* Free the aligned copy, if we made one. */
+	free(abuf);
+
 	/* Success! */
 	return (0);
 
@@ -198,6 +429,8 @@ err1:
 	if (close(fd))
 		warnp("close");
 err0:
+	free(abuf);
+
 	/* Failure! */
 	return (-1);
 }
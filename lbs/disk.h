@@ -1,9 +1,26 @@
 #ifndef DISK_H_
 #define DISK_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
 
+/* Alignment of buffers, offsets, and lengths for direct I/O. */
+#define DISK_DIRECT_ALIGN	4096
+
+/**
+ * disk_direct_supported(void):
+ * Return non-zero if direct (uncached) I/O is available on this platform.
+ */
+int disk_direct_supported(void);
+
+/**
+ * disk_allocbuf(nbytes):
+ * Allocate a buffer of ${nbytes} bytes which is suitably aligned for direct
+ * I/O.  The buffer should be freed with free().
+ */
+uint8_t * disk_allocbuf(size_t);
+
 /**
  * disk_syncdir(path):
  * Make sure the directory ${path} is synced to disk.  On some systems, it is
@@ -15,19 +32,59 @@
 int disk_syncdir(const char *);
 
 /**
- * disk_read(path, offset, nbytes, buf):
- * Read ${nbytes} bytes from position ${offset} in file ${path} into the
- * buffer ${buf}.  Treat EOF as an error.  If the file ${path} does not
- * exist, fail and return with errno set to ENOENT.
+ * disk_open(path, direct):
+ * Open the file ${path} for reading and return a file descriptor.  If the
+ * file ${path} does not exist, fail and return with errno set to ENOENT.  If
+ * ${direct} is non-zero, bypass the kernel's buffer cache; reads must then
+ * use buffers from disk_allocbuf() and be aligned to DISK_DIRECT_ALIGN.
  */
-int disk_read(const char *, off_t, size_t, uint8_t *);
+int disk_open(const char *, int);
 
 /**
- * disk_write(path, creat, nbytes, buf, nosync):
+ * disk_pread(fd, offset, nbytes, buf):
+ * Read ${nbytes} bytes from position ${offset} in the file open as ${fd}
+ * into the buffer ${buf}.  Treat EOF as an error.
+ */
+int disk_pread(int, off_t, size_t, uint8_t *);
+
+/**
+ * disk_write(path, creat, nbytes, buf, nosync, direct):
  * Append ${nbytes} from ${buf} to the end of the file ${path} and fsync.  If
  * ${creat} is non-zero, create the file (which should not exist yet) first
- * with 0600 permissions.  If ${nosync} is non-zero, skip the fsync.
+ * with 0600 permissions.  If ${nosync} is non-zero, skip the fsync.  If
+ * ${direct} is non-zero, bypass the kernel's buffer cache; ${nbytes} and the
+ * length of the file must then be multiples of DISK_DIRECT_ALIGN.
+ */
+int disk_write(const char *, int, size_t, const uint8_t *, int, int);
+
+/**
+ * disk_openw(path, create, direct):
+ * Open the file ${path} for writing and return a file descriptor.  If
+ * ${create} is non-zero, create the file (which should not exist yet) with
+ * 0600 permissions.  If ${direct} is non-zero, bypass the kernel's buffer
+ * cache.
+ */
+int disk_openw(const char *, int, int);
+
+/**
+ * disk_pwrite(fd, offset, nbytes, buf):
+ * Write ${nbytes} bytes from ${buf} to position ${offset} in the file open
+ * as ${fd}.
+ */
+int disk_pwrite(int, off_t, size_t, const uint8_t *);
+
+/**
+ * disk_prealloc(fd, len):
+ * Make sure that space is allocated for the first ${len} bytes of the file
+ * open as ${fd}, if the platform and filesystem support this.
+ */
+int disk_prealloc(int, off_t);
+
+/**
+ * disk_sync(fd, dataonly):
+ * Flush the file open as ${fd} to disk.  If ${dataonly} is non-zero, only
+ * flush data and the metadata needed to read it, if the platform allows.
  */
-int disk_write(const char *, int, size_t, const uint8_t *, int);
+int disk_sync(int, int);
 
 #endif /* !DISK_H_ */
@@ -150,6 +150,10 @@ gotrequest(void * cookie, int status)
 			if (dispatch_request_get(D, R))
 				goto err0;
 			break;
+		case PROTO_LBS_GETV:
+			if (dispatch_request_getv(D, R))
+				goto err0;
+			break;
 		case PROTO_LBS_APPEND:
 			/* Make sure the (implied) block length is correct. */
 			if (R->r.append.blklen != D->blocklen) {
@@ -197,12 +201,16 @@ err0:
 }
 
 /**
- * dispatch_init(S, blocklen, nreaders):
+ * dispatch_init(S, blocklen, nreaders, useuring):
  * Initialize a dispatcher to manage requests to storage state ${S} with
- * block size ${blocklen}, using ${nreaders} read threads.
+ * block size ${blocklen}, using ${nreaders} read threads.  If ${useuring} is
+ * non-zero, perform reads via io_uring with up to ${nreaders} in flight
+ * instead of using read threads, and perform appends via io_uring where
+ * possible.
  */
 struct dispatch_state *
-dispatch_init(struct storage_state * S, size_t blocklen, size_t nreaders)
+dispatch_init(struct storage_state * S, size_t blocklen, size_t nreaders,
+    int useuring)
 {
 	struct dispatch_state * D;
 	size_t nworkers;
@@ -243,32 +251,46 @@ dispatch_init(struct storage_state * S, size_t blocklen, size_t nreaders)
 		goto err3;
 	}
 
-	/* Create worker threads. */
+	/* Set up io_uring for reads and appends, if requested. */
+	D->uring = NULL;
+	if (useuring && dispatch_uring_init(D)) {
+		warnp("Cannot set up io_uring");
+		goto err4;
+	}
+
+	/*
+	 * Create worker threads.  If we're reading via io_uring, we only
+	 * need the writer thread (for appends which io_uring can't perform)
+	 * and the deleter thread.
+	 */
 	nworkers = D->nreaders + 2;
 	if (IMALLOC(D->workers, nworkers, struct workctl *)) {
 		warnp("malloc");
-		goto err4;
+		goto err5;
 	}
 	for (i = 0; i < nworkers; i++)
 		D->workers[i] = NULL;
-	for (i = 0; i < nworkers; i++) {
+	for (i = (D->uring != NULL) ? D->nreaders : 0; i < nworkers; i++) {
 		if ((D->workers[i] =
 		    worker_create(i, S, D->spair[1])) == NULL) {
 			warnp("Cannot create worker thread");
-			goto err5;
+			goto err6;
 		}
 	}
 
 	/* Success! */
 	return (D);
 
-err5:
+err6:
 	for (i = 0; i < nworkers; i++) {
 		if (D->workers[i] == NULL)
 			continue;
 		worker_kill(D->workers[i]);
 	}
 	free(D->workers);
+err5:
+	if (D->uring != NULL)
+		dispatch_uring_done(D);
 err4:
 	network_read_cancel(D->wakeup_cookie);
 err3:
@@ -430,6 +452,8 @@ dispatch_done(struct dispatch_state * D)
 
 	/* Shut down the worker threads. */
 	for (i = 0; i < D->nreaders + 2; i++) {
+		if (D->workers[i] == NULL)
+			continue;
 		if (worker_kill(D->workers[i])) {
 			warnp("Cannot destroy worker thread");
 			rc = -1;
@@ -437,6 +461,10 @@ dispatch_done(struct dispatch_state * D)
 	}
 	free(D->workers);
 
+	/* Shut down io_uring (if applicable). */
+	if (D->uring != NULL)
+		dispatch_uring_done(D);
+
 	/* Stop reading work completion messages. */
 	network_read_cancel(D->wakeup_cookie);
 
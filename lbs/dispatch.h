@@ -9,11 +9,15 @@ struct dispatch_state;
 struct storage_state;
 
 /**
- * dispatch_init(S, blocklen, nreaders):
+ * dispatch_init(S, blocklen, nreaders, useuring):
  * Initialize a dispatcher to manage requests to storage state ${S} with
- * block size ${blocklen}, using ${nreaders} read threads.
+ * block size ${blocklen}, using ${nreaders} read threads.  If ${useuring} is
+ * non-zero, perform reads via io_uring with up to ${nreaders} in flight
+ * instead of using read threads, and perform appends via io_uring where
+ * possible.
  */
-struct dispatch_state * dispatch_init(struct storage_state *, size_t, size_t);
+struct dispatch_state * dispatch_init(struct storage_state *, size_t, size_t,
+    int);
 
 /**
  * dispatch_accept(D, s):
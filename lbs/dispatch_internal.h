@@ -9,12 +9,16 @@ struct netbuf_read;
 struct netbuf_write;
 struct proto_lbs_request;
 struct storage_state;
+struct uring;
+struct uring_append;
+struct uring_read;
 
 /* Linked list structure for queue of pending block reads. */
 struct readq {
 	struct readq * next;		/* Next pending read. */
-	uint64_t reqID;			/* Packet ID of GET request. */
-	uint64_t blkno;			/* Requested block #. */
+	uint64_t reqID;			/* Packet ID of GET(V) request. */
+	uint64_t blkno;			/* First requested block #. */
+	uint32_t nblks;			/* Number of requested blocks. */
 };
 
 /* State of the work dispatcher. */
@@ -29,6 +33,11 @@ struct dispatch_state {
 	size_t nreaders_idle;		/* How many readers are idle... */
 	size_t * readers_idle;		/* ... and what are their #s? */
 
+	/* Reads via io_uring; if used, readers are slots in ureads. */
+	struct uring * uring;		/* Ring, or NULL if using threads. */
+	struct uring_read * ureads;	/* Reads in progress. */
+	struct uring_append * uappend;	/* APPEND via io_uring, if any. */
+
 	/* Storage management. */
 	size_t blocklen;		/* Block length. */
 	struct storage_state * sstate;	/* Back-end storage state. */
@@ -79,6 +88,13 @@ int dispatch_request_params2(struct dispatch_state *,
 int dispatch_request_get(struct dispatch_state *,
     struct proto_lbs_request *);
 
+/**
+ * dispatch_request_getv(dstate, R):
+ * Handle and free a GETV request (queue it if necessary).
+ */
+int dispatch_request_getv(struct dispatch_state *,
+    struct proto_lbs_request *);
+
 /**
  * dispatch_request_pokereadq(dstate):
  * Launch queued GET(s) if possible.
@@ -99,4 +115,44 @@ int dispatch_request_append(struct dispatch_state *,
 int dispatch_request_free(struct dispatch_state *,
     struct proto_lbs_request *);
 
+/**
+ * dispatch_uring_init(dstate):
+ * Set up the dispatcher ${dstate} to perform GETs and APPENDs via io_uring,
+ * with up to ${dstate}->nreaders reads in flight at once.
+ */
+int dispatch_uring_init(struct dispatch_state *);
+
+/**
+ * dispatch_uring_launch(dstate, reqID, blkno, nblks):
+ * Start reading the ${nblks} blocks starting at block ${blkno} for the GET
+ * or GETV request ${reqID} in an idle io_uring read slot.  The read is not
+ * submitted until dispatch_uring_submit is called.
+ */
+int dispatch_uring_launch(struct dispatch_state *, uint64_t, uint64_t,
+    uint32_t);
+
+/**
+ * dispatch_uring_append(dstate, reqID, blkno, nblks, buf):
+ * Start writing the ${nblks} blocks in ${buf} starting at block ${blkno} for
+ * the APPEND request ${reqID}, and syncing them.  Return 1 if the APPEND was
+ * started, in which case ${buf} will be freed once it completes; or 0 if the
+ * APPEND must be performed by the writer thread instead.  No other APPEND
+ * may be in progress.
+ */
+int dispatch_uring_append(struct dispatch_state *, uint64_t, uint64_t,
+    uint64_t, uint8_t *);
+
+/**
+ * dispatch_uring_submit(dstate):
+ * Submit any reads queued by dispatch_uring_launch.
+ */
+int dispatch_uring_submit(struct dispatch_state *);
+
+/**
+ * dispatch_uring_done(dstate):
+ * Stop using io_uring in the dispatcher ${dstate}.  No reads or APPENDs may
+ * be in progress.
+ */
+void dispatch_uring_done(struct dispatch_state *);
+
 #endif /* !DISPATCH_INTERNAL_H_ */
@@ -94,13 +94,10 @@ err1:
 	return (-1);
 }
 
-/**
- * dispatch_request_get(dstate, R):
- * Handle and free a GET request (queue it if necessary).
- */
-int
-dispatch_request_get(struct dispatch_state * dstate,
-    struct proto_lbs_request * R)
+/* Queue a read of ${nblks} blocks starting at ${blkno} for request ${R}. */
+static int
+queueread(struct dispatch_state * dstate, struct proto_lbs_request * R,
+    uint64_t blkno, uint32_t nblks)
 {
 	struct readq * rq;
 
@@ -109,7 +106,8 @@ dispatch_request_get(struct dispatch_state * dstate,
 		goto err1;
 	rq->next = NULL;
 	rq->reqID = R->ID;
-	rq->blkno = R->r.get.blkno;
+	rq->blkno = blkno;
+	rq->nblks = nblks;
 	if (dstate->readq_head == NULL)
 		dstate->readq_head = rq;
 	else
@@ -133,6 +131,30 @@ err0:
 	return (-1);
 }
 
+/**
+ * dispatch_request_get(dstate, R):
+ * Handle and free a GET request (queue it if necessary).
+ */
+int
+dispatch_request_get(struct dispatch_state * dstate,
+    struct proto_lbs_request * R)
+{
+
+	return (queueread(dstate, R, R->r.get.blkno, 1));
+}
+
+/**
+ * dispatch_request_getv(dstate, R):
+ * Handle and free a GETV request (queue it if necessary).
+ */
+int
+dispatch_request_getv(struct dispatch_state * dstate,
+    struct proto_lbs_request * R)
+{
+
+	return (queueread(dstate, R, R->r.getv.blkno, R->r.getv.nblks));
+}
+
 /**
  * dispatch_request_pokereadq(dstate):
  * Launch queued GET(s) if possible.
@@ -149,18 +171,27 @@ dispatch_request_pokereadq(struct dispatch_state * dstate)
 		/* Grab the first read from the queue. */
 		R = dstate->readq_head;
 
-		/* Allocate a buffer to read the block into. */
-		if ((buf = malloc(dstate->blocklen)) == NULL)
-			goto err0;
-
-		/* Grab an idle reader. */
-		reader = dstate->workers[
-		    dstate->readers_idle[dstate->nreaders_idle - 1]];
-		dstate->nreaders_idle -= 1;
-
-		/* Give the reader the work. */
-		if (worker_assign(reader, 0, R->blkno, 0, buf, R->reqID))
-			goto err1;
+		if (dstate->uring != NULL) {
+			/* Queue the read on the ring. */
+			if (dispatch_uring_launch(dstate, R->reqID, R->blkno,
+			    R->nblks))
+				goto err0;
+		} else {
+			/* Allocate a buffer to read the block(s) into. */
+			if ((buf = storage_allocbuf(dstate->sstate,
+			    R->nblks)) == NULL)
+				goto err0;
+
+			/* Grab an idle reader. */
+			reader = dstate->workers[
+			    dstate->readers_idle[dstate->nreaders_idle - 1]];
+			dstate->nreaders_idle -= 1;
+
+			/* Give the reader the work. */
+			if (worker_assign(reader, 0, R->blkno, R->nblks, buf,
+			    R->reqID))
+				goto err1;
+		}
 
 		/* Remove the work from the queue. */
 		dstate->readq_head = R->next;
@@ -169,6 +200,10 @@ dispatch_request_pokereadq(struct dispatch_state * dstate)
 		free(R);
 	}
 
+	/* Submit reads queued on the ring. */
+	if ((dstate->uring != NULL) && dispatch_uring_submit(dstate))
+		goto err0;
+
 	/* Success! */
 	return (0);
 
@@ -208,12 +243,26 @@ dispatch_request_append(struct dispatch_state * dstate,
 		goto badblkno;
 	}
 
-	/* Give the writer the work. */
+	/* We're writing now. */
 	dstate->writer_busy = 1;
+
+	/* Write via io_uring if possible. */
+	if (dstate->uring != NULL) {
+		switch (dispatch_uring_append(dstate, R->ID,
+		    R->r.append.blkno, R->r.append.nblks, R->r.append.buf)) {
+		case -1:
+			goto err1;
+		case 1:
+			goto started;
+		}
+	}
+
+	/* Give the writer the work. */
 	if (worker_assign(writer, 1, R->r.append.blkno, R->r.append.nblks,
 	    R->r.append.buf, R->ID))
 		goto err1;
 
+started:
 	/* Free the request but NOT the buffer, since the thread owns that. */
 	free(R);
 
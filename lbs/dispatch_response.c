@@ -35,17 +35,18 @@ dispatch_response_send(struct dispatch_state * dstate, struct workctl * thread)
 	case 0:	/* read operation. */
 		/* Sanity check. */
 		assert(dstate->blocklen <= UINT32_MAX);
+		assert(nblks <= PROTO_LBS_GETV_MAX);
 
-		/* If we read a block, our status is 0; otherwise, 1. */
-		if (nblks == 1)
+		/* If we read the block(s), our status is 0; otherwise, 1. */
+		if (nblks > 0)
 			status = 0;
 		else
 			status = 1;
 
-		/* Send a response. */
+		/* Send a response; a GET looks like a one-block GETV. */
 		dstate->npending--;
-		if (proto_lbs_response_get(dstate->writeq, reqID, status,
-		    (uint32_t)dstate->blocklen, buf))
+		if (proto_lbs_response_getv(dstate->writeq, reqID, status,
+		    (uint32_t)nblks, (uint32_t)dstate->blocklen, buf))
 			goto err1;
 
 		/* Free the buffer holding read data. */
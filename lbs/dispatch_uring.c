@@ -0,0 +1,503 @@
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "events.h"
+#include "imalloc.h"
+#include "proto_lbs.h"
+#include "warnp.h"
+
+#include "storage.h"
+#include "uring.h"
+
+#include "dispatch_internal.h"
+
+/* A GET or GETV being read via io_uring. */
+struct uring_read {
+	uint64_t reqID;			/* Packet ID of GET(V) request. */
+	uint32_t nblks;			/* Number of blocks requested. */
+	uint64_t blkno;			/* Next block to read. */
+	size_t nleft;			/* Blocks not yet read. */
+	uint8_t * buf;			/* Buffer holding the blocks. */
+	size_t bufpos;			/* Position of current piece in buf. */
+
+	/* Current piece (blocks in a single file). */
+	int fd;				/* File holding the blocks. */
+	off_t offset;			/* Position of blkno in file. */
+	size_t len;			/* Length of piece. */
+	size_t done;			/* Bytes read so far. */
+};
+
+/* An APPEND being written via io_uring. */
+struct uring_append {
+	uint64_t reqID;			/* Packet ID of APPEND request. */
+	uint64_t blkno;			/* First block being written. */
+	uint64_t nblks;			/* Number of blocks. */
+	uint8_t * buf;			/* Blocks, or NULL if idle. */
+	int fd;				/* File being appended to. */
+	off_t offset;			/* Position of blkno in file. */
+	size_t len;			/* Length of blocks. */
+	size_t done;			/* Bytes written so far. */
+	int dosync;			/* Sync the file after writing? */
+};
+
+/* Cookies for APPEND operations; read cookies are slots < nreaders. */
+#define COOKIE_WRITE	UINT64_MAX
+#define COOKIE_FSYNC	(UINT64_MAX - 1)
+
+/* Queue (the rest of) the current piece of the read ${slot} on the ring. */
+static void
+queueread(struct dispatch_state * D, size_t slot)
+{
+	struct uring_read * U = &D->ureads[slot];
+
+	uring_read(D->uring, U->fd, U->offset + (off_t)U->done,
+	    &U->buf[U->bufpos + U->done], U->len - U->done, slot);
+}
+
+/*
+ * Start reading the next piece of the read ${slot}: As many of the remaining
+ * blocks as are in the same file.  Return 0 if a block does not exist.
+ */
+static int
+startpiece(struct dispatch_state * D, size_t slot)
+{
+	struct uring_read * U = &D->ureads[slot];
+	uint64_t navail;
+
+	/* Find the file holding the next block. */
+	if ((U->fd = storage_read_getfd(D->sstate, U->blkno, &U->offset,
+	    &navail)) == -1) {
+		/* ENOENT means that the block does not exist. */
+		if (errno == ENOENT)
+			return (0);
+
+		/* Anything else is an error. */
+		return (-1);
+	}
+
+	/* Read as many blocks as we need from this file. */
+	if (navail > U->nleft)
+		navail = U->nleft;
+	U->len = (size_t)navail * D->blocklen;
+	U->done = 0;
+	queueread(D, slot);
+
+	/* Success! */
+	return (1);
+}
+
+/* Send a response for the read ${slot} and make the slot available. */
+static int
+finish(struct dispatch_state * D, size_t slot, int status)
+{
+	struct uring_read * U = &D->ureads[slot];
+
+	/* Send a response. */
+	assert(D->blocklen <= UINT32_MAX);
+	D->npending--;
+	if (proto_lbs_response_getv(D->writeq, U->reqID, status, U->nblks,
+	    (uint32_t)D->blocklen, U->buf))
+		goto err0;
+
+	/* Free the buffer and make the slot available again. */
+	free(U->buf);
+	D->readers_idle[D->nreaders_idle++] = slot;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Queue (the rest of) the write for the APPEND on the ring, followed by an
+ * fsync which will only start once the write has completed.
+ */
+static void
+queuewrite(struct dispatch_state * D)
+{
+	struct uring_append * A = D->uappend;
+
+	uring_write(D->uring, A->fd, A->offset + (off_t)A->done,
+	    &A->buf[A->done], A->len - A->done, COOKIE_WRITE, A->dosync);
+	if (A->dosync)
+		uring_fsync(D->uring, A->fd, COOKIE_FSYNC);
+}
+
+/* Record the blocks written for the APPEND and send a response. */
+static int
+finishappend(struct dispatch_state * D)
+{
+	struct uring_append * A = D->uappend;
+	uint64_t blkno;
+
+	/* Close the file and record the new blocks. */
+	if (storage_write_close(D->sstate, A->fd, A->blkno, A->nblks, A->buf))
+		goto err0;
+
+	/* Figure out what the next available block number is. */
+	if ((blkno = storage_nextblock(D->sstate)) == (uint64_t)(-1))
+		goto err0;
+
+	/* Send a response back. */
+	D->npending--;
+	if (proto_lbs_response_append(D->writeq, A->reqID, 0, blkno))
+		goto err0;
+
+	/* Free the buffer; we can accept another APPEND now. */
+	free(A->buf);
+	A->buf = NULL;
+	D->writer_busy = 0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* The write or fsync ${cookie} for the APPEND completed with ${res}. */
+static int
+gotappend(struct dispatch_state * D, uint64_t cookie, int res)
+{
+	struct uring_append * A = D->uappend;
+
+	/* The fsync is cancelled if the write fails or is short. */
+	if ((cookie == COOKIE_FSYNC) && (res == -ECANCELED))
+		return (0);
+
+	/* Retry operations which were interrupted. */
+	if ((res == -EINTR) || (res == -EAGAIN)) {
+		if (cookie == COOKIE_WRITE)
+			queuewrite(D);
+		else
+			uring_fsync(D->uring, A->fd, COOKIE_FSYNC);
+		return (0);
+	}
+
+	/* Any other error is fatal, as in the writer thread. */
+	if (res < 0) {
+		warn0("Failure %s block file: %s",
+		    (cookie == COOKIE_WRITE) ? "writing" : "syncing",
+		    strerror(-res));
+		goto err0;
+	}
+
+	/* The fsync has completed; we're done. */
+	if (cookie == COOKIE_FSYNC)
+		return (finishappend(D));
+
+	/* If we didn't write everything, write the rest. */
+	if (res == 0) {
+		warn0("Unable to write to block file");
+		goto err0;
+	}
+	A->done += (size_t)res;
+	if (A->done < A->len) {
+		queuewrite(D);
+		return (0);
+	}
+
+	/* If we're not waiting for an fsync, we're done. */
+	if (A->dosync == 0)
+		return (finishappend(D));
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Operations on the ring have completed. */
+static int
+gotcompletions(void * cookie)
+{
+	struct dispatch_state * D = cookie;
+	struct uring_read * U;
+	uint64_t slot;
+	int res;
+
+	/* Reset the completion notification before looking for work. */
+	if (uring_ack(D->uring))
+		goto err0;
+
+	/* Handle completed operations. */
+	while (uring_reap(D->uring, &slot, &res)) {
+		/* Is this part of an APPEND? */
+		if ((slot == COOKIE_WRITE) || (slot == COOKIE_FSYNC)) {
+			if (gotappend(D, slot, res))
+				goto err0;
+			continue;
+		}
+
+		/* Otherwise, it's a read. */
+		assert(slot < D->nreaders);
+		U = &D->ureads[slot];
+
+		/* Retry reads which were interrupted. */
+		if ((res == -EINTR) || (res == -EAGAIN)) {
+			queueread(D, (size_t)slot);
+			continue;
+		}
+
+		/* Any other error is fatal, as in the reader threads. */
+		if (res < 0) {
+			warn0("Failure reading block: %s", strerror(-res));
+			goto err0;
+		}
+		if (res == 0) {
+			warn0("Unexpected EOF reading block file");
+			goto err0;
+		}
+
+		/* If we didn't get the whole piece, read the rest. */
+		U->done += (size_t)res;
+		if (U->done < U->len) {
+			queueread(D, (size_t)slot);
+			continue;
+		}
+
+		/* We're done with the file. */
+		if (storage_read_putfd(D->sstate, U->fd))
+			goto err0;
+
+		/* Advance past the blocks we read. */
+		U->blkno += U->len / D->blocklen;
+		U->nleft -= U->len / D->blocklen;
+		U->bufpos += U->len;
+
+		/* If we have more blocks to read, start on the next file. */
+		if (U->nleft > 0) {
+			switch (startpiece(D, (size_t)slot)) {
+			case -1:
+				goto err0;
+			case 0:
+				if (finish(D, (size_t)slot, 1))
+					goto err0;
+				break;
+			}
+			continue;
+		}
+
+		/* Check the blocks against their checksums. */
+		if (storage_read_verify(D->sstate, U->blkno - U->nblks,
+		    U->nblks, U->buf))
+			goto err0;
+
+		/* Send a response. */
+		if (finish(D, (size_t)slot, 0))
+			goto err0;
+	}
+
+	/* Launch queued GETs and submit any new operations or retries. */
+	if (dispatch_request_pokereadq(D))
+		goto err0;
+
+	/* Wait for more completions. */
+	if (events_network_register(gotcompletions, D,
+	    uring_getfd(D->uring), EVENTS_NETWORK_OP_READ)) {
+		warnp("Error waiting for io_uring completions");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * dispatch_uring_init(dstate):
+ * Set up the dispatcher ${dstate} to perform GETs and APPENDs via io_uring,
+ * with up to ${dstate}->nreaders reads in flight at once.
+ */
+int
+dispatch_uring_init(struct dispatch_state * dstate)
+{
+
+	/* Allocate read slots. */
+	if (IMALLOC(dstate->ureads, dstate->nreaders, struct uring_read))
+		goto err0;
+
+	/* Allocate APPEND state. */
+	if ((dstate->uappend = malloc(sizeof(struct uring_append))) == NULL)
+		goto err1;
+	dstate->uappend->buf = NULL;
+
+	/* Create the ring; an APPEND needs room for a write and an fsync. */
+	if ((dstate->uring = uring_init(dstate->nreaders + 2)) == NULL)
+		goto err2;
+
+	/* Wait for completions. */
+	if (events_network_register(gotcompletions, dstate,
+	    uring_getfd(dstate->uring), EVENTS_NETWORK_OP_READ)) {
+		warnp("Error waiting for io_uring completions");
+		goto err3;
+	}
+
+	/* Success! */
+	return (0);
+
+err3:
+	uring_free(dstate->uring);
+err2:
+	free(dstate->uappend);
+err1:
+	free(dstate->ureads);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * dispatch_uring_launch(dstate, reqID, blkno, nblks):
+ * Start reading the ${nblks} blocks starting at block ${blkno} for the GET
+ * or GETV request ${reqID} in an idle io_uring read slot.  The read is not
+ * submitted until dispatch_uring_submit is called.
+ */
+int
+dispatch_uring_launch(struct dispatch_state * dstate, uint64_t reqID,
+    uint64_t blkno, uint32_t nblks)
+{
+	struct uring_read * U;
+	size_t slot;
+
+	/* Grab an idle slot. */
+	assert(dstate->nreaders_idle > 0);
+	slot = dstate->readers_idle[--dstate->nreaders_idle];
+	U = &dstate->ureads[slot];
+
+	/* Allocate a buffer to read the blocks into. */
+	if ((U->buf = storage_allocbuf(dstate->sstate, nblks)) == NULL)
+		goto err1;
+	U->reqID = reqID;
+	U->nblks = nblks;
+	U->blkno = blkno;
+	U->nleft = nblks;
+	U->bufpos = 0;
+
+	/* If the blocks are held in memory, respond now. */
+	switch (storage_read_cached(dstate->sstate, blkno, nblks, U->buf)) {
+	case -1:
+		goto err2;
+	case 1:
+		return (finish(dstate, slot, 0));
+	}
+
+	/* Start reading; if a block does not exist, respond now. */
+	switch (startpiece(dstate, slot)) {
+	case -1:
+		goto err2;
+	case 0:
+		return (finish(dstate, slot, 1));
+	}
+
+	/* Success! */
+	return (0);
+
+err2:
+	free(U->buf);
+err1:
+	dstate->nreaders_idle++;
+
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * dispatch_uring_append(dstate, reqID, blkno, nblks, buf):
+ * Start writing the ${nblks} blocks in ${buf} starting at block ${blkno} for
+ * the APPEND request ${reqID}, and syncing them.  Return 1 if the APPEND was
+ * started, in which case ${buf} will be freed once it completes; or 0 if the
+ * APPEND must be performed by the writer thread instead.  No other APPEND
+ * may be in progress.
+ */
+int
+dispatch_uring_append(struct dispatch_state * dstate, uint64_t reqID,
+    uint64_t blkno, uint64_t nblks, uint8_t * buf)
+{
+	struct uring_append * A = dstate->uappend;
+
+	/* Sanity check. */
+	assert(A->buf == NULL);
+
+	/* Find out where the blocks go, if we can write them here. */
+	switch (storage_write_open(dstate->sstate, blkno, nblks, &A->fd,
+	    &A->offset, &A->dosync)) {
+	case -1:
+		goto err0;
+	case 0:
+		return (0);
+	}
+
+	/* Record the APPEND. */
+	A->reqID = reqID;
+	A->blkno = blkno;
+	A->nblks = nblks;
+	A->buf = buf;
+	A->len = (size_t)(nblks * dstate->blocklen);
+	A->done = 0;
+
+	/* Queue the write and fsync, and start them. */
+	queuewrite(dstate);
+	if (uring_submit(dstate->uring))
+		goto err1;
+
+	/* Success! */
+	return (1);
+
+err1:
+	A->buf = NULL;
+	close(A->fd);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * dispatch_uring_submit(dstate):
+ * Submit any reads queued by dispatch_uring_launch.
+ */
+int
+dispatch_uring_submit(struct dispatch_state * dstate)
+{
+
+	return (uring_submit(dstate->uring));
+}
+
+/**
+ * dispatch_uring_done(dstate):
+ * Stop using io_uring in the dispatcher ${dstate}.  No reads or APPENDs may
+ * be in progress.
+ */
+void
+dispatch_uring_done(struct dispatch_state * dstate)
+{
+
+	/* Sanity checks. */
+	assert(dstate->nreaders_idle == dstate->nreaders);
+	assert(dstate->uappend->buf == NULL);
+
+	/* Stop waiting for completions. */
+	if (events_network_cancel(uring_getfd(dstate->uring),
+	    EVENTS_NETWORK_OP_READ))
+		warnp("Error cancelling io_uring completion wait");
+
+	/* Free the ring, the APPEND state, and the read slots. */
+	uring_free(dstate->uring);
+	free(dstate->uappend);
+	free(dstate->ureads);
+}
@@ -21,7 +21,8 @@ usage(void)
 
 	fprintf(stderr, "usage: kivaloo-lbs -s <lbs socket> -d <storage dir> "
 	    "-b <block size> [-n <# of readers>] [-p <pidfile>] "
-	    "[-1] [-L] [-l <read latency in ns>]\n");
+	    "[-1] [-L] [-l <read latency in ns>] [-u] [-D] "
+	    "[-c <# of cached blocks>] [-P] [-C]\n");
 	fprintf(stderr, "       kivaloo-lbs --version\n");
 	exit(1);
 }
@@ -44,11 +45,16 @@ main(int argc, char * argv[])
 	char * opt_s = NULL;
 	char * opt_d = NULL;
 	size_t opt_b = (size_t)(-1);
+	size_t opt_c = 0;
+	int opt_C = 0;
+	int opt_D = 0;
 	size_t opt_n = 16;
 	char * opt_p = NULL;
+	int opt_P = 0;
 	int opt_1 = 0;
 	long opt_l = 0;
 	int opt_L = 0;
+	int opt_u = 0;
 
 	/* Working variables. */
 	struct sock_addr ** sas;
@@ -67,12 +73,31 @@ main(int argc, char * argv[])
 				goto err1;
 			}
 			break;
+		GETOPT_OPTARG("-c"):
+			if (opt_c != 0)
+				usage();
+			if (PARSENUM(&opt_c, optarg, 1, 1000000)) {
+				warn0("Number of cached blocks must be in"
+				    " [1, 10^6]");
+				goto err1;
+			}
+			break;
+		GETOPT_OPT("-C"):
+			if (opt_C != 0)
+				usage();
+			opt_C = 1;
+			break;
 		GETOPT_OPTARG("-d"):
 			if (opt_d != NULL)
 				usage();
 			if ((opt_d = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPT("-D"):
+			if (opt_D != 0)
+				usage();
+			opt_D = 1;
+			break;
 		GETOPT_OPTARG("-l"):
 			if (opt_l != 0)
 				usage();
@@ -100,12 +125,22 @@ main(int argc, char * argv[])
 			if ((opt_p = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPT("-P"):
+			if (opt_P != 0)
+				usage();
+			opt_P = 1;
+			break;
 		GETOPT_OPTARG("-s"):
 			if (opt_s != NULL)
 				usage();
 			if ((opt_s = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPT("-u"):
+			if (opt_u != 0)
+				usage();
+			opt_u = 1;
+			break;
 		GETOPT_OPT("--version"):
 			fprintf(stderr, "kivaloo-lbs @VERSION@\n");
 			exit(0);
@@ -137,6 +172,10 @@ main(int argc, char * argv[])
 		usage();
 	if (opt_b == (size_t)(-1))
 		usage();
+	if (opt_u && (opt_l != 0)) {
+		warn0("Read latency cannot be used with io_uring");
+		goto err1;
+	}
 
 	/* Resolve the listening address. */
 	if ((sas = sock_resolve(opt_s)) == NULL) {
@@ -156,7 +195,8 @@ main(int argc, char * argv[])
 		goto err2;
 
 	/* Initialize the storage back-end. */
-	if ((S = storage_init(opt_d, opt_b, opt_l, opt_L)) == NULL) {
+	if ((S = storage_init(opt_d, opt_b, opt_l, opt_L, opt_D,
+	    opt_c, opt_P, opt_C)) == NULL) {
 		warnp("Error initializing storage directory: %s", opt_d);
 		goto err3;
 	}
@@ -174,7 +214,7 @@ main(int argc, char * argv[])
 	}
 
 	/* Initialize the dispatcher. */
-	if ((D = dispatch_init(S, opt_b, opt_n)) == NULL) {
+	if ((D = dispatch_init(S, opt_b, opt_n, opt_u)) == NULL) {
 		warnp("Error initializing work dispatcher");
 		goto err4;
 	}
@@ -7,39 +7,118 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "crc32c.h"
 #include "elasticqueue.h"
 #include "warnp.h"
 
 #include "disk.h"
+#include "storage_blkcache.h"
+#include "storage_crcs.h"
+#include "storage_fdcache.h"
 #include "storage_findfiles.h"
 #include "storage_internal.h"
+#include "storage_pfile.h"
 #include "storage_util.h"
 
 #include "storage.h"
 
+/*
+ * Start a new block file once the last file holds more than 1/NEWFILE_FRAC
+ * of the stored blocks.  Since blocks can only be freed by deleting whole
+ * files, this limits the space held by freed blocks to a fraction of the
+ * stored data; finding a block takes time logarithmic in the number of
+ * files, so we can afford to keep the files small.
+ */
+#define NEWFILE_FRAC	64
+
+/*
+ * Maximum number of block files to keep open for reading.  There are about
+ * NEWFILE_FRAC live block files once the stored data stops growing, and each
+ * may have a checksum file; leave room for both, with some to spare, so that
+ * random reads across all the stored data don't miss the cache.
+ */
+#define FDCACHE_NFDS	(4 * NEWFILE_FRAC)
+
 /* State of an individual file. */
 struct file_state {
 	uint64_t start;			/* First block # in file. */
 	uint64_t len;			/* Length of file in blocks. */
+	int pfile;			/* Preallocated file. */
+	int crcs;			/* Has a checksum file. */
 };
 
+/*
+ * Set ${nblks} to the number of blocks in the block file ${sf}.  If ${last}
+ * is non-zero, this is the final file and may be truncated.
+ */
+static int
+getlen(struct storage_state * S, struct storage_file * sf, int last,
+    uint64_t * nblks)
+{
+	char * s;
+	off_t num_blocks;
+
+	/* Does it have a non-integer number of blocks? */
+	if ((sf->len % (off_t)S->blocklen) != 0) {
+		/* Not permitted for files in the middle. */
+		if (!last) {
+			warn0("Block storage file has non-integer"
+			    " number of blocks: %016" PRIx64, sf->fileno);
+			goto err0;
+		}
+
+		/*
+		 * The final file may have a non-integer number of blocks due
+		 * to an interrupted write; just remove any partial block.
+		 */
+		if ((s = storage_util_mkpath(S, sf->fileno,
+		    STORAGE_UTIL_BLKS)) == NULL)
+			goto err0;
+		if (truncate(s, sf->len - (sf->len % (off_t)S->blocklen)))
+			goto err1;
+		free(s);
+	}
+
+	/* Compute number of blocks. */
+	num_blocks = sf->len / (off_t)S->blocklen;
+#if UINTMAX_MAX > UINT64_MAX
+	if ((uintmax_t)num_blocks > (uintmax_t)UINT64_MAX)
+		goto err0;
+#endif
+	*nblks = (uint64_t)num_blocks;
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 /**
- * storage_init(storagedir, blklen, latency, nosync):
+ * storage_init(storagedir, blklen, latency, nosync, direct, ncache,
+ *     prealloc, crcs):
  * Initialize and return the storage state for ${blklen}-byte blocks of data
  * stored in ${storagedir}.  Sleep ${latency} ns in storage_read() calls.  If
- * ${nosync} is non-zero, don't use fsync.
+ * ${nosync} is non-zero, don't use fsync.  If ${direct} is non-zero, bypass
+ * the kernel's buffer cache.  If ${ncache} is non-zero, keep the ${ncache}
+ * most recently written blocks in memory.  If ${prealloc} is non-zero,
+ * create new block files as preallocated files.  If ${crcs} is non-zero,
+ * store checksums of the blocks in new block files.
  */
 struct storage_state *
 storage_init(const char * storagedir, size_t blocklen, long latency,
-    int nosync)
+    int nosync, int direct, size_t ncache, int prealloc, int crcs)
 {
 	struct storage_state * S;
 	struct elasticqueue * files;
 	struct storage_file * sf;
 	struct file_state fs;
-	char * s;
+	struct file_state * fsp;
+	CRC32C_CTX ctx;
 	int rc;
-	off_t num_blocks;
 
 	/* Sanity-check the block size. */
 	assert(blocklen > 0);
@@ -49,6 +128,17 @@ storage_init(const char * storagedir, size_t blocklen, long latency,
 	assert(blocklen <= INT32_MAX);
 #endif
 
+	/* Make sure we can do direct I/O if requested. */
+	if (direct && !disk_direct_supported()) {
+		warn0("Direct I/O is not supported on this platform");
+		goto err0;
+	}
+	if (direct && (blocklen % DISK_DIRECT_ALIGN)) {
+		warn0("Block size must be a multiple of %d for direct I/O",
+		    DISK_DIRECT_ALIGN);
+		goto err0;
+	}
+
 	/* Allocate structure and fill in static data. */
 	if ((S = malloc(sizeof(struct storage_state))) == NULL)
 		goto err0;
@@ -56,6 +146,22 @@ storage_init(const char * storagedir, size_t blocklen, long latency,
 	S->blocklen = blocklen;
 	S->latency = latency;
 	S->nosync = nosync;
+	S->direct = direct;
+	S->prealloc = prealloc;
+	S->hdrblks = storage_pfile_hdrblks(blocklen);
+	S->wfd = -1;
+	S->crcs = crcs;
+	S->verify = crcs;
+	S->tcrcs_fileno = (uint64_t)(-1);
+	S->tcrcs = NULL;
+	S->tcrcs_alloc = 0;
+
+	/*
+	 * CRC32C_Init sets up lookup tables the first time it is called, and
+	 * doing so is not thread-safe; make sure this happens now, before we
+	 * have multiple threads.
+	 */
+	CRC32C_Init(&ctx);
 
 	/*
 	 * Figure out the maximum number of blocks a file can contain without
@@ -72,13 +178,29 @@ storage_init(const char * storagedir, size_t blocklen, long latency,
 #endif
 	S->maxnblks = S->maxnblks / S->blocklen;
 
+	/* Leave room for the header of a preallocated file. */
+	S->maxnblks -= S->hdrblks;
+
+	/* Create a cache of open block files. */
+	if ((S->fdcache = storage_fdcache_init(FDCACHE_NFDS)) == NULL)
+		goto err1;
+
+	/* Create a cache of recently written blocks, if requested. */
+	if (ncache > 0) {
+		if ((S->blkcache = storage_blkcache_init(S->blocklen,
+		    ncache)) == NULL)
+			goto err2;
+	} else {
+		S->blkcache = NULL;
+	}
+
 	/* Create an elastic queue to hold block file state. */
 	if ((S->files = elasticqueue_init(sizeof(struct file_state))) == NULL)
-		goto err1;
+		goto err3;
 
 	/* Get a sorted list of block files. */
 	if ((files = storage_findfiles(S->storagedir)) == NULL)
-		goto err2;
+		goto err4;
 
 	/* If we have at least one file, its # is where the blocks start. */
 	if (elasticqueue_getlen(files) > 0) {
@@ -102,43 +224,33 @@ storage_init(const char * storagedir, size_t blocklen, long latency,
 		if (fs.start != S->nextblk) {
 			warn0("Start of block storage file does not match"
 			    " end of previous file: %016" PRIx64, sf->fileno);
-			goto err3;
+			goto err5;
 		}
 
-		/* Does it have a non-integer number of blocks? */
-		if ((sf->len % (off_t)S->blocklen) != 0) {
-			/* Not permitted for files in the middle. */
-			if (elasticqueue_getlen(files) > 1) {
-				warn0("Block storage file has non-integer"
-				    " number of blocks: %016" PRIx64,
-				    sf->fileno);
-				goto err3;
-			}
-
-			/*
-			 * The final file may have a non-integer number of
-			 * blocks due to an interrupted write; just remove
-			 * any partial block.
-			 */
-			if ((s = storage_util_mkpath(S, sf->fileno)) == NULL)
-				goto err3;
-			if (truncate(s, sf->len - (sf->len %
-			    (off_t)S->blocklen)))
-				goto err4;
-			free(s);
+		/*
+		 * Figure out how many blocks the file holds; preallocated
+		 * files record this in their headers.
+		 */
+		fs.pfile = sf->pfile;
+		if (fs.pfile) {
+			if (storage_pfile_recover(S, sf->fileno, &fs.len))
+				goto err5;
+		} else {
+			if (getlen(S, sf, elasticqueue_getlen(files) == 1,
+			    &fs.len))
+				goto err5;
 		}
 
-		/* Compute number of blocks. */
-		num_blocks = sf->len / (off_t)S->blocklen;
-#if UINTMAX_MAX > UINT64_MAX
-		if ((uintmax_t)num_blocks > (uintmax_t)UINT64_MAX)
-			goto err3;
-#endif
-		fs.len = (uint64_t)num_blocks;
+		/* Does the file have checksums? */
+		if (storage_crcs_recover(S, sf->fileno, fs.len,
+		    elasticqueue_getlen(files) == 1, &fs.crcs))
+			goto err5;
+		if (fs.crcs)
+			S->verify = 1;
 
 		/* Add to the queue of block file state structures. */
 		if (elasticqueue_add(S->files, &fs))
-			goto err3;
+			goto err5;
 
 		/* Adjust nextblk to account for this latest block file. */
 		S->nextblk = fs.start + fs.len;
@@ -150,21 +262,42 @@ storage_init(const char * storagedir, size_t blocklen, long latency,
 	/* Free the (now empty) queue of files. */
 	elasticqueue_free(files);
 
+	/*
+	 * Checksums for a new block file are written before the file is
+	 * created; delete any left behind by an interrupted write.
+	 */
+	if (storage_crcs_unlink(S, S->nextblk))
+		goto err4;
+
 	/* Create a lock on the dynamic data. */
 	if ((rc = pthread_rwlock_init(&S->lck, NULL)) != 0) {
 		warn0("pthread_rwlock_init: %s", strerror(rc));
-		goto err2;
+		goto err4;
+	}
+
+	/* Load the last file's checksums, recovering any lost in a crash. */
+	if (elasticqueue_getlen(S->files) > 0) {
+		fsp = elasticqueue_get(S->files,
+		    elasticqueue_getlen(S->files) - 1);
+		if (fsp->crcs && storage_crcs_load(S, fsp->start, fsp->len))
+			goto err6;
 	}
 
 	/* Success! */
 	return (S);
 
+err6:
+	pthread_rwlock_destroy(&S->lck);
+	storage_crcs_free(S);
+	goto err4;
+err5:
+	elasticqueue_free(files);
 err4:
-	free(s);
+	elasticqueue_free(S->files);
 err3:
-	elasticqueue_free(files);
+	storage_blkcache_free(S->blkcache);
 err2:
-	elasticqueue_free(S->files);
+	storage_fdcache_free(S->fdcache);
 err1:
 	free(S);
 err0:
@@ -202,18 +335,70 @@ err0:
 }
 
 /**
- * storage_read(S, blkno, buf):
- * Using storage state ${S}, read block number ${blkno} into the buffer
- * ${buf}.  Return 1 on success; 0 if the block does not exist; or
- * -1 on error.
+ * storage_allocbuf(S, nblks):
+ * Allocate and return a buffer which can hold ${nblks} blocks for the storage
+ * state ${S} and is suitably aligned to be passed to storage_read().  The
+ * buffer should be freed with free().
+ */
+uint8_t *
+storage_allocbuf(struct storage_state * S, size_t nblks)
+{
+
+	/* Sanity-check. */
+	assert((nblks > 0) && (nblks <= SIZE_MAX / S->blocklen));
+
+	return (disk_allocbuf(nblks * S->blocklen));
+}
+
+/*
+ * Return the state of the file holding block number ${blkno}, which must
+ * exist.  The caller must hold a lock on the storage state ${S}.
+ */
+static struct file_state *
+findfile(struct storage_state * S, uint64_t blkno)
+{
+	struct file_state * fs;
+	size_t lo, mid, hi;
+
+	/*
+	 * Files are contiguous and sorted by starting block, so we binary
+	 * search for the last file starting at or before ${blkno}.
+	 */
+	lo = 0;
+	hi = elasticqueue_getlen(S->files);
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		fs = elasticqueue_get(S->files, mid);
+		if (fs->start <= blkno)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	fs = elasticqueue_get(S->files, lo);
+	assert(fs != NULL);
+	assert((fs->start <= blkno) && (blkno < fs->start + fs->len));
+
+	return (fs);
+}
+
+/**
+ * storage_read_getfd(S, blkno, offset, nblks):
+ * Using storage state ${S}, find the file holding block number ${blkno} and
+ * return a file descriptor open for reading it; set ${offset} to the
+ * position of the block within the file and ${nblks} to the number of
+ * blocks in the file starting from ${blkno}.  Return -1 and set errno to
+ * ENOENT if the block does not exist; or return -1 on error.  The descriptor
+ * must be released via storage_read_putfd().
  */
 int
-storage_read(struct storage_state * S, uint64_t blkno, uint8_t * buf)
+storage_read_getfd(struct storage_state * S, uint64_t blkno, off_t * offset,
+    uint64_t * nblks)
 {
 	struct file_state * fs;
-	size_t i;
-	char * s = NULL;	/* free(NULL) simplifies error path. */
-	struct timespec nstime;
+	uint64_t fnum;
+	uint64_t fpos;
+	int pfile;
+	int fd;
 
 	/* Grab a read lock. */
 	if (storage_util_readlock(S))
@@ -221,37 +406,223 @@ storage_read(struct storage_state * S, uint64_t blkno, uint8_t * buf)
 
 	/* Figure out if we have this block. */
 	if ((blkno < S->minblk) || (blkno >= S->nextblk))
-		goto enoent2;
+		goto enoent;
 
-	/* Figure out which file to read from, and at what position. */
-	for (i = 0; ; i++) {
-		fs = elasticqueue_get(S->files, i);
-		assert(fs != NULL);
-		if (blkno < fs->start + fs->len)
-			break;
-	}
-	assert(fs->start <= blkno);
+	/* Figure out which file to read from. */
+	fs = findfile(S, blkno);
+
+	/*
+	 * Record which file we're reading from, since the queue may be
+	 * modified once we release the lock.
+	 */
+	fnum = fs->start;
+	pfile = fs->pfile;
+	*nblks = fs->start + fs->len - blkno;
 
 	/* Release the read lock. */
 	if (storage_util_unlock(S))
 		goto err0;
 
-	/* Read the block. */
-	if ((s = storage_util_mkpath(S, fs->start)) == NULL)
+	/*
+	 * Get a descriptor for the file.  If this fails with ENOENT, we lost
+	 * a race against the deleter thread; the block does not exist.
+	 */
+	if ((fd = storage_fdcache_get(S, fnum,
+	    pfile ? STORAGE_UTIL_BLKP : STORAGE_UTIL_BLKS)) == -1)
 		goto err0;
-	if (disk_read(s, (off_t)((blkno - fs->start) * S->blocklen),
-	    S->blocklen, buf)) {
-		/*
-		 * If errno is ENOENT, we lost a race against the deleter
-		 * thread.  The block does not exist.
-		 */
-		if (errno == ENOENT)
-			goto enoent1;
 
-		/* Anything else is an error. */
-		goto err1;
+	/* Blocks in preallocated files follow the header. */
+	fpos = blkno - fnum;
+	if (pfile)
+		fpos += S->hdrblks;
+
+	/* Success! */
+	*offset = (off_t)(fpos * S->blocklen);
+	return (fd);
+
+enoent:
+	/* Release the lock. */
+	if (storage_util_unlock(S))
+		goto err0;
+
+	/* This block is not available. */
+	errno = ENOENT;
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_read_putfd(S, fd):
+ * Release the file descriptor ${fd} returned by storage_read_getfd().
+ */
+int
+storage_read_putfd(struct storage_state * S, int fd)
+{
+
+	return (storage_fdcache_release(S, fd));
+}
+
+/**
+ * storage_read_cached(S, blkno, nblks, buf):
+ * Using storage state ${S}, read the ${nblks} blocks starting at block
+ * number ${blkno} into the buffer ${buf} if they are all held in memory.
+ * Return 1 on success; 0 if any of the blocks are not held in memory or do
+ * not exist; or -1 on error.
+ */
+int
+storage_read_cached(struct storage_state * S, uint64_t blkno, size_t nblks,
+    uint8_t * buf)
+{
+	size_t i;
+	int rc;
+
+	/* If we don't have a block cache, we can't have the blocks. */
+	if (S->blkcache == NULL)
+		return (0);
+
+	/* Grab a read lock. */
+	if (storage_util_readlock(S))
+		goto err0;
+
+	/* Look in the cache, if the blocks haven't been deleted. */
+	if ((blkno < S->minblk) || (blkno >= S->nextblk) ||
+	    (nblks > S->nextblk - blkno)) {
+		rc = 0;
+	} else {
+		for (i = 0, rc = 1; (i < nblks) && (rc == 1); i++)
+			rc = storage_blkcache_get(S->blkcache, blkno + i,
+			    &buf[i * S->blocklen]);
+	}
+
+	/* Release the read lock. */
+	if (storage_util_unlock(S))
+		goto err0;
+
+	/* Success (or error from storage_blkcache_get). */
+	return (rc);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_read_verify(S, blkno, nblks, buf):
+ * Using storage state ${S}, check the ${nblks} blocks starting at block
+ * number ${blkno} which were read into the buffer ${buf} against their
+ * checksums, if they have any.  Return -1 on error or if a checksum does
+ * not match.
+ */
+int
+storage_read_verify(struct storage_state * S, uint64_t blkno, size_t nblks,
+    const uint8_t * buf)
+{
+	struct file_state * fs;
+	uint64_t fnum;
+	uint64_t navail;
+	int crcs;
+
+	/* If no files have checksums, there's nothing to check. */
+	if (!S->verify)
+		return (0);
+
+	/* Check the blocks in each file in turn. */
+	while (nblks > 0) {
+		/* Grab a read lock. */
+		if (storage_util_readlock(S))
+			goto err0;
+
+		/* If the blocks have been deleted, there's nothing to check. */
+		if ((blkno < S->minblk) || (blkno >= S->nextblk)) {
+			if (storage_util_unlock(S))
+				goto err0;
+			break;
+		}
+
+		/* Find the file holding the next block. */
+		fs = findfile(S, blkno);
+		fnum = fs->start;
+		crcs = fs->crcs;
+		navail = fs->start + fs->len - blkno;
+		if (navail > nblks)
+			navail = nblks;
+
+		/* Release the read lock. */
+		if (storage_util_unlock(S))
+			goto err0;
+
+		/* Check the blocks if the file has checksums. */
+		if (crcs && (storage_crcs_verify(S, fnum, blkno - fnum,
+		    (size_t)navail, buf) == -1))
+			goto err0;
+
+		/* Move on to the next file. */
+		blkno += navail;
+		nblks -= (size_t)navail;
+		buf += (size_t)navail * S->blocklen;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_read(S, blkno, nblks, buf):
+ * Using storage state ${S}, read the ${nblks} blocks starting at block
+ * number ${blkno} into the buffer ${buf}.  Return 1 on success; 0 if any of
+ * the blocks do not exist; or -1 on error.
+ */
+int
+storage_read(struct storage_state * S, uint64_t blkno, size_t nblks,
+    uint8_t * buf)
+{
+	off_t offset;
+	uint64_t navail;
+	int fd;
+	struct timespec nstime;
+	int rc;
+
+	/* If the blocks are held in memory, we don't need to touch the disk. */
+	if ((rc = storage_read_cached(S, blkno, nblks, buf)) != 0)
+		return (rc);
+
+	/* Read as many blocks as possible from each file in turn. */
+	while (nblks > 0) {
+		/* Get a descriptor for the file holding the next block. */
+		if ((fd = storage_read_getfd(S, blkno, &offset,
+		    &navail)) == -1) {
+			/* If errno is ENOENT, the block does not exist. */
+			if (errno == ENOENT)
+				goto enoent;
+
+			/* Anything else is an error. */
+			goto err0;
+		}
+		if (navail > nblks)
+			navail = nblks;
+
+		/* Read the blocks. */
+		if (disk_pread(fd, offset, (size_t)navail * S->blocklen, buf))
+			goto err1;
+
+		/* We're done with the descriptor. */
+		if (storage_read_putfd(S, fd))
+			goto err0;
+
+		/* Check the blocks against their checksums. */
+		if (storage_read_verify(S, blkno, (size_t)navail, buf))
+			goto err0;
+
+		/* Move on to the next file. */
+		blkno += navail;
+		nblks -= (size_t)navail;
+		buf += (size_t)navail * S->blocklen;
 	}
-	free(s);
 
 	/* Sleep the indicated duration. */
 	if (S->latency) {
@@ -263,18 +634,78 @@ storage_read(struct storage_state * S, uint64_t blkno, uint8_t * buf)
 	/* Success! */
 	return (1);
 
-enoent2:
+enoent:
+	/* This block is not available. */
+	return (0);
+
+err1:
+	storage_read_putfd(S, fd);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Return non-zero if appending ${nblks} blocks to the storage state ${S}
+ * requires creating a new block file after the last file ${fs} (which is
+ * NULL if there are no files yet).  We start a new file if any of the
+ * following conditions apply:
+ * 1. We have no files yet.
+ * 2. The last file is more than 1/NEWFILE_FRAC of the total stored data.
+ * 3. Adding to the last file will result in the file having too many blocks.
+ * The caller must hold a lock on ${S}.
+ */
+static int
+needfile(struct storage_state * S, struct file_state * fs, uint64_t nblks)
+{
+
+	if (fs == NULL)
+		return (1);
+	if (fs->len > (S->nextblk - S->minblk) / NEWFILE_FRAC)
+		return (1);
+	if (fs->len + nblks > S->maxnblks)
+		return (1);
+	return (0);
+}
+
+/*
+ * Record that the ${nblks} blocks from ${buf} starting at block ${blkno}
+ * have been appended to the last file.
+ */
+static int
+appended(struct storage_state * S, uint64_t blkno, uint64_t nblks,
+    const uint8_t * buf)
+{
+	struct file_state * fs;
+
+	/* Keep a copy of the blocks; they are likely to be read soon. */
+	if ((S->blkcache != NULL) &&
+	    storage_blkcache_add(S->blkcache, blkno, nblks, buf))
+		goto err0;
+
+	/* Pick up a write lock. */
+	if (storage_util_writelock(S))
+		goto err0;
+
+	/*
+	 * Get a pointer to the last file.  We must do this here since the
+	 * queue may have been modified while we didn't have a lock.
+	 */
+	fs = elasticqueue_get(S->files, elasticqueue_getlen(S->files) - 1);
+
+	/* Adjust block count. */
+	fs->len += nblks;
+
+	/* Adjust next-block-to-write value. */
+	S->nextblk += nblks;
+
 	/* Release the lock. */
 	if (storage_util_unlock(S))
-		goto err1;
-enoent1:
-	free(s);
+		goto err0;
 
-	/* This block is not available. */
+	/* Success! */
 	return (0);
 
-err1:
-	free(s);
 err0:
 	/* Failure! */
 	return (-1);
@@ -294,6 +725,9 @@ storage_write(struct storage_state * S,
 	struct file_state * fs;
 	int newfile;
 	uint64_t fnum;
+	uint64_t fpos;
+	int pfile;
+	int crcs;
 	char * s = NULL;	/* free(NULL) simplifies error path. */
 
 	/* Sanity checks.  We must have nblks * S->blocklen <= SIZE_MAX. */
@@ -315,48 +749,51 @@ storage_write(struct storage_state * S,
 	/* Get a pointer to the last file (or NULL if no files exist). */
 	fs = elasticqueue_get(S->files, elasticqueue_getlen(S->files) - 1);
 
-	/**
-	 * Figure out if we should continue appending to the last file, or
-	 * create a new file.  We start a new file if either of the following
-	 * conditions apply:
-	 * 1. We have no files yet.
-	 * 2. The last file is more than 1/16 of the total stored data.
-	 * 3. Adding to the last file will result in the file having too
-	 *    many blocks.
-	 */
-	if (fs == NULL)
-		newfile = 1;
-	else if (fs->len > (S->nextblk - S->minblk) / 16)
-		newfile = 1;
-	else if (fs->len + nblks > S->maxnblks)
-		newfile = 1;
-	else
-		newfile = 0;
+	/* Should we continue appending to the last file? */
+	newfile = needfile(S, fs, nblks);
 
 	/* If we're creating a new file, add a new file_state to the queue. */
 	if (newfile) {
 		fs_new.start = blkno;
 		fs_new.len = 0;
+		fs_new.pfile = S->prealloc;
+		fs_new.crcs = S->crcs;
 		fs = &fs_new;
 		if (elasticqueue_add(S->files, fs))
 			goto err2;
 	}
 
-	/* Record which file we're appending to. */
+	/* Record which file we're appending to, and where. */
 	fnum = fs->start;
+	fpos = fs->len;
+	pfile = fs->pfile;
+	crcs = fs->crcs;
 
 	/* Release the lock. */
 	if (storage_util_unlock(S))
 		goto err0;
 
-	/* Write the block(s) to the end of the file. */
-	if ((s = storage_util_mkpath(S, fnum)) == NULL)
+	/* The new file's checksums will be held in memory. */
+	if (newfile && storage_crcs_newfile(S, fnum, crcs))
 		goto err0;
-	if (disk_write(s, newfile, (size_t)(S->blocklen * nblks), buf,
-	    S->nosync)) {
-		goto err1;
+
+	/* Write checksums for the blocks before writing the blocks. */
+	if (crcs && storage_crcs_append(S, fnum, newfile, fpos, nblks, buf))
+		goto err0;
+
+	/* Write the block(s) to the end of the file. */
+	if (pfile) {
+		if (storage_pfile_append(S, fnum, newfile, fpos, nblks, buf))
+			goto err0;
+	} else {
+		if ((s = storage_util_mkpath(S, fnum,
+		    STORAGE_UTIL_BLKS)) == NULL)
+			goto err0;
+		if (disk_write(s, newfile, (size_t)(S->blocklen * nblks),
+		    buf, S->nosync, S->direct))
+			goto err1;
+		free(s);
 	}
-	free(s);
 
 	/* Make sure any file creation is flushed to disk. */
 	if ((newfile) && (S->nosync == 0)) {
@@ -364,33 +801,126 @@ storage_write(struct storage_state * S,
 			goto err0;
 	}
 
-	/* Pick up a write lock. */
-	if (storage_util_writelock(S))
+	/* Record the new blocks. */
+	if (appended(S, blkno, nblks, buf))
 		goto err0;
 
-	/*
-	 * Get a pointer to the last file.  We must do this here since the
-	 * queue may have been modified while we didn't have a lock.
-	 */
-	fs = elasticqueue_get(S->files, elasticqueue_getlen(S->files) - 1);
+	/* Success! */
+	return (0);
 
-	/* Adjust block count. */
-	fs->len += nblks;
+err2:
+	storage_util_unlock(S);
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
 
-	/* Adjust next-block-to-write value. */
-	S->nextblk += nblks;
+/**
+ * storage_write_open(S, blkno, nblks, fd, offset, dosync):
+ * Using storage state ${S}, prepare to append ${nblks} blocks starting at
+ * block ${blkno} by writing them to position ${offset} of the file open as
+ * ${fd} and then (if ${dosync} is non-zero) syncing it.  Return 1 on
+ * success; 0 if the blocks must instead be appended via storage_write()
+ * because a new block file is needed or the last file is a preallocated
+ * file, has checksums, or would be written with direct I/O; or -1 on error.
+ * Once the blocks have been written, storage_write_close() must be called.
+ * The same restrictions apply as for storage_write().
+ */
+int
+storage_write_open(struct storage_state * S, uint64_t blkno, uint64_t nblks,
+    int * fd, off_t * offset, int * dosync)
+{
+	struct file_state * fs;
+	uint64_t fnum;
+	uint64_t fpos;
+	char * s;
+
+	/* Sanity checks.  We must have nblks * S->blocklen <= SIZE_MAX. */
+	assert((nblks != 0) && (S->blocklen != 0));
+	assert(nblks <= SIZE_MAX / S->blocklen);
+
+	/* Direct I/O needs aligned buffers, which we might not have. */
+	if (S->direct)
+		return (0);
+
+	/* Pick up a read lock; only we modify the file list. */
+	if (storage_util_readlock(S))
+		goto err0;
+
+	/* Sanity-check the write position. */
+	if (blkno != S->nextblk) {
+		warn0("Attempt to append data with wrong blkno");
+		warn0("(%016" PRIx64 ", should be %016" PRIx64 ")",
+		    blkno, S->nextblk);
+		goto err1;
+	}
+
+	/* Can we simply append to the last file? */
+	fs = elasticqueue_get(S->files, elasticqueue_getlen(S->files) - 1);
+	if (needfile(S, fs, nblks) || fs->pfile || fs->crcs) {
+		if (storage_util_unlock(S))
+			goto err0;
+		return (0);
+	}
+
+	/* Record which file we're appending to, and where. */
+	fnum = fs->start;
+	fpos = fs->len;
 
 	/* Release the lock. */
 	if (storage_util_unlock(S))
 		goto err0;
 
+	/* Open the file. */
+	if ((s = storage_util_mkpath(S, fnum, STORAGE_UTIL_BLKS)) == NULL)
+		goto err0;
+	if ((*fd = disk_openw(s, 0, 0)) == -1)
+		goto err2;
+	free(s);
+
+	/* The blocks go at the end of the file. */
+	*offset = (off_t)(fpos * S->blocklen);
+	*dosync = (S->nosync == 0);
+
 	/* Success! */
-	return (0);
+	return (1);
 
 err2:
-	storage_util_unlock(S);
-err1:
 	free(s);
+	goto err0;
+err1:
+	storage_util_unlock(S);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_write_close(S, fd, blkno, nblks, buf):
+ * Using storage state ${S}, close the descriptor ${fd} returned by
+ * storage_write_open() and record that the ${nblks} blocks from ${buf}
+ * starting at block ${blkno} have been written to it (and synced).
+ */
+int
+storage_write_close(struct storage_state * S, int fd, uint64_t blkno,
+    uint64_t nblks, const uint8_t * buf)
+{
+
+	/* Close the file. */
+	if (close(fd)) {
+		warnp("close");
+		goto err0;
+	}
+
+	/* Record the new blocks. */
+	if (appended(S, blkno, nblks, buf))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
 err0:
 	/* Failure! */
 	return (-1);
@@ -406,6 +936,8 @@ storage_delete(struct storage_state * S, uint64_t blkno)
 {
 	struct file_state * fs;
 	uint64_t fileno;
+	int pfile;
+	int crcs;
 	char * s;
 
 	/* Loop until we don't need to delete anything. */
@@ -430,6 +962,8 @@ storage_delete(struct storage_state * S, uint64_t blkno)
 
 		/* We want to delete the first file. */
 		fileno = fs->start;
+		pfile = fs->pfile;
+		crcs = fs->crcs;
 
 		/* Remove the file from the file queue. */
 		elasticqueue_delete(S->files);
@@ -442,13 +976,25 @@ storage_delete(struct storage_state * S, uint64_t blkno)
 		if (storage_util_unlock(S))
 			goto err0;
 
+		/*
+		 * Drop the file from the descriptor cache.  Readers which
+		 * are still using it keep it open until they finish; new
+		 * readers will treat the file as not existing.
+		 */
+		if (storage_fdcache_evict(S, fileno))
+			goto err0;
+
 		/*
 		 * Delete the file.  We don't need to worry about racing
 		 * against the writer, since we will never delete the last
 		 * file; and racing against readers is handled by readers
-		 * treating ENOENT properly.
+		 * treating ENOENT properly.  Delete the checksums first so
+		 * that they can't be left behind without their blocks.
 		 */
-		if ((s = storage_util_mkpath(S, fileno)) == NULL)
+		if (crcs && storage_crcs_unlink(S, fileno))
+			goto err0;
+		if ((s = storage_util_mkpath(S, fileno,
+		    pfile ? STORAGE_UTIL_BLKP : STORAGE_UTIL_BLKS)) == NULL)
 			goto err0;
 		if (unlink(s)) {
 			warnp("unlink(%s)", s);
@@ -491,6 +1037,14 @@ storage_done(struct storage_state * S)
 		goto err0;
 	}
 
+	/* Close the file we were appending to, if any. */
+	storage_pfile_close(S);
+
+	/* Free the checksums and caches. */
+	storage_crcs_free(S);
+	storage_blkcache_free(S->blkcache);
+	storage_fdcache_free(S->fdcache);
+
 	/* Free the queue of file state structures. */
 	elasticqueue_free(S->files);
 
@@ -1,6 +1,8 @@
 #ifndef STORAGE_H_
 #define STORAGE_H_
 
+#include <sys/types.h>
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -8,12 +10,18 @@
 struct storage_state;
 
 /**
- * storage_init(storagedir, blklen, latency, nosync):
+ * storage_init(storagedir, blklen, latency, nosync, direct, ncache,
+ *     prealloc, crcs):
  * Initialize and return the storage state for ${blklen}-byte blocks of data
  * stored in ${storagedir}.  Sleep ${latency} ns in storage_read() calls.  If
- * ${nosync} is non-zero, don't use fsync.
+ * ${nosync} is non-zero, don't use fsync.  If ${direct} is non-zero, bypass
+ * the kernel's buffer cache.  If ${ncache} is non-zero, keep the ${ncache}
+ * most recently written blocks in memory.  If ${prealloc} is non-zero,
+ * create new block files as preallocated files.  If ${crcs} is non-zero,
+ * store checksums of the blocks in new block files.
  */
-struct storage_state * storage_init(const char *, size_t, long, int);
+struct storage_state * storage_init(const char *, size_t, long, int, int,
+    size_t, int, int);
 
 /**
  * storage_nextblock(S):
@@ -23,12 +31,58 @@ struct storage_state * storage_init(const char *, size_t, long, int);
 uint64_t storage_nextblock(struct storage_state *);
 
 /**
- * storage_read(S, blkno, buf):
- * Using storage state ${S}, read block number ${blkno} into the buffer
- * ${buf}.  Return 1 on success; 0 if the block does not exist; or
- * -1 on error.
+ * storage_allocbuf(S, nblks):
+ * Allocate and return a buffer which can hold ${nblks} blocks for the storage
+ * state ${S} and is suitably aligned to be passed to storage_read().  The
+ * buffer should be freed with free().
+ */
+uint8_t * storage_allocbuf(struct storage_state *, size_t);
+
+/**
+ * storage_read_getfd(S, blkno, offset, nblks):
+ * Using storage state ${S}, find the file holding block number ${blkno} and
+ * return a file descriptor open for reading it; set ${offset} to the
+ * position of the block within the file and ${nblks} to the number of
+ * blocks in the file starting from ${blkno}.  Return -1 and set errno to
+ * ENOENT if the block does not exist; or return -1 on error.  The descriptor
+ * must be released via storage_read_putfd().
+ */
+int storage_read_getfd(struct storage_state *, uint64_t, off_t *,
+    uint64_t *);
+
+/**
+ * storage_read_putfd(S, fd):
+ * Release the file descriptor ${fd} returned by storage_read_getfd().
+ */
+int storage_read_putfd(struct storage_state *, int);
+
+/**
+ * storage_read_cached(S, blkno, nblks, buf):
+ * Using storage state ${S}, read the ${nblks} blocks starting at block
+ * number ${blkno} into the buffer ${buf} if they are all held in memory.
+ * Return 1 on success; 0 if any of the blocks are not held in memory or do
+ * not exist; or -1 on error.
+ */
+int storage_read_cached(struct storage_state *, uint64_t, size_t,
+    uint8_t *);
+
+/**
+ * storage_read_verify(S, blkno, nblks, buf):
+ * Using storage state ${S}, check the ${nblks} blocks starting at block
+ * number ${blkno} which were read into the buffer ${buf} against their
+ * checksums, if they have any.  Return -1 on error or if a checksum does
+ * not match.
+ */
+int storage_read_verify(struct storage_state *, uint64_t, size_t,
+    const uint8_t *);
+
+/**
+ * storage_read(S, blkno, nblks, buf):
+ * Using storage state ${S}, read the ${nblks} blocks starting at block
+ * number ${blkno} into the buffer ${buf}.  Return 1 on success; 0 if any of
+ * the blocks do not exist; or -1 on error.
  */
-int storage_read(struct storage_state *, uint64_t, uint8_t *);
+int storage_read(struct storage_state *, uint64_t, size_t, uint8_t *);
 
 /**
  * storage_write(S, blkno, nblks, buf):
@@ -38,6 +92,29 @@ int storage_read(struct storage_state *, uint64_t, uint8_t *);
  */
 int storage_write(struct storage_state *, uint64_t, uint64_t, uint8_t *);
 
+/**
+ * storage_write_open(S, blkno, nblks, fd, offset, dosync):
+ * Using storage state ${S}, prepare to append ${nblks} blocks starting at
+ * block ${blkno} by writing them to position ${offset} of the file open as
+ * ${fd} and then (if ${dosync} is non-zero) syncing it.  Return 1 on
+ * success; 0 if the blocks must instead be appended via storage_write()
+ * because a new block file is needed or the last file is a preallocated
+ * file, has checksums, or would be written with direct I/O; or -1 on error.
+ * Once the blocks have been written, storage_write_close() must be called.
+ * The same restrictions apply as for storage_write().
+ */
+int storage_write_open(struct storage_state *, uint64_t, uint64_t, int *,
+    off_t *, int *);
+
+/**
+ * storage_write_close(S, fd, blkno, nblks, buf):
+ * Using storage state ${S}, close the descriptor ${fd} returned by
+ * storage_write_open() and record that the ${nblks} blocks from ${buf}
+ * starting at block ${blkno} have been written to it (and synced).
+ */
+int storage_write_close(struct storage_state *, int, uint64_t, uint64_t,
+    const uint8_t *);
+
 /**
  * storage_delete(S, blkno):
  * Using storage state ${S}, delete none, some, or all blocks prior to (but
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "warnp.h"
+
+#include "storage_blkcache.h"
+
+/*
+ * Since blocks are appended in increasing order, the most recently written
+ * blocks are kept in a circular buffer: block number X lives in slot
+ * X % nslots, and blknos[] records which block number each slot holds.
+ */
+struct storage_blkcache {
+	pthread_mutex_t mtx;		/* Lock on the cache. */
+	size_t blklen;			/* Block size in bytes. */
+	size_t nslots;			/* Number of blocks in the cache. */
+	uint64_t * blknos;		/* Block # in each slot. */
+	uint8_t * blks;			/* Block data. */
+};
+
+/* Marker for an empty slot. */
+#define EMPTY	((uint64_t)(-1))
+
+/**
+ * storage_blkcache_init(blklen, nblks):
+ * Create and return a cache which holds the ${nblks} most recently written
+ * ${blklen}-byte blocks.
+ */
+struct storage_blkcache *
+storage_blkcache_init(size_t blklen, size_t nblks)
+{
+	struct storage_blkcache * C;
+	size_t i;
+	int rc;
+
+	/* Sanity-check. */
+	if ((nblks == 0) || (nblks > SIZE_MAX / sizeof(uint64_t)) ||
+	    (nblks > SIZE_MAX / blklen)) {
+		warn0("Block cache size is out of range");
+		goto err0;
+	}
+
+	/* Allocate structures. */
+	if ((C = malloc(sizeof(struct storage_blkcache))) == NULL)
+		goto err0;
+	C->blklen = blklen;
+	C->nslots = nblks;
+	if ((C->blknos = malloc(nblks * sizeof(uint64_t))) == NULL)
+		goto err1;
+	if ((C->blks = malloc(nblks * blklen)) == NULL)
+		goto err2;
+
+	/* All slots start empty. */
+	for (i = 0; i < C->nslots; i++)
+		C->blknos[i] = EMPTY;
+
+	/* Create a lock on the cache. */
+	if ((rc = pthread_mutex_init(&C->mtx, NULL)) != 0) {
+		warn0("pthread_mutex_init: %s", strerror(rc));
+		goto err3;
+	}
+
+	/* Success! */
+	return (C);
+
+err3:
+	free(C->blks);
+err2:
+	free(C->blknos);
+err1:
+	free(C);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * storage_blkcache_add(C, blkno, nblks, buf):
+ * Add the ${nblks} blocks in ${buf}, starting at block number ${blkno}, to
+ * the cache ${C}.  Block numbers must be added in increasing order.
+ */
+int
+storage_blkcache_add(struct storage_blkcache * C, uint64_t blkno,
+    uint64_t nblks, const uint8_t * buf)
+{
+	size_t slot;
+	int rc;
+
+	/* If we have more blocks than slots, only the last ones matter. */
+	if (nblks > C->nslots) {
+		buf += (size_t)(nblks - C->nslots) * C->blklen;
+		blkno += nblks - C->nslots;
+		nblks = C->nslots;
+	}
+
+	/* Lock the cache. */
+	if ((rc = pthread_mutex_lock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Copy the blocks in, overwriting the oldest cached blocks. */
+	for (; nblks > 0; nblks--, blkno++, buf += C->blklen) {
+		slot = (size_t)(blkno % C->nslots);
+		C->blknos[slot] = blkno;
+		memcpy(&C->blks[slot * C->blklen], buf, C->blklen);
+	}
+
+	/* Unlock the cache. */
+	if ((rc = pthread_mutex_unlock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_blkcache_get(C, blkno, buf):
+ * If block number ${blkno} is in the cache ${C}, copy it into ${buf} and
+ * return 1; otherwise, return 0.  Return -1 on error.
+ */
+int
+storage_blkcache_get(struct storage_blkcache * C, uint64_t blkno,
+    uint8_t * buf)
+{
+	size_t slot = (size_t)(blkno % C->nslots);
+	int found;
+	int rc;
+
+	/* Lock the cache. */
+	if ((rc = pthread_mutex_lock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Copy the block out if we have it. */
+	if ((found = (C->blknos[slot] == blkno)) != 0)
+		memcpy(buf, &C->blks[slot * C->blklen], C->blklen);
+
+	/* Unlock the cache. */
+	if ((rc = pthread_mutex_unlock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		goto err0;
+	}
+
+	/* Success! */
+	return (found);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_blkcache_free(C):
+ * Free the cache ${C}.
+ */
+void
+storage_blkcache_free(struct storage_blkcache * C)
+{
+	int rc;
+
+	/* Behave consistently with free(NULL). */
+	if (C == NULL)
+		return;
+
+	/* Destroy the lock. */
+	if ((rc = pthread_mutex_destroy(&C->mtx)) != 0)
+		warn0("pthread_mutex_destroy: %s", strerror(rc));
+
+	/* Free structures. */
+	free(C->blks);
+	free(C->blknos);
+	free(C);
+}
@@ -0,0 +1,38 @@
+#ifndef STORAGE_BLKCACHE_H_
+#define STORAGE_BLKCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque type. */
+struct storage_blkcache;
+
+/**
+ * storage_blkcache_init(blklen, nblks):
+ * Create and return a cache which holds the ${nblks} most recently written
+ * ${blklen}-byte blocks.
+ */
+struct storage_blkcache * storage_blkcache_init(size_t, size_t);
+
+/**
+ * storage_blkcache_add(C, blkno, nblks, buf):
+ * Add the ${nblks} blocks in ${buf}, starting at block number ${blkno}, to
+ * the cache ${C}.  Block numbers must be added in increasing order.
+ */
+int storage_blkcache_add(struct storage_blkcache *, uint64_t, uint64_t,
+    const uint8_t *);
+
+/**
+ * storage_blkcache_get(C, blkno, buf):
+ * If block number ${blkno} is in the cache ${C}, copy it into ${buf} and
+ * return 1; otherwise, return 0.  Return -1 on error.
+ */
+int storage_blkcache_get(struct storage_blkcache *, uint64_t, uint8_t *);
+
+/**
+ * storage_blkcache_free(C):
+ * Free the cache ${C}.
+ */
+void storage_blkcache_free(struct storage_blkcache *);
+
+#endif /* !STORAGE_BLKCACHE_H_ */
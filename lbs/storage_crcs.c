@@ -0,0 +1,494 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "warnp.h"
+
+#include "disk.h"
+#include "storage.h"
+#include "storage_fdcache.h"
+#include "storage_internal.h"
+#include "storage_util.h"
+
+#include "storage_crcs.h"
+
+/* Number of checksums to handle at once when verifying or loading blocks. */
+#define VERIFY_CHUNK	256
+
+/* Compute the CRC32C of the ${blocklen}-byte block ${buf}. */
+static void
+blkcrc(const uint8_t * buf, size_t blocklen, uint8_t cbuf[4])
+{
+	CRC32C_CTX ctx;
+
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, buf, blocklen);
+	CRC32C_Final(cbuf, &ctx);
+}
+
+/* Make room in memory for ${nblks} checksums of the last block file. */
+static int
+reserve(struct storage_state * S, uint64_t nblks)
+{
+	uint8_t * tcrcs;
+	uint64_t nalloc;
+
+	/* Do we already have enough space? */
+	if (nblks <= S->tcrcs_alloc)
+		return (0);
+
+	/* Grow geometrically so that appends don't copy too much. */
+	nalloc = S->tcrcs_alloc * 2;
+	if (nalloc < nblks)
+		nalloc = nblks;
+	if (nalloc > SIZE_MAX / 4) {
+		errno = ENOMEM;
+		goto err0;
+	}
+
+	/* Readers may be copying checksums out; hold them off. */
+	if (storage_util_writelock(S))
+		goto err0;
+	if ((tcrcs = realloc(S->tcrcs, (size_t)nalloc * 4)) == NULL)
+		goto err1;
+	S->tcrcs = tcrcs;
+	S->tcrcs_alloc = nalloc;
+	if (storage_util_unlock(S))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err1:
+	storage_util_unlock(S);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Set the block file whose checksums are held in memory. */
+static int
+setfile(struct storage_state * S, uint64_t fileno)
+{
+
+	if (storage_util_writelock(S))
+		goto err0;
+	S->tcrcs_fileno = fileno;
+	if (storage_util_unlock(S))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Compute the checksums of blocks ${from} to ${to} - 1 of the last block
+ * file ${fileno} in the storage state ${S} from the blocks on disk, and
+ * store them in memory.
+ */
+static int
+recompute(struct storage_state * S, uint64_t fileno, uint64_t from,
+    uint64_t to)
+{
+	uint8_t * buf;
+	off_t offset;
+	uint64_t navail;
+	uint64_t i, n;
+	int fd;
+
+	/* Allocate a buffer for reading blocks. */
+	if ((buf = storage_allocbuf(S, VERIFY_CHUNK)) == NULL)
+		goto err0;
+
+	/* Read the blocks, a chunk at a time. */
+	for (; from < to; from += n) {
+		if ((fd = storage_read_getfd(S, fileno + from, &offset,
+		    &navail)) == -1)
+			goto err1;
+		n = to - from;
+		if (n > VERIFY_CHUNK)
+			n = VERIFY_CHUNK;
+		if (n > navail)
+			n = navail;
+		if (disk_pread(fd, offset, (size_t)(n * S->blocklen), buf))
+			goto err2;
+		if (storage_read_putfd(S, fd))
+			goto err1;
+		for (i = 0; i < n; i++)
+			blkcrc(&buf[i * S->blocklen], S->blocklen,
+			    &S->tcrcs[(from + i) * 4]);
+	}
+
+	/* Clean up. */
+	free(buf);
+
+	/* Success! */
+	return (0);
+
+err2:
+	storage_read_putfd(S, fd);
+err1:
+	free(buf);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_recover(S, fileno, nblks, last, crcs):
+ * Set ${crcs} to non-zero if the block file ${fileno} in the storage state
+ * ${S} has a checksum file, and if so, trim it to hold at most ${nblks}
+ * checksums.  If ${last} is non-zero, the block file is the last file; its
+ * checksum file may be short (or, if ${S} stores checksums for new files,
+ * missing), and storage_crcs_load must be called to fill it in.
+ */
+int
+storage_crcs_recover(struct storage_state * S, uint64_t fileno,
+    uint64_t nblks, int last, int * crcs)
+{
+	struct stat sb;
+	char * s;
+
+	/* Does this block file have checksums? */
+	if ((s = storage_util_mkpath(S, fileno, STORAGE_UTIL_CRCS)) == NULL)
+		goto err0;
+	if (stat(s, &sb)) {
+		if (errno != ENOENT) {
+			warnp("stat(%s)", s);
+			goto err1;
+		}
+
+		/* No checksum file; the last file's may have been lost. */
+		*crcs = last ? S->crcs : 0;
+		goto done;
+	}
+	*crcs = 1;
+
+	/* Only the last file's checksums are written without syncing. */
+	if (((uint64_t)sb.st_size / 4 < nblks) && !last) {
+		warn0("Checksum file is missing checksums: %016" PRIx64,
+		    fileno);
+		goto err1;
+	}
+
+	/* Remove checksums written before an interrupted block write. */
+	if ((uint64_t)sb.st_size > nblks * 4) {
+		if (truncate(s, (off_t)(nblks * 4))) {
+			warnp("truncate(%s)", s);
+			goto err1;
+		}
+	}
+
+done:
+	free(s);
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_load(S, fileno, nblks):
+ * Read the checksums of the ${nblks} blocks in the last block file
+ * ${fileno} in the storage state ${S} into memory, computing any which are
+ * missing from its checksum file from the blocks and writing them out.
+ */
+int
+storage_crcs_load(struct storage_state * S, uint64_t fileno, uint64_t nblks)
+{
+	struct stat sb;
+	uint64_t have = 0;
+	char * s;
+	int create;
+	int fd;
+
+	/* Make room for the checksums. */
+	if (reserve(S, nblks))
+		goto err0;
+
+	/* Read the checksums we have, if any. */
+	if ((s = storage_util_mkpath(S, fileno, STORAGE_UTIL_CRCS)) == NULL)
+		goto err0;
+	if ((fd = disk_open(s, 0)) == -1) {
+		if (errno != ENOENT)
+			goto err1;
+		create = 1;
+	} else {
+		create = 0;
+		if (fstat(fd, &sb)) {
+			warnp("fstat(%s)", s);
+			goto err2;
+		}
+		have = (uint64_t)sb.st_size / 4;
+		if (have > nblks)
+			have = nblks;
+		if ((have > 0) &&
+		    disk_pread(fd, 0, (size_t)have * 4, S->tcrcs))
+			goto err2;
+		if (close(fd)) {
+			warnp("close(%s)", s);
+			goto err1;
+		}
+	}
+
+	/* Compute any checksums lost in a crash, and write them out. */
+	if (have < nblks) {
+		if (recompute(S, fileno, have, nblks))
+			goto err1;
+		if (disk_write(s, create, (size_t)(nblks - have) * 4,
+		    &S->tcrcs[have * 4], S->nosync, 0))
+			goto err1;
+		if (create && (S->nosync == 0) &&
+		    disk_syncdir(S->storagedir))
+			goto err1;
+	}
+
+	/* Readers can now find these checksums in memory. */
+	if (setfile(S, fileno))
+		goto err1;
+
+	/* Clean up. */
+	free(s);
+
+	/* Success! */
+	return (0);
+
+err2:
+	close(fd);
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_newfile(S, fileno, crcs):
+ * Make the block file ${fileno} the last file in the storage state ${S},
+ * which is about to be created; it has checksums if ${crcs} is non-zero.
+ * Sync the checksum file of the previous last file, if any, since it is no
+ * longer synced along with its blocks.
+ */
+int
+storage_crcs_newfile(struct storage_state * S, uint64_t fileno, int crcs)
+{
+	char * s;
+	int fd;
+
+	/* Flush the checksums of the old last file to disk. */
+	if ((S->tcrcs_fileno != (uint64_t)(-1)) && (S->nosync == 0)) {
+		if ((s = storage_util_mkpath(S, S->tcrcs_fileno,
+		    STORAGE_UTIL_CRCS)) == NULL)
+			goto err0;
+		if ((fd = disk_open(s, 0)) == -1) {
+			/* The deleter may have removed the file already. */
+			if (errno != ENOENT)
+				goto err1;
+		} else {
+			if (disk_sync(fd, 1))
+				goto err2;
+			if (close(fd)) {
+				warnp("close(%s)", s);
+				goto err1;
+			}
+		}
+		free(s);
+	}
+
+	/* Hold the new file's checksums in memory. */
+	if (setfile(S, crcs ? fileno : (uint64_t)(-1)))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err2:
+	close(fd);
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_append(S, fileno, create, fpos, nblks, buf):
+ * Append checksums of the ${nblks} blocks in ${buf}, which will be written
+ * at position ${fpos} (in blocks) of the last block file ${fileno}, to the
+ * copy in memory and to the checksum file for the block file in the storage
+ * state ${S}, creating it if ${create} is non-zero.  The checksum file is
+ * not synced; syncing the blocks makes the checksums recoverable.
+ */
+int
+storage_crcs_append(struct storage_state * S, uint64_t fileno, int create,
+    uint64_t fpos, uint64_t nblks, const uint8_t * buf)
+{
+	uint64_t i;
+	char * s;
+
+	/* Sanity-check. */
+	assert(S->tcrcs_fileno == fileno);
+
+	/* Make room for the new checksums. */
+	if (reserve(S, fpos + nblks))
+		goto err0;
+
+	/*
+	 * Compute the checksums.  Readers only look at checksums for blocks
+	 * which have been written, so we don't need a lock here.
+	 */
+	for (i = 0; i < nblks; i++)
+		blkcrc(&buf[i * S->blocklen], S->blocklen,
+		    &S->tcrcs[(fpos + i) * 4]);
+
+	/* Write them out. */
+	if ((s = storage_util_mkpath(S, fileno, STORAGE_UTIL_CRCS)) == NULL)
+		goto err0;
+	if (disk_write(s, create, (size_t)nblks * 4, &S->tcrcs[fpos * 4],
+	    1, 0))
+		goto err1;
+
+	/* Clean up. */
+	free(s);
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_verify(S, fileno, fpos, nblks, buf):
+ * Check that the ${nblks} blocks in ${buf}, which were read from position
+ * ${fpos} (in blocks) of the block file ${fileno} in the storage state ${S},
+ * match their checksums.  Return 1 if they do; 0 if the file has been
+ * deleted; or -1 on error or if a checksum does not match.
+ */
+int
+storage_crcs_verify(struct storage_state * S, uint64_t fileno, uint64_t fpos,
+    size_t nblks, const uint8_t * buf)
+{
+	uint8_t cbuf[VERIFY_CHUNK * 4];
+	uint8_t cbuf_actual[VERIFY_CHUNK * 4];
+	size_t i, n;
+	int inmem;
+	int fd = -1;
+
+	/* Check the blocks, a chunk at a time. */
+	while (nblks > 0) {
+		n = (nblks < VERIFY_CHUNK) ? nblks : VERIFY_CHUNK;
+
+		/* Compute the checksums of the blocks we read. */
+		for (i = 0; i < n; i++)
+			blkcrc(&buf[i * S->blocklen], S->blocklen,
+			    &cbuf_actual[i * 4]);
+
+		/* The last file's checksums are held in memory. */
+		if (storage_util_readlock(S))
+			goto err1;
+		if ((inmem = (S->tcrcs_fileno == fileno)) != 0)
+			memcpy(cbuf, &S->tcrcs[fpos * 4], n * 4);
+		if (storage_util_unlock(S))
+			goto err1;
+
+		/* Otherwise, read them from the checksum file. */
+		if (!inmem) {
+			if ((fd == -1) && ((fd = storage_fdcache_get(S,
+			    fileno, STORAGE_UTIL_CRCS)) == -1)) {
+				/* If we lost a race against the deleter... */
+				if (errno == ENOENT)
+					return (0);
+				goto err0;
+			}
+			if (disk_pread(fd, (off_t)(fpos * 4), n * 4, cbuf))
+				goto err1;
+		}
+
+		/* Compare. */
+		for (i = 0; i < n; i++) {
+			if (memcmp(&cbuf[i * 4], &cbuf_actual[i * 4], 4)) {
+				warn0("Checksum mismatch on block %016" PRIx64,
+				    fileno + fpos + i);
+				goto err1;
+			}
+		}
+		fpos += n;
+		nblks -= n;
+		buf += n * S->blocklen;
+	}
+
+	/* We're done with the checksum file. */
+	if ((fd != -1) && storage_fdcache_release(S, fd))
+		goto err0;
+
+	/* Success! */
+	return (1);
+
+err1:
+	if (fd != -1)
+		storage_fdcache_release(S, fd);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_unlink(S, fileno):
+ * Delete the checksum file for the block file ${fileno} in the storage state
+ * ${S}, if it exists.
+ */
+int
+storage_crcs_unlink(struct storage_state * S, uint64_t fileno)
+{
+	char * s;
+
+	/* Delete the file, if it exists. */
+	if ((s = storage_util_mkpath(S, fileno, STORAGE_UTIL_CRCS)) == NULL)
+		goto err0;
+	if (unlink(s) && (errno != ENOENT)) {
+		warnp("unlink(%s)", s);
+		goto err1;
+	}
+	free(s);
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_crcs_free(S):
+ * Free the checksums held in memory for the storage state ${S}.
+ */
+void
+storage_crcs_free(struct storage_state * S)
+{
+
+	free(S->tcrcs);
+}
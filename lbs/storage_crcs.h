@@ -0,0 +1,82 @@
+#ifndef STORAGE_CRCS_H_
+#define STORAGE_CRCS_H_
+
+#include <stdint.h>
+
+/* Opaque type. */
+struct storage_state;
+
+/**
+ * Block checksums are stored in files named "crcs_<16 hex digits>" holding
+ * the CRC32C of each block in the corresponding block file, in order.  The
+ * checksums of the last block file are also held in memory, and are written
+ * to its checksum file before the blocks but not synced; syncing the blocks
+ * is enough, since checksums lost in a crash are recomputed from the blocks
+ * by storage_crcs_load.  A block file's checksum file is synced when it
+ * stops being the last file.  A checksum file may hold more checksums than
+ * its block file holds blocks; only the last file's may hold fewer.
+ */
+
+/**
+ * storage_crcs_recover(S, fileno, nblks, last, crcs):
+ * Set ${crcs} to non-zero if the block file ${fileno} in the storage state
+ * ${S} has a checksum file, and if so, trim it to hold at most ${nblks}
+ * checksums.  If ${last} is non-zero, the block file is the last file; its
+ * checksum file may be short (or, if ${S} stores checksums for new files,
+ * missing), and storage_crcs_load must be called to fill it in.
+ */
+int storage_crcs_recover(struct storage_state *, uint64_t, uint64_t, int,
+    int *);
+
+/**
+ * storage_crcs_load(S, fileno, nblks):
+ * Read the checksums of the ${nblks} blocks in the last block file
+ * ${fileno} in the storage state ${S} into memory, computing any which are
+ * missing from its checksum file from the blocks and writing them out.
+ */
+int storage_crcs_load(struct storage_state *, uint64_t, uint64_t);
+
+/**
+ * storage_crcs_newfile(S, fileno, crcs):
+ * Make the block file ${fileno} the last file in the storage state ${S},
+ * which is about to be created; it has checksums if ${crcs} is non-zero.
+ * Sync the checksum file of the previous last file, if any, since it is no
+ * longer synced along with its blocks.
+ */
+int storage_crcs_newfile(struct storage_state *, uint64_t, int);
+
+/**
+ * storage_crcs_append(S, fileno, create, fpos, nblks, buf):
+ * Append checksums of the ${nblks} blocks in ${buf}, which will be written
+ * at position ${fpos} (in blocks) of the last block file ${fileno}, to the
+ * copy in memory and to the checksum file for the block file in the storage
+ * state ${S}, creating it if ${create} is non-zero.  The checksum file is
+ * not synced; syncing the blocks makes the checksums recoverable.
+ */
+int storage_crcs_append(struct storage_state *, uint64_t, int, uint64_t,
+    uint64_t, const uint8_t *);
+
+/**
+ * storage_crcs_verify(S, fileno, fpos, nblks, buf):
+ * Check that the ${nblks} blocks in ${buf}, which were read from position
+ * ${fpos} (in blocks) of the block file ${fileno} in the storage state ${S},
+ * match their checksums.  Return 1 if they do; 0 if the file has been
+ * deleted; or -1 on error or if a checksum does not match.
+ */
+int storage_crcs_verify(struct storage_state *, uint64_t, uint64_t, size_t,
+    const uint8_t *);
+
+/**
+ * storage_crcs_unlink(S, fileno):
+ * Delete the checksum file for the block file ${fileno} in the storage state
+ * ${S}, if it exists.
+ */
+int storage_crcs_unlink(struct storage_state *, uint64_t);
+
+/**
+ * storage_crcs_free(S):
+ * Free the checksums held in memory for the storage state ${S}.
+ */
+void storage_crcs_free(struct storage_state *);
+
+#endif /* !STORAGE_CRCS_H_ */
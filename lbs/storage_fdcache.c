@@ -0,0 +1,528 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "warnp.h"
+
+#include "disk.h"
+#include "storage_internal.h"
+#include "storage_util.h"
+
+#include "storage_fdcache.h"
+
+/* Index used to terminate lists and hash chains. */
+#define NONE	SIZE_MAX
+
+/*
+ * A cached open block file.  An entry is either empty (on the free list),
+ * idle (open with no readers, on the LRU list), or in use; an entry which is
+ * in use and has been evicted is "dead": it can no longer be found by file
+ * number, and is closed once its last reader releases it.
+ */
+struct fdcache_entry {
+	uint64_t fileno;		/* Block file number. */
+	int type;			/* Type of file. */
+	int fd;				/* Descriptor, or -1 if empty. */
+	int dead;			/* Close once refcnt hits zero. */
+	size_t refcnt;			/* Number of readers using fd. */
+	size_t knext;			/* Next in (fileno, type) chain. */
+	size_t fnext;			/* Next in descriptor chain. */
+	size_t prev;			/* Previous in LRU list. */
+	size_t next;			/* Next in LRU or free list. */
+};
+
+/* Cache of open block files. */
+struct storage_fdcache {
+	pthread_mutex_t mtx;		/* Lock on the cache. */
+	struct fdcache_entry * ents;	/* Cache entries. */
+	size_t nents;			/* Number of cache entries. */
+	size_t * kbuckets;		/* Chains by (fileno, type). */
+	size_t * fbuckets;		/* Chains by descriptor. */
+	size_t nbuckets;		/* Number of buckets; a power of 2. */
+	size_t lru_head;		/* Most recently used idle entry. */
+	size_t lru_tail;		/* Least recently used idle entry. */
+	size_t freelist;		/* First empty entry. */
+	uint64_t minfile;		/* Files below this are evicted. */
+};
+
+/* Lock the cache. */
+static int
+lock(struct storage_fdcache * C)
+{
+	int rc;
+
+	if ((rc = pthread_mutex_lock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_lock: %s", strerror(rc));
+		return (-1);
+	}
+
+	/* Success! */
+	return (0);
+}
+
+/* Unlock the cache. */
+static int
+unlock(struct storage_fdcache * C)
+{
+	int rc;
+
+	if ((rc = pthread_mutex_unlock(&C->mtx)) != 0) {
+		warn0("pthread_mutex_unlock: %s", strerror(rc));
+		return (-1);
+	}
+
+	/* Success! */
+	return (0);
+}
+
+/* Return the (fileno, type) hash bucket for the file. */
+static size_t *
+kbucket(struct storage_fdcache * C, uint64_t fileno, int type)
+{
+	uint64_t h;
+
+	h = (fileno * 2 + (uint64_t)type) * UINT64_C(0x9e3779b97f4a7c15);
+	return (&C->kbuckets[(size_t)(h >> 32) & (C->nbuckets - 1)]);
+}
+
+/* Return the descriptor hash bucket for ${fd}. */
+static size_t *
+fbucket(struct storage_fdcache * C, int fd)
+{
+
+	return (&C->fbuckets[(size_t)fd & (C->nbuckets - 1)]);
+}
+
+/* Find the live entry for the file, or return NONE. */
+static size_t
+findkey(struct storage_fdcache * C, uint64_t fileno, int type)
+{
+	struct fdcache_entry * E;
+	size_t i;
+
+	for (i = *kbucket(C, fileno, type); i != NONE; i = E->knext) {
+		E = &C->ents[i];
+		if ((E->fileno == fileno) && (E->type == type))
+			break;
+	}
+	return (i);
+}
+
+/* Find the entry holding ${fd}, or return NONE. */
+static size_t
+findfd(struct storage_fdcache * C, int fd)
+{
+	size_t i;
+
+	for (i = *fbucket(C, fd); i != NONE; i = C->ents[i].fnext) {
+		if (C->ents[i].fd == fd)
+			break;
+	}
+	return (i);
+}
+
+/*
+ * Remove entry ${i} from the chain starting at ${p}, which is a (fileno,
+ * type) chain if ${bykey} is non-zero or a descriptor chain otherwise.
+ */
+static void
+unchain(struct storage_fdcache * C, size_t * p, size_t i, int bykey)
+{
+
+	while (*p != i)
+		p = bykey ? &C->ents[*p].knext : &C->ents[*p].fnext;
+	*p = bykey ? C->ents[i].knext : C->ents[i].fnext;
+}
+
+/* Add the idle entry ${i} to the head of the LRU list. */
+static void
+lru_add(struct storage_fdcache * C, size_t i)
+{
+	struct fdcache_entry * E = &C->ents[i];
+
+	E->prev = NONE;
+	E->next = C->lru_head;
+	if (C->lru_head != NONE)
+		C->ents[C->lru_head].prev = i;
+	else
+		C->lru_tail = i;
+	C->lru_head = i;
+}
+
+/* Remove the idle entry ${i} from the LRU list. */
+static void
+lru_remove(struct storage_fdcache * C, size_t i)
+{
+	struct fdcache_entry * E = &C->ents[i];
+
+	if (E->prev != NONE)
+		C->ents[E->prev].next = E->next;
+	else
+		C->lru_head = E->next;
+	if (E->next != NONE)
+		C->ents[E->next].prev = E->prev;
+	else
+		C->lru_tail = E->prev;
+}
+
+/*
+ * Remove entry ${i} from the descriptor chain (and, unless it is dead, the
+ * (fileno, type) chain), put it on the free list, and return the descriptor
+ * it held.  The caller must close the descriptor after unlocking the cache.
+ */
+static int
+release_ent(struct storage_fdcache * C, size_t i)
+{
+	struct fdcache_entry * E = &C->ents[i];
+	int fd = E->fd;
+
+	if (!E->dead)
+		unchain(C, kbucket(C, E->fileno, E->type), i, 1);
+	unchain(C, fbucket(C, fd), i, 0);
+	E->fd = -1;
+	E->dead = 0;
+	E->refcnt = 0;
+	E->next = C->freelist;
+	C->freelist = i;
+	return (fd);
+}
+
+/* Close ${fd}, if it is a descriptor. */
+static void
+closefd(int fd)
+{
+
+	if ((fd != -1) && close(fd))
+		warnp("close");
+}
+
+/**
+ * storage_fdcache_init(nfds):
+ * Create and return a cache which holds up to ${nfds} open block files.
+ */
+struct storage_fdcache *
+storage_fdcache_init(size_t nfds)
+{
+	struct storage_fdcache * C;
+	size_t i;
+	int rc;
+
+	/* Allocate structures. */
+	if ((C = malloc(sizeof(struct storage_fdcache))) == NULL)
+		goto err0;
+	if ((C->ents = malloc(nfds * sizeof(struct fdcache_entry))) == NULL)
+		goto err1;
+	C->nents = nfds;
+	C->minfile = 0;
+
+	/* Use at least twice as many buckets as entries. */
+	for (C->nbuckets = 1; C->nbuckets < nfds * 2; C->nbuckets <<= 1)
+		continue;
+	if ((C->kbuckets = malloc(C->nbuckets * sizeof(size_t))) == NULL)
+		goto err2;
+	if ((C->fbuckets = malloc(C->nbuckets * sizeof(size_t))) == NULL)
+		goto err3;
+	for (i = 0; i < C->nbuckets; i++) {
+		C->kbuckets[i] = NONE;
+		C->fbuckets[i] = NONE;
+	}
+
+	/* All entries start empty. */
+	C->freelist = NONE;
+	for (i = C->nents; i > 0; i--) {
+		C->ents[i - 1].fd = -1;
+		C->ents[i - 1].dead = 0;
+		C->ents[i - 1].refcnt = 0;
+		C->ents[i - 1].next = C->freelist;
+		C->freelist = i - 1;
+	}
+	C->lru_head = C->lru_tail = NONE;
+
+	/* Create a lock on the cache. */
+	if ((rc = pthread_mutex_init(&C->mtx, NULL)) != 0) {
+		warn0("pthread_mutex_init: %s", strerror(rc));
+		goto err4;
+	}
+
+	/* Success! */
+	return (C);
+
+err4:
+	free(C->fbuckets);
+err3:
+	free(C->kbuckets);
+err2:
+	free(C->ents);
+err1:
+	free(C);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * storage_fdcache_get(S, fileno, type):
+ * Return a file descriptor open for reading the file ${fileno} of type
+ * ${type} (as passed to storage_util_mkpath()) in the storage state ${S},
+ * opening it if it is not already in the cache.  If the
+ * file has been (or is being) deleted, fail and return with errno set to
+ * ENOENT.  The descriptor must be passed to storage_fdcache_release() once
+ * the caller is finished with it.
+ */
+int
+storage_fdcache_get(struct storage_state * S, uint64_t fileno, int type)
+{
+	struct storage_fdcache * C = S->fdcache;
+	struct fdcache_entry * E;
+	char * s;
+	size_t i;
+	int fd;
+	int oldfd = -1;
+	int saved_errno;
+
+	/* Lock the cache. */
+	if (lock(C))
+		goto err0;
+
+	/* If this file has been evicted, the blocks no longer exist. */
+	if (fileno < C->minfile)
+		goto enoent;
+
+	/* Is the file already open? */
+	if ((i = findkey(C, fileno, type)) != NONE)
+		goto hit;
+
+	/* Open the file without holding the lock. */
+	if (unlock(C))
+		goto err0;
+
+	/*
+	 * Open the file.  If errno is ENOENT, we lost a race against the
+	 * deleter thread; pass that back to our caller.
+	 */
+	if ((s = storage_util_mkpath(S, fileno, type)) == NULL)
+		goto err0;
+	fd = disk_open(s, S->direct && (type != STORAGE_UTIL_CRCS));
+	saved_errno = errno;
+	free(s);
+	if (fd == -1) {
+		errno = saved_errno;
+		goto err0;
+	}
+
+	/* Lock the cache again. */
+	if (lock(C))
+		goto err2;
+
+	/* The file may have been evicted while we were opening it. */
+	if (fileno < C->minfile) {
+		oldfd = fd;
+		goto enoent;
+	}
+
+	/* Another reader may have opened it too; if so, use theirs. */
+	if ((i = findkey(C, fileno, type)) != NONE) {
+		oldfd = fd;
+		goto hit;
+	}
+
+	/* If there are no empty entries, empty the LRU idle entry. */
+	if ((C->freelist == NONE) && ((i = C->lru_tail) != NONE)) {
+		lru_remove(C, i);
+		oldfd = release_ent(C, i);
+	}
+
+	/*
+	 * If every entry is in use, hand the descriptor back uncached;
+	 * storage_fdcache_release will close it.
+	 */
+	if ((i = C->freelist) == NONE)
+		goto done;
+	C->freelist = C->ents[i].next;
+
+	/* Fill in the entry and add it to the hash chains. */
+	E = &C->ents[i];
+	E->fileno = fileno;
+	E->type = type;
+	E->fd = fd;
+	E->refcnt = 1;
+	E->knext = *kbucket(C, fileno, type);
+	*kbucket(C, fileno, type) = i;
+	E->fnext = *fbucket(C, fd);
+	*fbucket(C, fd) = i;
+	goto done;
+
+hit:
+	/* Use the cached descriptor. */
+	E = &C->ents[i];
+	if (E->refcnt++ == 0)
+		lru_remove(C, i);
+	fd = E->fd;
+
+done:
+	/* Unlock the cache. */
+	if (unlock(C))
+		goto err1;
+
+	/* Close any descriptor we don't need any more. */
+	closefd(oldfd);
+
+	/* Success! */
+	return (fd);
+
+enoent:
+	/* This file doesn't exist any more. */
+	unlock(C);
+	closefd(oldfd);
+	errno = ENOENT;
+	goto err0;
+
+err2:
+	closefd(fd);
+	goto err0;
+err1:
+	closefd(oldfd);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_fdcache_release(S, fd):
+ * Release the file descriptor ${fd} returned by storage_fdcache_get().
+ */
+int
+storage_fdcache_release(struct storage_state * S, int fd)
+{
+	struct storage_fdcache * C = S->fdcache;
+	struct fdcache_entry * E;
+	size_t i;
+	int oldfd = -1;
+
+	/* Lock the cache. */
+	if (lock(C))
+		goto err0;
+
+	if ((i = findfd(C, fd)) != NONE) {
+		/* Drop our reference; close if the file was evicted. */
+		E = &C->ents[i];
+		if (--E->refcnt == 0) {
+			if (E->dead)
+				oldfd = release_ent(C, i);
+			else
+				lru_add(C, i);
+		}
+	} else {
+		/* This descriptor was never cached. */
+		oldfd = fd;
+	}
+
+	/* Unlock the cache. */
+	if (unlock(C))
+		goto err1;
+
+	/* Close the descriptor if nobody needs it. */
+	closefd(oldfd);
+
+	/* Success! */
+	return (0);
+
+err1:
+	closefd(oldfd);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_fdcache_evict(S, fileno):
+ * Remove the files for block file ${fileno} and all earlier block files from
+ * the cache in the storage state ${S}, closing their descriptors once they
+ * are no longer in use.  This must be called before the files are unlinked.
+ */
+int
+storage_fdcache_evict(struct storage_state * S, uint64_t fileno)
+{
+	struct storage_fdcache * C = S->fdcache;
+	struct fdcache_entry * E;
+	int * fds;
+	size_t nfds = 0;
+	size_t i;
+
+	/* We may need to close every entry. */
+	if ((fds = malloc(C->nents * sizeof(int))) == NULL) {
+		warnp("malloc");
+		goto err0;
+	}
+
+	/* Lock the cache. */
+	if (lock(C))
+		goto err1;
+
+	/* Don't open this file (or any earlier file) again. */
+	if (C->minfile <= fileno)
+		C->minfile = fileno + 1;
+
+	/* Close or mark for closing any cached copies. */
+	for (i = 0; i < C->nents; i++) {
+		E = &C->ents[i];
+		if ((E->fd == -1) || E->dead || (E->fileno > fileno))
+			continue;
+		if (E->refcnt == 0) {
+			lru_remove(C, i);
+			fds[nfds++] = release_ent(C, i);
+		} else {
+			unchain(C, kbucket(C, E->fileno, E->type), i, 1);
+			E->dead = 1;
+		}
+	}
+
+	/* Unlock the cache. */
+	if (unlock(C))
+		goto err2;
+
+	/* Close the descriptors we removed. */
+	for (i = 0; i < nfds; i++)
+		closefd(fds[i]);
+	free(fds);
+
+	/* Success! */
+	return (0);
+
+err2:
+	for (i = 0; i < nfds; i++)
+		closefd(fds[i]);
+err1:
+	free(fds);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_fdcache_free(C):
+ * Close all file descriptors held by the cache ${C} and free it.
+ */
+void
+storage_fdcache_free(struct storage_fdcache * C)
+{
+	size_t i;
+	int rc;
+
+	/* Close any open descriptors. */
+	for (i = 0; i < C->nents; i++)
+		closefd(C->ents[i].fd);
+
+	/* Destroy the lock. */
+	if ((rc = pthread_mutex_destroy(&C->mtx)) != 0)
+		warn0("pthread_mutex_destroy: %s", strerror(rc));
+
+	/* Free structures. */
+	free(C->fbuckets);
+	free(C->kbuckets);
+	free(C->ents);
+	free(C);
+}
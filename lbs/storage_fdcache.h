@@ -0,0 +1,48 @@
+#ifndef STORAGE_FDCACHE_H_
+#define STORAGE_FDCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque types. */
+struct storage_fdcache;
+struct storage_state;
+
+/**
+ * storage_fdcache_init(nfds):
+ * Create and return a cache which holds up to ${nfds} open block files.
+ */
+struct storage_fdcache * storage_fdcache_init(size_t);
+
+/**
+ * storage_fdcache_get(S, fileno, type):
+ * Return a file descriptor open for reading the file ${fileno} of type
+ * ${type} (as passed to storage_util_mkpath()) in the storage state ${S},
+ * opening it if it is not already in the cache.  If the
+ * file has been (or is being) deleted, fail and return with errno set to
+ * ENOENT.  The descriptor must be passed to storage_fdcache_release() once
+ * the caller is finished with it.
+ */
+int storage_fdcache_get(struct storage_state *, uint64_t, int);
+
+/**
+ * storage_fdcache_release(S, fd):
+ * Release the file descriptor ${fd} returned by storage_fdcache_get().
+ */
+int storage_fdcache_release(struct storage_state *, int);
+
+/**
+ * storage_fdcache_evict(S, fileno):
+ * Remove the files for block file ${fileno} and all earlier block files from
+ * the cache in the storage state ${S}, closing their descriptors once they
+ * are no longer in use.  This must be called before the files are unlinked.
+ */
+int storage_fdcache_evict(struct storage_state *, uint64_t);
+
+/**
+ * storage_fdcache_free(C):
+ * Close all file descriptors held by the cache ${C} and free it.
+ */
+void storage_fdcache_free(struct storage_fdcache *);
+
+#endif /* !STORAGE_FDCACHE_H_ */
@@ -34,7 +34,8 @@ fs_compar(void * cookie, const void * _x, const void * _y)
 
 /**
  * storage_findfiles(path):
- * Look for files named "blks_<16 hex digits>" in the directory ${path}.
+ * Look for files named "blks_<16 hex digits>" or "blkp_<16 hex digits>" in
+ * the directory ${path}.
  * Return an elastic queue of struct storage_file, in order of increasing
  * fileno.
  */
@@ -65,8 +66,8 @@ storage_findfiles(const char * path)
 	}
 
 	/*
-	 * Look for files named "blks_<64-bit hexified first block #>" and
-	 * create storage_file structures for each.
+	 * Look for files named "blks_<64-bit hexified first block #>" or
+	 * "blkp_<...>" and create storage_file structures for each.
 	 */
 	while (1) {
 		/* Get a pointer to the next directory entry. */
@@ -78,8 +79,9 @@ storage_findfiles(const char * path)
 		if (strlen(dp->d_name) != strlen("blks_0123456789abcdef"))
 			continue;
 
-		/* Skip anything which doesn't start with "blks_". */
-		if (strncmp(dp->d_name, "blks_", 5))
+		/* Skip anything which doesn't start with "blks_" or "blkp_". */
+		if (strncmp(dp->d_name, "blks_", 5) &&
+		    strncmp(dp->d_name, "blkp_", 5))
 			continue;
 
 		/* Make sure the name has 8 hexified bytes and parse. */
@@ -104,9 +106,10 @@ storage_findfiles(const char * path)
 		if ((sf = malloc(sizeof(struct storage_file))) == NULL)
 			goto err4;
 
-		/* Fill in file number and size. */
+		/* Fill in file number, size, and type. */
 		sf->fileno = be64dec(fileno_exp);
 		sf->len = sb.st_size;
+		sf->pfile = (dp->d_name[3] == 'p');
 
 		/* Insert the file into the heap. */
 		if (ptrheap_add(H, sf))
@@ -9,11 +9,13 @@
 struct storage_file {
 	uint64_t fileno;	/* Hex digits in "blks_<16 hex digits>". */
 	off_t len;		/* Length of the file, in bytes. */
+	int pfile;		/* Named "blkp_..." (preallocated). */
 };
 
 /**
  * storage_findfiles(path):
- * Look for files named "blks_<16 hex digits>" in the directory ${path}.
+ * Look for files named "blks_<16 hex digits>" or "blkp_<16 hex digits>" in
+ * the directory ${path}.
  * Return an elastic queue of struct storage_file, in order of increasing
  * fileno.
  */
@@ -6,6 +6,8 @@
 
 /* Opaque types. */
 struct elasticqueue;
+struct storage_blkcache;
+struct storage_fdcache;
 
 /* Back-end storage state. */
 struct storage_state {
@@ -13,6 +15,13 @@ struct storage_state {
 	const char * storagedir;	/* Directory containing bits. */
 	size_t blocklen;		/* Block size in bytes. */
 	uint64_t maxnblks;		/* Maximum # of blocks in a file. */
+	int direct;			/* Bypass the buffer cache. */
+	int prealloc;			/* Create preallocated files. */
+	uint64_t hdrblks;		/* Header blocks in such files. */
+	int crcs;			/* Store checksums for new files. */
+	int verify;			/* Some files have checksums. */
+	struct storage_fdcache * fdcache;	/* Open block files. */
+	struct storage_blkcache * blkcache;	/* Recent blocks, or NULL. */
 
 	/* Debugging options. */
 	long latency;			/* Read latency in ns. */
@@ -23,6 +32,17 @@ struct storage_state {
 	struct elasticqueue * files;	/* File states. */
 	uint64_t minblk;		/* Minimum valid block #. */
 	uint64_t nextblk;		/* Next block # to write. */
+
+	/* Checksums of the last block file; see storage_crcs.h. */
+	uint64_t tcrcs_fileno;		/* Block file, or -1 if none. */
+	uint8_t * tcrcs;		/* 4 bytes per block. */
+	uint64_t tcrcs_alloc;		/* Checksums allocated. */
+
+	/* Preallocated file being appended to; used by the writer only. */
+	int wfd;			/* Descriptor, or -1 if none. */
+	uint64_t wfileno;		/* Block file number. */
+	uint64_t walloc;		/* Data blocks allocated. */
+	int wslot;			/* Slot for next commit record. */
 };
 
 /**
@@ -31,6 +51,9 @@ struct storage_state {
  * 2. If files is non-empty, minblk = head(files)->start.
  * 3. If files is non-empty, nextblk = tail(files)->start + tail(files)->len.
  * 4. For consecutive entries x, y in files, x->start + x->len = y->start.
+ * 5. If tcrcs_fileno != -1, tcrcs holds the checksums of all the blocks in
+ *    the block file tcrcs_fileno, which is the last (or, while the writer
+ *    is starting a new file, the second-last) file.
  */
 
 #endif /* !STORAGE_INTERNAL_H_ */
@@ -0,0 +1,373 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "sysendian.h"
+#include "warnp.h"
+
+#include "disk.h"
+#include "storage_internal.h"
+#include "storage_util.h"
+
+#include "storage_pfile.h"
+
+/*
+ * Maximum number of bytes to allocate beyond the blocks being written.  We
+ * allocate as much space again as the file holds, up to this limit, so that
+ * small files don't waste space and large files rarely need to be extended.
+ */
+#define PFILE_EXTENT	(16 * 1024 * 1024)
+
+/* Maximum number of bytes to read at once when checking blocks. */
+#define PFILE_CHUNK	(1024 * 1024)
+
+/* Commit record layout. */
+#define REC_MAGIC	"lbs_pcr1"	/* 8-byte magic. */
+#define REC_NBLKS	8		/* Blocks in file after this append. */
+#define REC_PREV	16		/* Blocks in file before this append. */
+#define REC_DATACRC	24		/* CRC32C of appended blocks. */
+#define REC_CRC		28		/* CRC32C of record up to here. */
+
+/* Compute the CRC32C of ${len} bytes from ${buf}. */
+static void
+crc(const uint8_t * buf, size_t len, uint8_t cbuf[4])
+{
+	CRC32C_CTX ctx;
+
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, buf, len);
+	CRC32C_Final(cbuf, &ctx);
+}
+
+/*
+ * Return 1 if blocks [${start}, ${end}) of the file ${fd} match the CRC32C
+ * value ${cbuf}; 0 if they do not; or -1 on error.
+ */
+static int
+checkdata(struct storage_state * S, int fd, uint64_t start, uint64_t end,
+    const uint8_t cbuf[4])
+{
+	CRC32C_CTX ctx;
+	uint8_t cbuf_actual[4];
+	uint8_t * buf;
+	size_t chunkblks;
+	size_t n;
+
+	/* Allocate a buffer holding at least one block. */
+	if ((chunkblks = PFILE_CHUNK / S->blocklen) == 0)
+		chunkblks = 1;
+	if ((buf = disk_allocbuf(chunkblks * S->blocklen)) == NULL) {
+		warnp("posix_memalign");
+		goto err0;
+	}
+
+	/* Feed the blocks into the CRC, one chunk at a time. */
+	CRC32C_Init(&ctx);
+	while (start < end) {
+		n = chunkblks;
+		if (n > end - start)
+			n = (size_t)(end - start);
+		if (disk_pread(fd, (off_t)((S->hdrblks + start) * S->blocklen),
+		    n * S->blocklen, buf))
+			goto err1;
+		CRC32C_Update(&ctx, buf, n * S->blocklen);
+		start += n;
+	}
+	CRC32C_Final(cbuf_actual, &ctx);
+
+	/* Free the buffer. */
+	free(buf);
+
+	/* Do the CRCs match? */
+	return (memcmp(cbuf, cbuf_actual, 4) == 0);
+
+err1:
+	free(buf);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Read the commit records from the preallocated block file ${fileno} and
+ * set ${nblks} to the number of blocks committed and ${slot} to the slot
+ * holding the latest valid commit record, or -1 if there is none.
+ */
+static int
+readstate(struct storage_state * S, uint64_t fileno, uint64_t * nblks,
+    int * slot)
+{
+	struct stat sb;
+	uint8_t cbuf[4];
+	uint8_t * rec;
+	uint64_t maxnblks;
+	uint64_t n, prev;
+	char * s;
+	int fd;
+	int i;
+
+	/* Open the file. */
+	if ((s = storage_util_mkpath(S, fileno, STORAGE_UTIL_BLKP)) == NULL)
+		goto err0;
+	if ((fd = disk_open(s, 0)) == -1) {
+		warnp("open(%s)", s);
+		goto err1;
+	}
+
+	/* Figure out how many blocks the file has space for. */
+	if (fstat(fd, &sb)) {
+		warnp("fstat(%s)", s);
+		goto err2;
+	}
+	if ((uint64_t)sb.st_size / S->blocklen > S->hdrblks)
+		maxnblks = (uint64_t)sb.st_size / S->blocklen - S->hdrblks;
+	else
+		maxnblks = 0;
+
+	/* Allocate a buffer for reading commit records. */
+	if ((rec = disk_allocbuf(STORAGE_PFILE_RECLEN)) == NULL) {
+		warnp("posix_memalign");
+		goto err2;
+	}
+
+	/* Look for the valid commit record with the most blocks. */
+	*nblks = 0;
+	*slot = -1;
+	for (i = 0; i < 2; i++) {
+		/* If the file is too short to hold this record, skip it. */
+		if (sb.st_size < (off_t)(i + 1) * STORAGE_PFILE_RECLEN)
+			continue;
+
+		/* Read the record. */
+		if (disk_pread(fd, (off_t)i * STORAGE_PFILE_RECLEN,
+		    STORAGE_PFILE_RECLEN, rec))
+			goto err3;
+
+		/* Check the magic and the record's CRC. */
+		crc(rec, REC_CRC, cbuf);
+		if (memcmp(rec, REC_MAGIC, 8) || memcmp(&rec[REC_CRC], cbuf, 4))
+			continue;
+
+		/* Is the record plausible, and newer than any we've seen? */
+		n = be64dec(&rec[REC_NBLKS]);
+		prev = be64dec(&rec[REC_PREV]);
+		if ((prev > n) || (n > maxnblks) || (n <= *nblks))
+			continue;
+
+		/* The blocks written in this append must be intact. */
+		switch (checkdata(S, fd, prev, n, &rec[REC_DATACRC])) {
+		case -1:
+			goto err3;
+		case 0:
+			continue;
+		}
+
+		/* This is the best record so far. */
+		*nblks = n;
+		*slot = i;
+	}
+
+	/* Clean up. */
+	free(rec);
+	if (close(fd))
+		warnp("close");
+	free(s);
+
+	/* Success! */
+	return (0);
+
+err3:
+	free(rec);
+err2:
+	if (close(fd))
+		warnp("close");
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_pfile_hdrblks(blocklen):
+ * Return the number of ${blocklen}-byte blocks at the start of a
+ * preallocated block file which are occupied by the commit records.
+ */
+uint64_t
+storage_pfile_hdrblks(size_t blocklen)
+{
+
+	return ((2 * STORAGE_PFILE_RECLEN + blocklen - 1) / blocklen);
+}
+
+/**
+ * storage_pfile_recover(S, fileno, nblks):
+ * Read the commit records of the preallocated block file ${fileno} in the
+ * storage state ${S} and set ${nblks} to the number of blocks it holds.
+ */
+int
+storage_pfile_recover(struct storage_state * S, uint64_t fileno,
+    uint64_t * nblks)
+{
+	int slot;
+
+	return (readstate(S, fileno, nblks, &slot));
+}
+
+/**
+ * storage_pfile_append(S, fileno, create, pos, nblks, buf):
+ * Write the ${nblks} blocks in ${buf} to the preallocated block file
+ * ${fileno} in the storage state ${S} after the ${pos} blocks which it
+ * already holds, and commit them.  If ${create} is non-zero, create the
+ * file (and ${pos} must be zero).  There MUST NOT at any time be more than
+ * one thread calling this function.
+ */
+int
+storage_pfile_append(struct storage_state * S, uint64_t fileno, int create,
+    uint64_t pos, uint64_t nblks, const uint8_t * buf)
+{
+	uint8_t * abuf = NULL;	/* free(NULL) simplifies error path. */
+	uint8_t * rec;
+	size_t len = (size_t)(nblks * S->blocklen);
+	uint64_t nalloc;
+	uint64_t nextent;
+	uint64_t n;
+	char * s;
+	int slot;
+
+	/* Open the file, unless we're already appending to it. */
+	if ((S->wfd == -1) || (S->wfileno != fileno)) {
+		/* We won't be appending to the previous file any more. */
+		storage_pfile_close(S);
+
+		/* Find the latest commit record in an existing file. */
+		if (create) {
+			slot = -1;
+		} else {
+			if (readstate(S, fileno, &n, &slot))
+				goto err0;
+			if (n != pos) {
+				warn0("Preallocated block file %016" PRIx64
+				    " has %" PRIu64 " blocks, expected %"
+				    PRIu64, fileno, n, pos);
+				goto err0;
+			}
+		}
+
+		/* Open (or create) the file. */
+		if ((s = storage_util_mkpath(S, fileno,
+		    STORAGE_UTIL_BLKP)) == NULL)
+			goto err0;
+		S->wfd = disk_openw(s, create, S->direct);
+		free(s);
+		if (S->wfd == -1)
+			goto err0;
+		S->wfileno = fileno;
+		S->wslot = (slot == 0) ? 1 : 0;
+
+		/* We don't know how much space is allocated yet. */
+		S->walloc = 0;
+	}
+
+	/*
+	 * If the new blocks extend past the space we've allocated, allocate
+	 * another extent and flush the file size to disk; once this is done,
+	 * fdatasync is sufficient to commit data written into the extent.
+	 */
+	if (pos + nblks > S->walloc) {
+		nextent = pos + nblks;
+		if (nextent > PFILE_EXTENT / S->blocklen)
+			nextent = PFILE_EXTENT / S->blocklen;
+		nalloc = pos + nblks + nextent;
+		if (nalloc > S->maxnblks)
+			nalloc = S->maxnblks;
+		if (disk_prealloc(S->wfd,
+		    (off_t)((S->hdrblks + nalloc) * S->blocklen)))
+			goto err0;
+		if ((S->nosync == 0) && disk_sync(S->wfd, 0))
+			goto err0;
+		S->walloc = nalloc;
+	}
+
+	/* Direct I/O needs an aligned buffer. */
+	if (S->direct && ((uintptr_t)buf % DISK_DIRECT_ALIGN)) {
+		if ((abuf = disk_allocbuf(len)) == NULL) {
+			warnp("posix_memalign");
+			goto err0;
+		}
+		memcpy(abuf, buf, len);
+		buf = abuf;
+	}
+
+	/* Write the blocks. */
+	if (disk_pwrite(S->wfd, (off_t)((S->hdrblks + pos) * S->blocklen),
+	    len, buf))
+		goto err1;
+
+	/* Construct a commit record. */
+	if ((rec = disk_allocbuf(STORAGE_PFILE_RECLEN)) == NULL) {
+		warnp("posix_memalign");
+		goto err1;
+	}
+	memset(rec, 0, STORAGE_PFILE_RECLEN);
+	memcpy(rec, REC_MAGIC, 8);
+	be64enc(&rec[REC_NBLKS], pos + nblks);
+	be64enc(&rec[REC_PREV], pos);
+	crc(buf, len, &rec[REC_DATACRC]);
+	crc(rec, REC_CRC, &rec[REC_CRC]);
+
+	/*
+	 * Write it into the slot which doesn't hold the latest record, so
+	 * that if we crash before the blocks reach the disk the previous
+	 * record will still be intact.
+	 */
+	if (disk_pwrite(S->wfd, (off_t)S->wslot * STORAGE_PFILE_RECLEN,
+	    STORAGE_PFILE_RECLEN, rec))
+		goto err2;
+	S->wslot ^= 1;
+
+	/* Commit the blocks and the record with a single flush. */
+	if ((S->nosync == 0) && disk_sync(S->wfd, 1))
+		goto err2;
+
+	/* Free buffers. */
+	free(rec);
+	free(abuf);
+
+	/* Success! */
+	return (0);
+
+err2:
+	free(rec);
+err1:
+	free(abuf);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * storage_pfile_close(S):
+ * Close the preallocated block file which the storage state ${S} has open
+ * for appending, if any.
+ */
+void
+storage_pfile_close(struct storage_state * S)
+{
+
+	/* Nothing to do if we don't have a file open. */
+	if (S->wfd == -1)
+		return;
+
+	/* Close the file. */
+	if (close(S->wfd))
+		warnp("close");
+	S->wfd = -1;
+}
@@ -0,0 +1,55 @@
+#ifndef STORAGE_PFILE_H_
+#define STORAGE_PFILE_H_
+
+#include <stdint.h>
+
+/* Opaque type. */
+struct storage_state;
+
+/**
+ * Preallocated block files ("blkp_<16 hex digits>") start with two commit
+ * records, each in its own STORAGE_PFILE_RECLEN-byte slot; the first
+ * storage_pfile_hdrblks() blocks of the file hold these and the data blocks
+ * follow.  The space after the data blocks is allocated in advance, so the
+ * length of the file does not indicate how many blocks it holds; instead,
+ * each APPEND writes the new blocks and then a commit record (alternating
+ * between the two slots) holding the new number of blocks and CRC32C values
+ * of the record and the newly written blocks, and issues a single
+ * fdatasync.  After a crash, the valid record with the most blocks
+ * indicates how many blocks the file holds.
+ */
+#define STORAGE_PFILE_RECLEN	4096
+
+/**
+ * storage_pfile_hdrblks(blocklen):
+ * Return the number of ${blocklen}-byte blocks at the start of a
+ * preallocated block file which are occupied by the commit records.
+ */
+uint64_t storage_pfile_hdrblks(size_t);
+
+/**
+ * storage_pfile_recover(S, fileno, nblks):
+ * Read the commit records of the preallocated block file ${fileno} in the
+ * storage state ${S} and set ${nblks} to the number of blocks it holds.
+ */
+int storage_pfile_recover(struct storage_state *, uint64_t, uint64_t *);
+
+/**
+ * storage_pfile_append(S, fileno, create, pos, nblks, buf):
+ * Write the ${nblks} blocks in ${buf} to the preallocated block file
+ * ${fileno} in the storage state ${S} after the ${pos} blocks which it
+ * already holds, and commit them.  If ${create} is non-zero, create the
+ * file (and ${pos} must be zero).  There MUST NOT at any time be more than
+ * one thread calling this function.
+ */
+int storage_pfile_append(struct storage_state *, uint64_t, int, uint64_t,
+    uint64_t, const uint8_t *);
+
+/**
+ * storage_pfile_close(S):
+ * Close the preallocated block file which the storage state ${S} has open
+ * for appending, if any.
+ */
+void storage_pfile_close(struct storage_state *);
+
+#endif /* !STORAGE_PFILE_H_ */
@@ -79,18 +79,21 @@ err0:
 }
 
 /**
- * storage_util_mkpath(S, fileno):
+ * storage_util_mkpath(S, fileno, type):
  * Return the malloc-allocated NUL-terminated string "${dir}/blks_${fileno}"
- * where ${dir} is ${S}->storagedir and ${fileno} is a 0-padding hex value.
+ * (or "blkp_" or "crcs_" in place of "blks_" if ${type} is STORAGE_UTIL_BLKP
+ * or STORAGE_UTIL_CRCS) where ${dir} is ${S}->storagedir and ${fileno} is a
+ * 0-padding hex value.
  */
 char *
-storage_util_mkpath(struct storage_state * S, uint64_t fileno)
+storage_util_mkpath(struct storage_state * S, uint64_t fileno, int type)
 {
+	static const char * prefixes[] = {"blks", "blkp", "crcs"};
 	char * s;
 
 	/* Construct path. */
-	if (asprintf(&s, "%s/blks_%016" PRIx64,
-	    S->storagedir, fileno) == -1) {
+	if (asprintf(&s, "%s/%s_%016" PRIx64, S->storagedir,
+	    prefixes[type], fileno) == -1) {
 		warnp("asprintf");
 		goto err0;
 	}
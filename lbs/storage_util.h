@@ -6,6 +6,11 @@
 /* Opaque types. */
 struct storage_state;
 
+/* Types of files in the storage directory. */
+#define STORAGE_UTIL_BLKS	0	/* Block file. */
+#define STORAGE_UTIL_BLKP	1	/* Preallocated block file. */
+#define STORAGE_UTIL_CRCS	2	/* Block checksums. */
+
 /**
  * storage_util_readlock(S):
  * Grab a read lock on the storage state ${S}.
@@ -25,10 +30,12 @@ int storage_util_writelock(struct storage_state *);
 int storage_util_unlock(struct storage_state *);
 
 /**
- * storage_util_mkpath(S, fileno):
+ * storage_util_mkpath(S, fileno, type):
  * Return the malloc-allocated NUL-terminated string "${dir}/blks_${fileno}"
- * where ${dir} is ${S}->storagedir and ${fileno} is a 0-padding hex value.
+ * (or "blkp_" or "crcs_" in place of "blks_" if ${type} is STORAGE_UTIL_BLKP
+ * or STORAGE_UTIL_CRCS) where ${dir} is ${S}->storagedir and ${fileno} is a
+ * 0-padding hex value.
  */
-char * storage_util_mkpath(struct storage_state *, uint64_t);
+char * storage_util_mkpath(struct storage_state *, uint64_t, int);
 
 #endif /* !STORAGE_UTIL_H_ */
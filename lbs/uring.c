@@ -0,0 +1,471 @@
+#ifdef APISUPPORT_CONFIG_FILE
+#include APISUPPORT_CONFIG_FILE
+#endif
+
+#ifdef APISUPPORT_LINUX_IO_URING
+/**
+ * APISUPPORT CFLAGS: LINUX_IO_URING
+ */
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "warnp.h"
+
+#include "uring.h"
+
+/* Ring state. */
+struct uring {
+	int ringfd;			/* Ring descriptor. */
+	int evfd;			/* Completion eventfd. */
+	unsigned int to_submit;		/* SQEs queued but not submitted. */
+
+	/* Submission queue. */
+	void * sq_ptr;			/* Mapped SQ ring. */
+	size_t sq_len;			/* Length of mapping. */
+	unsigned int * sq_head;		/* Consumed by kernel. */
+	unsigned int * sq_tail;		/* Produced by us. */
+	unsigned int sq_mask;		/* Ring mask. */
+	unsigned int sq_entries;	/* Ring size. */
+	unsigned int * sq_array;	/* Indexes into sqes. */
+	struct io_uring_sqe * sqes;	/* Submission queue entries. */
+	size_t sqes_len;		/* Length of mapping. */
+
+	/* Completion queue. */
+	void * cq_ptr;			/* Mapped CQ ring. */
+	size_t cq_len;			/* Length of mapping. */
+	unsigned int * cq_head;		/* Consumed by us. */
+	unsigned int * cq_tail;		/* Produced by kernel. */
+	unsigned int cq_mask;		/* Ring mask. */
+	struct io_uring_cqe * cqes;	/* Completion queue entries. */
+};
+
+/**
+ * uring_init(nentries):
+ * Create an io_uring which can hold at least ${nentries} operations in
+ * flight.  Return NULL with errno set to ENOTSUP if io_uring support was not
+ * compiled in.
+ */
+struct uring *
+uring_init(size_t nentries)
+{
+	struct uring * R;
+	struct io_uring_params p;
+	uint8_t * sq;
+	uint8_t * cq;
+	long rc;
+
+	/* Sanity-check: The kernel limits rings to 32768 entries. */
+	assert((nentries > 0) && (nentries <= 32768));
+
+	/* Allocate structure. */
+	if ((R = malloc(sizeof(struct uring))) == NULL)
+		goto err0;
+	R->to_submit = 0;
+
+	/* Create the ring. */
+	memset(&p, 0, sizeof(struct io_uring_params));
+	if ((rc = syscall(__NR_io_uring_setup, (unsigned int)nentries,
+	    &p)) == -1) {
+		warnp("io_uring_setup");
+		goto err1;
+	}
+	R->ringfd = (int)rc;
+
+	/* Map the submission queue ring. */
+	R->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	if ((R->sq_ptr = mmap(NULL, R->sq_len, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, R->ringfd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+		warnp("mmap");
+		goto err2;
+	}
+	sq = R->sq_ptr;
+	R->sq_head = (unsigned int *)(void *)&sq[p.sq_off.head];
+	R->sq_tail = (unsigned int *)(void *)&sq[p.sq_off.tail];
+	R->sq_mask = *(unsigned int *)(void *)&sq[p.sq_off.ring_mask];
+	R->sq_entries = p.sq_entries;
+	R->sq_array = (unsigned int *)(void *)&sq[p.sq_off.array];
+
+	/* Map the submission queue entries. */
+	R->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	if ((R->sqes = mmap(NULL, R->sqes_len, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, R->ringfd, IORING_OFF_SQES)) == MAP_FAILED) {
+		warnp("mmap");
+		goto err3;
+	}
+
+	/* Map the completion queue ring. */
+	R->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((R->cq_ptr = mmap(NULL, R->cq_len, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, R->ringfd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+		warnp("mmap");
+		goto err4;
+	}
+	cq = R->cq_ptr;
+	R->cq_head = (unsigned int *)(void *)&cq[p.cq_off.head];
+	R->cq_tail = (unsigned int *)(void *)&cq[p.cq_off.tail];
+	R->cq_mask = *(unsigned int *)(void *)&cq[p.cq_off.ring_mask];
+	R->cqes = (struct io_uring_cqe *)(void *)&cq[p.cq_off.cqes];
+
+	/* Create an eventfd and have the ring signal it on completions. */
+	if ((R->evfd = eventfd(0, EFD_NONBLOCK)) == -1) {
+		warnp("eventfd");
+		goto err5;
+	}
+	if (syscall(__NR_io_uring_register, R->ringfd,
+	    IORING_REGISTER_EVENTFD, &R->evfd, 1) == -1) {
+		warnp("io_uring_register");
+		goto err6;
+	}
+
+	/* Success! */
+	return (R);
+
+err6:
+	if (close(R->evfd))
+		warnp("close");
+err5:
+	munmap(R->cq_ptr, R->cq_len);
+err4:
+	munmap(R->sqes, R->sqes_len);
+err3:
+	munmap(R->sq_ptr, R->sq_len);
+err2:
+	if (close(R->ringfd))
+		warnp("close");
+err1:
+	free(R);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * uring_getfd(R):
+ * Return a descriptor which becomes readable when operations on the ring
+ * ${R} complete.
+ */
+int
+uring_getfd(struct uring * R)
+{
+
+	return (R->evfd);
+}
+
+/**
+ * uring_ack(R):
+ * Reset the descriptor returned by uring_getfd() to not being readable.
+ * This should be called before calling uring_reap() to collect completed
+ * operations.
+ */
+int
+uring_ack(struct uring * R)
+{
+	uint64_t count;
+
+	/* Reading the eventfd resets its counter to zero. */
+	while (read(R->evfd, &count, sizeof(uint64_t)) == -1) {
+		/* Try again on EINTR. */
+		if (errno == EINTR)
+			continue;
+
+		/* If the counter was already zero, we're done. */
+		if (errno == EAGAIN)
+			break;
+
+		/* Anything else is an error. */
+		warnp("read(eventfd)");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Queue an operation ${opcode} on the ring ${R}. */
+static void
+queue(struct uring * R, uint8_t opcode, int fd, off_t offset,
+    const uint8_t * buf, size_t nbytes, uint64_t cookie, uint8_t flags)
+{
+	struct io_uring_sqe * sqe;
+	unsigned int tail;
+	unsigned int idx;
+
+	/* We're the only writer of the tail. */
+	tail = *R->sq_tail;
+	assert(tail - __atomic_load_n(R->sq_head, __ATOMIC_ACQUIRE) <
+	    R->sq_entries);
+	assert(nbytes <= UINT32_MAX);
+
+	/* Fill in the submission queue entry. */
+	idx = tail & R->sq_mask;
+	sqe = &R->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->off = (uint64_t)offset;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = (uint32_t)nbytes;
+	sqe->user_data = cookie;
+
+	/* Publish it. */
+	R->sq_array[idx] = idx;
+	__atomic_store_n(R->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	R->to_submit += 1;
+}
+
+/**
+ * uring_read(R, fd, offset, buf, nbytes, cookie):
+ * Queue a read of ${nbytes} bytes from position ${offset} of the file ${fd}
+ * into ${buf} on the ring ${R}; ${cookie} will be returned by uring_reap()
+ * when it completes.  The read is not started until uring_submit() is
+ * called.  The caller must not have more than ${nentries} operations queued
+ * or in flight.
+ */
+void
+uring_read(struct uring * R, int fd, off_t offset, uint8_t * buf,
+    size_t nbytes, uint64_t cookie)
+{
+
+	queue(R, IORING_OP_READ, fd, offset, buf, nbytes, cookie, 0);
+}
+
+/**
+ * uring_write(R, fd, offset, buf, nbytes, cookie, link):
+ * Queue a write of ${nbytes} bytes from ${buf} to position ${offset} of the
+ * file ${fd} on the ring ${R}, as for uring_read().  If ${link} is non-zero,
+ * the next operation queued will not start until the write has completed,
+ * and will fail with -ECANCELED if the write fails or is short.
+ */
+void
+uring_write(struct uring * R, int fd, off_t offset, const uint8_t * buf,
+    size_t nbytes, uint64_t cookie, int link)
+{
+
+	queue(R, IORING_OP_WRITE, fd, offset, buf, nbytes, cookie,
+	    link ? IOSQE_IO_LINK : 0);
+}
+
+/**
+ * uring_fsync(R, fd, cookie):
+ * Queue an fsync of the file ${fd} on the ring ${R}, as for uring_read().
+ */
+void
+uring_fsync(struct uring * R, int fd, uint64_t cookie)
+{
+
+	queue(R, IORING_OP_FSYNC, fd, 0, NULL, 0, cookie, 0);
+}
+
+/**
+ * uring_submit(R):
+ * Start all operations queued on the ring ${R}.
+ */
+int
+uring_submit(struct uring * R)
+{
+	long rc;
+
+	/* Keep going until the kernel has taken everything. */
+	while (R->to_submit > 0) {
+		if ((rc = syscall(__NR_io_uring_enter, R->ringfd,
+		    R->to_submit, 0, 0, NULL, 0)) == -1) {
+			if (errno == EINTR)
+				continue;
+			warnp("io_uring_enter");
+			goto err0;
+		}
+
+		/*
+		 * We never have more operations in flight than the rings can
+		 * hold, so the kernel should always take something; if it
+		 * doesn't, retrying would just spin.
+		 */
+		if (rc == 0) {
+			warn0("io_uring_enter did not accept any operations");
+			goto err0;
+		}
+		R->to_submit -= (unsigned int)rc;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * uring_reap(R, cookie, res):
+ * If an operation on the ring ${R} has completed, set ${cookie} to its
+ * cookie and ${res} to its result (the number of bytes read or written,
+ * zero for an fsync, or a negated errno value) and return 1; otherwise,
+ * return 0.
+ */
+int
+uring_reap(struct uring * R, uint64_t * cookie, int * res)
+{
+	struct io_uring_cqe * cqe;
+	unsigned int head;
+
+	/* Is there anything in the completion queue? */
+	head = *R->cq_head;
+	if (head == __atomic_load_n(R->cq_tail, __ATOMIC_ACQUIRE))
+		return (0);
+
+	/* Grab the entry and hand it back to the kernel. */
+	cqe = &R->cqes[head & R->cq_mask];
+	*cookie = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(R->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	/* We got one. */
+	return (1);
+}
+
+/**
+ * uring_free(R):
+ * Free the ring ${R}.  All operations must have completed.
+ */
+void
+uring_free(struct uring * R)
+{
+
+	/* Close the eventfd; closing the ring unregisters it. */
+	if (close(R->evfd))
+		warnp("close");
+
+	/* Unmap the rings and close the ring descriptor. */
+	munmap(R->cq_ptr, R->cq_len);
+	munmap(R->sqes, R->sqes_len);
+	munmap(R->sq_ptr, R->sq_len);
+	if (close(R->ringfd))
+		warnp("close");
+
+	/* Free the structure. */
+	free(R);
+}
+
+#else /* !APISUPPORT_LINUX_IO_URING */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "warnp.h"
+
+#include "uring.h"
+
+/**
+ * uring_init(nentries):
+ * Create an io_uring which can hold at least ${nentries} operations in
+ * flight.  Return NULL with errno set to ENOTSUP if io_uring support was not
+ * compiled in.
+ */
+struct uring *
+uring_init(size_t nentries)
+{
+
+	(void)nentries; /* UNUSED */
+
+	/* We don't have io_uring. */
+	warn0("io_uring support not compiled in");
+	errno = ENOTSUP;
+	return (NULL);
+}
+
+/* The remaining functions cannot be reached without a ring. */
+int
+uring_getfd(struct uring * R)
+{
+
+	(void)R; /* UNUSED */
+	return (-1);
+}
+
+int
+uring_ack(struct uring * R)
+{
+
+	(void)R; /* UNUSED */
+	return (-1);
+}
+
+void
+uring_read(struct uring * R, int fd, off_t offset, uint8_t * buf,
+    size_t nbytes, uint64_t cookie)
+{
+
+	(void)R; /* UNUSED */
+	(void)fd; /* UNUSED */
+	(void)offset; /* UNUSED */
+	(void)buf; /* UNUSED */
+	(void)nbytes; /* UNUSED */
+	(void)cookie; /* UNUSED */
+}
+
+void
+uring_write(struct uring * R, int fd, off_t offset, const uint8_t * buf,
+    size_t nbytes, uint64_t cookie, int link)
+{
+
+	(void)R; /* UNUSED */
+	(void)fd; /* UNUSED */
+	(void)offset; /* UNUSED */
+	(void)buf; /* UNUSED */
+	(void)nbytes; /* UNUSED */
+	(void)cookie; /* UNUSED */
+	(void)link; /* UNUSED */
+}
+
+void
+uring_fsync(struct uring * R, int fd, uint64_t cookie)
+{
+
+	(void)R; /* UNUSED */
+	(void)fd; /* UNUSED */
+	(void)cookie; /* UNUSED */
+}
+
+int
+uring_submit(struct uring * R)
+{
+
+	(void)R; /* UNUSED */
+	return (-1);
+}
+
+int
+uring_reap(struct uring * R, uint64_t * cookie, int * res)
+{
+
+	(void)R; /* UNUSED */
+	(void)cookie; /* UNUSED */
+	(void)res; /* UNUSED */
+	return (0);
+}
+
+void
+uring_free(struct uring * R)
+{
+
+	(void)R; /* UNUSED */
+}
+
+#endif /* !APISUPPORT_LINUX_IO_URING */
@@ -0,0 +1,82 @@
+#ifndef URING_H_
+#define URING_H_
+
+#include <sys/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque type. */
+struct uring;
+
+/**
+ * uring_init(nentries):
+ * Create an io_uring which can hold at least ${nentries} operations in
+ * flight.  Return NULL with errno set to ENOTSUP if io_uring support was not
+ * compiled in.
+ */
+struct uring * uring_init(size_t);
+
+/**
+ * uring_getfd(R):
+ * Return a descriptor which becomes readable when operations on the ring
+ * ${R} complete.
+ */
+int uring_getfd(struct uring *);
+
+/**
+ * uring_ack(R):
+ * Reset the descriptor returned by uring_getfd() to not being readable.
+ * This should be called before calling uring_reap() to collect completed
+ * operations.
+ */
+int uring_ack(struct uring *);
+
+/**
+ * uring_read(R, fd, offset, buf, nbytes, cookie):
+ * Queue a read of ${nbytes} bytes from position ${offset} of the file ${fd}
+ * into ${buf} on the ring ${R}; ${cookie} will be returned by uring_reap()
+ * when it completes.  The read is not started until uring_submit() is
+ * called.  The caller must not have more than ${nentries} operations queued
+ * or in flight.
+ */
+void uring_read(struct uring *, int, off_t, uint8_t *, size_t, uint64_t);
+
+/**
+ * uring_write(R, fd, offset, buf, nbytes, cookie, link):
+ * Queue a write of ${nbytes} bytes from ${buf} to position ${offset} of the
+ * file ${fd} on the ring ${R}, as for uring_read().  If ${link} is non-zero,
+ * the next operation queued will not start until the write has completed,
+ * and will fail with -ECANCELED if the write fails or is short.
+ */
+void uring_write(struct uring *, int, off_t, const uint8_t *, size_t,
+    uint64_t, int);
+
+/**
+ * uring_fsync(R, fd, cookie):
+ * Queue an fsync of the file ${fd} on the ring ${R}, as for uring_read().
+ */
+void uring_fsync(struct uring *, int, uint64_t);
+
+/**
+ * uring_submit(R):
+ * Start all operations queued on the ring ${R}.
+ */
+int uring_submit(struct uring *);
+
+/**
+ * uring_reap(R, cookie, res):
+ * If an operation on the ring ${R} has completed, set ${cookie} to its
+ * cookie and ${res} to its result (the number of bytes read or written,
+ * zero for an fsync, or a negated errno value) and return 1; otherwise,
+ * return 0.
+ */
+int uring_reap(struct uring *, uint64_t *, int *);
+
+/**
+ * uring_free(R):
+ * Free the ring ${R}.  All operations must have completed.
+ */
+void uring_free(struct uring *);
+
+#endif /* !URING_H_ */
@@ -31,8 +31,8 @@ struct workctl {
 	int op;			/* 0 = read, 1 = write, 2 = free. */
 	uint64_t blkno;		/* Block to read, first block to write, */
 				/* or first block to NOT delete. */
-	size_t nblks;		/* Number of blocks to write. */
-				/* Number of blocks successfully read. */
+	size_t nblks;		/* Number of blocks to read or write. */
+				/* Reads set this to 0 on failure. */
 	uint8_t * buf;		/* Buffer to read/write into/from. */
 	uint64_t reqID;		/* ID of request (not used by worker). */
 };
@@ -73,10 +73,15 @@ workthread(void * cookie)
 		/* Do the work. */
 		switch (ctl->op) {
 		case 0:	/* Read */
-			if ((ctl->nblks = (size_t)storage_read(ctl->sstate,
-			    ctl->blkno, ctl->buf)) == (size_t)(-1)) {
+			switch (storage_read(ctl->sstate,
+			    ctl->blkno, ctl->nblks, ctl->buf)) {
+			case -1:
 				warnp("Failure reading block");
 				exit(1);
+			case 0:
+				/* Blocks not found. */
+				ctl->nblks = 0;
+				break;
 			}
 			break;
 		case 1:	/* Write */
@@ -133,3 +133,24 @@ kvldskey_mlen(const struct kvldskey * x, const struct kvldskey * y)
 	/* Return the matching length. */
 	return (mlen);
 }
+
+/**
+ * kvldskey_prefix(K, mlen):
+ * Return the 8 bytes of ${K} following its first ${mlen} bytes as a
+ * big-endian integer, padded with zero bytes if ${K} is too short.  If keys
+ * ${x} and ${y} match up to ${mlen} bytes, then ${x} < ${y} if the prefix of
+ * ${x} is less than that of ${y}, and ${x} > ${y} if it is greater.
+ */
+uint64_t
+kvldskey_prefix(const struct kvldskey * K, size_t mlen)
+{
+	uint64_t x = 0;
+	size_t i;
+
+	for (i = mlen; i < mlen + 8; i++) {
+		x <<= 8;
+		if (i < K->len)
+			x += K->buf[i];
+	}
+	return (x);
+}
@@ -73,6 +73,15 @@ int kvldskey_cmp2(const struct kvldskey *, const struct kvldskey *, size_t);
  */
 size_t kvldskey_mlen(const struct kvldskey *, const struct kvldskey *);
 
+/**
+ * kvldskey_prefix(K, mlen):
+ * Return the 8 bytes of ${K} following its first ${mlen} bytes as a
+ * big-endian integer, padded with zero bytes if ${K} is too short.  If keys
+ * ${x} and ${y} match up to ${mlen} bytes, then ${x} < ${y} if the prefix of
+ * ${x} is less than that of ${y}, and ${x} > ${y} if it is greater.
+ */
+uint64_t kvldskey_prefix(const struct kvldskey *, size_t);
+
 /**
  * kvldskey_free(K):
  * Free the key ${K}.
@@ -0,0 +1,168 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpusupport.h"
+#include "pfxsearch_sse42.h"
+#include "warnp.h"
+
+#include "pfxsearch.h"
+
+/*
+ * Once the range of positions which might hold ${x} is no longer than this,
+ * stop bisecting and count values in the range instead; this avoids the
+ * mispredicted branches at the bottom of a binary search, and lets us use
+ * SIMD comparisons where available.
+ */
+#define SCANLEN	16
+
+#if defined(CPUSUPPORT_X86_SSE42)
+#define HWACCEL
+
+static enum {
+	HW_SOFTWARE = 0,
+	HW_X86_SSE42,
+	HW_UNSET
+} hwaccel = HW_UNSET;
+#endif
+
+/* Count values in P[0 .. n - 1] which are less than / at most x. */
+static void
+count(const uint64_t * P, size_t n, uint64_t x, size_t * nlt, size_t * nle)
+{
+	size_t i;
+
+	*nlt = *nle = 0;
+	for (i = 0; i < n; i++) {
+		*nlt += (P[i] < x);
+		*nle += (P[i] <= x);
+	}
+}
+
+#ifdef HWACCEL
+/*
+ * Test whether hardware extensions and software code produce the same results.
+ */
+static int
+hwtest(void)
+{
+	uint64_t P[7] = {
+		0, 1, 0x7fffffffffffffff, 0x8000000000000000,
+		0x8000000000000000, 0xfffffffffffffffe, 0xffffffffffffffff
+	};
+	uint64_t x[5] = {
+		0, 2, 0x8000000000000000, 0xfffffffffffffffe,
+		0xffffffffffffffff
+	};
+	size_t nlt, nle, nlt_hw, nle_hw;
+	size_t i;
+
+	/* Compare counts for each value. */
+	for (i = 0; i < 5; i++) {
+		count(P, 7, x[i], &nlt, &nle);
+#if defined(CPUSUPPORT_X86_SSE42)
+		pfxsearch_count_sse42(P, 7, x[i], &nlt_hw, &nle_hw);
+#endif
+		if ((nlt_hw != nlt) || (nle_hw != nle))
+			return (1);
+	}
+
+	/* Success! */
+	return (0);
+}
+
+/* Which type of hardware acceleration should we use, if any? */
+static void
+hwaccel_init(void)
+{
+
+	/* If we've already set hwaccel, we're finished. */
+	if (hwaccel != HW_UNSET)
+		return;
+
+	/* Default to software. */
+	hwaccel = HW_SOFTWARE;
+
+#if defined(CPUSUPPORT_X86_SSE42)
+	CPUSUPPORT_VALIDATE(hwaccel, HW_X86_SSE42, cpusupport_x86_sse42(),
+	    hwtest());
+#endif
+}
+#endif /* HWACCEL */
+
+/* Return the number of values in P[0 .. n - 1] which are less than x. */
+static size_t
+lowerbound(const uint64_t * P, size_t n, uint64_t x)
+{
+	size_t min = 0, max = n, mid;
+
+	while (min != max) {
+		mid = min + (max - min) / 2;
+		if (P[mid] < x)
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	return (min);
+}
+
+/* Return the number of values in P[0 .. n - 1] which are at most x. */
+static size_t
+upperbound(const uint64_t * P, size_t n, uint64_t x)
+{
+	size_t min = 0, max = n, mid;
+
+	while (min != max) {
+		mid = min + (max - min) / 2;
+		if (P[mid] <= x)
+			min = mid + 1;
+		else
+			max = mid;
+	}
+	return (min);
+}
+
+/**
+ * pfxsearch(P, n, x, lo, hi):
+ * Given an array ${P} of ${n} values in non-decreasing order, set ${lo} to
+ * the number of values less than ${x} and ${hi} to the number of values less
+ * than or equal to ${x}.
+ */
+void
+pfxsearch(const uint64_t * P, size_t n, uint64_t x, size_t * lo, size_t * hi)
+{
+	size_t min = 0, max = n, mid;
+	size_t nlt, nle;
+
+#ifdef HWACCEL
+	/* Ensure that we've chosen the type of hardware acceleration. */
+	hwaccel_init();
+#endif
+
+	/*
+	 * Bisect until the values in P[min .. max - 1] are the only ones
+	 * which might equal x.
+	 */
+	while (max - min > SCANLEN) {
+		mid = min + (max - min) / 2;
+		if (P[mid] < x) {
+			min = mid + 1;
+		} else if (P[mid] > x) {
+			max = mid;
+		} else {
+			/* Values equal to x extend on both sides of mid. */
+			*lo = min + lowerbound(&P[min], mid - min, x);
+			*hi = mid + upperbound(&P[mid], max - mid, x);
+			return;
+		}
+	}
+
+	/* Count the values in the remaining range. */
+#if defined(CPUSUPPORT_X86_SSE42)
+	if (hwaccel == HW_X86_SSE42)
+		pfxsearch_count_sse42(&P[min], max - min, x, &nlt, &nle);
+	else
+#endif
+		count(&P[min], max - min, x, &nlt, &nle);
+	*lo = min + nlt;
+	*hi = min + nle;
+}
@@ -0,0 +1,24 @@
+#ifndef PFXSEARCH_H_
+#define PFXSEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Search of a sorted array of 64-bit key prefixes.  B+Tree nodes keep the
+ * 8 bytes of each key following the prefix all of the node's keys share as
+ * a big-endian integer; comparing these integers orders keys correctly
+ * except when two prefixes are equal, so a search of the prefix array
+ * narrows a search of the keys themselves down to the keys whose prefixes
+ * tie with the target's prefix.
+ */
+
+/**
+ * pfxsearch(P, n, x, lo, hi):
+ * Given an array ${P} of ${n} values in non-decreasing order, set ${lo} to
+ * the number of values less than ${x} and ${hi} to the number of values less
+ * than or equal to ${x}.
+ */
+void pfxsearch(const uint64_t *, size_t, uint64_t, size_t *, size_t *);
+
+#endif /* !PFXSEARCH_H_ */
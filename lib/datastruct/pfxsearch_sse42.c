@@ -0,0 +1,69 @@
+#include "cpusupport.h"
+#ifdef CPUSUPPORT_X86_SSE42
+/**
+ * CPUSUPPORT CFLAGS: X86_SSE42
+ */
+
+#include <nmmintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pfxsearch_sse42.h"
+
+/**
+ * pfxsearch_count_sse42(P, n, x, nlt, nle):
+ * Set ${nlt} to the number of the ${n} values in ${P} which are less than
+ * ${x} and ${nle} to the number which are less than or equal to ${x}.  This
+ * implementation uses x86 SSE4.2 instructions, and should only be used if
+ * CPUSUPPORT_X86_SSE42 is defined and cpusupport_x86_sse42() returns nonzero.
+ */
+void
+pfxsearch_count_sse42(const uint64_t * P, size_t n, uint64_t x,
+    size_t * nlt, size_t * nle)
+{
+	__m128i sign, X, V;
+	__m128i LT, GT;
+	uint64_t c[2];
+	size_t lt, gt;
+	size_t i;
+
+	/*
+	 * SSE4.2 only has a signed 64-bit comparison, so flip the top bit of
+	 * each value; this turns an unsigned comparison into a signed one.
+	 */
+	sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+	X = _mm_xor_si128(_mm_set1_epi64x((long long)x), sign);
+
+	/*
+	 * Count values less than and greater than x, two at a time; each
+	 * comparison yields -1 in lanes where it holds, so subtracting the
+	 * comparison results counts the matches in each lane.
+	 */
+	LT = GT = _mm_setzero_si128();
+	for (i = 0; i + 2 <= n; i += 2) {
+		V = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&P[i]),
+		    sign);
+		LT = _mm_sub_epi64(LT, _mm_cmpgt_epi64(X, V));
+		GT = _mm_sub_epi64(GT, _mm_cmpgt_epi64(V, X));
+	}
+
+	/* Add up the lanes. */
+	_mm_storeu_si128((__m128i *)c, LT);
+	lt = (size_t)(c[0] + c[1]);
+	_mm_storeu_si128((__m128i *)c, GT);
+	gt = (size_t)(c[0] + c[1]);
+
+	/* Handle a final odd value. */
+	if (i < n) {
+		if (P[i] < x)
+			lt++;
+		else if (P[i] > x)
+			gt++;
+	}
+
+	/* Return the counts. */
+	*nlt = lt;
+	*nle = n - gt;
+}
+
+#endif /* CPUSUPPORT_X86_SSE42 */
@@ -0,0 +1,17 @@
+#ifndef PFXSEARCH_SSE42_H_
+#define PFXSEARCH_SSE42_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * pfxsearch_count_sse42(P, n, x, nlt, nle):
+ * Set ${nlt} to the number of the ${n} values in ${P} which are less than
+ * ${x} and ${nle} to the number which are less than or equal to ${x}.  This
+ * implementation uses x86 SSE4.2 instructions, and should only be used if
+ * CPUSUPPORT_X86_SSE42 is defined and cpusupport_x86_sse42() returns nonzero.
+ */
+void pfxsearch_count_sse42(const uint64_t *, size_t, uint64_t, size_t *,
+    size_t *);
+
+#endif /* !PFXSEARCH_SSE42_H_ */
@@ -5,13 +5,52 @@
 
 #include "pool.h"
 
+/* Return the first record in the eviction queue after ${rec}, or the head. */
+static void *
+after(struct pool * P, void * rec)
+{
+
+	if (rec == NULL)
+		return (P->evict_head);
+	else
+		return (get_pool_elem(P, rec)->next);
+}
+
+/*
+ * Pick a record to evict from the pool ${P}, or return NULL if none can be.
+ * If ${lowok} is zero, don't pick a low-priority record.
+ */
+static void *
+pickvictim(struct pool * P, int lowok)
+{
+
+	/* Low-priority records go first. */
+	if (lowok && (P->evict_lowtail != NULL))
+		return (P->evict_head);
+
+	/*
+	 * Evict the oldest unused record if they make up more than an eighth
+	 * of the pool or there's nothing else to evict; otherwise evict the
+	 * least recently used of the other records.  (Johnson and Shasha
+	 * suggest a quarter, but this leaves too little room for the nodes
+	 * we use repeatedly once locked nodes are accounted for.)
+	 */
+	if ((P->nnew > P->size / 8) || (P->nmain == 0))
+		return (after(P, P->evict_lowtail));
+	else if (P->evict_newtail != NULL)
+		return (after(P, P->evict_newtail));
+	else
+		return (after(P, P->evict_lowtail));
+}
+
 /**
- * pool_init(nrec, offset):
+ * pool_init(nrec, offset, policy):
  * Create a pool with target size ${nrec} records, where each record has a
- * (struct pool_elem *) reserved at offset ${offset}.
+ * (struct pool_elem *) reserved at offset ${offset}, using the eviction
+ * policy ${policy}.
  */
 struct pool *
-pool_init(size_t nrec, size_t offset)
+pool_init(size_t nrec, size_t offset, int policy)
 {
 	struct pool * P;
 
@@ -23,7 +62,10 @@ pool_init(size_t nrec, size_t offset)
 	P->size = nrec;
 	P->used = 0;
 	P->evict_head = P->evict_tail = NULL;
+	P->evict_lowtail = P->evict_newtail = NULL;
+	P->nnew = P->nmain = 0;
 	P->offset = offset;
+	P->policy = policy;
 
 	/* Success! */
 	return (P);
@@ -50,14 +92,70 @@ pool_rec_add(struct pool * P, void * rec, void ** evict)
 	    malloc(sizeof(struct pool_elem))) == NULL)
 		goto err0;
 	get_pool_elem(P, rec)->wire_count = 1;
+	get_pool_elem(P, rec)->seg =
+	    (P->policy == POOL_2Q) ? POOL_SEG_NEW : POOL_SEG_MAIN;
 
 	/* Add the record to the pool. */
 	P->used += 1;
 
 	/* Evict a record if necessary and possible. */
 	if ((P->used > P->size) && (P->evict_head != NULL)) {
-		/* Grab the record at the head of the evict queue. */
-		*evict = P->evict_head;
+		/* Pick a record to evict. */
+		*evict = pickvictim(P, 1);
+
+		/* Remove said record from the queue. */
+		pool_delqueue(P, *evict);
+
+		/* Remove the record from the pool. */
+		free(get_pool_elem(P, *evict));
+		P->used -= 1;
+	} else {
+		*evict = NULL;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * pool_rec_add_lowpri(P, rec, evict):
+ * As pool_rec_add(), but add ${rec} as a low-priority record: Until it is
+ * next locked via pool_rec_lock(), the record will be placed ahead of all
+ * normal-priority records in the eviction queue when its lock count drops
+ * to zero.  Only normal-priority records will be evicted to make space for
+ * ${rec}; if the pool is at its target size and none can be evicted, do not
+ * add ${rec} and return 1.
+ */
+int
+pool_rec_add_lowpri(struct pool * P, void * rec, void ** evict)
+{
+	void * victim;
+
+	/* Find the normal-priority record we would evict. */
+	victim = pickvictim(P, 0);
+
+	/* If we're full and can't evict anything, don't add the record. */
+	if ((P->used >= P->size) && (victim == NULL))
+		return (1);
+
+	/* Create a pool_elem structure for this record. */
+	if ((get_pool_elem(P, rec) =
+	    malloc(sizeof(struct pool_elem))) == NULL)
+		goto err0;
+	get_pool_elem(P, rec)->wire_count = 1;
+	get_pool_elem(P, rec)->seg = POOL_SEG_LOW;
+
+	/* Add the record to the pool. */
+	P->used += 1;
+
+	/* Evict a normal-priority record if necessary. */
+	if (P->used > P->size) {
+		/* Evict the record we picked. */
+		*evict = victim;
 
 		/* Remove said record from the queue. */
 		pool_delqueue(P, *evict);
@@ -132,21 +230,43 @@ pool_free(struct pool * P)
 void
 pool_addqueue(struct pool * P, void * rec)
 {
+	struct pool_elem * E = get_pool_elem(P, rec);
+	void * prev;
 
-	/* This record has no successor. */
-	get_pool_elem(P, rec)->next = NULL;
-
-	/* This record's predecessor is the current last record (if any). */
-	get_pool_elem(P, rec)->prev = P->evict_tail;
+	/* Find the record to insert after, and update per-segment state. */
+	switch (E->seg) {
+	case POOL_SEG_LOW:
+		/* After any other low-priority records. */
+		prev = P->evict_lowtail;
+		P->evict_lowtail = rec;
+		break;
+	case POOL_SEG_NEW:
+		/* After any other unused and low-priority records. */
+		if (P->evict_newtail != NULL)
+			prev = P->evict_newtail;
+		else
+			prev = P->evict_lowtail;
+		P->evict_newtail = rec;
+		P->nnew += 1;
+		break;
+	default:
+		/* At the end of the queue. */
+		prev = P->evict_tail;
+		P->nmain += 1;
+		break;
+	}
 
-	/* Add this record to the queue. */
-	if (P->evict_head == NULL)
+	/* Link this record in after ${prev}. */
+	E->prev = prev;
+	E->next = after(P, prev);
+	if (prev == NULL)
 		P->evict_head = rec;
 	else
-		get_pool_elem(P, P->evict_tail)->next = rec;
-
-	/* This record is now the last record in the queue. */
-	P->evict_tail = rec;
+		get_pool_elem(P, prev)->next = rec;
+	if (E->next == NULL)
+		P->evict_tail = rec;
+	else
+		get_pool_elem(P, E->next)->prev = rec;
 }
 
 /**
@@ -156,26 +276,34 @@ pool_addqueue(struct pool * P, void * rec)
 void
 pool_delqueue(struct pool * P, void * rec)
 {
-	void * next = get_pool_elem(P, rec)->next;
-	void * prev = get_pool_elem(P, rec)->prev;
-
-	/* If this is the only record in the queue, it becomes empty. */
-	if ((P->evict_head == rec) && (P->evict_tail == rec)) {
-		P->evict_head = P->evict_tail = NULL;
-	} else
-	/* If this is the head, we have a new head. */
-	    if (P->evict_head == rec) {
+	struct pool_elem * E = get_pool_elem(P, rec);
+	void * next = E->next;
+	void * prev = E->prev;
+
+	/* If this was the last record in its segment, the previous one is. */
+	if (P->evict_lowtail == rec)
+		P->evict_lowtail = prev;
+	if (P->evict_newtail == rec) {
+		if ((prev != NULL) &&
+		    (get_pool_elem(P, prev)->seg == POOL_SEG_NEW))
+			P->evict_newtail = prev;
+		else
+			P->evict_newtail = NULL;
+	}
+
+	/* Update segment counts. */
+	if (E->seg == POOL_SEG_NEW)
+		P->nnew -= 1;
+	else if (E->seg == POOL_SEG_MAIN)
+		P->nmain -= 1;
+
+	/* Unlink the record from its neighbours. */
+	if (prev == NULL)
 		P->evict_head = next;
-		get_pool_elem(P, next)->prev = NULL;
-	} else
-	/* If this is the tail, we have a new tail. */
-	    if (P->evict_tail == rec) {
+	else
+		get_pool_elem(P, prev)->next = next;
+	if (next == NULL)
 		P->evict_tail = prev;
-		get_pool_elem(P, prev)->next = NULL;
-	} else
-	/* This is in the middle; point prev and next to each other. */
-	    {
+	else
 		get_pool_elem(P, next)->prev = prev;
-		get_pool_elem(P, prev)->next = next;
-	}
 }
@@ -10,11 +10,25 @@ struct pool;
 struct pool_elem;
 
 /**
- * pool_init(nrec, offset):
+ * Eviction policies.  POOL_LRU evicts the least recently used record.
+ * POOL_2Q uses the "simplified 2Q" policy of Johnson and Shasha: Records
+ * which have not been used again since they were added are kept in a FIFO
+ * queue separate from other records and are evicted first, unless they make
+ * up no more than an eighth of the pool, in which case the least recently
+ * used of the other records is evicted.  This prevents a stream of records
+ * which are used only once from flushing the records which are used
+ * repeatedly out of the pool.
+ */
+#define POOL_LRU	0
+#define POOL_2Q		1
+
+/**
+ * pool_init(nrec, offset, policy):
  * Create a pool with target size ${nrec} records, where each record has a
- * (struct pool_elem *) reserved at offset ${offset}.
+ * (struct pool_elem *) reserved at offset ${offset}, using the eviction
+ * policy ${policy}.
  */
-struct pool * pool_init(size_t, size_t);
+struct pool * pool_init(size_t, size_t, int);
 
 /**
  * pool_rec_add(P, rec, evict):
@@ -26,6 +40,17 @@ struct pool * pool_init(size_t, size_t);
  */
 int pool_rec_add(struct pool *, void *, void **);
 
+/**
+ * pool_rec_add_lowpri(P, rec, evict):
+ * As pool_rec_add(), but add ${rec} as a low-priority record: Until it is
+ * next locked via pool_rec_lock(), the record will be placed ahead of all
+ * normal-priority records in the eviction queue when its lock count drops
+ * to zero.  Only normal-priority records will be evicted to make space for
+ * ${rec}; if the pool is at its target size and none can be evicted, do not
+ * add ${rec} and return 1.
+ */
+int pool_rec_add_lowpri(struct pool *, void *, void **);
+
 /**
  * pool_rec_free(P, rec):
  * Remove the record ${rec} from the pool ${P}.  The record ${rec} must have
@@ -67,13 +92,27 @@ void pool_free(struct pool *);
 #endif
 #include <stdint.h>
 
+/**
+ * Records with lock count zero are kept in a single eviction queue, made up
+ * of low-priority records, then records which have not been used since
+ * they were added (if using POOL_2Q), then other records.
+ */
+#define POOL_SEG_LOW	0	/* Low-priority records. */
+#define POOL_SEG_NEW	1	/* Records not used since added (2Q). */
+#define POOL_SEG_MAIN	2	/* All other records. */
+
 /* Pool structure. */
 struct pool {
 	size_t size;		/* Target size of pool. */
 	size_t used;		/* Current size of pool. */
 	void * evict_head;	/* First record to evict. */
 	void * evict_tail;	/* Last record to evict. */
+	void * evict_lowtail;	/* Last low-priority record to evict. */
+	void * evict_newtail;	/* Last POOL_SEG_NEW record to evict. */
+	size_t nnew;		/* # of POOL_SEG_NEW records in queue. */
+	size_t nmain;		/* # of POOL_SEG_MAIN records in queue. */
 	size_t offset;		/* Offset of rec.(struct pool_elem). */
+	int policy;		/* Eviction policy. */
 };
 
 /* Pool element structure. */
@@ -89,6 +128,9 @@ struct pool_elem {
 
 	/* If wire_count == 0, previous element to be evicted. */
 	void * prev;
+
+	/* Segment of the eviction queue this record belongs in. */
+	int seg;
 };
 
 /* Find the pool_elem within a record. */
@@ -122,6 +164,17 @@ pool_rec_lock(struct pool * P, void * rec)
 	/* Remove from the evictable queue if necessary. */
 	if (get_pool_elem(P, rec)->wire_count == 1)
 		pool_delqueue(P, rec);
+
+	/*
+	 * Someone is using this record, so it isn't low-priority any more;
+	 * and if it was already in the pool unused, it has been used again.
+	 */
+	if (get_pool_elem(P, rec)->seg == POOL_SEG_LOW) {
+		get_pool_elem(P, rec)->seg =
+		    (P->policy == POOL_2Q) ? POOL_SEG_NEW : POOL_SEG_MAIN;
+	} else if (get_pool_elem(P, rec)->wire_count == 1) {
+		get_pool_elem(P, rec)->seg = POOL_SEG_MAIN;
+	}
 }
 
 /**
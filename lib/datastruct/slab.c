@@ -0,0 +1,191 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+/* Objects are aligned to this many bytes within a slab. */
+#define SLAB_ALIGN	16
+
+/* Target size of a slab, in bytes. */
+#define SLAB_BYTES	(1024 * 1024)
+
+/* Header at the start of each slab; objects follow at offset SLAB_HDRLEN. */
+struct slab_hdr {
+	struct slab_hdr * next;		/* Next slab in list. */
+};
+#define SLAB_HDRLEN							\
+	((sizeof(struct slab_hdr) + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN)
+
+/* Slab allocator structure. */
+struct slab {
+	size_t stride;			/* Bytes per object in a slab. */
+	size_t nper;			/* Objects per slab. */
+	struct slab_hdr * slabs;	/* List of slabs. */
+	uint8_t * freelist;		/* First free object, or NULL. */
+};
+
+/* Read and write the free list pointer stored in a free object. */
+static uint8_t *
+getnext(uint8_t * obj)
+{
+	uint8_t * next;
+
+	memcpy(&next, obj, sizeof(uint8_t *));
+	return (next);
+}
+
+static void
+setnext(uint8_t * obj, uint8_t * next)
+{
+
+	memcpy(obj, &next, sizeof(uint8_t *));
+}
+
+/* Allocate a new slab and add its objects to the free list. */
+static int
+grow(struct slab * S)
+{
+	struct slab_hdr * H;
+	uint8_t * p;
+	size_t i;
+
+	/* Allocate the slab. */
+	if ((H = malloc(SLAB_HDRLEN + S->nper * S->stride)) == NULL)
+		goto err0;
+
+	/* Add it to the list of slabs. */
+	H->next = S->slabs;
+	S->slabs = H;
+
+	/* Add its objects to the free list, lowest address first. */
+	p = (uint8_t *)H + SLAB_HDRLEN;
+	for (i = S->nper; i > 0; i--) {
+		setnext(&p[(i - 1) * S->stride], S->freelist);
+		S->freelist = &p[(i - 1) * S->stride];
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * slab_init(objlen, nrec):
+ * Create a slab allocator for objects of length ${objlen} bytes, which will
+ * typically hold up to ${nrec} objects at once.
+ */
+struct slab *
+slab_init(size_t objlen, size_t nrec)
+{
+	struct slab * S;
+
+	/* Allocate a slab allocator structure. */
+	if ((S = malloc(sizeof(struct slab))) == NULL)
+		goto err0;
+
+	/* Free objects must be able to hold a free list pointer. */
+	if (objlen < sizeof(uint8_t *))
+		objlen = sizeof(uint8_t *);
+
+	/* Round the object length up to keep objects aligned. */
+	if (objlen > SIZE_MAX - SLAB_ALIGN)
+		goto err1;
+	S->stride = (objlen + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+
+	/*
+	 * Put as many objects into a slab as will fit into SLAB_BYTES, but
+	 * no more than we're expecting to need, and at least one.
+	 */
+	S->nper = SLAB_BYTES / S->stride;
+	if (S->nper > nrec)
+		S->nper = nrec;
+	if (S->nper == 0)
+		S->nper = 1;
+	if (S->nper > (SIZE_MAX - SLAB_HDRLEN) / S->stride)
+		goto err1;
+
+	/* No slabs or free objects yet. */
+	S->slabs = NULL;
+	S->freelist = NULL;
+
+	/* Success! */
+	return (S);
+
+err1:
+	free(S);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * slab_alloc(S):
+ * Allocate an object from the slab allocator ${S}.
+ */
+void *
+slab_alloc(struct slab * S)
+{
+	uint8_t * obj;
+
+	/* If we have no free objects, allocate another slab. */
+	if ((S->freelist == NULL) && grow(S))
+		goto err0;
+
+	/* Take the first object from the free list. */
+	obj = S->freelist;
+	S->freelist = getnext(obj);
+
+	/* Success! */
+	return (obj);
+
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * slab_release(S, obj):
+ * Return the object ${obj}, which must have been allocated from the slab
+ * allocator ${S}, to the allocator.  Like free(3), do nothing if ${obj} is
+ * NULL.
+ */
+void
+slab_release(struct slab * S, void * obj)
+{
+
+	/* Behave consistently with free(NULL). */
+	if (obj == NULL)
+		return;
+
+	/* Put the object at the head of the free list. */
+	setnext(obj, S->freelist);
+	S->freelist = obj;
+}
+
+/**
+ * slab_free(S):
+ * Free the slab allocator ${S} and all of the objects allocated from it.
+ */
+void
+slab_free(struct slab * S)
+{
+	struct slab_hdr * H;
+
+	/* Behave consistently with free(NULL). */
+	if (S == NULL)
+		return;
+
+	/* Free the slabs. */
+	while ((H = S->slabs) != NULL) {
+		S->slabs = H->next;
+		free(H);
+	}
+
+	/* Free the allocator structure. */
+	free(S);
+}
@@ -0,0 +1,45 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+
+/**
+ * Slab allocator for fixed-size objects.  Objects are carved out of large
+ * allocations ("slabs") and are recycled via a free list rather than being
+ * returned to the system; slabs are only freed by slab_free().  This avoids
+ * per-object malloc overhead and fragmentation when objects are allocated
+ * and freed at a high rate, at the cost of holding on to the peak amount of
+ * memory used.
+ */
+
+/* Opaque slab allocator structure. */
+struct slab;
+
+/**
+ * slab_init(objlen, nrec):
+ * Create a slab allocator for objects of length ${objlen} bytes, which will
+ * typically hold up to ${nrec} objects at once.
+ */
+struct slab * slab_init(size_t, size_t);
+
+/**
+ * slab_alloc(S):
+ * Allocate an object from the slab allocator ${S}.
+ */
+void * slab_alloc(struct slab *);
+
+/**
+ * slab_release(S, obj):
+ * Return the object ${obj}, which must have been allocated from the slab
+ * allocator ${S}, to the allocator.  Like free(3), do nothing if ${obj} is
+ * NULL.
+ */
+void slab_release(struct slab *, void *);
+
+/**
+ * slab_free(S):
+ * Free the slab allocator ${S} and all of the objects allocated from it.
+ */
+void slab_free(struct slab *);
+
+#endif /* !SLAB_H_ */
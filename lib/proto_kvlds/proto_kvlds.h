@@ -8,6 +8,7 @@
 struct kvldskey;
 struct netbuf_read;
 struct netbuf_write;
+struct wire_packet;
 struct wire_requestqueue;
 
 /**
@@ -166,6 +167,13 @@ struct proto_kvlds_request {
  */
 struct proto_kvlds_request * proto_kvlds_request_alloc(void);
 
+/**
+ * proto_kvlds_request_parse(P, R):
+ * Parse the packet ${P} into the KVLDS request structure ${R}.
+ */
+int proto_kvlds_request_parse(const struct wire_packet *,
+    struct proto_kvlds_request *);
+
 /**
  * proto_kvlds_request_read(R, req):
  * Read a packet from the reader ${R} and parse it as an KVLDS request.  Return
@@ -230,4 +238,26 @@ int proto_kvlds_response_get(struct netbuf_write *, uint64_t, int,
 int proto_kvlds_response_range(struct netbuf_write *, uint64_t, size_t,
     const struct kvldskey *, struct kvldskey **, struct kvldskey **);
 
+/**
+ * proto_kvlds_response_range_getbuf(Q, ID, nkeys, next, kvlen):
+ * Start writing a RANGE response with ID ${ID}, next key ${next} and
+ * ${nkeys} key-value pairs, the serializations of which occupy a total of
+ * ${kvlen} bytes, to the write queue ${Q}.  Return a pointer to where the
+ * serialized keys and values should be written, each key followed by its
+ * value.  This must be followed by a call to
+ * proto_kvlds_response_range_done().
+ */
+uint8_t * proto_kvlds_response_range_getbuf(struct netbuf_write *, uint64_t,
+    size_t, const struct kvldskey *, size_t);
+
+/**
+ * proto_kvlds_response_range_done(Q, kvbuf, next, kvlen):
+ * Finish writing a RANGE response to the write queue ${Q}.  The value
+ * ${kvbuf} must be the pointer returned by
+ * proto_kvlds_response_range_getbuf(), and the values ${next} and ${kvlen}
+ * must be the values which were passed to it.
+ */
+int proto_kvlds_response_range_done(struct netbuf_write *, uint8_t *,
+    const struct kvldskey *, size_t);
+
 #endif /* !PROTO_KVLDS_H_ */
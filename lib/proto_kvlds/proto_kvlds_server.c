@@ -19,7 +19,7 @@ MPOOL(request, struct proto_kvlds_request, 4096);
  * proto_kvlds_request_parse(P, R):
  * Parse the packet ${P} into the KVLDS request structure ${R}.
  */
-static int
+int
 proto_kvlds_request_parse(const struct wire_packet * P,
     struct proto_kvlds_request * R)
 {
@@ -308,41 +308,34 @@ proto_kvlds_response_range(struct netbuf_write * Q, uint64_t ID,
     size_t nkeys, const struct kvldskey * next,
     struct kvldskey ** keys, struct kvldskey ** values)
 {
-	uint8_t * wbuf;
-	size_t len;
+	uint8_t * kvbuf;
+	size_t kvlen;
 	size_t i;
 	size_t bufpos;
 
-	/* Sanity check: We can't return more than 2^32-1 keys. */
-	assert(nkeys <= UINT32_MAX);
-
-	/* Figure out how long the packet will be. */
-	len = 8;
-	len += kvldskey_serial_size(next);
+	/* Figure out how long the key-value pairs will be. */
+	kvlen = 0;
 	for (i = 0; i < nkeys; i++) {
-		len += kvldskey_serial_size(keys[i]);
-		len += kvldskey_serial_size(values[i]);
+		kvlen += kvldskey_serial_size(keys[i]);
+		kvlen += kvldskey_serial_size(values[i]);
 	}
 
-	/* Get a packet data buffer. */
-	if ((wbuf = wire_writepacket_getbuf(Q, ID, len)) == NULL)
+	/* Get a buffer for the key-value pairs. */
+	if ((kvbuf = proto_kvlds_response_range_getbuf(Q, ID, nkeys, next,
+	    kvlen)) == NULL)
 		goto err0;
 
-	/* Write the packet data. */
-	be32enc(&wbuf[0], 0);
-	be32enc(&wbuf[4], (uint32_t)nkeys);
-	bufpos = 8;
-	kvldskey_serialize(next, &wbuf[bufpos]);
-	bufpos += kvldskey_serial_size(next);
+	/* Write the key-value pairs. */
+	bufpos = 0;
 	for (i = 0; i < nkeys; i++) {
-		kvldskey_serialize(keys[i], &wbuf[bufpos]);
+		kvldskey_serialize(keys[i], &kvbuf[bufpos]);
 		bufpos += kvldskey_serial_size(keys[i]);
-		kvldskey_serialize(values[i], &wbuf[bufpos]);
+		kvldskey_serialize(values[i], &kvbuf[bufpos]);
 		bufpos += kvldskey_serial_size(values[i]);
 	}
 
 	/* Finish the packet. */
-	if (wire_writepacket_done(Q, wbuf, len))
+	if (proto_kvlds_response_range_done(Q, kvbuf, next, kvlen))
 		goto err0;
 
 	/* Success! */
@@ -352,3 +345,59 @@ err0:
 	/* Failure! */
 	return (-1);
 }
+
+/**
+ * proto_kvlds_response_range_getbuf(Q, ID, nkeys, next, kvlen):
+ * Start writing a RANGE response with ID ${ID}, next key ${next} and
+ * ${nkeys} key-value pairs, the serializations of which occupy a total of
+ * ${kvlen} bytes, to the write queue ${Q}.  Return a pointer to where the
+ * serialized keys and values should be written, each key followed by its
+ * value.  This must be followed by a call to
+ * proto_kvlds_response_range_done().
+ */
+uint8_t *
+proto_kvlds_response_range_getbuf(struct netbuf_write * Q, uint64_t ID,
+    size_t nkeys, const struct kvldskey * next, size_t kvlen)
+{
+	uint8_t * wbuf;
+	size_t len;
+
+	/* Sanity check: We can't return more than 2^32-1 keys. */
+	assert(nkeys <= UINT32_MAX);
+
+	/* Figure out how long the packet will be. */
+	len = 8 + kvldskey_serial_size(next) + kvlen;
+
+	/* Get a packet data buffer. */
+	if ((wbuf = wire_writepacket_getbuf(Q, ID, len)) == NULL)
+		goto err0;
+
+	/* Write the packet header and next key. */
+	be32enc(&wbuf[0], 0);
+	be32enc(&wbuf[4], (uint32_t)nkeys);
+	kvldskey_serialize(next, &wbuf[8]);
+
+	/* The caller writes the key-value pairs. */
+	return (&wbuf[8 + kvldskey_serial_size(next)]);
+
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * proto_kvlds_response_range_done(Q, kvbuf, next, kvlen):
+ * Finish writing a RANGE response to the write queue ${Q}.  The value
+ * ${kvbuf} must be the pointer returned by
+ * proto_kvlds_response_range_getbuf(), and the values ${next} and ${kvlen}
+ * must be the values which were passed to it.
+ */
+int
+proto_kvlds_response_range_done(struct netbuf_write * Q, uint8_t * kvbuf,
+    const struct kvldskey * next, size_t kvlen)
+{
+	size_t hlen = 8 + kvldskey_serial_size(next);
+
+	/* Finish the packet. */
+	return (wire_writepacket_done(Q, kvbuf - hlen, hlen + kvlen));
+}
@@ -42,6 +42,19 @@ int proto_lbs_request_params2(struct wire_requestqueue *,
 int proto_lbs_request_get(struct wire_requestqueue *, uint64_t, size_t,
     int (*)(void *, int, int, const uint8_t *), void *);
 
+/**
+ * proto_lbs_request_getv(Q, blkno, nblks, blklen, callback, cookie):
+ * Send a GETV request to read the ${nblks} blocks of length ${blklen}
+ * starting at block ${blkno} via the request queue ${Q}.  Invoke
+ *     ${callback}(${cookie}, failed, status, buf)
+ * upon request completion, where failed is 0 on success and 1 on failure,
+ * status is 0 if the blocks have been read and 1 if any of the blocks do not
+ * exist, and buf contains the data of the ${nblks} blocks.  The value
+ * ${nblks} must be between 1 and PROTO_LBS_GETV_MAX inclusive.
+ */
+int proto_lbs_request_getv(struct wire_requestqueue *, uint64_t, uint32_t,
+    size_t, int (*)(void *, int, int, const uint8_t *), void *);
+
 /**
  * proto_lbs_request_append_blks(Q, nblks, blkno, blklen, bufv,
  *     callback, cookie):
@@ -87,8 +100,12 @@ int proto_lbs_request_free(struct wire_requestqueue *, uint64_t,
 #define PROTO_LBS_GET		1
 #define PROTO_LBS_APPEND	2
 #define PROTO_LBS_FREE		3
+#define PROTO_LBS_GETV		5
 #define PROTO_LBS_NONE		((uint32_t)(-1))
 
+/* Maximum number of blocks in a GETV request. */
+#define PROTO_LBS_GETV_MAX	256
+
 /* LBS request structure. */
 struct proto_lbs_request {
 	uint64_t ID;
@@ -106,6 +123,10 @@ struct proto_lbs_request {
 		struct proto_lbs_request_get {
 			uint64_t blkno;		/* Block # to read. */
 		} get;
+		struct proto_lbs_request_getv {
+			uint64_t blkno;		/* First block # to read. */
+			uint32_t nblks;		/* # of blocks to read. */
+		} getv;
 		struct proto_lbs_request_append {
 			uint32_t nblks;		/* # of blocks to write. */
 			uint32_t blklen;	/* Block length. */
@@ -152,6 +173,15 @@ int proto_lbs_response_params2(struct netbuf_write *, uint64_t,
 int proto_lbs_response_get(struct netbuf_write *, uint64_t,
     int, uint32_t, const uint8_t *);
 
+/**
+ * proto_lbs_response_getv(Q, ID, status, nblks, blklen, buf):
+ * Send a GETV response with ID ${ID} to the write queue ${Q} with status code
+ * ${status} and ${nblks} blocks of ${blklen} bytes of data from ${buf} if
+ * ${status} is zero.
+ */
+int proto_lbs_response_getv(struct netbuf_write *, uint64_t,
+    int, uint32_t, uint32_t, const uint8_t *);
+
 /**
  * proto_lbs_response_append(Q, ID, status, blkno):
  * Send an APPEND response with ID ${ID} to the write queue ${Q} with status
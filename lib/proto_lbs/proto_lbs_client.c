@@ -12,6 +12,7 @@
 static int callback_params(void *, uint8_t *, size_t);
 static int callback_params2(void *, uint8_t *, size_t);
 static int callback_get(void *, uint8_t *, size_t);
+static int callback_getv(void *, uint8_t *, size_t);
 static int callback_append(void *, uint8_t *, size_t);
 static int callback_free(void *, uint8_t *, size_t);
 
@@ -31,6 +32,12 @@ struct get_cookie {
 	size_t blklen;
 };
 
+struct getv_cookie {
+	int (* callback)(void *, int, int, const uint8_t *);
+	void * cookie;
+	size_t datalen;
+};
+
 struct append_cookie {
 	int (* callback)(void *, int, int, uint64_t);
 	void * cookie;
@@ -294,6 +301,103 @@ failed:
 	return (rc);
 }
 
+/**
+ * proto_lbs_request_getv(Q, blkno, nblks, blklen, callback, cookie):
+ * Send a GETV request to read the ${nblks} blocks of length ${blklen}
+ * starting at block ${blkno} via the request queue ${Q}.  Invoke
+ *     ${callback}(${cookie}, failed, status, buf)
+ * upon request completion, where failed is 0 on success and 1 on failure,
+ * status is 0 if the blocks have been read and 1 if any of the blocks do not
+ * exist, and buf contains the data of the ${nblks} blocks.  The value
+ * ${nblks} must be between 1 and PROTO_LBS_GETV_MAX inclusive.
+ */
+int
+proto_lbs_request_getv(struct wire_requestqueue * Q,
+    uint64_t blkno, uint32_t nblks, size_t blklen,
+    int (* callback)(void *, int, int, const uint8_t *), void * cookie)
+{
+	struct getv_cookie * C;
+	uint8_t * buf;
+
+	/* Sanity checks. */
+	assert(callback != NULL);
+	assert((nblks > 0) && (nblks <= PROTO_LBS_GETV_MAX));
+
+	/* Bake a cookie. */
+	if ((C = malloc(sizeof(struct getv_cookie))) == NULL)
+		goto err0;
+	C->callback = callback;
+	C->cookie = cookie;
+	C->datalen = nblks * blklen;
+
+	/* Start writing a request. */
+	if ((buf = wire_requestqueue_add_getbuf(Q, 16,
+	    callback_getv, C)) == NULL)
+		goto err1;
+
+	/* Construct request. */
+	be32enc(&buf[0], PROTO_LBS_GETV);
+	be64enc(&buf[4], blkno);
+	be32enc(&buf[12], nblks);
+
+	/* Finish writing request. */
+	if (wire_requestqueue_add_done(Q, buf, 16))
+		goto err1;
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(C);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* GETV response-handling callback. */
+static int
+callback_getv(void * cookie, uint8_t * buf, size_t buflen)
+{
+	struct getv_cookie * C = cookie;
+	int failed = 1;
+	int status = 0;
+	const uint8_t * blks = NULL;
+	int rc;
+
+	/* If we have a packet, parse it. */
+	if (buf != NULL) {
+		/* Is the status code sane? */
+		if (buflen < 4)
+			BAD("GETV", "bogus length");
+		if (be32dec(&buf[0]) > 1)
+			BAD("GETV", "bogus status code");
+		status = (int)be32dec(&buf[0]);
+
+		/* Do we have the right packet length? */
+		if ((status == 0) && (buflen != 4 + C->datalen))
+			BAD("GETV", "wrong length for status");
+		if ((status == 1) && (buflen != 4))
+			BAD("GETV", "wrong length for status");
+
+		/* Find the block data, if any. */
+		if (status == 0)
+			blks = &buf[4];
+
+		/* We successfully parsed this response. */
+		failed = 0;
+	}
+
+failed:
+	/* Invoke the upstream callback. */
+	rc = (C->callback)(C->cookie, failed, status, blks);
+
+	/* Free the cookie. */
+	free(C);
+
+	/* Return status from callback. */
+	return (rc);
+}
+
 /**
  * proto_lbs_request_append_blks(Q, nblks, blkno, blklen, bufv,
  *     callback, cookie):
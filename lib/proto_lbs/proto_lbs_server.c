@@ -43,6 +43,15 @@ proto_lbs_request_parse(const struct wire_packet * P,
 			goto err0;
 		R->r.get.blkno = be64dec(&P->buf[4]);
 		break;
+	case PROTO_LBS_GETV:
+		if (P->len != 16)
+			goto err0;
+		R->r.getv.blkno = be64dec(&P->buf[4]);
+		R->r.getv.nblks = be32dec(&P->buf[12]);
+		if ((R->r.getv.nblks == 0) ||
+		    (R->r.getv.nblks > PROTO_LBS_GETV_MAX))
+			goto err0;
+		break;
 	case PROTO_LBS_APPEND:
 		if (P->len < 16)
 			goto err0;
@@ -190,14 +199,33 @@ int
 proto_lbs_response_get(struct netbuf_write * Q, uint64_t ID,
     int status, uint32_t blklen, const uint8_t * buf)
 {
+
+	/* A GET response is the same as a GETV response for one block. */
+	return (proto_lbs_response_getv(Q, ID, status, 1, blklen, buf));
+}
+
+/**
+ * proto_lbs_response_getv(Q, ID, status, nblks, blklen, buf):
+ * Send a GETV response with ID ${ID} to the write queue ${Q} with status code
+ * ${status} and ${nblks} blocks of ${blklen} bytes of data from ${buf} if
+ * ${status} is zero.
+ */
+int
+proto_lbs_response_getv(struct netbuf_write * Q, uint64_t ID,
+    int status, uint32_t nblks, uint32_t blklen, const uint8_t * buf)
+{
 	uint8_t * wbuf;
+	size_t datalen;
 	size_t len;
 
 	/* Sanity check. */
 	assert((status == 0) || (status == 1));
+	assert((status == 1) || ((nblks > 0) &&
+	    (nblks <= PROTO_LBS_GETV_MAX)));
 
 	/* Compute the response length. */
-	len = 4 + ((status == 0) ? blklen : 0);
+	datalen = (size_t)nblks * blklen;
+	len = 4 + ((status == 0) ? datalen : 0);
 
 	/* Get a packet data buffer. */
 	if ((wbuf = wire_writepacket_getbuf(Q, ID, len)) == NULL)
@@ -206,7 +234,7 @@ proto_lbs_response_get(struct netbuf_write * Q, uint64_t ID,
 	/* Write the packet data. */
 	be32enc(&wbuf[0], (uint32_t)status);
 	if (status == 0)
-		memcpy(&wbuf[4], buf, blklen);
+		memcpy(&wbuf[4], buf, datalen);
 
 	/* Finish the packet. */
 	if (wire_writepacket_done(Q, wbuf, len))
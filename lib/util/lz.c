@@ -0,0 +1,254 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sysendian.h"
+
+#include "lz.h"
+
+/*
+ * Compressed data format: A sequence of tokens, each of which is
+ *	1 byte: (literal length << 4) + (match length - MINMATCH), with each
+ *		length capped at 15;
+ *	if the literal length is 15 or more, the literal length minus 15
+ *		as a series of bytes to be summed, ending with a byte < 255;
+ *	the literals;
+ *	and unless this is the last token,
+ *	2 bytes: LE offset (from 1 to 65535) to copy the match from;
+ *	if the match length is 15 + MINMATCH or more, the match length minus
+ *		(15 + MINMATCH) encoded in the same way as the literal length.
+ * The last token has no match and ends at the end of the compressed data.
+ */
+
+/* Minimum match length. */
+#define MINMATCH	4
+
+/* Maximum match offset. */
+#define MAXOFFSET	65535
+
+/* Number of bits in the hash of 4 bytes used to find matches. */
+#define HASHBITS	12
+
+/* Hash the 4 bytes at ${p}. */
+static size_t
+hash4(const uint8_t * p)
+{
+
+	return ((le32dec(p) * (uint32_t)2654435761) >> (32 - HASHBITS));
+}
+
+/* Write out the part of a length ${len} which does not fit into a nibble. */
+static int
+putlen(uint8_t * out, size_t outlen, size_t * op, size_t len)
+{
+
+	/* Write 255s, then whatever is left over. */
+	for (; len >= 255; len -= 255) {
+		if (*op == outlen)
+			goto err0;
+		out[(*op)++] = 255;
+	}
+	if (*op == outlen)
+		goto err0;
+	out[(*op)++] = (uint8_t)len;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Not enough space. */
+	return (-1);
+}
+
+/*
+ * Write out a token with the ${litlen} literals ${lit} followed (unless
+ * ${mlen} is zero) by a match of length ${mlen} at offset ${off}.
+ */
+static int
+putseq(uint8_t * out, size_t outlen, size_t * op, const uint8_t * lit,
+    size_t litlen, size_t off, size_t mlen)
+{
+	size_t mcode = (mlen > 0) ? mlen - MINMATCH : 0;
+
+	/* Token. */
+	if (*op == outlen)
+		goto err0;
+	out[(*op)++] = (uint8_t)(((litlen < 15 ? litlen : 15) << 4) +
+	    (mcode < 15 ? mcode : 15));
+
+	/* Literals. */
+	if ((litlen >= 15) && putlen(out, outlen, op, litlen - 15))
+		goto err0;
+	if (outlen - *op < litlen)
+		goto err0;
+	memcpy(&out[*op], lit, litlen);
+	*op += litlen;
+
+	/* Match, if any. */
+	if (mlen > 0) {
+		if (outlen - *op < 2)
+			goto err0;
+		le16enc(&out[*op], (uint16_t)off);
+		*op += 2;
+		if ((mcode >= 15) && putlen(out, outlen, op, mcode - 15))
+			goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Not enough space. */
+	return (-1);
+}
+
+/* Read the part of a length which did not fit into a nibble. */
+static int
+getlen(const uint8_t * in, size_t inlen, size_t * ip, size_t * len,
+    size_t maxlen)
+{
+	uint8_t c;
+
+	do {
+		if (*ip == inlen)
+			goto err0;
+		c = in[(*ip)++];
+		*len += c;
+
+		/* Stop before the length can overflow. */
+		if (*len > maxlen)
+			goto err0;
+	} while (c == 255);
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Invalid data. */
+	return (-1);
+}
+
+/**
+ * lz_compress(in, inlen, out, outlen):
+ * Compress the ${inlen} bytes in ${in} into the ${outlen}-byte buffer ${out}.
+ * Return the length of the compressed data, or 0 if it would not fit.
+ */
+size_t
+lz_compress(const uint8_t * in, size_t inlen, uint8_t * out, size_t outlen)
+{
+	size_t htab[1 << HASHBITS];
+	size_t ip, anchor, op;
+	size_t ref, mlen;
+	size_t h;
+
+	/* No positions seen yet. */
+	for (h = 0; h < (1 << HASHBITS); h++)
+		htab[h] = (size_t)(-1);
+
+	/* Look for matches with earlier data with the same hash. */
+	for (op = anchor = ip = 0; inlen - ip >= MINMATCH; ) {
+		h = hash4(&in[ip]);
+		ref = htab[h];
+		htab[h] = ip;
+
+		/* If we don't have a match, move on to the next byte. */
+		if ((ref == (size_t)(-1)) || (ip - ref > MAXOFFSET) ||
+		    memcmp(&in[ref], &in[ip], MINMATCH)) {
+			ip++;
+			continue;
+		}
+
+		/* Extend the match as far as possible. */
+		for (mlen = MINMATCH; ip + mlen < inlen; mlen++) {
+			if (in[ref + mlen] != in[ip + mlen])
+				break;
+		}
+
+		/* Write out the literals since the last match, and this. */
+		if (putseq(out, outlen, &op, &in[anchor], ip - anchor,
+		    ip - ref, mlen))
+			goto err0;
+		ip += mlen;
+		anchor = ip;
+	}
+
+	/* Write out the remaining literals. */
+	if (putseq(out, outlen, &op, &in[anchor], inlen - anchor, 0, 0))
+		goto err0;
+
+	/* Success! */
+	return (op);
+
+err0:
+	/* The compressed data doesn't fit. */
+	return (0);
+}
+
+/**
+ * lz_decompress(in, inlen, out, outlen):
+ * Decompress the ${inlen} bytes of compressed data in ${in} into the
+ * ${outlen}-byte buffer ${out}.  Return 0 if the data is valid and
+ * decompresses to exactly ${outlen} bytes; or -1 otherwise.
+ */
+int
+lz_decompress(const uint8_t * in, size_t inlen, uint8_t * out, size_t outlen)
+{
+	size_t ip, op;
+	size_t litlen, mlen, off;
+	uint8_t token;
+
+	for (op = ip = 0; ; ) {
+		/* Read a token. */
+		if (ip == inlen)
+			goto err0;
+		token = in[ip++];
+
+		/* Copy the literals. */
+		litlen = token >> 4;
+		if ((litlen == 15) && getlen(in, inlen, &ip, &litlen, outlen))
+			goto err0;
+		if ((inlen - ip < litlen) || (outlen - op < litlen))
+			goto err0;
+		memcpy(&out[op], &in[ip], litlen);
+		ip += litlen;
+		op += litlen;
+
+		/* The last token ends at the end of the compressed data. */
+		if (ip == inlen)
+			break;
+
+		/* Read the offset and length of the match. */
+		if (inlen - ip < 2)
+			goto err0;
+		off = le16dec(&in[ip]);
+		ip += 2;
+		if ((off == 0) || (off > op))
+			goto err0;
+		mlen = (token & 15) + MINMATCH;
+		if ((mlen == 15 + MINMATCH) &&
+		    getlen(in, inlen, &ip, &mlen, outlen))
+			goto err0;
+		if (outlen - op < mlen)
+			goto err0;
+
+		/* Copy the match, which may overlap what it is copying. */
+		if (off >= mlen) {
+			memcpy(&out[op], &out[op - off], mlen);
+			op += mlen;
+		} else {
+			for (; mlen > 0; mlen--, op++)
+				out[op] = out[op - off];
+		}
+	}
+
+	/* We should have filled the buffer exactly. */
+	if (op != outlen)
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Invalid compressed data. */
+	return (-1);
+}
@@ -0,0 +1,33 @@
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Simple byte-oriented LZ77 compression, in the style of LZ4: The compressed
+ * data is a sequence of tokens, each of which is a byte holding a literal
+ * length (high 4 bits) and a match length minus 4 (low 4 bits), where a
+ * nibble value of 15 is followed by bytes to be added to it until a byte
+ * other than 255 is read; followed by the literals; followed (except in the
+ * final token) by a 2-byte little-endian offset to copy the match from.
+ * This is fast enough to compress and decompress data on every read and
+ * write of a page, and works well on data with repeated strings.
+ */
+
+/**
+ * lz_compress(in, inlen, out, outlen):
+ * Compress the ${inlen} bytes in ${in} into the ${outlen}-byte buffer ${out}.
+ * Return the length of the compressed data, or 0 if it would not fit.
+ */
+size_t lz_compress(const uint8_t *, size_t, uint8_t *, size_t);
+
+/**
+ * lz_decompress(in, inlen, out, outlen):
+ * Decompress the ${inlen} bytes of compressed data in ${in} into the
+ * ${outlen}-byte buffer ${out}.  Return 0 if the data is valid and
+ * decompresses to exactly ${outlen} bytes; or -1 otherwise.
+ */
+int lz_decompress(const uint8_t *, size_t, uint8_t *, size_t);
+
+#endif /* !LZ_H_ */
@@ -35,6 +35,25 @@ void wire_packet_free(struct wire_packet *);
  */
 int wire_readpacket_peek(struct netbuf_read *, struct wire_packet *);
 
+/**
+ * wire_readpacket_peek_raw(R, P, crc):
+ * As wire_readpacket_peek(), but only verify the checksum of the packet
+ * header, and store the CRC32C of the packet data which is recorded in the
+ * packet trailer into the 4-byte buffer ${crc}.  The packet data can later be
+ * verified by calling wire_readpacket_verify(), or forwarded without being
+ * verified by passing ${crc} to wire_writepacket_raw().
+ */
+int wire_readpacket_peek_raw(struct netbuf_read *, struct wire_packet *,
+    uint8_t *);
+
+/**
+ * wire_readpacket_verify(P, crc):
+ * Verify that the CRC32C of the data in the packet ${P} matches the 4-byte
+ * value ${crc} returned by wire_readpacket_peek_raw().  Return 0 if it does,
+ * or -1 if the packet is corrupt.
+ */
+int wire_readpacket_verify(const struct wire_packet *, const uint8_t *);
+
 /**
  * wire_readpacket_wait(R, callback, cookie):
  * Wait until a packet is available to be read from ${R} or a failure occurs
@@ -74,12 +93,28 @@ uint8_t * wire_writepacket_getbuf(struct netbuf_write *, uint64_t, size_t);
  */
 int wire_writepacket_done(struct netbuf_write *, uint8_t *, size_t);
 
+/**
+ * wire_writepacket_done_raw(W, wbuf, len, crc):
+ * As wire_writepacket_done(), but use the 4-byte value ${crc} as the CRC32C
+ * of the packet data rather than computing it.
+ */
+int wire_writepacket_done_raw(struct netbuf_write *, uint8_t *, size_t,
+    const uint8_t *);
+
 /**
  * wire_writepacket(W, packet):
  * Write the packet ${packet} to the buffered writer ${W}.
  */
 int wire_writepacket(struct netbuf_write *, const struct wire_packet *);
 
+/**
+ * wire_writepacket_raw(W, packet, crc):
+ * Write the packet ${packet}, the CRC32C of the data of which is the 4-byte
+ * value ${crc}, to the buffered writer ${W}.
+ */
+int wire_writepacket_raw(struct netbuf_write *, const struct wire_packet *,
+    const uint8_t *);
+
 /**
  * wire_requestqueue_init(s):
  * Create and return a request queue attached to socket ${s}.  The caller is
@@ -123,6 +158,19 @@ int wire_requestqueue_add_done(struct wire_requestqueue *, uint8_t *, size_t);
 int wire_requestqueue_add(struct wire_requestqueue *, uint8_t *,
     size_t, int (*)(void *, uint8_t *, size_t), void *);
 
+/**
+ * wire_requestqueue_add_raw(Q, buf, buflen, crc, callback, cookie):
+ * As wire_requestqueue_add(), but use the 4-byte value ${crc} as the CRC32C
+ * of the request record rather than computing it, and invoke
+ * ${callback}(${cookie}, resbuf, resbuflen, rescrc) where ${rescrc} is the
+ * CRC32C of the response record as recorded in the response packet.  The
+ * response record is not verified against ${rescrc}; the callback is
+ * responsible for doing so, or for passing it on to someone who will.
+ */
+int wire_requestqueue_add_raw(struct wire_requestqueue *, uint8_t *, size_t,
+    const uint8_t *, int (*)(void *, uint8_t *, size_t, const uint8_t *),
+    void *);
+
 /**
  * wire_requestqueue_destroy(Q):
  * Destroy the request queue ${Q}.  The response callbacks will be queued to
@@ -32,6 +32,36 @@ static int callback_wait_gotdata(void *, int);
  */
 int
 wire_readpacket_peek(struct netbuf_read * R, struct wire_packet * P)
+{
+	uint8_t crc[4];
+
+	/* Look for a packet. */
+	if (wire_readpacket_peek_raw(R, P, crc))
+		goto failed;
+
+	/* If we have a packet, verify the data checksum. */
+	if ((P->buf != NULL) && wire_readpacket_verify(P, crc))
+		goto failed;
+
+	/* Success! */
+	return (0);
+
+failed:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * wire_readpacket_peek_raw(R, P, crc):
+ * As wire_readpacket_peek(), but only verify the checksum of the packet
+ * header, and store the CRC32C of the packet data which is recorded in the
+ * packet trailer into the 4-byte buffer ${crc}.  The packet data can later be
+ * verified by calling wire_readpacket_verify(), or forwarded without being
+ * verified by passing ${crc} to wire_writepacket_raw().
+ */
+int
+wire_readpacket_peek_raw(struct netbuf_read * R, struct wire_packet * P,
+    uint8_t * crc)
 {
 	CRC32C_CTX ctx;
 	uint8_t * data;
@@ -70,16 +100,9 @@ wire_readpacket_peek(struct netbuf_read * R, struct wire_packet * P)
 	if (datalen < P->len + 20)
 		goto nopacket;
 
-	/* Verify the data checksum. */
-	CRC32C_Init(&ctx);
-	CRC32C_Update(&ctx, &data[16], P->len);
-	CRC32C_Final(cbuf, &ctx);
+	/* The trailer is the data checksum XORed with the header checksum. */
 	for (i = 0; i < 4; i++)
-		cbuf[i] ^= data[16 + P->len + i];
-	if (memcmp(&data[12], cbuf, 4)) {
-		warn0("Incorrect CRC on packet data");
-		goto failed;
-	}
+		crc[i] = data[16 + P->len + i] ^ data[12 + i];
 
 	/* Point at the data. */
 	P->buf = &data[16];
@@ -93,6 +116,35 @@ failed:
 	return (-1);
 }
 
+/**
+ * wire_readpacket_verify(P, crc):
+ * Verify that the CRC32C of the data in the packet ${P} matches the 4-byte
+ * value ${crc} returned by wire_readpacket_peek_raw().  Return 0 if it does,
+ * or -1 if the packet is corrupt.
+ */
+int
+wire_readpacket_verify(const struct wire_packet * P, const uint8_t * crc)
+{
+	CRC32C_CTX ctx;
+	uint8_t cbuf[4];
+
+	/* Compute and compare the data checksum. */
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, P->buf, P->len);
+	CRC32C_Final(cbuf, &ctx);
+	if (memcmp(crc, cbuf, 4)) {
+		warn0("Incorrect CRC on packet data");
+		goto failed;
+	}
+
+	/* Success! */
+	return (0);
+
+failed:
+	/* Failure! */
+	return (-1);
+}
+
 /**
  * wire_readpacket_wait(R, callback, cookie):
  * Wait until a packet is available to be read from ${R} or a failure occurs
@@ -14,6 +14,7 @@
 
 struct request {
 	int (* callback)(void *, uint8_t *, size_t);
+	int (* callback_raw)(void *, uint8_t *, size_t, const uint8_t *);
 	void * cookie;
 };
 
@@ -38,7 +39,10 @@ failreq(void * cookie)
 	int rc;
 
 	/* Perform a no-response callback. */
-	rc = (R->callback)(R->cookie, NULL, 0);
+	if (R->callback_raw != NULL)
+		rc = (R->callback_raw)(R->cookie, NULL, 0, NULL);
+	else
+		rc = (R->callback)(R->cookie, NULL, 0);
 
 	/* Free the request structure. */
 	mpool_request_free(R);
@@ -54,6 +58,8 @@ readpackets(void * cookie, int status)
 	struct wire_requestqueue * Q = cookie;
 	struct wire_packet P;
 	struct request * R;
+	uint8_t crc[4];
+	int rc;
 
 	/* We're not waiting for a packet to be available any more. */
 	Q->read_cookie = NULL;
@@ -64,8 +70,8 @@ readpackets(void * cookie, int status)
 
 	/* Handle packets until there are no more or we encounter an error. */
 	do {
-		/* Grab a packet. */
-		if (wire_readpacket_peek(Q->R, &P))
+		/* Grab a packet (we check its data once we know its owner). */
+		if (wire_readpacket_peek_raw(Q->R, &P, crc))
 			goto fail;
 
 		/* Exit the loop if no packet is available. */
@@ -81,11 +87,23 @@ readpackets(void * cookie, int status)
 			goto fail;
 		}
 
+		/*
+		 * Verify the packet data, unless the callback will be handed
+		 * the data checksum and can take responsibility for it.
+		 */
+		if ((R->callback_raw == NULL) &&
+		    wire_readpacket_verify(&P, crc))
+			goto fail;
+
 		/* Delete the request from the pending request map. */
 		seqptrmap_delete(Q->reqs, (int64_t)P.ID);
 
 		/* Invoke the upstream callback. */
-		if ((R->callback)(R->cookie, P.buf, P.len))
+		if (R->callback_raw != NULL)
+			rc = (R->callback_raw)(R->cookie, P.buf, P.len, crc);
+		else
+			rc = (R->callback)(R->cookie, P.buf, P.len);
+		if (rc)
 			goto err0;
 
 		/* Free the request structure. */
@@ -207,20 +225,12 @@ err0:
 	return (NULL);
 }
 
-/**
- * wire_requestqueue_add_getbuf(Q, len, callback, cookie):
- * Start writing a request of length ${len} to the request queue ${Q}.  Return
- * a pointer to where the request packet data should be written.  This must be
- * followed by a call to wire_requestqueue_add_done().
- *
- * Invoke ${callback}(${cookie}, resbuf, resbuflen) when a response is received,
- * or with resbuf == NULL if the request failed (because it couldn't be sent
- * or because the connection failed or was destroyed before a response was
- * received).  Note that responses may arrive out-of-order.
- */
-uint8_t *
-wire_requestqueue_add_getbuf(struct wire_requestqueue * Q, size_t len,
-    int (* callback)(void *, uint8_t *, size_t), void * cookie)
+/* Start writing a request; see wire_requestqueue_add_getbuf(). */
+static uint8_t *
+addreq_getbuf(struct wire_requestqueue * Q, size_t len,
+    int (* callback)(void *, uint8_t *, size_t),
+    int (* callback_raw)(void *, uint8_t *, size_t, const uint8_t *),
+    void * cookie)
 {
 	struct request * R;
 	uint8_t * wbuf;
@@ -230,6 +240,7 @@ wire_requestqueue_add_getbuf(struct wire_requestqueue * Q, size_t len,
 	if ((R = mpool_request_malloc()) == NULL)
 		goto err0;
 	R->callback = callback;
+	R->callback_raw = callback_raw;
 	R->cookie = cookie;
 
 	/* If the request queue has failed, we can't send a request. */
@@ -262,6 +273,26 @@ err0:
 	return (NULL);
 }
 
+/**
+ * wire_requestqueue_add_getbuf(Q, len, callback, cookie):
+ * Start writing a request of length ${len} to the request queue ${Q}.  Return
+ * a pointer to where the request packet data should be written.  This must be
+ * followed by a call to wire_requestqueue_add_done().
+ *
+ * Invoke ${callback}(${cookie}, resbuf, resbuflen) when a response is received,
+ * or with resbuf == NULL if the request failed (because it couldn't be sent
+ * or because the connection failed or was destroyed before a response was
+ * received).  Note that responses may arrive out-of-order.
+ */
+uint8_t *
+wire_requestqueue_add_getbuf(struct wire_requestqueue * Q, size_t len,
+    int (* callback)(void *, uint8_t *, size_t), void * cookie)
+{
+
+	/* Start writing the request. */
+	return (addreq_getbuf(Q, len, callback, NULL, cookie));
+}
+
 /**
  * wire_requestqueue_add_done(Q, wbuf, len):
  * Finish writing a request to the request queue ${Q}.  The value ${wbuf} must
@@ -319,6 +350,49 @@ err0:
 	return (-1);
 }
 
+/**
+ * wire_requestqueue_add_raw(Q, buf, buflen, crc, callback, cookie):
+ * As wire_requestqueue_add(), but use the 4-byte value ${crc} as the CRC32C
+ * of the request record rather than computing it, and invoke
+ * ${callback}(${cookie}, resbuf, resbuflen, rescrc) where ${rescrc} is the
+ * CRC32C of the response record as recorded in the response packet.  The
+ * response record is not verified against ${rescrc}; the callback is
+ * responsible for doing so, or for passing it on to someone who will.
+ */
+int
+wire_requestqueue_add_raw(struct wire_requestqueue * Q,
+    uint8_t * buf, size_t buflen, const uint8_t * crc,
+    int (* callback)(void *, uint8_t *, size_t, const uint8_t *),
+    void * cookie)
+{
+	uint8_t * wbuf;
+
+	/* Start writing the request. */
+	if ((wbuf = addreq_getbuf(Q, buflen, NULL, callback, cookie)) == NULL)
+		goto err0;
+
+	/* Copy the request data into the provided buffer. */
+	memcpy(wbuf, buf, buflen);
+
+	/* If the request queue has failed, just free the dummy buffer. */
+	if (Q->failed) {
+		free(wbuf);
+		goto done;
+	}
+
+	/* Finish writing the request, using the checksum we were given. */
+	if (wire_writepacket_done_raw(Q->WQ, wbuf, buflen, crc))
+		goto err0;
+
+done:
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 /**
  * wire_requestqueue_destroy(Q):
  * Destroy the request queue ${Q}.  The response callbacks will be queued to
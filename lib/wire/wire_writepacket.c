@@ -54,6 +54,25 @@ wire_writepacket_done(struct netbuf_write * W, uint8_t * wbuf, size_t len)
 {
 	CRC32C_CTX ctx;
 	uint8_t cbuf[4];
+
+	/* Compute the CRC32C of the packet data. */
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, wbuf, len);
+	CRC32C_Final(cbuf, &ctx);
+
+	/* Finish writing the packet. */
+	return (wire_writepacket_done_raw(W, wbuf, len, cbuf));
+}
+
+/**
+ * wire_writepacket_done_raw(W, wbuf, len, crc):
+ * As wire_writepacket_done(), but use the 4-byte value ${crc} as the CRC32C
+ * of the packet data rather than computing it.
+ */
+int
+wire_writepacket_done_raw(struct netbuf_write * W, uint8_t * wbuf,
+    size_t len, const uint8_t * crc)
+{
 	size_t i;
 	uint8_t * header_crc;
 
@@ -65,14 +84,9 @@ wire_writepacket_done(struct netbuf_write * W, uint8_t * wbuf, size_t len)
 	 */
 	header_crc = &wbuf[-4];
 
-	/* Compute the CRC32C of the packet data. */
-	CRC32C_Init(&ctx);
-	CRC32C_Update(&ctx, wbuf, len);
-	CRC32C_Final(cbuf, &ctx);
-
 	/* Write the trailer. */
 	for (i = 0; i < 4; i++)
-		wbuf[len + i] = cbuf[i] ^ header_crc[i];
+		wbuf[len + i] = crc[i] ^ header_crc[i];
 
 	/* We've finished constructing the packet. */
 	if (netbuf_write_consume(W, len + 20))
@@ -114,3 +128,34 @@ err0:
 	/* Failure! */
 	return (-1);
 }
+
+/**
+ * wire_writepacket_raw(W, packet, crc):
+ * Write the packet ${packet}, the CRC32C of the data of which is the 4-byte
+ * value ${crc}, to the buffered writer ${W}.
+ */
+int
+wire_writepacket_raw(struct netbuf_write * W,
+    const struct wire_packet * packet, const uint8_t * crc)
+{
+	uint8_t * wbuf;
+
+	/* Write the packet header. */
+	if ((wbuf =
+	    wire_writepacket_getbuf(W, packet->ID, packet->len)) == NULL)
+		goto err0;
+
+	/* Copy the packet data into place. */
+	memcpy(wbuf, packet->buf, packet->len);
+
+	/* Write the packet trailer. */
+	if (wire_writepacket_done_raw(W, wbuf, packet->len, crc))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
@@ -0,0 +1,20 @@
+#include <sys/epoll.h>
+
+#include <stddef.h>
+
+int
+main(void)
+{
+	struct epoll_event ev;
+	int epfd;
+
+	/* Create an epoll descriptor and wait on it. */
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP;
+	ev.data.fd = 0;
+	(void)epoll_ctl(epfd, EPOLL_CTL_ADD, 0, &ev);
+	(void)epoll_wait(epfd, &ev, 1, 0);
+
+	/* Success! */
+	return (0);
+}
@@ -0,0 +1,29 @@
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+int
+main(void)
+{
+	struct io_uring_params p;
+	struct io_uring_sqe sqe;
+	long (* sc)(long, ...) = syscall;
+
+	/* Check that we have the ring setup call and the READ opcode. */
+	memset(&p, 0, sizeof(p));
+	(void)sc(__NR_io_uring_setup, 1, &p);
+	sqe.opcode = IORING_OP_READ;
+	(void)sqe;
+
+	/* We need eventfd for waking up the event loop. */
+	(void)eventfd(0, EFD_NONBLOCK);
+
+	/* Success! */
+	return (0);
+}
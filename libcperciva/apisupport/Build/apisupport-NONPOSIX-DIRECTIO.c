@@ -0,0 +1,12 @@
+#include <fcntl.h>
+
+int
+main(void)
+{
+	int flags = O_RDONLY | O_DIRECT;
+
+	(void)flags;
+
+	/* Success! */
+	return (0);
+}
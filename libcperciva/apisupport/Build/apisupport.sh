@@ -75,6 +75,22 @@ feature NONPOSIX SETGROUPS "" ""			\
 	"-U_POSIX_C_SOURCE -U_XOPEN_SOURCE"		\
 	"-U_POSIX_C_SOURCE -U_XOPEN_SOURCE -Wno-reserved-id-macro"
 
+# Detect how to use O_DIRECT.  Linux exposes it with _GNU_SOURCE; FreeBSD
+# only hides it when POSIX compliance is requested.
+feature NONPOSIX DIRECTIO ""				\
+	"" "-D_GNU_SOURCE"				\
+	"-U_POSIX_C_SOURCE -U_XOPEN_SOURCE"		\
+	"-U_POSIX_C_SOURCE -U_XOPEN_SOURCE -Wno-reserved-id-macro"
+
+# Detect how to compile Linux io_uring code.  This always needs non-POSIX
+# declarations (e.g., syscall).
+feature LINUX IO_URING ""				\
+	"-D_DEFAULT_SOURCE"				\
+	"-D_DEFAULT_SOURCE -Wno-reserved-id-macro"
+
+# Detect how to compile Linux epoll code.
+feature LINUX EPOLL "" ""
+
 # Detect how to compile libssl and libcrypto code.
 feature LIBSSL HOST_NAME "-lssl" ""			\
 	"-Wno-cast-qual"
@@ -1,3 +1,7 @@
+#ifdef APISUPPORT_CONFIG_FILE
+#include APISUPPORT_CONFIG_FILE
+#endif
+
 #include <sys/select.h>
 
 #include <assert.h>
@@ -16,6 +20,9 @@
 #include "events.h"
 #include "events_internal.h"
 
+/* On Linux, events_network_epoll.c is used instead of this poll backend. */
+#ifndef APISUPPORT_LINUX_EPOLL
+
 /*
  * Sanity checks on the nfds_t type: POSIX simply says "an unsigned integer
  * type used for the number of file descriptors", but it doesn't make sense
@@ -495,3 +502,5 @@ events_network_shutdown(void)
 	socketlist_free(S);
 	S = NULL;
 }
+
+#endif /* !APISUPPORT_LINUX_EPOLL */
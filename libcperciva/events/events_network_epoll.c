@@ -0,0 +1,537 @@
+#ifdef APISUPPORT_CONFIG_FILE
+#include APISUPPORT_CONFIG_FILE
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "elasticarray.h"
+#include "warnp.h"
+
+#include "events.h"
+#include "events_internal.h"
+
+#ifdef APISUPPORT_LINUX_EPOLL
+/**
+ * APISUPPORT CFLAGS: LINUX_EPOLL
+ */
+
+#include <sys/epoll.h>
+
+/*
+ * This is a drop-in replacement for the poll backend in events_network.c.
+ * The poll backend hands the kernel an array of every descriptor with events
+ * registered on every call to events_network_select, so its cost grows with
+ * the number of (mostly idle) connections; here the kernel keeps the set of
+ * descriptors we're interested in, and only tells us about ready ones.
+ *
+ * The epoll descriptor is inherited across fork(), and the parent and child
+ * would share the set of registered descriptors; so a process which forks
+ * after registering network events must not register network events in both
+ * the parent and the child.
+ */
+
+/* Maximum number of events to collect from each epoll_wait call. */
+#define MAXEVENTS	1024
+
+/* Structure for holding readability and writability events for a socket. */
+struct socketrec {
+	struct eventrec * reader;
+	struct eventrec * writer;
+	uint32_t events;	/* Events registered with epoll. */
+	uint32_t revents;	/* Events ready and not yet returned. */
+};
+
+/* List of sockets. */
+ELASTICARRAY_DECL(SOCKETLIST, socketlist, struct socketrec);
+static SOCKETLIST S = NULL;
+
+/* The epoll descriptor. */
+static int epfd = -1;
+
+/* Number of descriptors registered with epoll. */
+static size_t nfds;
+
+/* Events returned by the last epoll_wait call. */
+static struct epoll_event evs[MAXEVENTS];
+static size_t nevs;
+
+/* Position to which events_network_get has scanned in evs. */
+static size_t evscanpos;
+
+/**
+ * Invariants:
+ * 1. Descriptors are registered with epoll iff they have events registered,
+ *    unless an epoll_ctl call failed to remove a registration:
+ *     S[i].reader != NULL ==> (S[i].events & EPOLLIN) != 0
+ *     S[i].writer != NULL ==> (S[i].events & EPOLLOUT) != 0
+ *     nfds == #{i : S[i].events != 0}
+ * 2. We don't have events ready which we don't want:
+ *     S[i].reader == NULL ==> (S[i].revents & EPOLLIN) == 0
+ *     S[i].writer == NULL ==> (S[i].revents & EPOLLOUT) == 0
+ * 3. Ready events are in position to be scanned later:
+ *     S[i].revents != 0 ==> i == evs[j].data.fd for some evscanpos <= j < nevs
+ */
+
+static void events_network_shutdown(void);
+
+/* Initialize data structures if we haven't already done so. */
+static int
+init(void)
+{
+
+	/* If we're already initialized, do nothing. */
+	if (S != NULL)
+		goto done;
+
+	/* Create an epoll descriptor. */
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		warnp("epoll_create1");
+		goto err0;
+	}
+
+	/* Initialize the socket list. */
+	if ((S = socketlist_init(0)) == NULL)
+		goto err1;
+
+	/* We have no descriptors registered or events returned. */
+	nfds = nevs = evscanpos = 0;
+
+	/* Clean up the socket list at exit. */
+	if (atexit(events_network_shutdown))
+		goto err0;
+
+done:
+	/* Success! */
+	return (0);
+
+err1:
+	if (close(epfd))
+		warnp("close");
+	epfd = -1;
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Grow the socket list and initialize new records. */
+static int
+growsocketlist(size_t nrec)
+{
+	size_t i;
+
+	/* Get the old size. */
+	i = socketlist_getsize(S);
+
+	/* Grow the list. */
+	if (socketlist_resize(S, nrec))
+		goto err0;
+
+	/* Initialize new members. */
+	for (; i < nrec; i++) {
+		socketlist_get(S, i)->reader = NULL;
+		socketlist_get(S, i)->writer = NULL;
+		socketlist_get(S, i)->events = 0;
+		socketlist_get(S, i)->revents = 0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Return the epoll events we want for the socket record ${R}. */
+static uint32_t
+wanted(const struct socketrec * R)
+{
+	uint32_t events = 0;
+
+	if (R->reader != NULL)
+		events |= EPOLLIN;
+	if (R->writer != NULL)
+		events |= EPOLLOUT;
+	return (events);
+}
+
+/* Tell epoll which events we want for descriptor ${fd}. */
+static int
+setevents(size_t fd)
+{
+	struct socketrec * R = socketlist_get(S, fd);
+	struct epoll_event ev;
+	uint32_t events = wanted(R);
+	int op;
+
+	/* Forget about any ready events which we no longer want. */
+	R->revents &= events;
+
+	/* If epoll already has the right events, we have nothing to do. */
+	if (R->events == events)
+		goto done;
+
+	/* Add, modify, or delete the registration. */
+	if (R->events == 0)
+		op = EPOLL_CTL_ADD;
+	else if (events == 0)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+	ev.events = events;
+	ev.data.fd = (int)fd;
+	if (epoll_ctl(epfd, op, (int)fd, &ev) == 0)
+		goto registered;
+
+	/*
+	 * If the descriptor was closed since we registered it, epoll will
+	 * have forgotten about it (or, if it was duplicated first, will still
+	 * remember it even though it has been closed and perhaps reopened).
+	 */
+	if ((op == EPOLL_CTL_DEL) && ((errno == EBADF) || (errno == ENOENT)))
+		goto registered;
+	if ((op == EPOLL_CTL_MOD) && (errno == ENOENT) &&
+	    (epoll_ctl(epfd, EPOLL_CTL_ADD, (int)fd, &ev) == 0))
+		goto registered;
+	if ((op == EPOLL_CTL_ADD) && (errno == EEXIST) &&
+	    (epoll_ctl(epfd, EPOLL_CTL_MOD, (int)fd, &ev) == 0))
+		goto registered;
+
+	/* Anything else is an error. */
+	warnp("epoll_ctl");
+	goto err0;
+
+registered:
+	/* Keep track of how many descriptors are registered. */
+	if ((R->events == 0) && (events != 0))
+		nfds++;
+	if ((R->events != 0) && (events == 0))
+		nfds--;
+	R->events = events;
+
+done:
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * events_network_register(func, cookie, s, op):
+ * Register ${func}(${cookie}) to be run when socket ${s} is ready for
+ * reading or writing depending on whether ${op} is EVENTS_NETWORK_OP_READ or
+ * EVENTS_NETWORK_OP_WRITE.  If there is already an event registration for
+ * this ${s}/${op} pair, errno will be set to EEXIST and the function will
+ * fail.
+ */
+int
+events_network_register(int (* func)(void *), void * cookie, int s, int op)
+{
+	struct eventrec ** r;
+
+	/* Initialize if necessary. */
+	if (init())
+		goto err0;
+
+	/* Sanity-check socket number. */
+	if (s < 0) {
+		warn0("Invalid file descriptor for network event: %d", s);
+		goto err0;
+	}
+
+	/* Sanity-check operation. */
+	if ((op != EVENTS_NETWORK_OP_READ) &&
+	    (op != EVENTS_NETWORK_OP_WRITE)) {
+		warn0("Invalid operation for network event: %d", op);
+		goto err0;
+	}
+
+	/* Grow the array if necessary. */
+	if (((size_t)(s) >= socketlist_getsize(S)) &&
+	    (growsocketlist((size_t)s + 1) != 0))
+		goto err0;
+
+	/* Look up the relevant event pointer. */
+	if (op == EVENTS_NETWORK_OP_READ)
+		r = &socketlist_get(S, (size_t)s)->reader;
+	else
+		r = &socketlist_get(S, (size_t)s)->writer;
+
+	/* Error out if we already have an event registered. */
+	if (*r != NULL) {
+		errno = EEXIST;
+		goto err0;
+	}
+
+	/* Register the new event. */
+	if ((*r = events_mkrec(func, cookie)) == NULL)
+		goto err0;
+
+	/* If we had no events registered, start a clock. */
+	if (nfds == 0)
+		events_network_selectstats_startclock();
+
+	/* Ask epoll to watch for the event. */
+	if (setevents((size_t)s))
+		goto err1;
+
+	/* Success! */
+	return (0);
+
+err1:
+	events_freerec(*r);
+	*r = NULL;
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * events_network_cancel(s, op):
+ * Cancel the event registered for the socket/operation pair ${s}/${op}.  If
+ * there is no such registration, errno will be set to ENOENT and the
+ * function will fail.
+ */
+int
+events_network_cancel(int s, int op)
+{
+	struct eventrec ** r;
+
+	/* Initialize if necessary. */
+	if (init())
+		goto err0;
+
+	/* Sanity-check socket number. */
+	if (s < 0) {
+		warn0("Invalid file descriptor for network event: %d", s);
+		goto err0;
+	}
+
+	/* Sanity-check operation. */
+	if ((op != EVENTS_NETWORK_OP_READ) &&
+	    (op != EVENTS_NETWORK_OP_WRITE)) {
+		warn0("Invalid operation for network event: %d", op);
+		goto err0;
+	}
+
+	/* We have no events registered beyond the end of the array. */
+	if ((size_t)(s) >= socketlist_getsize(S)) {
+		errno = ENOENT;
+		goto err0;
+	}
+
+	/* Look up the relevant event pointer. */
+	if (op == EVENTS_NETWORK_OP_READ)
+		r = &socketlist_get(S, (size_t)s)->reader;
+	else
+		r = &socketlist_get(S, (size_t)s)->writer;
+
+	/* Check if we have an event. */
+	if (*r == NULL) {
+		errno = ENOENT;
+		goto err0;
+	}
+
+	/* Free the event. */
+	events_freerec(*r);
+	*r = NULL;
+
+	/*
+	 * Stop watching for the event.  This must happen now rather than
+	 * lazily, since the caller may be about to close the descriptor.
+	 */
+	if (setevents((size_t)s))
+		goto err0;
+
+	/* If that was the last remaining event, stop the clock. */
+	if (nfds == 0)
+		events_network_selectstats_stopclock();
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * events_network_select(tv, interrupt_requested):
+ * Check for socket readiness events, waiting up to ${tv} time if there are
+ * no sockets immediately ready, or indefinitely if ${tv} is NULL.  The value
+ * stored in ${tv} may be modified.  If ${*interrupt_requested} is non-zero
+ * and a signal is received, exit.
+ */
+int
+events_network_select(const struct timeval * tv,
+    const volatile sig_atomic_t * interrupt_requested)
+{
+	struct socketrec * R;
+	uint32_t revents;
+	size_t i;
+	int timeout;
+	int n;
+
+	/* Initialize if necessary. */
+	if (init())
+		goto err0;
+
+	/* Forget any events from the last call which weren't collected. */
+	for (; evscanpos < nevs; evscanpos++)
+		socketlist_get(S, (size_t)evs[evscanpos].data.fd)->revents = 0;
+	nevs = evscanpos = 0;
+
+	/*
+	 * Convert timeout to an integer number of ms.  We round up in order
+	 * to avoid creating busy loops when 0 < ${tv} < 1 ms.
+	 */
+	if (tv == NULL)
+		timeout = -1;
+	else if (tv->tv_sec >= INT_MAX / 1000)
+		timeout = INT_MAX;
+	else
+		timeout = (int)(tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000);
+
+	/* We're about to call epoll_wait! */
+	events_network_selectstats_select();
+
+	/* Wait for events. */
+	while ((n = epoll_wait(epfd, evs, MAXEVENTS, timeout)) == -1) {
+		/* EINTR is harmless, unless we've requested an interrupt. */
+		if (errno == EINTR) {
+			if (*interrupt_requested) {
+				n = 0;
+				break;
+			}
+			continue;
+		}
+
+		/* Anything else is an error. */
+		warnp("epoll_wait()");
+		goto err0;
+	}
+	nevs = (size_t)n;
+
+	/* Record which of the events we want are ready. */
+	for (i = 0; i < nevs; i++) {
+		R = socketlist_get(S, (size_t)evs[i].data.fd);
+
+		/*
+		 * If either EPOLLERR or EPOLLHUP is set, then we should invoke
+		 * whatever callbacks we have available.
+		 */
+		revents = evs[i].events;
+		if (revents & (EPOLLERR | EPOLLHUP))
+			revents |= EPOLLIN | EPOLLOUT;
+		R->revents = revents & wanted(R);
+
+		/*
+		 * If epoll is watching for events we don't want (because an
+		 * earlier attempt to stop it failed), try again now.
+		 */
+		if ((R->events & ~wanted(R)) &&
+		    setevents((size_t)evs[i].data.fd))
+			goto err0;
+	}
+
+	/* If we have any events registered, start the clock again. */
+	if (nfds > 0)
+		events_network_selectstats_startclock();
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/**
+ * events_network_get(void):
+ * Find a socket readiness event which was identified by a previous call to
+ * events_network_select, and return it as an eventrec structure; or return
+ * NULL if there are no such events available.  The caller is responsible for
+ * freeing the returned memory.
+ */
+struct eventrec *
+events_network_get(void)
+{
+	struct socketrec * R;
+	struct eventrec * r;
+
+	/* We haven't found any events yet. */
+	r = NULL;
+
+	/* Scan through the returned events looking for ready descriptors. */
+	for (; evscanpos < nevs; evscanpos++) {
+		R = socketlist_get(S, (size_t)evs[evscanpos].data.fd);
+
+		/* Are we ready for reading? */
+		if (R->revents & EPOLLIN) {
+			r = R->reader;
+			R->reader = NULL;
+			break;
+		}
+
+		/* Are we ready for writing? */
+		if (R->revents & EPOLLOUT) {
+			r = R->writer;
+			R->writer = NULL;
+			break;
+		}
+	}
+
+	/* Nothing to do if we didn't find an event. */
+	if (r == NULL)
+		goto done;
+
+	/*
+	 * Stop watching for the event we're returning.  If this fails, we
+	 * can still return the event; we'll try again if epoll reports the
+	 * descriptor as being ready.
+	 */
+	(void)setevents((size_t)evs[evscanpos].data.fd);
+
+	/* If we're returning the last registered event, stop the clock. */
+	if (nfds == 0)
+		events_network_selectstats_stopclock();
+
+done:
+	/* Return the event we found, or NULL if we didn't find any. */
+	return (r);
+}
+
+/**
+ * events_network_shutdown(void):
+ * Clean up and free memory.  This should run automatically via atexit.
+ */
+static void
+events_network_shutdown(void)
+{
+
+	/* If we're not initialized, do nothing. */
+	if (S == NULL)
+		return;
+
+	/* If we have any registered events, do nothing. */
+	if (nfds > 0)
+		return;
+
+	/* Close the epoll descriptor. */
+	if (close(epfd))
+		warnp("close");
+	epfd = -1;
+
+	/* Free the socket list. */
+	socketlist_free(S);
+	S = NULL;
+}
+
+#endif /* APISUPPORT_LINUX_EPOLL */
@@ -8,9 +8,12 @@
 #include "mpool.h"
 #include "netbuf.h"
 #include "network.h"
+#include "proto_kvlds.h"
 #include "warnp.h"
 #include "wire.h"
 
+#include "getcache.h"
+
 #include "dispatch.h"
 
 /* Dispatcher state. */
@@ -27,6 +30,11 @@ struct dispatch_state {
 	/* Request queue. */
 	struct wire_requestqueue * Q;		/* Connected to target. */
 	int failed;				/* Q has failed. */
+
+	/* GET response cache. */
+	struct getcache * cache;		/* Cache, or NULL. */
+	struct proto_kvlds_request * req;	/* Parsed request. */
+	int coalesce;				/* Coalesce identical GETs. */
 };
 
 /* Listening socket. */
@@ -55,6 +63,8 @@ struct sock_active {
 struct forwardee {
 	struct sock_active * conn;		/* Request origin. */
 	uint64_t ID;				/* Request ID. */
+	struct getcache_req * creq;		/* Cache state, or NULL. */
+	struct forwardee * next;		/* Next GET waiting with us. */
 };
 
 MPOOL(forwardee, struct forwardee, 32768);
@@ -63,8 +73,10 @@ static void accept_stop(struct dispatch_state *);
 static int accept_start(struct dispatch_state *);
 static int callback_gotconn(void *, int);
 static int readreq(struct sock_active *);
+static int cachereq(struct dispatch_state *, struct forwardee *,
+    const struct wire_packet *, int *);
 static int callback_gotrequests(void *, int);
-static int callback_gotresponse(void *, uint8_t *, size_t);
+static int callback_gotresponse(void *, uint8_t *, size_t, const uint8_t *);
 static int reqdone(struct sock_active *);
 static int dropconn(struct sock_active *);
 
@@ -247,6 +259,77 @@ err0:
 	return (-1);
 }
 
+/*
+ * Handle the request ${P}, with cookie ${F}, using the GET cache.  Set
+ * ${*handled} to 1 if it was answered from the cache (and ${F} is no longer
+ * needed); to 2 if it will be answered with the response to an identical
+ * GET which is in progress; or to 0 if it needs to be forwarded, in which
+ * case the cache knows that it is about to be.
+ */
+static int
+cachereq(struct dispatch_state * dstate, struct forwardee * F,
+    const struct wire_packet * P, int * handled)
+{
+	struct proto_kvlds_request * R = dstate->req;
+	struct wire_packet RP;
+	const uint8_t * rcrc;
+	struct forwardee * F_leader;
+	int ismr;
+
+	/* We haven't handled the request yet. */
+	*handled = 0;
+
+	/* If we can't parse it, the target will reject it; just forward it. */
+	if (proto_kvlds_request_parse(P, R))
+		return (0);
+
+	/* Only requests involving a single key's value are interesting. */
+	switch (R->type) {
+	case PROTO_KVLDS_GET:
+		/* Send a cached response if we have one. */
+		if (getcache_lookup(dstate->cache, R->key, &RP.buf, &RP.len,
+		    &rcrc)) {
+			RP.ID = P->ID;
+			if (wire_writepacket_raw(F->conn->writeq, &RP, rcrc))
+				goto err0;
+			*handled = 1;
+			return (0);
+		}
+
+		/* Wait for an identical GET if possible. */
+		if (dstate->coalesce && ((F_leader =
+		    getcache_inflight(dstate->cache, R->key)) != NULL)) {
+			F->next = F_leader->next;
+			F_leader->next = F;
+			*handled = 2;
+			return (0);
+		}
+		ismr = 0;
+		break;
+	case PROTO_KVLDS_SET:
+	case PROTO_KVLDS_CAS:
+	case PROTO_KVLDS_ADD:
+	case PROTO_KVLDS_MODIFY:
+	case PROTO_KVLDS_DELETE:
+	case PROTO_KVLDS_CAD:
+		ismr = 1;
+		break;
+	default:
+		return (0);
+	}
+
+	/* The cache needs to know what we're sending to the target. */
+	if ((F->creq = getcache_start(dstate->cache, R->key, ismr, F)) == NULL)
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
 static int
 callback_gotrequests(void * cookie, int status)
 {
@@ -254,6 +337,8 @@ callback_gotrequests(void * cookie, int status)
 	struct dispatch_state * dstate = S->dstate;
 	struct wire_packet P;
 	struct forwardee * F;
+	uint8_t crc[4];
+	int handled;
 
 	/* We're not waiting for a packet to be available any more. */
 	S->read_cookie = NULL;
@@ -265,21 +350,49 @@ callback_gotrequests(void * cookie, int status)
 	/* Handle packets until there are no more or we encounter an error. */
 	do {
 		/* Grab a packet. */
-		if (wire_readpacket_peek(S->readq, &P))
+		if (wire_readpacket_peek_raw(S->readq, &P, crc))
 			goto fail;
 
 		/* Exit the loop if no packet is available. */
 		if (P.buf == NULL)
 			break;
 
+		/*
+		 * Verify the request data ourselves: If we forwarded a corrupt
+		 * request, the target would drop its connection to us, taking
+		 * down every other client along with this one.
+		 */
+		if (wire_readpacket_verify(&P, crc))
+			goto fail;
+
 		/* Bake a cookie. */
 		if ((F = mpool_forwardee_malloc()) == NULL)
 			goto err0;
 		F->ID = P.ID;
 		F->conn = S;
+		F->creq = NULL;
+		F->next = NULL;
+
+		/* Try to handle the request using the GET cache. */
+		handled = 0;
+		if ((dstate->cache != NULL) &&
+		    cachereq(dstate, F, &P, &handled))
+			goto err1;
+		switch (handled) {
+		case 1:
+			/* We've already sent the response. */
+			mpool_forwardee_free(F);
+			wire_readpacket_consume(S->readq, &P);
+			continue;
+		case 2:
+			/* We'll send the response when it arrives. */
+			S->nrequests++;
+			wire_readpacket_consume(S->readq, &P);
+			continue;
+		}
 
-		/* Send the request to the target. */
-		if (wire_requestqueue_add(dstate->Q, P.buf, P.len,
+		/* Send the request to the target, reusing its checksum. */
+		if (wire_requestqueue_add_raw(dstate->Q, P.buf, P.len, crc,
 		    callback_gotresponse, F))
 			goto err1;
 
@@ -315,42 +428,61 @@ err0:
 }
 
 static int
-callback_gotresponse(void * cookie, uint8_t * buf, size_t buflen)
+callback_gotresponse(void * cookie, uint8_t * buf, size_t buflen,
+    const uint8_t * crc)
 {
 	struct forwardee * F = cookie;
+	struct forwardee * F_next;
 	struct sock_active * S = F->conn;
 	struct sock_active * S_next;
 	struct dispatch_state * dstate = S->dstate;
 	struct wire_packet P;
 
+	/* Let the GET cache know how the request turned out. */
+	if (F->creq != NULL)
+		getcache_done(dstate->cache, F->creq, buf, buflen, crc);
+
 	/* Did this request fail? */
 	if (buf == NULL)
 		goto failed;
 
-	/* Send the response back to the client. */
-	P.ID = F->ID;
+	/*
+	 * Send the response back to the client, and to any clients which sent
+	 * identical GETs while this request was in progress.  We pass along
+	 * the checksum of the response data without verifying it; the clients
+	 * will do that.
+	 */
 	P.buf = buf;
 	P.len = buflen;
-	if (wire_writepacket(S->writeq, &P))
-		goto err1;
+	for (; F != NULL; F = F_next) {
+		F_next = F->next;
+		S = F->conn;
 
-	/* Free the cookie. */
-	mpool_forwardee_free(F);
+		/* Send the response. */
+		P.ID = F->ID;
+		if (wire_writepacket_raw(S->writeq, &P, crc))
+			goto err1;
 
-	/* We've finished with a request. */
-	if (reqdone(S))
-		goto err0;
+		/* Free the cookie. */
+		mpool_forwardee_free(F);
+
+		/* We've finished with a request. */
+		if (reqdone(S))
+			goto err0;
+	}
 
 	/* Success! */
 	return (0);
 
 failed:
-	/* Free our cookie. */
-	mpool_forwardee_free(F);
-
-	/* We've finished with a request. */
-	if (reqdone(S))
-		goto err0;
+	/* Free our cookie(s); the requests are finished. */
+	for (; F != NULL; F = F_next) {
+		F_next = F->next;
+		S = F->conn;
+		mpool_forwardee_free(F);
+		if (reqdone(S))
+			goto err0;
+	}
 
 	/* Stop trying to accept connections. */
 	accept_stop(dstate);
@@ -450,14 +582,19 @@ err1:
 }
 
 /**
- * dispatch_init(socks, nsocks, Q, maxconn):
+ * dispatch_init(socks, nsocks, Q, maxconn, cachekeys, coalesce):
  * Initialize a dispatcher to accept connections from the listening sockets
  * ${socks[0]} ... ${socks[nsocks - 1]} (but no more than ${maxconn} at
- * once) and shuttle requests/responses to/from the request queue ${Q}.
+ * once) and shuttle requests/responses to/from the request queue ${Q}.  If
+ * ${cachekeys} is non-zero, the target must be KVLDS, and responses to GET
+ * requests for up to ${cachekeys} keys will be cached.  If ${coalesce} is
+ * non-zero, the target must be KVLDS, and GET requests which are identical
+ * to a GET in progress will be answered with its response.
  */
 struct dispatch_state *
 dispatch_init(const int * socks, size_t nsocks,
-    struct wire_requestqueue * Q, size_t maxconn)
+    struct wire_requestqueue * Q, size_t maxconn, size_t cachekeys,
+    int coalesce)
 {
 	struct dispatch_state * dstate;
 	size_t i;
@@ -471,11 +608,22 @@ dispatch_init(const int * socks, size_t nsocks,
 	dstate->nsock_active_max = maxconn;
 	dstate->Q = Q;
 	dstate->failed = 0;
+	dstate->cache = NULL;
+	dstate->req = NULL;
+	dstate->coalesce = coalesce;
+
+	/* Create a GET response cache if requested or needed. */
+	if ((cachekeys > 0) || coalesce) {
+		if ((dstate->cache = getcache_init(cachekeys)) == NULL)
+			goto err1;
+		if ((dstate->req = proto_kvlds_request_alloc()) == NULL)
+			goto err2;
+	}
 
 	/* Allocate an array of listeners. */
 	if ((dstate->sock_listen =
 	    malloc(nsocks * sizeof(struct sock_listen))) == NULL)
-		goto err1;
+		goto err2;
 	for (i = 0; i < nsocks; i++) {
 		dstate->sock_listen[i].dstate = dstate;
 		dstate->sock_listen[i].s = socks[i];
@@ -484,13 +632,17 @@ dispatch_init(const int * socks, size_t nsocks,
 
 	/* Start accepting connections. */
 	if (accept_start(dstate))
-		goto err2;
+		goto err3;
 
 	/* Success! */
 	return (dstate);
 
-err2:
+err3:
 	free(dstate->sock_listen);
+err2:
+	if (dstate->req != NULL)
+		proto_kvlds_request_free(dstate->req);
+	getcache_free(dstate->cache);
 err1:
 	free(dstate);
 err0:
@@ -528,6 +680,9 @@ dispatch_done(struct dispatch_state * dstate)
 	assert(dstate->nsock_active == 0);
 
 	/* Free memory. */
+	if (dstate->req != NULL)
+		proto_kvlds_request_free(dstate->req);
+	getcache_free(dstate->cache);
 	free(dstate->sock_listen);
 	free(dstate);
 }
@@ -8,13 +8,17 @@ struct dispatch_state;
 struct wire_requestqueue;
 
 /**
- * dispatch_init(socks, nsocks, Q, maxconn):
+ * dispatch_init(socks, nsocks, Q, maxconn, cachekeys, coalesce):
  * Initialize a dispatcher to accept connections from the listening sockets
  * ${socks[0]} ... ${socks[nsocks - 1]} (but no more than ${maxconn} at
- * once) and shuttle requests/responses to/from the request queue ${Q}.
+ * once) and shuttle requests/responses to/from the request queue ${Q}.  If
+ * ${cachekeys} is non-zero, the target must be KVLDS, and responses to GET
+ * requests for up to ${cachekeys} keys will be cached.  If ${coalesce} is
+ * non-zero, the target must be KVLDS, and GET requests which are identical
+ * to a GET in progress will be answered with its response.
  */
-struct dispatch_state *
-dispatch_init(const int *, size_t, struct wire_requestqueue *, size_t);
+struct dispatch_state * dispatch_init(const int *, size_t,
+    struct wire_requestqueue *, size_t, size_t, int);
 
 /**
  * dispatch_alive(dstate):
@@ -0,0 +1,388 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+#include "kvldskey.h"
+#include "mpool.h"
+#include "queue.h"
+#include "sysendian.h"
+
+#include "getcache.h"
+
+/* Maximum length of a GET response: A status and a value. */
+#define MAXRESPLEN	(4 + 256)
+
+/* Minimum hash table size, since keys with requests in progress use it too. */
+#define MINBUCKETS	1024
+
+/*
+ * State for a key which has a cached GET response or requests in progress.
+ * Entries with cached responses are on the LRU list; entries which have
+ * neither a cached response nor requests in progress are freed.
+ */
+struct getcache_entry {
+	struct kvldskey * key;			/* The key. */
+	uint32_t hash;				/* Hash of the key. */
+	LIST_ENTRY(getcache_entry) hashlink;	/* Hash bucket. */
+	TAILQ_ENTRY(getcache_entry) lrulink;	/* LRU list. */
+	size_t nreqs;				/* # requests in progress. */
+	size_t nmrs;				/* # of which might modify. */
+	uint64_t mrgen;				/* # modifying reqs started. */
+	struct getcache_req * leader;		/* GET others can wait for. */
+	size_t resplen;				/* 0 if nothing cached. */
+	uint8_t resp[MAXRESPLEN];		/* Cached response. */
+	uint8_t crc[4];				/* CRC32C of cached response. */
+};
+
+/* Request in progress. */
+struct getcache_req {
+	struct getcache_entry * E;		/* Key state. */
+	int ismr;				/* Might modify the value. */
+	int cacheable;				/* GET started with no MRs. */
+	uint64_t mrgen;				/* E->mrgen when started. */
+	void * cookie;				/* From getcache_start. */
+};
+
+MPOOL(getcache_req, struct getcache_req, 4096);
+
+/* GET response cache. */
+struct getcache {
+	LIST_HEAD(, getcache_entry) * buckets;	/* Hash table. */
+	size_t nbuckets;			/* Size of hash table. */
+	TAILQ_HEAD(, getcache_entry) lru;	/* Cached, LRU first. */
+	size_t ncached;				/* # cached responses. */
+	size_t maxcached;			/* Maximum ncached. */
+};
+
+/* Compute the hash of a key. */
+static uint32_t
+hash(const struct kvldskey * k)
+{
+	CRC32C_CTX ctx;
+	uint32_t h;
+
+	/* Compute CRC32C(k). */
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, k->buf, k->len);
+	CRC32C_Final((uint8_t *)&h, &ctx);
+
+	/* Return hash value. */
+	return (h);
+}
+
+/* Find the entry for the key ${k} with hash ${h}, or return NULL. */
+static struct getcache_entry *
+find(struct getcache * C, const struct kvldskey * k, uint32_t h)
+{
+	struct getcache_entry * E;
+
+	LIST_FOREACH(E, &C->buckets[h & (C->nbuckets - 1)], hashlink) {
+		if ((E->hash == h) && (kvldskey_cmp(E->key, k) == 0))
+			return (E);
+	}
+
+	/* No such entry. */
+	return (NULL);
+}
+
+/* Forget the cached response (if any) in ${E}. */
+static void
+uncache(struct getcache * C, struct getcache_entry * E)
+{
+
+	/* Nothing to do if we don't have a cached response. */
+	if (E->resplen == 0)
+		return;
+
+	/* Remove from the LRU list. */
+	TAILQ_REMOVE(&C->lru, E, lrulink);
+	C->ncached--;
+	E->resplen = 0;
+}
+
+/* Free ${E} if it is no longer useful. */
+static void
+release(struct getcache_entry * E)
+{
+
+	/* Keep entries which have responses or requests in progress. */
+	if ((E->resplen != 0) || (E->nreqs != 0))
+		return;
+
+	/* Remove from the hash table and free. */
+	LIST_REMOVE(E, hashlink);
+	free(E->key);
+	free(E);
+}
+
+/* Check that ${resp} is a well-formed GET response with CRC32C ${crc}. */
+static int
+validresp(const uint8_t * resp, size_t resplen, const uint8_t * crc)
+{
+	CRC32C_CTX ctx;
+	uint8_t cbuf[4];
+
+	/* We need a status; if it's zero, it must be followed by a value. */
+	if ((resplen < 4) || (resplen > MAXRESPLEN))
+		return (0);
+	switch (be32dec(&resp[0])) {
+	case 0:
+		if ((resplen == 4) || (resplen != 5 + (size_t)resp[4]))
+			return (0);
+		break;
+	case 1:
+		if (resplen != 4)
+			return (0);
+		break;
+	default:
+		return (0);
+	}
+
+	/* We're going to hand this out repeatedly, so check it's not bad. */
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, resp, resplen);
+	CRC32C_Final(cbuf, &ctx);
+	if (memcmp(cbuf, crc, 4))
+		return (0);
+
+	/* Looks good. */
+	return (1);
+}
+
+/**
+ * getcache_init(maxkeys):
+ * Create a cache of KVLDS GET responses for up to ${maxkeys} keys.  If
+ * ${maxkeys} is zero, no responses will be cached, but the cache can still
+ * be used to find GETs in progress via getcache_inflight().
+ */
+struct getcache *
+getcache_init(size_t maxkeys)
+{
+	struct getcache * C;
+	size_t i;
+
+	/* Allocate structure. */
+	if ((C = malloc(sizeof(struct getcache))) == NULL)
+		goto err0;
+	TAILQ_INIT(&C->lru);
+	C->ncached = 0;
+	C->maxcached = maxkeys;
+
+	/* Allocate a power-of-two number of buckets, at least maxkeys. */
+	for (C->nbuckets = MINBUCKETS; C->nbuckets < maxkeys; C->nbuckets <<= 1)
+		continue;
+	if ((C->buckets = calloc(C->nbuckets, sizeof(*C->buckets))) == NULL)
+		goto err1;
+	for (i = 0; i < C->nbuckets; i++)
+		LIST_INIT(&C->buckets[i]);
+
+	/* Success! */
+	return (C);
+
+err1:
+	free(C);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * getcache_lookup(C, key, resp, resplen, crc):
+ * If the cache ${C} holds a GET response for ${key}, set ${resp} and
+ * ${resplen} to point at its data and its length, set ${crc} to point at the
+ * CRC32C of its data, and return 1.  Otherwise, return 0.  The response data
+ * remains valid until ${C} is next modified.
+ */
+int
+getcache_lookup(struct getcache * C, const struct kvldskey * key,
+    uint8_t ** resp, size_t * resplen, const uint8_t ** crc)
+{
+	struct getcache_entry * E;
+
+	/* Do we have a cached response? */
+	if (((E = find(C, key, hash(key))) == NULL) || (E->resplen == 0))
+		return (0);
+
+	/* This is now the most recently used response. */
+	TAILQ_REMOVE(&C->lru, E, lrulink);
+	TAILQ_INSERT_TAIL(&C->lru, E, lrulink);
+
+	/* Return the response. */
+	*resp = E->resp;
+	*resplen = E->resplen;
+	*crc = E->crc;
+	return (1);
+}
+
+/**
+ * getcache_inflight(C, key):
+ * If a GET for ${key} is in progress, and its response would also be a
+ * correct response to a GET for ${key} which arrived now, return the cookie
+ * which was passed to getcache_start() for it.  Otherwise, return NULL.
+ */
+void *
+getcache_inflight(struct getcache * C, const struct kvldskey * key)
+{
+	struct getcache_entry * E;
+
+	/* Do we have a GET in progress which we could wait for? */
+	if (((E = find(C, key, hash(key))) == NULL) || (E->leader == NULL))
+		return (NULL);
+
+	/* Return its cookie. */
+	return (E->leader->cookie);
+}
+
+/**
+ * getcache_start(C, key, ismr, cookie):
+ * Record in the cache ${C} that a request for ${key} is being forwarded to
+ * the target; it is a GET if ${ismr} is zero, or a request which might
+ * modify the value associated with ${key} otherwise.  Return a cookie which
+ * must be passed to getcache_done() once the request has completed.  The
+ * value ${cookie} may be returned by getcache_inflight() until then.
+ */
+struct getcache_req *
+getcache_start(struct getcache * C, const struct kvldskey * key, int ismr,
+    void * cookie)
+{
+	struct getcache_entry * E;
+	struct getcache_req * R;
+	uint32_t h;
+
+	/* Bake a cookie. */
+	if ((R = mpool_getcache_req_malloc()) == NULL)
+		goto err0;
+
+	/* Find or create an entry for this key. */
+	h = hash(key);
+	if ((E = find(C, key, h)) == NULL) {
+		if ((E = malloc(sizeof(struct getcache_entry))) == NULL)
+			goto err1;
+		if ((E->key = kvldskey_dup(key)) == NULL)
+			goto err2;
+		E->hash = h;
+		E->nreqs = 0;
+		E->nmrs = 0;
+		E->mrgen = 0;
+		E->leader = NULL;
+		E->resplen = 0;
+		LIST_INSERT_HEAD(&C->buckets[h & (C->nbuckets - 1)], E,
+		    hashlink);
+	}
+
+	/*
+	 * A GET response can only be cached if the target has already
+	 * responded to every request which could have modified the value
+	 * before the GET is sent; otherwise the GET might be handled before
+	 * the modification takes effect.
+	 */
+	R->E = E;
+	R->ismr = ismr;
+	R->cacheable = (E->nmrs == 0);
+	R->mrgen = E->mrgen;
+	R->cookie = cookie;
+
+	/*
+	 * Record the request.  If it might modify the value, the cached
+	 * response (if any) is about to become stale, and so are the responses
+	 * to any GETs in progress; otherwise, if its response could be cached,
+	 * it is also a correct response for GETs which arrive before it.
+	 */
+	E->nreqs++;
+	if (ismr) {
+		E->nmrs++;
+		E->mrgen++;
+		E->leader = NULL;
+		uncache(C, E);
+	} else if (R->cacheable && (E->leader == NULL)) {
+		E->leader = R;
+	}
+
+	/* Success! */
+	return (R);
+
+err2:
+	free(E);
+err1:
+	mpool_getcache_req_free(R);
+err0:
+	/* Failure! */
+	return (NULL);
+}
+
+/**
+ * getcache_done(C, R, resp, resplen, crc):
+ * Record in the cache ${C} that the request ${R} has completed with the
+ * ${resplen}-byte response ${resp}, the data CRC32C of which is claimed to
+ * be ${crc}; or failed, if ${resp} is NULL.  If the request was a GET and no
+ * request which might have modified the value has been forwarded since
+ * before it was sent, cache the response.
+ */
+void
+getcache_done(struct getcache * C, struct getcache_req * R,
+    const uint8_t * resp, size_t resplen, const uint8_t * crc)
+{
+	struct getcache_entry * E = R->E;
+	struct getcache_entry * E_lru;
+
+	/* This request is no longer in progress. */
+	E->nreqs--;
+	if (R->ismr)
+		E->nmrs--;
+	if (E->leader == R)
+		E->leader = NULL;
+
+	/*
+	 * Cache the response if it is fresh, well-formed, and we don't have
+	 * one already.  If any request which might modify the value was sent
+	 * after this GET, E->mrgen will have changed.
+	 */
+	if ((resp != NULL) && !R->ismr && R->cacheable &&
+	    (R->mrgen == E->mrgen) && (E->resplen == 0) &&
+	    (C->maxcached > 0) && validresp(resp, resplen, crc)) {
+		memcpy(E->resp, resp, resplen);
+		memcpy(E->crc, crc, 4);
+		E->resplen = resplen;
+		TAILQ_INSERT_TAIL(&C->lru, E, lrulink);
+		C->ncached++;
+
+		/* Evict the least recently used response if necessary. */
+		if (C->ncached > C->maxcached) {
+			E_lru = TAILQ_FIRST(&C->lru);
+			uncache(C, E_lru);
+			if (E_lru != E)
+				release(E_lru);
+		}
+	}
+
+	/* Free the entry if it's no longer needed. */
+	release(E);
+
+	/* Free the cookie. */
+	mpool_getcache_req_free(R);
+}
+
+/**
+ * getcache_free(C):
+ * Free the cache ${C}, which must not have any requests in progress.
+ */
+void
+getcache_free(struct getcache * C)
+{
+	struct getcache_entry * E;
+
+	/* Behave consistently with free(NULL). */
+	if (C == NULL)
+		return;
+
+	/* Free the cached responses; their entries will be freed too. */
+	while ((E = TAILQ_FIRST(&C->lru)) != NULL) {
+		uncache(C, E);
+		release(E);
+	}
+
+	/* Free the hash table and the cache. */
+	free(C->buckets);
+	free(C);
+}
@@ -0,0 +1,66 @@
+#ifndef GETCACHE_H_
+#define GETCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Opaque types. */
+struct getcache;
+struct getcache_req;
+struct kvldskey;
+
+/**
+ * getcache_init(maxkeys):
+ * Create a cache of KVLDS GET responses for up to ${maxkeys} keys.  If
+ * ${maxkeys} is zero, no responses will be cached, but the cache can still
+ * be used to find GETs in progress via getcache_inflight().
+ */
+struct getcache * getcache_init(size_t);
+
+/**
+ * getcache_lookup(C, key, resp, resplen, crc):
+ * If the cache ${C} holds a GET response for ${key}, set ${resp} and
+ * ${resplen} to point at its data and its length, set ${crc} to point at the
+ * CRC32C of its data, and return 1.  Otherwise, return 0.  The response data
+ * remains valid until ${C} is next modified.
+ */
+int getcache_lookup(struct getcache *, const struct kvldskey *,
+    uint8_t **, size_t *, const uint8_t **);
+
+/**
+ * getcache_inflight(C, key):
+ * If a GET for ${key} is in progress, and its response would also be a
+ * correct response to a GET for ${key} which arrived now, return the cookie
+ * which was passed to getcache_start() for it.  Otherwise, return NULL.
+ */
+void * getcache_inflight(struct getcache *, const struct kvldskey *);
+
+/**
+ * getcache_start(C, key, ismr, cookie):
+ * Record in the cache ${C} that a request for ${key} is being forwarded to
+ * the target; it is a GET if ${ismr} is zero, or a request which might
+ * modify the value associated with ${key} otherwise.  Return a cookie which
+ * must be passed to getcache_done() once the request has completed.  The
+ * value ${cookie} may be returned by getcache_inflight() until then.
+ */
+struct getcache_req * getcache_start(struct getcache *,
+    const struct kvldskey *, int, void *);
+
+/**
+ * getcache_done(C, R, resp, resplen, crc):
+ * Record in the cache ${C} that the request ${R} has completed with the
+ * ${resplen}-byte response ${resp}, the data CRC32C of which is claimed to
+ * be ${crc}; or failed, if ${resp} is NULL.  If the request was a GET and no
+ * request which might have modified the value has been forwarded since
+ * before it was sent, cache the response.
+ */
+void getcache_done(struct getcache *, struct getcache_req *,
+    const uint8_t *, size_t, const uint8_t *);
+
+/**
+ * getcache_free(C):
+ * Free the cache ${C}, which must not have any requests in progress.
+ */
+void getcache_free(struct getcache *);
+
+#endif /* !GETCACHE_H_ */
@@ -17,6 +17,7 @@
 #include "wire.h"
 
 #include "dispatch.h"
+#include "workers.h"
 
 ELASTICARRAY_DECL(ADDRLIST, addrlist, struct sock_addr *);
 
@@ -26,7 +27,8 @@ usage(void)
 
 	fprintf(stderr, "usage: kivaloo-mux -t <target socket> "
 	    "-s <source socket> [-s <source socket> ...] "
-	    "[-n <max # connections] [-p <pidfile>]\n");
+	    "[-C <# cached keys>] [-g] [-n <max # connections] "
+	    "[-p <pidfile>] [-w <# workers>]\n");
 	fprintf(stderr, "       kivaloo-mux --version\n");
 	exit(1);
 }
@@ -47,15 +49,19 @@ main(int argc, char * argv[])
 	struct dispatch_state * dstate;
 
 	/* Command-line parameters. */
+	size_t opt_C = 0;
+	int opt_g = 0;
 	size_t opt_n = 0;
 	char * opt_p = NULL;
 	char * opt_t = NULL;
+	size_t opt_w = 0;
 	ADDRLIST opt_s;
 	char * opt_s_1 = NULL;
 
 	/* Working variables. */
 	size_t opt_s_size;
 	struct sock_addr ** sas;
+	int worker;
 	size_t i;
 	const char * ch;
 
@@ -70,6 +76,19 @@ main(int argc, char * argv[])
 	/* Parse the command line. */
 	while ((ch = GETOPT(argc, argv)) != NULL) {
 		GETOPT_SWITCH(ch) {
+		GETOPT_OPTARG("-C"):
+			if (opt_C != 0)
+				usage();
+			if (PARSENUM(&opt_C, optarg, 1, 1 << 24)) {
+				warn0("Invalid option: -C %s", optarg);
+				usage();
+			}
+			break;
+		GETOPT_OPT("-g"):
+			if (opt_g != 0)
+				usage();
+			opt_g = 1;
+			break;
 		GETOPT_OPTARG("-n"):
 			if (opt_n != 0)
 				usage();
@@ -115,6 +134,14 @@ main(int argc, char * argv[])
 			if ((opt_t = strdup(optarg)) == NULL)
 				OPT_EPARSE(ch, optarg);
 			break;
+		GETOPT_OPTARG("-w"):
+			if (opt_w != 0)
+				usage();
+			if (PARSENUM(&opt_w, optarg, 1, 256)) {
+				warn0("Invalid option: -w %s", optarg);
+				usage();
+			}
+			break;
 		GETOPT_OPT("--version"):
 			fprintf(stderr, "kivaloo-mux @VERSION@\n");
 			exit(0);
@@ -140,6 +167,12 @@ main(int argc, char * argv[])
 	if (opt_t == NULL)
 		usage();
 
+	/* Workers can't see each other's requests, so can't share a cache. */
+	if (((opt_C != 0) || opt_g) && (opt_w > 1)) {
+		warn0("The -C and -g options cannot be used with -w");
+		usage();
+	}
+
 	/* Resolve target address. */
 	if ((sas = sock_resolve(opt_t)) == NULL) {
 		warnp("Error resolving socket address: %s", opt_t);
@@ -154,15 +187,6 @@ main(int argc, char * argv[])
 	if ((sock_t = sock_connect(sas)) == -1)
 		exit(1);
 
-	/* Free the target address(es). */
-	sock_addr_freelist(sas);
-
-	/* Create a queue of requests to the target. */
-	if ((Q_t = wire_requestqueue_init(sock_t)) == NULL) {
-		warnp("Cannot create request queue");
-		exit(1);
-	}
-
 	/* Allocate array of source sockets. */
 	if ((socks_s = malloc(opt_s_size * sizeof(int))) == NULL) {
 		warnp("malloc");
@@ -176,13 +200,6 @@ main(int argc, char * argv[])
 			exit(1);
 	}
 
-	/* Initialize the dispatcher. */
-	if ((dstate = dispatch_init(socks_s, opt_s_size,
-	    Q_t, opt_n ? opt_n : SIZE_MAX)) == NULL) {
-		warnp("Failed to initialize dispatcher");
-		exit(1);
-	}
-
 	/* Daemonize and write pid. */
 	if (opt_p == NULL) {
 		if (asprintf(&opt_p, "%s.pid", opt_s_1) == -1) {
@@ -195,6 +212,36 @@ main(int argc, char * argv[])
 		exit(1);
 	}
 
+	/* Start worker processes, which share the listening sockets. */
+	if ((worker = workers_start(opt_w)) == -1) {
+		warnp("Failed to start worker processes");
+		exit(1);
+	}
+
+	/* Each worker needs its own connection to the target. */
+	if (worker > 0) {
+		if (close(sock_t))
+			warnp("close");
+		if ((sock_t = sock_connect(sas)) == -1)
+			exit(1);
+	}
+
+	/* Free the target address(es). */
+	sock_addr_freelist(sas);
+
+	/* Create a queue of requests to the target. */
+	if ((Q_t = wire_requestqueue_init(sock_t)) == NULL) {
+		warnp("Cannot create request queue");
+		exit(1);
+	}
+
+	/* Initialize the dispatcher. */
+	if ((dstate = dispatch_init(socks_s, opt_s_size,
+	    Q_t, opt_n ? opt_n : SIZE_MAX, opt_C, opt_g)) == NULL) {
+		warnp("Failed to initialize dispatcher");
+		exit(1);
+	}
+
 	/* Loop until the dispatcher is finished. */
 	do {
 		if (events_run()) {
@@ -0,0 +1,120 @@
+#include <sys/types.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "events.h"
+#include "warnp.h"
+
+#include "workers.h"
+
+/* Our parent has exited; so should we. */
+static int
+callback_parentgone(void * cookie)
+{
+
+	(void)cookie; /* UNUSED */
+
+	/* Exit, just as our parent did. */
+	exit(0);
+}
+
+/**
+ * workers_start(n):
+ * Fork ${n} - 1 worker processes, each of which will exit when the calling
+ * process exits.  Return 0 in the calling process, a worker number between
+ * 1 and ${n} - 1 in each worker process, or -1 on error.  This must be
+ * called before any events are registered.
+ */
+int
+workers_start(size_t n)
+{
+	int fd[2];
+	size_t i;
+
+	/* If we only want one worker, it's us. */
+	if (n <= 1)
+		return (0);
+
+	/* Don't leave zombies behind if a worker exits before we do. */
+	if (signal(SIGCHLD, SIG_IGN) == SIG_ERR) {
+		warnp("signal(SIGCHLD)");
+		goto err0;
+	}
+
+	/*
+	 * Create a pipe which nobody will ever write to.  We hold the write
+	 * end open until we exit (for whatever reason), at which point the
+	 * workers will see EOF on the read end.
+	 */
+	if (pipe(fd)) {
+		warnp("pipe");
+		goto err0;
+	}
+
+	/* Fork the workers. */
+	for (i = 1; i < n; i++) {
+		switch (fork()) {
+		case -1:
+			/* Fork failed. */
+			warnp("fork");
+			goto err1;
+		case 0:
+			/* In worker process. */
+			goto worker;
+		default:
+			/* In parent process. */
+			break;
+		}
+	}
+
+	/* We don't need the read end of the pipe. */
+	while (close(fd[0])) {
+		if (errno == EINTR)
+			continue;
+		warnp("close");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+worker:
+	/* Only the parent should hold the write end of the pipe. */
+	while (close(fd[1])) {
+		if (errno == EINTR)
+			continue;
+		warnp("close");
+		goto err2;
+	}
+
+	/* Exit when the parent exits. */
+	if (events_network_register(callback_parentgone, NULL, fd[0],
+	    EVENTS_NETWORK_OP_READ)) {
+		warnp("Cannot watch for parent exit");
+		goto err2;
+	}
+
+	/* Success! */
+	return ((int)i);
+
+err2:
+	if (close(fd[0]))
+		warnp("close");
+
+	/* Failure! */
+	return (-1);
+
+err1:
+	/* Any workers we started will exit when we do. */
+	if (close(fd[1]))
+		warnp("close");
+	if (close(fd[0]))
+		warnp("close");
+err0:
+	/* Failure! */
+	return (-1);
+}
@@ -0,0 +1,15 @@
+#ifndef WORKERS_H_
+#define WORKERS_H_
+
+#include <stddef.h>
+
+/**
+ * workers_start(n):
+ * Fork ${n} - 1 worker processes, each of which will exit when the calling
+ * process exits.  Return 0 in the calling process, a worker number between
+ * 1 and ${n} - 1 in each worker process, or -1 on error.  This must be
+ * called before any events are registered.
+ */
+int workers_start(size_t);
+
+#endif /* !WORKERS_H_ */
@@ -0,0 +1,229 @@
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "events.h"
+#include "monoclock.h"
+#include "warnp.h"
+
+/* Number of round trips to time for each number of idle descriptors. */
+#define NTRIPS	100000
+
+/* Numbers of idle descriptors to test with. */
+static const size_t nidles[] = {0, 10, 100, 1000, 10000};
+
+/* Active socket pair, and state of the ping-pong between its ends. */
+static int s[2];
+static long tripsleft;
+static int done;
+
+/* Idle descriptors with events registered. */
+static int * idle;
+
+/* Register a read callback on ${fd}. */
+static int
+readon(int fd, int (* callback)(void *))
+{
+
+	if (events_network_register(callback, NULL, fd,
+	    EVENTS_NETWORK_OP_READ)) {
+		warnp("events_network_register");
+		return (-1);
+	}
+	return (0);
+}
+
+/* Read a byte from ${fd}. */
+static int
+readbyte(int fd)
+{
+	uint8_t c;
+
+	if (read(fd, &c, 1) != 1) {
+		warnp("read");
+		return (-1);
+	}
+	return (0);
+}
+
+/* Write a byte to ${fd}. */
+static int
+writebyte(int fd)
+{
+	uint8_t c = 0;
+
+	if (write(fd, &c, 1) != 1) {
+		warnp("write");
+		return (-1);
+	}
+	return (0);
+}
+
+/* A byte has come back to s[0]; send it again if we're not done. */
+static int
+callback_ping(void * cookie)
+{
+
+	(void)cookie; /* UNUSED */
+
+	/* Read the byte. */
+	if (readbyte(s[0]))
+		return (-1);
+
+	/* Are we done? */
+	if (--tripsleft == 0) {
+		done = 1;
+		return (0);
+	}
+
+	/* Send it back and wait for it to return. */
+	if (writebyte(s[0]) || readon(s[0], callback_ping))
+		return (-1);
+	return (0);
+}
+
+/* A byte has arrived at s[1]; send it back. */
+static int
+callback_pong(void * cookie)
+{
+
+	(void)cookie; /* UNUSED */
+
+	/* Bounce the byte and wait for the next one. */
+	if (readbyte(s[1]) || writebyte(s[1]) || readon(s[1], callback_pong))
+		return (-1);
+	return (0);
+}
+
+/* We should never get here: the idle sockets are idle. */
+static int
+callback_idle(void * cookie)
+{
+
+	(void)cookie; /* UNUSED */
+
+	warn0("Idle socket became ready");
+	return (-1);
+}
+
+/* Time round trips between s[0] and s[1] with ${nidle} idle descriptors. */
+static int
+bench(size_t nidle)
+{
+	struct timeval tv_start, tv_end;
+	double t;
+	size_t i;
+
+	/* Create idle socket pairs and watch both ends for reading. */
+	for (i = 0; i < nidle; i += 2) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, &idle[i])) {
+			warnp("socketpair");
+			goto err0;
+		}
+		if (readon(idle[i], callback_idle) ||
+		    readon(idle[i + 1], callback_idle))
+			goto err0;
+	}
+
+	/* Bounce a byte back and forth NTRIPS times. */
+	tripsleft = NTRIPS;
+	done = 0;
+	if (monoclock_get(&tv_start))
+		goto err0;
+	if (readon(s[1], callback_pong) || readon(s[0], callback_ping) ||
+	    writebyte(s[0]))
+		goto err0;
+	if (events_spin(&done)) {
+		warnp("Error running event loop");
+		goto err0;
+	}
+	if (monoclock_get(&tv_end))
+		goto err0;
+
+	/* Each round trip is two events. */
+	t = timeval_diff(tv_start, tv_end);
+	printf("%6zu idle descriptors: %.0f ns per event\n", nidle,
+	    t * 1000000000.0 / (2 * NTRIPS));
+
+	/* Stop bouncing, and clean up the idle sockets. */
+	if (events_network_cancel(s[1], EVENTS_NETWORK_OP_READ)) {
+		warnp("events_network_cancel");
+		goto err0;
+	}
+	for (i = 0; i < nidle; i++) {
+		if (events_network_cancel(idle[i], EVENTS_NETWORK_OP_READ)) {
+			warnp("events_network_cancel");
+			goto err0;
+		}
+		if (close(idle[i])) {
+			warnp("close");
+			goto err0;
+		}
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+int
+main(int argc, char * argv[])
+{
+	struct rlimit rl;
+	size_t i;
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_events_network\n");
+		exit(1);
+	}
+
+	/* We need lots of descriptors. */
+	if (getrlimit(RLIMIT_NOFILE, &rl)) {
+		warnp("getrlimit");
+		exit(1);
+	}
+	if (rl.rlim_max != RLIM_INFINITY)
+		rl.rlim_cur = rl.rlim_max;
+	if (setrlimit(RLIMIT_NOFILE, &rl)) {
+		warnp("setrlimit");
+		exit(1);
+	}
+
+	/* Create the active socket pair. */
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s)) {
+		warnp("socketpair");
+		exit(1);
+	}
+
+	/* Allocate space for the largest number of idle descriptors. */
+	if ((idle = malloc(nidles[sizeof(nidles) / sizeof(nidles[0]) - 1] *
+	    sizeof(int))) == NULL) {
+		warnp("malloc");
+		exit(1);
+	}
+
+	/* Time events with increasing numbers of idle descriptors. */
+	for (i = 0; i < sizeof(nidles) / sizeof(nidles[0]); i++) {
+		if (bench(nidles[i]))
+			exit(1);
+	}
+
+	/* Clean up. */
+	free(idle);
+	events_shutdown();
+
+	/* Success! */
+	exit(0);
+}
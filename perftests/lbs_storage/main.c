@@ -0,0 +1,382 @@
+#include <sys/time.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asprintf.h"
+#include "crc32c.h"
+#include "monoclock.h"
+#include "warnp.h"
+
+#include "disk.h"
+#include "storage.h"
+
+/* Block size used for the benchmark. */
+#define BLKLEN	512
+
+/* Number of reads to time for each storage layout. */
+#define NREADS	1000000
+
+/* Reads go to the most recent HOTFILES files, as with a hot working set. */
+#define HOTFILES	32
+
+/* Number of live block files lbs keeps once the stored data stops growing. */
+#define STEADYFILES	64
+
+/* Number of threads reading at once, as with lbs reader threads. */
+#define NTHREADS	8
+
+/* Number of checksums to time. */
+#define NCRCS	10000000
+
+/*
+ * Create ${nfiles} one-block files in ${dir}, with files holding their
+ * checksums if ${crcs} is non-zero.
+ */
+static int
+mkfiles(const char * dir, uint64_t nfiles, int crcs)
+{
+	uint8_t buf[BLKLEN];
+	uint8_t cbuf[4];
+	CRC32C_CTX ctx;
+	uint64_t i;
+	char * s;
+
+	memset(buf, 0, BLKLEN);
+	CRC32C_Init(&ctx);
+	CRC32C_Update(&ctx, buf, BLKLEN);
+	CRC32C_Final(cbuf, &ctx);
+	for (i = 0; i < nfiles; i++) {
+		if (asprintf(&s, "%s/blks_%016" PRIx64, dir, i) == -1) {
+			warnp("asprintf");
+			goto err0;
+		}
+		if (disk_write(s, 1, BLKLEN, buf, 1, 0))
+			goto err1;
+		free(s);
+		if (!crcs)
+			continue;
+		if (asprintf(&s, "%s/crcs_%016" PRIx64, dir, i) == -1) {
+			warnp("asprintf");
+			goto err0;
+		}
+		if (disk_write(s, 1, 4, cbuf, 1, 0))
+			goto err1;
+		free(s);
+	}
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Delete the ${nfiles} files created by mkfiles. */
+static int
+rmfiles(const char * dir, uint64_t nfiles)
+{
+	uint64_t i;
+	char * s;
+
+	for (i = 0; i < nfiles; i++) {
+		if (asprintf(&s, "%s/blks_%016" PRIx64, dir, i) == -1) {
+			warnp("asprintf");
+			goto err0;
+		}
+		if (unlink(s)) {
+			warnp("unlink(%s)", s);
+			goto err1;
+		}
+		free(s);
+		if (asprintf(&s, "%s/crcs_%016" PRIx64, dir, i) == -1) {
+			warnp("asprintf");
+			goto err0;
+		}
+		if (unlink(s) && (errno != ENOENT)) {
+			warnp("unlink(%s)", s);
+			goto err1;
+		}
+		free(s);
+	}
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(s);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * Time random reads from the most recent ${nhot} of ${nfiles} files in
+ * ${dir}, verifying checksums if ${crcs} is non-zero.
+ */
+static int
+bench(const char * dir, uint64_t nfiles, uint64_t nhot, int crcs)
+{
+	struct storage_state * S;
+	struct timeval tv_start, tv_end;
+	uint8_t buf[BLKLEN];
+	uint64_t blkno;
+	double t;
+	long i;
+
+	/* Set up storage. */
+	if (mkfiles(dir, nfiles, crcs))
+		goto err0;
+	if ((S = storage_init(dir, BLKLEN, 0, 1, 0, 0, 0, crcs)) == NULL) {
+		warnp("storage_init");
+		goto err1;
+	}
+
+	/* Read random blocks from the most recent files. */
+	if (monoclock_get(&tv_start))
+		goto err2;
+	for (i = 0; i < NREADS; i++) {
+		blkno = nfiles - 1 - (uint64_t)random() % nhot;
+		if (storage_read(S, blkno, 1, buf) != 1) {
+			warn0("Failed to read block %" PRIu64, blkno);
+			goto err2;
+		}
+	}
+	if (monoclock_get(&tv_end))
+		goto err2;
+
+	/* Report time per read. */
+	t = (double)(tv_end.tv_sec - tv_start.tv_sec) +
+	    (double)(tv_end.tv_usec - tv_start.tv_usec) * 0.000001;
+	printf("%8" PRIu64 " files, %4" PRIu64 " read: %.0f ns per read%s\n",
+	    nfiles, nhot, t * 1000000000.0 / NREADS,
+	    crcs ? " (verified)" : "");
+
+	/* Clean up. */
+	storage_done(S);
+	if (rmfiles(dir, nfiles))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err2:
+	storage_done(S);
+err1:
+	rmfiles(dir, nfiles);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* A thread reading random blocks. */
+struct reader {
+	struct storage_state * S;	/* Storage to read from. */
+	uint64_t nfiles;		/* Number of (one-block) files. */
+	uint64_t x;			/* Random number state. */
+	int failed;			/* Non-zero if a read failed. */
+	pthread_t thr;			/* The thread itself. */
+};
+
+/* Read NREADS / NTHREADS random blocks. */
+static void *
+readblocks(void * cookie)
+{
+	struct reader * R = cookie;
+	uint8_t buf[BLKLEN];
+	uint64_t blkno;
+	long i;
+
+	for (i = 0; i < NREADS / NTHREADS; i++) {
+		/* Pick a block (xorshift, since random() takes a lock). */
+		R->x ^= R->x << 13;
+		R->x ^= R->x >> 7;
+		R->x ^= R->x << 17;
+		blkno = R->x % R->nfiles;
+
+		/* Read it. */
+		if (storage_read(R->S, blkno, 1, buf) != 1) {
+			R->failed = 1;
+			break;
+		}
+	}
+
+	/* We're done. */
+	return (NULL);
+}
+
+/*
+ * Time random reads from all ${nfiles} files in ${dir} by NTHREADS threads
+ * at once.
+ */
+static int
+tbench(const char * dir, uint64_t nfiles)
+{
+	struct reader R[NTHREADS];
+	struct storage_state * S;
+	struct timeval tv_start, tv_end;
+	double t;
+	size_t i, j;
+	int rc;
+
+	/* Set up storage. */
+	if (mkfiles(dir, nfiles, 0))
+		goto err0;
+	if ((S = storage_init(dir, BLKLEN, 0, 1, 0, 0, 0, 0)) == NULL) {
+		warnp("storage_init");
+		goto err1;
+	}
+
+	/* Start the threads reading. */
+	if (monoclock_get(&tv_start))
+		goto err2;
+	for (i = 0; i < NTHREADS; i++) {
+		R[i].S = S;
+		R[i].nfiles = nfiles;
+		R[i].x = i + 1;
+		R[i].failed = 0;
+		if ((rc = pthread_create(&R[i].thr, NULL, readblocks,
+		    &R[i])) != 0) {
+			warn0("pthread_create: %s", strerror(rc));
+			goto err3;
+		}
+	}
+
+	/* Wait for them to finish. */
+	for (j = 0; j < NTHREADS; j++) {
+		if ((rc = pthread_join(R[j].thr, NULL)) != 0) {
+			warn0("pthread_join: %s", strerror(rc));
+			goto err2;
+		}
+		if (R[j].failed) {
+			warn0("Failed to read block");
+			goto err2;
+		}
+	}
+	if (monoclock_get(&tv_end))
+		goto err2;
+
+	/* Report time per read. */
+	t = (double)(tv_end.tv_sec - tv_start.tv_sec) +
+	    (double)(tv_end.tv_usec - tv_start.tv_usec) * 0.000001;
+	printf("%8" PRIu64 " files, %4" PRIu64 " read: %.0f ns per read"
+	    " (%d threads)\n", nfiles, nfiles, t * 1000000000.0 / NREADS,
+	    NTHREADS);
+
+	/* Clean up. */
+	storage_done(S);
+	if (rmfiles(dir, nfiles))
+		goto err0;
+
+	/* Success! */
+	return (0);
+
+err3:
+	for (j = 0; j < i; j++)
+		pthread_join(R[j].thr, NULL);
+err2:
+	storage_done(S);
+err1:
+	rmfiles(dir, nfiles);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Time computing checksums of ${blklen}-byte blocks. */
+static int
+crcbench(size_t blklen)
+{
+	struct timeval tv_start, tv_end;
+	CRC32C_CTX ctx;
+	uint8_t * buf;
+	uint8_t cbuf[4];
+	double t;
+	long i;
+
+	/* Allocate and fill a block. */
+	if ((buf = malloc(blklen)) == NULL)
+		goto err0;
+	memset(buf, 0x55, blklen);
+
+	/* Compute the checksum many times. */
+	if (monoclock_get(&tv_start))
+		goto err1;
+	for (i = 0; i < NCRCS; i++) {
+		buf[0] = (uint8_t)i;
+		CRC32C_Init(&ctx);
+		CRC32C_Update(&ctx, buf, blklen);
+		CRC32C_Final(cbuf, &ctx);
+	}
+	if (monoclock_get(&tv_end))
+		goto err1;
+
+	/* Report time per checksum. */
+	t = (double)(tv_end.tv_sec - tv_start.tv_sec) +
+	    (double)(tv_end.tv_usec - tv_start.tv_usec) * 0.000001;
+	printf("%8zu-byte block: %.0f ns per CRC32C (%02x%02x%02x%02x)\n",
+	    blklen, t * 1000000000.0 / NCRCS, cbuf[0], cbuf[1], cbuf[2],
+	    cbuf[3]);
+
+	/* Clean up. */
+	free(buf);
+
+	/* Success! */
+	return (0);
+
+err1:
+	free(buf);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+int
+main(int argc, char * argv[])
+{
+	uint64_t nfiles;
+	size_t blklen;
+
+	WARNP_INIT;
+
+	/* Check arguments. */
+	if (argc != 2) {
+		fprintf(stderr, "usage: test_lbs_storage %s\n", "<dir>");
+		exit(1);
+	}
+
+	/* Read latency should not depend on the number of files. */
+	for (nfiles = HOTFILES; nfiles <= 65536; nfiles *= 8) {
+		if (bench(argv[1], nfiles, HOTFILES, 0))
+			exit(1);
+	}
+
+	/* Reading all of the live files should not miss the fd cache. */
+	if (bench(argv[1], STEADYFILES, STEADYFILES, 0) ||
+	    bench(argv[1], STEADYFILES, STEADYFILES, 1))
+		exit(1);
+
+	/* Concurrent readers should not queue up behind the fd cache. */
+	if (tbench(argv[1], STEADYFILES) || tbench(argv[1], 4096))
+		exit(1);
+
+	/* Verifying block checksums should cost little next to the read. */
+	if (bench(argv[1], 4096, HOTFILES, 1))
+		exit(1);
+	for (blklen = BLKLEN; blklen <= 65536; blklen *= 8) {
+		if (crcbench(blklen))
+			exit(1);
+	}
+
+	/* Success! */
+	exit(0);
+}
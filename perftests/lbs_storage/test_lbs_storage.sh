@@ -0,0 +1,8 @@
+#!/bin/sh
+
+set -e
+
+rm -rf stor
+mkdir stor
+./test_lbs_storage stor
+rm -rf stor
@@ -0,0 +1,176 @@
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imalloc.h"
+#include "kvldskey.h"
+#include "monoclock.h"
+#include "pfxsearch.h"
+#include "warnp.h"
+
+/* Number of searches to time for each node size. */
+#define NSEARCHES	10000000
+
+/* Length of keys. */
+#define KEYLEN	24
+
+/* Numbers of keys in a node to test with. */
+static const size_t nkeyss[] = {16, 64, 256, 1024};
+
+/* Sort keys. */
+static int
+keycmp(const void * x, const void * y)
+{
+	const struct kvldskey * const * kx = x;
+	const struct kvldskey * const * ky = y;
+
+	return (kvldskey_cmp(*kx, *ky));
+}
+
+/*
+ * Return the position of ${k} in the ${nkeys} keys ${keys} which match ${k}
+ * up to ${mlen} bytes, searching the prefix array ${pfx} first if it is not
+ * NULL, in the same way as btree_find_kvpair.
+ */
+static size_t
+find(struct kvldskey * const * keys, const uint64_t * pfx, size_t nkeys,
+    size_t mlen, const struct kvldskey * k)
+{
+	size_t min, max, mid;
+	int rc;
+
+	/* Narrow the search down to the keys whose prefixes match. */
+	min = 0;
+	max = nkeys;
+	if (pfx != NULL)
+		pfxsearch(pfx, nkeys, kvldskey_prefix(k, mlen), &min, &max);
+
+	/* Bisect using the keys themselves. */
+	while (min != max) {
+		mid = min + (max - min) / 2;
+		rc = kvldskey_cmp2(k, keys[mid], mlen);
+		if (rc < 0)
+			max = mid;
+		else if (rc > 0)
+			min = mid + 1;
+		else
+			return (mid);
+	}
+	return (nkeys);
+}
+
+/*
+ * Time searches for random keys among ${nkeys} keys which share their first
+ * ${tied} bytes, with and without a prefix array.
+ */
+static int
+bench(size_t nkeys, size_t tied)
+{
+	struct timeval tv_start, tv_end;
+	struct kvldskey ** keys;
+	uint64_t * pfx;
+	uint8_t buf[KEYLEN];
+	size_t * targets;
+	double t[2];
+	size_t i, j;
+	int usepfx;
+
+	/* Create sorted random keys; they share the first ${tied} bytes. */
+	if (IMALLOC(keys, nkeys, struct kvldskey *))
+		goto err0;
+	memset(buf, 'k', KEYLEN);
+	for (i = 0; i < nkeys; i++) {
+		for (j = tied; j < KEYLEN; j++)
+			buf[j] = (uint8_t)random();
+		if ((keys[i] = kvldskey_create(buf, KEYLEN)) == NULL)
+			goto err1;
+	}
+	qsort(keys, nkeys, sizeof(struct kvldskey *), keycmp);
+
+	/* Build the prefix array, as kvlds does for a node with mlen_t 0. */
+	if (IMALLOC(pfx, nkeys, uint64_t))
+		goto err1;
+	for (i = 0; i < nkeys; i++)
+		pfx[i] = kvldskey_prefix(keys[i], 0);
+
+	/* Pick keys to search for. */
+	if (IMALLOC(targets, NSEARCHES, size_t))
+		goto err2;
+	for (i = 0; i < NSEARCHES; i++)
+		targets[i] = (size_t)random() % nkeys;
+
+	/* Time searches without and with the prefix array. */
+	for (usepfx = 0; usepfx < 2; usepfx++) {
+		if (monoclock_get(&tv_start))
+			goto err3;
+		for (i = 0; i < NSEARCHES; i++) {
+			if (find(keys, usepfx ? pfx : NULL, nkeys, 0,
+			    keys[targets[i]]) != targets[i]) {
+				warn0("Search found the wrong key");
+				goto err3;
+			}
+		}
+		if (monoclock_get(&tv_end))
+			goto err3;
+		t[usepfx] = timeval_diff(tv_start, tv_end);
+	}
+
+	/* Report time per search. */
+	printf("%5zu keys, %2zu bytes tied: %.1f ns per search,"
+	    " %.1f ns with prefixes\n", nkeys, tied,
+	    t[0] * 1000000000.0 / NSEARCHES, t[1] * 1000000000.0 / NSEARCHES);
+
+	/* Clean up. */
+	free(targets);
+	free(pfx);
+	for (i = 0; i < nkeys; i++)
+		kvldskey_free(keys[i]);
+	free(keys);
+
+	/* Success! */
+	return (0);
+
+err3:
+	free(targets);
+err2:
+	free(pfx);
+	i = nkeys;
+err1:
+	for (; i > 0; i--)
+		kvldskey_free(keys[i - 1]);
+	free(keys);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+int
+main(int argc, char * argv[])
+{
+	size_t i;
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_pfxsearch\n");
+		exit(1);
+	}
+
+	/*
+	 * Keys which differ within 8 bytes of the shared prefix are ordered
+	 * by the prefix array alone; keys which share longer prefixes than
+	 * that tie, so the prefix array is only overhead.
+	 */
+	for (i = 0; i < sizeof(nkeyss) / sizeof(nkeyss[0]); i++) {
+		if (bench(nkeyss[i], 4) || bench(nkeyss[i], 16))
+			exit(1);
+	}
+
+	/* Success! */
+	exit(0);
+}
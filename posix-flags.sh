@@ -0,0 +1,2 @@
+export "LDADD_POSIX=-lrt"
+export "CFLAGS_POSIX="
@@ -0,0 +1,150 @@
+#include <sys/time.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "warnp.h"
+
+#include "groupcommit.h"
+
+/* Target p99 latency. */
+#define L	0.05
+
+/* How long to wait for groupcommit to adjust its parameters. */
+static const struct timespec interval = {
+	.tv_sec = 1,
+	.tv_nsec = 100000000
+};
+
+/*
+ * Feed groupcommit ${narrivals} arrivals and ${nbatches} batches, the last
+ * ${nslow} of which take ${tslow} seconds and the rest ${t} seconds, spread
+ * over one adjustment interval.  Set ${w} and ${g} to the parameters it
+ * picks.
+ */
+static int
+run(size_t narrivals, size_t nbatches, double t, size_t nslow, double tslow,
+    double * w, size_t * g)
+{
+	struct groupcommit * G;
+	struct timeval tv_w;
+	size_t i;
+
+	/* Start an interval. */
+	if ((G = groupcommit_init(L)) == NULL) {
+		warnp("groupcommit_init");
+		goto err0;
+	}
+	tv_w.tv_sec = -1;
+	*g = 0;
+
+	/* Record requests and batches. */
+	for (i = 0; i < narrivals; i++)
+		groupcommit_arrival(G);
+	for (i = 0; i < nbatches; i++) {
+		if (groupcommit_batch(G, (i < nbatches - nslow) ? t : tslow,
+		    &tv_w, g))
+			goto err1;
+	}
+
+	/* Wait for the interval to end; the next batch adjusts things. */
+	if (nanosleep(&interval, NULL)) {
+		warnp("nanosleep");
+		goto err1;
+	}
+	if (groupcommit_batch(G, t, &tv_w, g))
+		goto err1;
+
+	/* Make sure the parameters were set exactly once. */
+	if ((tv_w.tv_sec == -1) || (*g == 0)) {
+		warn0("Group commit parameters were not set");
+		goto err1;
+	}
+	*w = (double)tv_w.tv_sec + (double)tv_w.tv_usec * 0.000001;
+
+	/* Clean up. */
+	groupcommit_free(G);
+
+	/* Success! */
+	return (0);
+
+err1:
+	groupcommit_free(G);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/* Check that requests waiting ${w} and for two ${S} batches meet L. */
+static int
+checkp99(const char * name, double w, double S)
+{
+
+	if (w + 2.0 * S > L * 1.01) {
+		warn0("%s: p99 latency %f exceeds target %f",
+		    name, w + 2.0 * S, L);
+		return (-1);
+	}
+	return (0);
+}
+
+int
+main(int argc, char * argv[])
+{
+	double w_sparse, w_burst, w_slow, w_tail;
+	size_t g_sparse, g_burst, g_slow, g_tail;
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_groupcommit\n");
+		exit(1);
+	}
+
+	/* Sparse requests: waiting won't gather any more of them. */
+	if (run(5, 5, 0.005, 0, 0.0, &w_sparse, &g_sparse))
+		exit(1);
+	if ((w_sparse != 0.0) || (g_sparse != 1)) {
+		warn0("sparse: delay %f, batch %zu; should be 0, 1",
+		    w_sparse, g_sparse);
+		exit(1);
+	}
+
+	/* A burst of requests: wait for larger batches, within the target. */
+	if (run(5000, 100, 0.005, 0, 0.0, &w_burst, &g_burst))
+		exit(1);
+	if ((w_burst <= 0.0) || (g_burst <= g_sparse)) {
+		warn0("burst: delay %f, batch %zu; should be larger",
+		    w_burst, g_burst);
+		exit(1);
+	}
+	if (checkp99("burst", w_burst, 0.005))
+		exit(1);
+
+	/* A burst of requests, but commits leave no time to wait. */
+	if (run(5000, 100, 0.03, 0, 0.0, &w_slow, &g_slow))
+		exit(1);
+	if ((w_slow != 0.0) || (g_slow != 1)) {
+		warn0("slow: delay %f, batch %zu; should be 0, 1",
+		    w_slow, g_slow);
+		exit(1);
+	}
+
+	/* A burst of requests, with 2% of commits slow: keep p99 in bounds. */
+	if (run(5000, 1000, 0.002, 20, 0.015, &w_tail, &g_tail))
+		exit(1);
+	if (w_tail >= w_burst) {
+		warn0("tail: delay %f should be less than %f",
+		    w_tail, w_burst);
+		exit(1);
+	}
+	if (checkp99("tail", w_tail, 0.015))
+		exit(1);
+
+	/* Success! */
+	exit(0);
+}
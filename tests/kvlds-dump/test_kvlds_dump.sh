@@ -5,6 +5,8 @@ LBS=../../lbs/lbs
 KVLDS=../../kvlds/kvlds
 DUMP=../../kvlds-dump/kvlds-dump
 UNDUMP=../../kvlds-undump/kvlds-undump
+MKPAIRS=../../bench/mkpairs/mkpairs
+BULK_INSERT=../../bench/bulk_insert/bulk_insert
 STOR=`pwd`/stor
 SOCKL=$STOR/sock_lbs
 SOCKK=$STOR/sock_kvlds
@@ -77,4 +79,30 @@ cmp $WRKDIR/keys-input $WRKDIR/keys-output2
 # Shut down kvlds and clean up
 kill `cat $SOCKK.pid`
 rm -r $STOR
+
+# Bulk-load pairs into kvlds run with the options $1, and dump the tree as
+# read back from disk into the file $2.
+bulkload() {
+	mkdir $STOR
+	[ `uname` = "FreeBSD" ] && chflags nodump $STOR
+	$LBS -s $SOCKL -d $STOR -b 1024
+	$KVLDS -s $SOCKK -l $SOCKL -z $1
+	$MKPAIRS 100000 | $BULK_INSERT $SOCKK > /dev/null
+	kill `cat $SOCKK.pid`
+	rm $SOCKK.pid $SOCKK
+	$KVLDS -s $SOCKK -l $SOCKL -z
+	$DUMP -t $SOCKK > $2
+	kill `cat $SOCKK.pid`
+	kill `cat $SOCKL.pid`
+	sleep 1
+	rm -r $STOR
+}
+
+# Commits of this many pairs are large enough to be handed to serialization
+# threads; the trees should be the same with and without those threads.
+bulkload "" $WRKDIR/bulk
+bulkload "-T 4" $WRKDIR/bulk-threads
+cmp $WRKDIR/bulk $WRKDIR/bulk-threads
+
+# Clean up
 rm -r $WRKDIR
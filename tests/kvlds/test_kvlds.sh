@@ -111,10 +111,92 @@ else
 	exit 1
 fi
 
+# Check that a stalled client doesn't hold up other clients
+printf "Testing KVLDS with multiple connections..."
+( $TESTKVLDS $SOCKK & echo $! > $TESTKVLDS.pid ) 2>/dev/null
+$MSLEEP 100 && kill -STOP "$(cat $TESTKVLDS.pid)"
+if $TESTKVLDS $SOCKK; then
+	kill -KILL "$(cat $TESTKVLDS.pid)"
+	rm -f "${TESTKVLDS}.pid"
+	echo " PASSED!"
+else
+	kill -KILL "$(cat $TESTKVLDS.pid)"
+	rm -f "${TESTKVLDS}.pid"
+	echo " FAILED!"
+	exit 1
+fi
+
 # Shut down KVLDS
 kill `cat $SOCKK.pid`
 rm $SOCKK.pid $SOCKK
 
+# Test with scan-resistant eviction (again with evictions)
+printf "Testing KVLDS with 2Q eviction..."
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -Q
+if $TESTKVLDS $SOCKK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+
+# Test with compressed leaf pages (again with evictions)
+printf "Testing KVLDS with leaf compression..."
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -z
+if $TESTKVLDS $SOCKK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+
+# Test reading runs of pages with GETV (again with evictions)
+printf "Testing KVLDS with GETV reads..."
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -G
+if $TESTKVLDS $SOCKK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+
+# Test with adaptive group commits
+printf "Testing KVLDS with adaptive group commits..."
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -L 0.05
+if $TESTKVLDS $SOCKK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+
+# Test with serialization threads, with and without compression
+printf "Testing KVLDS with serialization threads..."
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -T 4
+if ! $TESTKVLDS $SOCKK; then
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+$KVLDS -s $SOCKK -l $SOCKL -v 104 -C 1024 -T 4 -z
+if $TESTKVLDS $SOCKK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCKK.pid`
+rm $SOCKK.pid $SOCKK
+
 # Check that killing KVLDS can't break it
 printf "Testing KVLDS crash-safety..."
 $KVLDS -s $SOCKK -l $SOCKL -v 104
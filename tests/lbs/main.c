@@ -30,6 +30,9 @@ static int get_not_exist_response;
 static int gets_done;
 static int gets_failed;
 static int gets_ndone;
+static int getv_done;
+static int getv_failed;
+static int getv_status;
 static int free_done;
 static int free_failed;
 
@@ -138,6 +141,25 @@ callback_gets(void * cookie, int failed, int status, const uint8_t * buf)
 	return (0);
 }
 
+/* Callback for GETV request. */
+static int
+callback_getv(void * cookie, int failed, int status, const uint8_t * buf)
+{
+	uint8_t * dstbuf = cookie;
+
+	/* Record returned values. */
+	getv_failed = failed;
+	getv_status = status;
+	if ((failed == 0) && (status == 0))
+		memcpy(dstbuf, buf, 16 * params_blklen);
+
+	/* We're done. */
+	getv_done = 1;
+
+	/* Success! */
+	return (0);
+}
+
 /* Callback for GET request for "block does not exist". */
 static int
 callback_get_should_not_exist(void * cookie, int failed, int status,
@@ -301,6 +323,43 @@ main(int argc, char * argv[])
 		goto err2;
 	}
 
+	/* Read pages in runs of 16, crossing file boundaries. */
+	for (i = 0; i + 16 <= 512; i += 7) {
+		getv_done = getv_failed = 0;
+		if (proto_lbs_request_getv(Q, params_nextblk - 512 + i, 16,
+		    params_blklen, callback_getv, buf)) {
+			warnp("Failed to send GETV request");
+			goto err2;
+		}
+		if (events_spin(&getv_done) || getv_failed || getv_status) {
+			warnp("GETV request failed");
+			goto err2;
+		}
+		for (j = 0; j < 16; j++) {
+			k = (i + j < 256) ? i + j : 0;
+			if (buf[j * params_blklen] != k) {
+				warn0("GETV data is incorrect");
+				goto err2;
+			}
+		}
+	}
+
+	/* Attempt to read a run extending past the last block. */
+	getv_done = getv_failed = 0;
+	if (proto_lbs_request_getv(Q, params_nextblk - 8, 16,
+	    params_blklen, callback_getv, buf)) {
+		warnp("Failed to send GETV request");
+		goto err2;
+	}
+	if (events_spin(&getv_done) || getv_failed) {
+		warnp("GETV request failed");
+		goto err2;
+	}
+	if (getv_status != 1) {
+		warnp("GETV request failed to return does-not-exist");
+		goto err2;
+	}
+
 	/* Attempt to read a non-existent block. */
 	get_done = get_failed = get_not_exist_response = 0;
 	if (proto_lbs_request_get(Q, BAD_BLKNO, params_blklen,
@@ -89,6 +89,100 @@ for S in "localhost:1234" "[127.0.0.1]:1235" "[::1]:1236"; do
 	rm -r $STOR
 done
 
+# Test reading and appending via io_uring (only available on Linux)
+printf "Testing LBS with io_uring reads and appends..."
+if [ `uname` = "Linux" ]; then
+	mkdir $STOR
+	$LBS -s $SOCK -d $STOR -b 512 -n 4 -u
+	if $TESTLBS $SOCK && $TESTLBS $SOCK; then
+		echo " PASSED!"
+	else
+		echo " FAILED!"
+		exit 1
+	fi
+	kill `cat $SOCK.pid`
+	rm $SOCK.pid
+	rm $SOCK
+	rm -r $STOR
+else
+	echo " can't test io_uring on `uname`."
+fi
+
+# Test direct I/O with a cache of recently written blocks
+printf "Testing LBS with direct I/O and block cache..."
+if [ `uname` = "Linux" ] || [ `uname` = "FreeBSD" ]; then
+	mkdir $STOR
+	$LBS -s $SOCK -d $STOR -b 4096 -D -c 16
+	if $TESTLBS $SOCK && $TESTLBS $SOCK; then
+		echo " PASSED!"
+	else
+		echo " FAILED!"
+		exit 1
+	fi
+	kill `cat $SOCK.pid`
+	rm $SOCK.pid
+	rm $SOCK
+	rm -r $STOR
+else
+	echo " can't test direct I/O on `uname`."
+fi
+
+# Test preallocated block files, including recovery after a restart
+printf "Testing LBS with preallocated files..."
+mkdir $STOR
+$LBS -s $SOCK -d $STOR -b 512 -P
+if ! $TESTLBS $SOCK; then
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCK.pid`
+$MSLEEP 100
+rm $SOCK.pid
+rm $SOCK
+$LBS -s $SOCK -d $STOR -b 512 -P
+if $TESTLBS $SOCK; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCK.pid`
+rm $SOCK.pid
+rm $SOCK
+rm -r $STOR
+
+# Test block checksums, including a restart with existing checksum files
+# after losing the (unsynced) checksums of the last block file
+printf "Testing LBS with block checksums..."
+mkdir $STOR
+$LBS -s $SOCK -d $STOR -b 512 -C
+if ! $TESTLBS $SOCK; then
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCK.pid`
+$MSLEEP 100
+rm $SOCK.pid
+rm $SOCK
+LASTBLKS=`ls $STOR/blks_* | tail -1`
+LASTCRCS=$STOR/crcs_${LASTBLKS##*/blks_}
+: > $LASTCRCS
+$LBS -s $SOCK -d $STOR -b 512 -C -P
+if ! $TESTLBS $SOCK; then
+	echo " FAILED!"
+	exit 1
+fi
+kill `cat $SOCK.pid`
+rm $SOCK.pid
+rm $SOCK
+if [ `wc -c < $LASTCRCS` -eq $((`wc -c < $LASTBLKS` / 128)) ]; then
+	echo " PASSED!"
+else
+	echo " FAILED!"
+	exit 1
+fi
+rm -r $STOR
+
 # If we're not running on FreeBSD, we can't use utrace and jemalloc to
 # check for memory leaks
 if ! [ `uname` = "FreeBSD" ]; then
@@ -0,0 +1,269 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+#include "warnp.h"
+
+/* Largest input to compress. */
+#define MAXLEN	65536
+
+/* Number of corrupted streams to try decompressing per input. */
+#define NCORRUPT	1000
+
+/* Random number state. */
+static uint64_t x = 1;
+
+/* Return a random number (xorshift, so runs are reproducible). */
+static uint64_t
+rnd(void)
+{
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return (x);
+}
+
+/* Fill ${buf} with ${len} random bytes. */
+static void
+fill_random(uint8_t * buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (uint8_t)rnd();
+}
+
+/*
+ * Fill ${buf} with ${len} bytes of compressible data: runs of a repeated
+ * byte, copies of earlier data at various distances, and random bytes.
+ */
+static void
+fill_compressible(uint8_t * buf, size_t len)
+{
+	size_t i, n, off;
+
+	for (i = 0; i < len; i += n) {
+		n = 1 + rnd() % 300;
+		if (n > len - i)
+			n = len - i;
+		switch (rnd() % 3) {
+		case 0:
+			memset(&buf[i], (int)(rnd() % 4), n);
+			break;
+		case 1:
+			if (i == 0) {
+				n = 0;
+				break;
+			}
+			off = 1 + rnd() % i;
+			for (; n > 0; n--, i++)
+				buf[i] = buf[i - off];
+			break;
+		default:
+			fill_random(&buf[i], n);
+			break;
+		}
+	}
+}
+
+/* Decompress ${zlen} bytes from ${z} into a buffer of exactly ${len} bytes. */
+static int
+decompress(const uint8_t * z, size_t zlen, uint8_t ** out, size_t len)
+{
+
+	/* Allocate exactly enough, so overruns are noticed by valgrind. */
+	if ((*out = malloc((len > 0) ? len : 1)) == NULL) {
+		warnp("malloc");
+		exit(1);
+	}
+	return (lz_decompress(z, zlen, *out, len));
+}
+
+/*
+ * Compress the ${len} bytes ${buf}; check that they decompress to the same
+ * data, and only at the right length; and check that truncated and
+ * corrupted compressed data are either rejected or decompress safely.
+ * If ${shrinks} is non-zero, the data must compress.
+ */
+static int
+roundtrip(const uint8_t * buf, size_t len, int shrinks)
+{
+	uint8_t * z;
+	uint8_t * out;
+	size_t zmax = len + len / 255 + 16;
+	size_t zlen, i, j;
+	uint8_t c;
+
+	/* Compress into enough space for incompressible data. */
+	if ((z = malloc(zmax)) == NULL) {
+		warnp("malloc");
+		exit(1);
+	}
+	if ((zlen = lz_compress(buf, len, z, zmax)) == 0) {
+		warn0("Failed to compress %zu bytes", len);
+		goto err1;
+	}
+	if (shrinks && (zlen >= len)) {
+		warn0("Compressed %zu bytes to %zu", len, zlen);
+		goto err1;
+	}
+
+	/* If there isn't enough space, compression must fail. */
+	if (lz_compress(buf, len, z, zlen - 1) != 0) {
+		warn0("Compressed %zu bytes into too little space", len);
+		goto err1;
+	}
+	if (lz_compress(buf, len, z, zlen) != zlen) {
+		warn0("Compressed %zu bytes inconsistently", len);
+		goto err1;
+	}
+
+	/* Decompress and compare. */
+	if (decompress(z, zlen, &out, len) || memcmp(out, buf, len)) {
+		warn0("Round trip of %zu bytes failed", len);
+		goto err2;
+	}
+	free(out);
+
+	/* Decompressing to the wrong length must fail. */
+	if (len > 0) {
+		if (decompress(z, zlen, &out, len - 1) == 0) {
+			warn0("Decompressed %zu bytes into %zu",
+			    len, len - 1);
+			goto err2;
+		}
+		free(out);
+	}
+	if (decompress(z, zlen, &out, len + 1) == 0) {
+		warn0("Decompressed %zu bytes into %zu", len, len + 1);
+		goto err2;
+	}
+	free(out);
+
+	/* Truncated data must be rejected. */
+	for (i = 0; i < zlen; i += 1 + i / 64) {
+		if (decompress(z, i, &out, len) == 0) {
+			warn0("Accepted %zu of %zu bytes of compressed data",
+			    i, zlen);
+			goto err2;
+		}
+		free(out);
+	}
+
+	/* Corrupted data must not make us read or write out of bounds. */
+	for (i = 0; i < NCORRUPT; i++) {
+		j = rnd() % zlen;
+		c = z[j];
+		z[j] = (uint8_t)(c ^ (1 + rnd() % 255));
+		(void)decompress(z, zlen, &out, len);
+		free(out);
+		z[j] = c;
+	}
+
+	/* Clean up. */
+	free(z);
+
+	/* Success! */
+	return (0);
+
+err2:
+	free(out);
+err1:
+	free(z);
+
+	/* Failure! */
+	return (-1);
+}
+
+/* Invalid compressed data, and the length it claims to decompress to. */
+static const struct {
+	const char * name;
+	const uint8_t * z;
+	size_t zlen;
+	size_t len;
+} bad[] = {
+	{ "empty", (const uint8_t *)"", 0, 0 },
+	{ "short literals", (const uint8_t *)"\x20" "a", 2, 2 },
+	{ "zero offset", (const uint8_t *)"\x10" "a" "\x00\x00" "\x00", 5, 5 },
+	{ "offset before start", (const uint8_t *)"\x10" "a" "\x02\x00" "\x00",
+	    5, 5 },
+	{ "missing offset", (const uint8_t *)"\x10" "a" "\x01", 3, 5 },
+	{ "long literals", (const uint8_t *)"\xf0\xff\xff\xff" "a", 5, 1000 },
+	{ "long match", (const uint8_t *)"\x1f" "a" "\x01\x00\xff\xff" "\x00",
+	    7, 100 },
+	{ "too long", (const uint8_t *)"\x10" "a" "\x01\x00" "\x00", 5, 4 },
+	{ "too short", (const uint8_t *)"\x10" "a" "\x01\x00" "\x00", 5, 6 }
+};
+
+int
+main(int argc, char * argv[])
+{
+	uint8_t * buf;
+	uint8_t * out;
+	size_t len;
+	size_t i;
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_lz\n");
+		exit(1);
+	}
+
+	/* Allocate space for test data. */
+	if ((buf = malloc(MAXLEN)) == NULL) {
+		warnp("malloc");
+		exit(1);
+	}
+
+	/* Valid data decompresses; a typo in the tests below would not. */
+	if (decompress((const uint8_t *)"\x10" "a" "\x01\x00" "\x00", 5,
+	    &out, 5) || memcmp(out, "aaaaa", 5)) {
+		warn0("Failed to decompress \"aaaaa\"");
+		exit(1);
+	}
+	free(out);
+
+	/* Reject invalid data. */
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		if (decompress(bad[i].z, bad[i].zlen, &out, bad[i].len) == 0) {
+			warn0("Accepted invalid data: %s", bad[i].name);
+			exit(1);
+		}
+		free(out);
+	}
+
+	/* Round-trip random and compressible data of various lengths. */
+	for (len = 0; len <= MAXLEN; len = (len < 64) ? len + 1 : len * 2) {
+		fill_random(buf, len);
+		if (roundtrip(buf, len, 0))
+			exit(1);
+		fill_compressible(buf, len);
+		if (roundtrip(buf, len, 0))
+			exit(1);
+	}
+
+	/* Runs and repeats must actually compress. */
+	memset(buf, 0, MAXLEN);
+	if (roundtrip(buf, MAXLEN, 1))
+		exit(1);
+	for (i = 0; i < MAXLEN; i++)
+		buf[i] = (uint8_t)(i % 251);
+	if (roundtrip(buf, MAXLEN, 1))
+		exit(1);
+	fill_compressible(buf, MAXLEN);
+	if (roundtrip(buf, MAXLEN, 1))
+		exit(1);
+
+	/* Clean up. */
+	free(buf);
+
+	/* Success! */
+	exit(0);
+}
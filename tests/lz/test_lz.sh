@@ -0,0 +1,5 @@
+#!/bin/sh
+
+set -e
+
+./test_lz
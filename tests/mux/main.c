@@ -199,6 +199,98 @@ err0:
 	return (-1);
 }
 
+static int
+get(struct wire_requestqueue * Q,
+    const struct kvldskey * key, const struct kvldskey * value)
+{
+
+	/* Send the request. */
+	op_done = 0;
+	op_count = 1;
+	if (proto_kvlds_request_get(Q, key, callback_get,
+	    (void *)(uintptr_t)value)) {
+		warnp("Error sending GET request");
+		goto err0;
+	}
+
+	/* Wait for it to finish. */
+	if (events_spin(&op_done) || op_failed) {
+		warnp("GET request failed");
+		goto err0;
+	}
+	if (op_badval) {
+		warnp("Bad value returned by GET!");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+static int
+delete(struct wire_requestqueue * Q, const struct kvldskey * key)
+{
+
+	/* Send the request. */
+	op_done = 0;
+	op_count = 1;
+	if (proto_kvlds_request_delete(Q, key, callback_done, NULL)) {
+		warnp("Error sending DELETE request");
+		goto err0;
+	}
+
+	/* Wait for it to finish. */
+	if (events_spin(&op_done) || op_failed) {
+		warnp("DELETE request failed");
+		goto err0;
+	}
+
+	/* Success! */
+	return (0);
+
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+static int
+setget(struct wire_requestqueue * Q, const char * key)
+{
+	struct kvldskey * k;
+	struct kvldskey * v;
+	char valbuf[20];
+	size_t i;
+
+	/* Create key. */
+	if ((k = kvldskey_create((const uint8_t *)key, strlen(key))) == NULL)
+		return (-1);
+
+	/* Repeatedly overwrite the value, and read each value back twice. */
+	for (i = 0; i < 1000; i++) {
+		sprintf(valbuf, "%zu", i);
+		v = kvldskey_create((uint8_t *)valbuf, strlen(valbuf));
+		if (v == NULL)
+			return (-1);
+		if (set(Q, k, v) || get(Q, k, v) || get(Q, k, v))
+			return (-1);
+		kvldskey_free(v);
+	}
+
+	/* Delete the value and check that it's gone. */
+	if (delete(Q, k) || get(Q, k, NULL) || get(Q, k, NULL))
+		return (-1);
+
+	/* Free the key. */
+	kvldskey_free(k);
+
+	/* Success! */
+	return (0);
+}
+
 static int
 pingpong(struct wire_requestqueue * Q, const char * key, const char * to,
     const char * from, int start)
@@ -349,7 +441,7 @@ main(int argc, char * argv[])
 	/* Check number of arguments. */
 	if (argc != 3) {
 		fprintf(stderr, "usage: test_mux %s %s\n",
-		    "<socketname>", "{ping | pong | <prefix>}");
+		    "<socketname>", "{ping | pong | setget<N> | <prefix>}");
 		exit(1);
 	}
 
@@ -365,6 +457,9 @@ main(int argc, char * argv[])
 	} else if (strcmp(argv[2], "pong") == 0) {
 		if (pingpong(Q, "pingpong", "pong", "ping", 0))
 			exit(1);
+	} else if (strncmp(argv[2], "setget", 6) == 0) {
+		if (setget(Q, argv[2]))
+			exit(1);
 	} else if (strcmp(argv[2], "loop") == 0) {
 		/* Repeatedly create/read/delete 10^4 pairs until we die. */
 		do {
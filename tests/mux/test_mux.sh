@@ -130,6 +130,81 @@ fi
 kill `cat $SOCKM.pid`
 rm $SOCKM $SOCKM.pid
 
+# Verify that GETs see the results of earlier requests via the GET cache.
+printf "Testing GET cache... "
+$MUX -t $SOCKK -s $SOCKM -C 100
+for X in 1 2 3 4; do
+	( $TESTMUX $SOCKM ${X}. || touch .failed; ) &
+	( $TESTMUX $SOCKM setget${X} || touch .failed; ) &
+done
+( $TESTMUX $SOCKM ping || touch .failed ) &
+( $TESTMUX $SOCKM pong || touch .failed ) &
+sleep 1
+while has_pid $TESTMUX; do
+	sleep 1
+done
+if [ -f .failed ]; then
+	echo " FAILED!"
+	exit 1
+else
+	echo " PASSED!"
+fi
+kill `cat $SOCKM.pid`
+rm $SOCKM $SOCKM.pid
+
+# Verify that GETs see the results of earlier requests when coalesced.
+printf "Testing GET coalescing... "
+$MUX -t $SOCKK -s $SOCKM -g
+for X in 1 2 3 4; do
+	( $TESTMUX $SOCKM ${X}. || touch .failed; ) &
+	( $TESTMUX $SOCKM setget${X} || touch .failed; ) &
+done
+( $TESTMUX $SOCKM ping || touch .failed ) &
+( $TESTMUX $SOCKM pong || touch .failed ) &
+sleep 1
+while has_pid $TESTMUX; do
+	sleep 1
+done
+if [ -f .failed ]; then
+	echo " FAILED!"
+	exit 1
+else
+	echo " PASSED!"
+fi
+kill `cat $SOCKM.pid`
+rm $SOCKM $SOCKM.pid
+
+# Verify running several clients and ping-pong with several workers.
+printf "Testing multiple workers... "
+$MUX -t $SOCKK -s $SOCKM -w 4
+for X in 1 2 3 4 5 6 7 8 9 10; do
+	( $TESTMUX $SOCKM ${X}. || touch .failed; ) &
+done
+( $TESTMUX $SOCKM ping || touch .failed ) &
+( $TESTMUX $SOCKM pong || touch .failed ) &
+sleep 1
+while has_pid $TESTMUX; do
+	sleep 1
+done
+if [ -f .failed ]; then
+	echo " FAILED!"
+	exit 1
+else
+	echo " PASSED!"
+fi
+
+# Verify that the workers die along with the original process.
+printf "Testing worker cleanup... "
+kill `cat $SOCKM.pid`
+rm $SOCKM $SOCKM.pid
+sleep 1
+if has_pid "$MUX -t $SOCKK -s $SOCKM"; then
+	echo " FAILED!"
+	exit 1
+else
+	echo " PASSED!"
+fi
+
 # If we're not running on FreeBSD, we can't use utrace and jemalloc to
 # check for memory leaks
 if ! [ `uname` = "FreeBSD" ]; then
@@ -0,0 +1,123 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpusupport.h"
+#include "pfxsearch.h"
+#include "pfxsearch_sse42.h"
+#include "warnp.h"
+
+/* Largest array to search. */
+#define MAXN	100
+
+/* Values to use, in order; the middle ones straddle the sign bit. */
+static const uint64_t vals[] = {
+	0, 1, 2, 0x7ffffffffffffffe, 0x7fffffffffffffff,
+	0x8000000000000000, 0x8000000000000001, 0xfffffffffffffffe,
+	0xffffffffffffffff
+};
+#define NVALS	(sizeof(vals) / sizeof(vals[0]))
+
+/* Count values in P[0 .. n - 1] which are less than / at most x. */
+static void
+count(const uint64_t * P, size_t n, uint64_t x, size_t * nlt, size_t * nle)
+{
+	size_t i;
+
+	*nlt = *nle = 0;
+	for (i = 0; i < n; i++) {
+		*nlt += (P[i] < x);
+		*nle += (P[i] <= x);
+	}
+}
+
+/*
+ * Fill P[0 .. n - 1] with values in non-decreasing order, drawn from the
+ * first ${nv} entries of vals[] so that there are many ties if ${nv} is
+ * small.
+ */
+static void
+fill(uint64_t * P, size_t n, size_t nv)
+{
+	uint64_t x;
+	size_t i, j;
+
+	/* Insert random values, keeping the array sorted. */
+	for (i = 0; i < n; i++) {
+		x = vals[(size_t)random() % nv];
+		for (j = i; (j > 0) && (P[j - 1] > x); j--)
+			P[j] = P[j - 1];
+		P[j] = x;
+	}
+}
+
+/* Check searches of P[0 .. n - 1] for x; return nonzero on mismatch. */
+static int
+check(const uint64_t * P, size_t n, uint64_t x)
+{
+	size_t lo, hi, nlt, nle;
+
+	/* Compare the search against counting. */
+	count(P, n, x, &nlt, &nle);
+	pfxsearch(P, n, x, &lo, &hi);
+	if ((lo != nlt) || (hi != nle)) {
+		warn0("pfxsearch(n = %zu, x = %016" PRIx64 ") = (%zu, %zu),"
+		    " should be (%zu, %zu)", n, x, lo, hi, nlt, nle);
+		return (1);
+	}
+
+#if defined(CPUSUPPORT_X86_SSE42)
+	/* Compare the SSE4.2 count against counting. */
+	if (cpusupport_x86_sse42()) {
+		pfxsearch_count_sse42(P, n, x, &lo, &hi);
+		if ((lo != nlt) || (hi != nle)) {
+			warn0("pfxsearch_count_sse42(n = %zu, x = %016" PRIx64
+			    ") = (%zu, %zu), should be (%zu, %zu)",
+			    n, x, lo, hi, nlt, nle);
+			return (1);
+		}
+	}
+#endif
+
+	/* Success! */
+	return (0);
+}
+
+int
+main(int argc, char * argv[])
+{
+	uint64_t P[MAXN];
+	size_t n, nv, i;
+	int trial;
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_pfxsearch\n");
+		exit(1);
+	}
+
+	/*
+	 * Search arrays of every length up to MAXN -- in particular, on both
+	 * sides of the 16-entry window below which pfxsearch stops bisecting
+	 * and counts -- holding runs of tied values, for each of vals[],
+	 * whether it is in the array or not.
+	 */
+	for (n = 0; n <= MAXN; n++) {
+		for (nv = 1; nv <= NVALS; nv++) {
+			for (trial = 0; trial < 10; trial++) {
+				fill(P, n, nv);
+				for (i = 0; i < NVALS; i++) {
+					if (check(P, n, vals[i]))
+						exit(1);
+				}
+			}
+		}
+	}
+
+	/* Success! */
+	exit(0);
+}
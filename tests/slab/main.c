@@ -0,0 +1,219 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+#include "warnp.h"
+
+/* Number of objects to hold at once; enough to need several slabs. */
+#define NOBJ	100000
+
+/* Fill ${obj} (${len} bytes) with a pattern derived from ${i}. */
+static void
+fill(uint8_t * obj, size_t len, size_t i)
+{
+	size_t j;
+
+	for (j = 0; j < len; j++)
+		obj[j] = (uint8_t)(i * 31 + j);
+}
+
+/* Check that ${obj} (${len} bytes) still holds the pattern for ${i}. */
+static int
+check(const uint8_t * obj, size_t len, size_t i)
+{
+	size_t j;
+
+	for (j = 0; j < len; j++) {
+		if (obj[j] != (uint8_t)(i * 31 + j))
+			return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Allocate ${nobj} objects of length ${objlen} from an allocator expecting
+ * ${nrec}, make sure they don't overlap, release them, and make sure the
+ * same objects are handed out again rather than new memory.
+ */
+static int
+cycle(size_t objlen, size_t nrec, size_t nobj)
+{
+	struct slab * S;
+	uint8_t ** objs;
+	size_t i;
+
+	/* Set up an allocator and somewhere to keep the objects. */
+	if ((S = slab_init(objlen, nrec)) == NULL) {
+		warnp("slab_init");
+		goto err0;
+	}
+	if ((objs = malloc(nobj * sizeof(uint8_t *))) == NULL) {
+		warnp("malloc");
+		goto err1;
+	}
+
+	/* Allocate objects and write to all of them. */
+	for (i = 0; i < nobj; i++) {
+		if ((objs[i] = slab_alloc(S)) == NULL) {
+			warnp("slab_alloc");
+			goto err2;
+		}
+		fill(objs[i], objlen, i);
+	}
+
+	/* Nothing should have been overwritten by a neighbour. */
+	for (i = 0; i < nobj; i++) {
+		if (check(objs[i], objlen, i)) {
+			warn0("object %zu of length %zu was overwritten",
+			    i, objlen);
+			goto err2;
+		}
+	}
+
+	/* Release the even-numbered objects, and NULL (a no-op). */
+	for (i = 0; i < nobj; i += 2)
+		slab_release(S, objs[i]);
+	slab_release(S, NULL);
+
+	/* The odd-numbered objects must be untouched. */
+	for (i = 1; i < nobj; i += 2) {
+		if (check(objs[i], objlen, i)) {
+			warn0("object %zu of length %zu was overwritten"
+			    " by a release", i, objlen);
+			goto err2;
+		}
+	}
+
+	/* Reallocating gets the released objects back, most recent first. */
+	for (i = (nobj - 1) / 2 * 2 + 2; i > 0; i -= 2) {
+		if (slab_alloc(S) != objs[i - 2]) {
+			warn0("released object %zu was not reused", i - 2);
+			goto err2;
+		}
+		fill(objs[i - 2], objlen, i - 2);
+	}
+
+	/* Check everything once more. */
+	for (i = 0; i < nobj; i++) {
+		if (check(objs[i], objlen, i)) {
+			warn0("object %zu of length %zu was overwritten"
+			    " after reuse", i, objlen);
+			goto err2;
+		}
+	}
+
+	/* Clean up. */
+	free(objs);
+	slab_free(S);
+
+	/* Success! */
+	return (0);
+
+err2:
+	free(objs);
+err1:
+	slab_free(S);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+/*
+ * With ${nrec} expected, each slab should hold ${nrec} objects: the first
+ * ${nrec} allocations are consecutive, and the next one is not.
+ */
+static int
+nper(size_t objlen, size_t nrec)
+{
+	struct slab * S;
+	uint8_t * first;
+	uint8_t * prev;
+	uint8_t * obj;
+	size_t stride = 0;
+	size_t i;
+
+	/* Set up an allocator. */
+	if ((S = slab_init(objlen, nrec)) == NULL) {
+		warnp("slab_init");
+		goto err0;
+	}
+
+	/* Allocate the first slab's worth of objects. */
+	if ((first = prev = slab_alloc(S)) == NULL) {
+		warnp("slab_alloc");
+		goto err1;
+	}
+	for (i = 1; i < nrec; i++) {
+		if ((obj = slab_alloc(S)) == NULL) {
+			warnp("slab_alloc");
+			goto err1;
+		}
+		if (i == 1) {
+			stride = (size_t)(obj - first);
+			if ((stride < objlen) || (stride > objlen + 64)) {
+				warn0("objects of length %zu are %zu bytes"
+				    " apart", objlen, stride);
+				goto err1;
+			}
+		} else if (obj != prev + stride) {
+			warn0("object %zu of %zu is not in the first slab",
+			    i, nrec);
+			goto err1;
+		}
+		prev = obj;
+	}
+
+	/* The next object must come from a new slab. */
+	if ((obj = slab_alloc(S)) == NULL) {
+		warnp("slab_alloc");
+		goto err1;
+	}
+	if ((nrec > 1) && (obj == prev + stride)) {
+		warn0("slab holds more than %zu objects", nrec);
+		goto err1;
+	}
+
+	/* Clean up. */
+	slab_free(S);
+
+	/* Success! */
+	return (0);
+
+err1:
+	slab_free(S);
+err0:
+	/* Failure! */
+	return (-1);
+}
+
+int
+main(int argc, char * argv[])
+{
+
+	WARNP_INIT;
+	(void)argv; /* UNUSED */
+
+	/* Sanity-check. */
+	if (argc != 1) {
+		fprintf(stderr, "usage: test_slab\n");
+		exit(1);
+	}
+
+	/* Objects shorter than a pointer still hold the free list. */
+	if (cycle(1, NOBJ, NOBJ) || cycle(sizeof(void *) - 1, 10, NOBJ))
+		exit(1);
+
+	/* Typical sizes, with more objects than expected. */
+	if (cycle(40, 1000, NOBJ) || cycle(4096, 16, 1000))
+		exit(1);
+
+	/* Slabs hold no more objects than expected, but at least one. */
+	if (nper(40, 3) || nper(1, 10) || nper(200, 0) || nper(200, 1))
+		exit(1);
+
+	/* Success! */
+	exit(0);
+}